@@ -0,0 +1,248 @@
+#include "alloc.hpp"
+
+#include "job.hpp"
+#include "mem.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace alloc
+{
+	struct alignas(16) arena::block
+	{
+		block*   next;
+		uint32_t size;
+		uint32_t used;
+	};
+
+	namespace
+	{
+		constexpr uint32_t block_size {64 * 1024};
+
+		uint32_t align(uint32_t size)
+		{
+			return (size + 15) & ~15u;
+		}
+
+		// Statistics of released arenas and destroyed heaps, merged by any thread
+		stats lua_stats {};
+		stats arena_stats {};
+
+		job::mutex lock;
+
+		bool init_lock()
+		{
+			job::init(lock);
+			return true;
+		}
+
+		// Initialized before main, as the first use can happen from any thread when
+		// configurations are generated in parallel
+		bool lock_init {init_lock()};
+
+		job::mutex& get_lock()
+		{
+			return lock;
+		}
+
+		void merge(stats& total, stats const& s)
+		{
+			job::mutex& m = get_lock();
+			job::lock(m);
+			total.allocations += s.allocations;
+			total.pooled += s.pooled;
+			total.frees += s.frees;
+			if (s.peak_bytes > total.peak_bytes)
+				total.peak_bytes = s.peak_bytes;
+			job::unlock(m);
+		}
+	} // namespace
+
+	void* push(arena& a, uint32_t size)
+	{
+		size = align(size ? size : 1);
+		++a.allocations;
+
+		arena::block* b = a.blocks;
+		if (!b || b->size - b->used < size)
+		{
+			// Large allocations get their own block, keeping the current one in use
+			uint32_t capacity = size > block_size / 4 ? size : block_size;
+			b = reinterpret_cast<arena::block*>(
+				tmalloc<char>(sizeof(arena::block) + capacity));
+			b->size = capacity;
+			b->used = 0;
+			a.bytes += capacity;
+			if (capacity != block_size && a.blocks)
+			{
+				b->next = a.blocks->next;
+				a.blocks->next = b;
+			}
+			else
+			{
+				b->next = a.blocks;
+				a.blocks = b;
+			}
+		}
+
+		void* res = reinterpret_cast<char*>(b + 1) + b->used;
+		b->used += size;
+		return res;
+	}
+
+	char* push_str(arena& a, char const* str, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(str));
+
+		char* res = push<char>(a, len + 1);
+		memcpy(res, str, len);
+		res[len] = '\0';
+		return res;
+	}
+
+	void release(arena& a)
+	{
+		stats s {a.allocations, 0, 0, a.bytes};
+		while (a.blocks)
+		{
+			arena::block* next = a.blocks->next;
+			tfree(a.blocks);
+			a.blocks = next;
+			++s.pooled;
+		}
+		s.frees = s.pooled;
+		if (s.allocations)
+			merge(arena_stats, s);
+
+		a = {};
+	}
+
+	// Blocks up to `max_pooled` bytes are rounded to a multiple of 16 bytes, and
+	// recycled through a free list per size class. Most blocks of a Lua state are
+	// small strings, tables and closures, so few of them reach malloc.
+	constexpr uint32_t max_pooled {512};
+	constexpr uint32_t class_count {max_pooled / 16};
+
+	struct lua_heap
+	{
+		struct free_block
+		{
+			free_block* next;
+		};
+
+		free_block* free_lists[class_count];
+
+		arena  slabs;
+		stats  s;
+		size_t bytes;
+	};
+
+	namespace
+	{
+		uint32_t get_class(size_t size)
+		{
+			return static_cast<uint32_t>((size - 1) >> 4);
+		}
+
+		void* heap_alloc(lua_heap* heap, size_t size)
+		{
+			++heap->s.allocations;
+			if (size > max_pooled)
+				return malloc(size);
+
+			++heap->s.pooled;
+			uint32_t               c = get_class(size);
+			lua_heap::free_block* res = heap->free_lists[c];
+			if (res)
+			{
+				heap->free_lists[c] = res->next;
+				return res;
+			}
+			return push(heap->slabs, (c + 1) << 4);
+		}
+
+		void heap_free(lua_heap* heap, void* ptr, size_t size)
+		{
+			++heap->s.frees;
+			if (size > max_pooled)
+			{
+				free(ptr);
+				return;
+			}
+
+			uint32_t               c = get_class(size);
+			lua_heap::free_block* b = static_cast<lua_heap::free_block*>(ptr);
+			b->next = heap->free_lists[c];
+			heap->free_lists[c] = b;
+		}
+	} // namespace
+
+	lua_heap* create_lua_heap()
+	{
+		lua_heap* heap = tmalloc<lua_heap>();
+		*heap = {};
+		return heap;
+	}
+
+	void destroy_lua_heap(lua_heap* heap)
+	{
+		// Pooled blocks are freed with their slabs, which are not counted as an arena
+		merge(lua_stats, heap->s);
+		heap->slabs.allocations = 0;
+		release(heap->slabs);
+		tfree(heap);
+	}
+
+	void* lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+	{
+		lua_heap* heap = static_cast<lua_heap*>(ud);
+
+		// When `ptr` is null, `osize` is the type of the object, not a size
+		if (!ptr)
+			osize = 0;
+
+		void* res = nullptr;
+		if (!nsize)
+		{
+			if (ptr)
+				heap_free(heap, ptr, osize);
+		}
+		else if (!ptr)
+			res = heap_alloc(heap, nsize);
+		else if (osize <= max_pooled && nsize <= max_pooled &&
+		         get_class(osize) == get_class(nsize))
+			res = ptr;
+		else if (osize > max_pooled && nsize > max_pooled)
+			res = realloc(ptr, nsize);
+		else
+		{
+			// Moves between a pool and malloc
+			res = heap_alloc(heap, nsize);
+			if (!res)
+				return nullptr;
+
+			memcpy(res, ptr, nsize < osize ? nsize : osize);
+			heap_free(heap, ptr, osize);
+		}
+
+		if (nsize && !res)
+			return nullptr;
+
+		heap->bytes += nsize;
+		heap->bytes -= osize;
+		if (heap->bytes > heap->s.peak_bytes)
+			heap->s.peak_bytes = heap->bytes;
+		return res;
+	}
+
+	stats get_lua_stats()
+	{
+		return lua_stats;
+	}
+
+	stats get_arena_stats()
+	{
+		return arena_stats;
+	}
+} // namespace alloc
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace alloc
+{
+	/// @brief Bump allocator for data sharing the same lifetime, such as the
+	/// temporaries of a generation. Memory is reserved in large blocks, and only freed
+	/// all at once by `release`. Not thread safe, each thread must use its own arena.
+	struct arena
+	{
+		struct block;
+
+		block*   blocks {nullptr};
+		uint64_t bytes {0};
+		uint64_t allocations {0};
+	};
+
+	/// @brief Allocates `size` bytes from `a`, aligned on 16 bytes.
+	void* push(arena& a, uint32_t size);
+
+	template <typename T>
+	T* push(arena& a, uint32_t count = 1)
+	{
+		return static_cast<T*>(push(a, sizeof(T) * count));
+	}
+
+	/// @brief Copies `len` bytes of `str` in `a`, '\0' terminated. If `len` is
+	/// UINT32_MAX, `str` must be '\0' terminated.
+	char* push_str(arena& a, char const* str, uint32_t len = UINT32_MAX);
+
+	/// @brief Frees all the memory allocated from `a`, and resets it to an empty arena.
+	void release(arena& a);
+
+	/// @brief Heap of a Lua state. Small blocks are served from per size class pools
+	/// carved in large slabs, larger ones from malloc.
+	struct lua_heap;
+
+	lua_heap* create_lua_heap();
+
+	/// @brief Frees all the memory of `heap`. The Lua state using it must be closed.
+	void destroy_lua_heap(lua_heap* heap);
+
+	/// @brief Allocation function given to lua_newstate, with a `lua_heap` as `ud`.
+	void* lua_alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+	struct stats
+	{
+		uint64_t allocations; // Allocations requested
+		uint64_t pooled;      // Served from size class pools, or blocks reserved by arenas
+		uint64_t frees;       // Blocks freed
+		uint64_t peak_bytes;  // Highest count of bytes used at once by a heap or an arena
+	};
+
+	/// @brief Retrieves the statistics of the Lua heaps destroyed so far.
+	stats get_lua_stats();
+
+	/// @brief Retrieves the statistics of the arenas released so far.
+	stats get_arena_stats();
+} // namespace alloc
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include "bytecode.hpp"
+
+extern "C"
+{
+#include <lua/lauxlib.h>
+#include <lua/lua.h>
+}
+
+#include "fs.hpp"
+#include "job.hpp"
+#include "map.hpp"
+#include "mem.hpp"
+#include "string.hpp"
+
+#include <string.h>
+
+namespace bc
+{
+	namespace
+	{
+		// Bytecode of the scripts loaded by the previous generations, keyed by script
+		// path, and valid as long as the script content is the same
+		struct script_cache
+		{
+			struct script
+			{
+				char const* path;
+				uint64_t    hash;
+				uint32_t    source_size;
+				char const* code;
+				uint32_t    code_size;
+				// Checksum of `code`, verified before loading it, as Lua doesn't check the
+				// bytecode it is given
+				uint64_t code_hash;
+				// Allocated this run, instead of pointing in `file`
+				bool owns_path;
+				bool owns_code;
+				// Loaded this run, and saved back
+				bool used;
+			};
+
+			bool       enabled {false};
+			job::mutex lock;
+
+			char const* file {nullptr};
+			uint64_t    file_size {0};
+
+			script*      scripts {nullptr};
+			uint32_t     scripts_size {0};
+			uint32_t     scripts_capacity {0};
+			map::str_map paths;
+		};
+
+		script_cache cache;
+
+		constexpr char     cache_magic[4] {'m', 'g', 'b', 'c'};
+		constexpr uint32_t cache_version = 2;
+
+		// FNV-1a, on 64 bits as the hash alone tells apart two versions of a script
+		uint64_t hash(char const* data, uint32_t size)
+		{
+			uint64_t res = 14695981039346656037ull;
+			for (uint32_t i {0}; i < size; ++i)
+			{
+				res ^= static_cast<uint8_t>(data[i]);
+				res *= 1099511628211ull;
+			}
+			return res;
+		}
+
+		// Adds or replaces the bytecode of `path`. Owned paths and bytecode were
+		// allocated this run, and are copied or freed by the cache, while the other ones
+		// point in the mapped file.
+		void cache_script(char const* path,
+		                  uint32_t    path_len,
+		                  uint64_t    source_hash,
+		                  uint32_t    source_size,
+		                  char const* code,
+		                  uint32_t    code_size,
+		                  uint64_t    code_hash,
+		                  bool        owned)
+		{
+			uint32_t i = map::find(cache.paths, path, path_len);
+			if (i != UINT32_MAX)
+			{
+				script_cache::script& s = cache.scripts[i];
+				if (s.owns_code)
+					tfree(s.code);
+				s.hash = source_hash;
+				s.source_size = source_size;
+				s.code = code;
+				s.code_size = code_size;
+				s.code_hash = code_hash;
+				s.owns_code = owned;
+				s.used = owned;
+				return;
+			}
+
+			if (cache.scripts_size == cache.scripts_capacity)
+			{
+				cache.scripts_capacity =
+					cache.scripts_capacity ? cache.scripts_capacity * 2 : 64;
+				cache.scripts = trealloc(cache.scripts, cache.scripts_capacity);
+			}
+
+			if (owned)
+			{
+				char* path_copy = tmalloc<char>(path_len + 1);
+				memcpy(path_copy, path, path_len);
+				path_copy[path_len] = '\0';
+				path = path_copy;
+			}
+
+			i = cache.scripts_size++;
+			cache.scripts[i] = {path,      source_hash, source_size, code,
+			                    code_size, code_hash,   owned,       owned, owned};
+			map::insert(cache.paths, path, i, path_len);
+		}
+
+		int write_dump(lua_State*, void const* data, size_t size, void* ud)
+		{
+			str::append(*static_cast<str::buffer*>(ud), static_cast<char const*>(data),
+			            size);
+			return 0;
+		}
+
+		bool read_u32(char const* data, uint64_t size, uint64_t& pos, uint32_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+
+		bool read_u64(char const* data, uint64_t size, uint64_t& pos, uint64_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+	} // namespace
+
+	void load_cache(char const* path)
+	{
+		job::init(cache.lock);
+		cache.enabled = true;
+
+		uint64_t    size = 0;
+		char const* file = fs::map_file(path, size);
+		if (!file)
+			return;
+
+		uint32_t version = 0;
+		uint64_t pos = sizeof(cache_magic);
+		if (size < pos || memcmp(file, cache_magic, sizeof(cache_magic)) != 0 ||
+		    !read_u32(file, size, pos, version) || version != cache_version)
+		{
+			fs::unmap_file(file, size);
+			return;
+		}
+
+		// Entries point in the mapped file, which is kept until saved
+		cache.file = file;
+		cache.file_size = size;
+		while (pos < size)
+		{
+			uint32_t path_len = 0;
+			uint64_t source_hash = 0;
+			uint32_t source_size = 0;
+			uint32_t code_size = 0;
+			uint64_t code_hash = 0;
+			if (!read_u32(file, size, pos, path_len) || size - pos < path_len + 1ull)
+				break;
+			char const* script_path = file + pos;
+			pos += path_len + 1;
+
+			if (!read_u64(file, size, pos, source_hash) ||
+			    !read_u32(file, size, pos, source_size) ||
+			    !read_u32(file, size, pos, code_size) ||
+			    !read_u64(file, size, pos, code_hash) || size - pos < code_size)
+				break;
+			char const* code = file + pos;
+			pos += code_size;
+
+			cache_script(script_path, path_len, source_hash, source_size, code, code_size,
+			             code_hash, false);
+		}
+	}
+
+	bool save_cache(char const* path)
+	{
+		if (!cache.enabled)
+			return true;
+
+		// Only the scripts still loaded are kept, the other ones were renamed or removed
+		str::buffer buf;
+		str::append(buf, cache_magic, sizeof(cache_magic));
+		str::append(buf, reinterpret_cast<char const*>(&cache_version),
+		            sizeof(cache_version));
+		for (uint32_t i {0}; i < cache.scripts_size; ++i)
+		{
+			script_cache::script const& s = cache.scripts[i];
+			if (!s.used)
+				continue;
+
+			uint32_t path_len = strlen(s.path);
+			str::append(buf, reinterpret_cast<char const*>(&path_len), sizeof(path_len));
+			str::append(buf, s.path, path_len + 1);
+			str::append(buf, reinterpret_cast<char const*>(&s.hash), sizeof(s.hash));
+			str::append(buf, reinterpret_cast<char const*>(&s.source_size),
+			            sizeof(s.source_size));
+			str::append(buf, reinterpret_cast<char const*>(&s.code_size),
+			            sizeof(s.code_size));
+			str::append(buf, reinterpret_cast<char const*>(&s.code_hash),
+			            sizeof(s.code_hash));
+			str::append(buf, s.code, s.code_size);
+		}
+
+		for (uint32_t i {0}; i < cache.scripts_size; ++i)
+		{
+			if (cache.scripts[i].owns_path)
+				tfree(cache.scripts[i].path);
+			if (cache.scripts[i].owns_code)
+				tfree(cache.scripts[i].code);
+		}
+		if (cache.scripts)
+			tfree(cache.scripts);
+		// Unmapped before writing, as a mapped file can't be replaced on Windows
+		if (cache.file)
+			fs::unmap_file(cache.file, cache.file_size);
+		map::release(cache.paths);
+		job::destroy(cache.lock);
+		cache = {};
+
+		bool res = fs::write_file_if_changed(path, buf.data, buf.size);
+		str::release(buf);
+		return res;
+	}
+
+	int32_t load_file(lua_State* L, char const* path)
+	{
+		if (!cache.enabled)
+			return luaL_loadfile(L, path);
+
+		// Unreadable scripts are left to Lua, which reports the error
+		uint32_t source_size = 0;
+		char*    source = fs::read_file(path, &source_size);
+		if (!source)
+			return luaL_loadfile(L, path);
+		uint64_t source_hash = hash(source, source_size);
+		tfree(source);
+
+		// The lock is kept while loading, so the bytecode is not replaced meanwhile
+		uint32_t path_len = strlen(path);
+		job::lock(cache.lock);
+		uint32_t i = map::find(cache.paths, path, path_len);
+		if (i != UINT32_MAX && cache.scripts[i].hash == source_hash &&
+		    cache.scripts[i].source_size == source_size &&
+		    hash(cache.scripts[i].code, cache.scripts[i].code_size) ==
+		        cache.scripts[i].code_hash)
+		{
+			script_cache::script& s = cache.scripts[i];
+			char const* chunk_name = lua_pushfstring(L, "@%s", path);
+			int32_t     res = luaL_loadbufferx(L, s.code, s.code_size, chunk_name, "b");
+			lua_remove(L, -2);
+			if (res == LUA_OK)
+			{
+				s.used = true;
+				job::unlock(cache.lock);
+				return res;
+			}
+
+			// Saved by another Lua version, compiled again
+			lua_pop(L, 1);
+		}
+		job::unlock(cache.lock);
+
+		int32_t res = luaL_loadfile(L, path);
+		if (res != LUA_OK)
+			return res;
+
+		// Debug information is kept, so errors still report the script lines
+		str::buffer dump;
+		if (lua_dump(L, write_dump, &dump, 0) != 0 || !dump.size)
+		{
+			str::release(dump);
+			return res;
+		}
+
+		job::lock(cache.lock);
+		cache_script(path, path_len, source_hash, source_size, dump.data, dump.size,
+		             hash(dump.data, dump.size), true);
+		job::unlock(cache.lock);
+		return res;
+	}
+} // namespace bc
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+struct lua_State;
+
+namespace bc
+{
+	/// @brief Enables the persistent cache of compiled scripts, used by `load_file`,
+	/// and maps the cache saved at `path` if any. The bytecode of a script is reused as
+	/// long as its content (identified by its size and hash) is the same, and the saved
+	/// bytecode matches its checksum, without parsing it again.
+	/// @param path Path to the cache file.
+	void load_cache(char const* path);
+
+	/// @brief Saves the bytecode of the scripts loaded since `load_cache` to `path`,
+	/// and disables the cache.
+	/// @param path Path to the cache file. Its directory must exist.
+	/// @return true Cache saved, or not enabled.
+	/// @return false Cache could not be written.
+	bool save_cache(char const* path);
+
+	/// @brief Loads the script `path` as a Lua function, like `luaL_loadfile`, from the
+	/// cache if the script didn't change. Can be called from multiple threads, with
+	/// distinct states.
+	/// @return int32_t LUA_OK with the function pushed on the stack, or an error code
+	/// with the error message pushed.
+	int32_t load_file(lua_State* L, char const* path);
+} // namespace bc
\ No newline at end of file
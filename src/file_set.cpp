@@ -0,0 +1,266 @@
+#include "file_set.hpp"
+
+extern "C"
+{
+#include <lua/lauxlib.h>
+#include <lua/lua.h>
+#include <lua/lualib.h>
+}
+
+#include "glob.hpp"
+#include "lua_env.hpp"
+#include "mem.hpp"
+
+#include <string.h>
+
+namespace fset
+{
+	namespace
+	{
+		constexpr char const* set_name {"mg.file_set"};
+
+		set const* check_set(lua_State* L, int32_t idx)
+		{
+			return static_cast<set const*>(luaL_checkudata(L, idx, set_name));
+		}
+
+		void push_file(lua_State* L, sym::id file)
+		{
+			lua_pushlstring(L, sym::str(file), sym::len(file));
+		}
+
+		// Open addressing set of ids, to compare file sets in linear time
+		struct id_set
+		{
+			sym::id* slots;
+			uint32_t mask;
+		};
+
+		id_set create_id_set(uint32_t size)
+		{
+			uint32_t capacity = 16;
+			while (capacity < size * 2)
+				capacity *= 2;
+
+			id_set res {tmalloc<sym::id>(capacity), capacity - 1};
+			memset(res.slots, 0, sizeof(sym::id) * capacity);
+			return res;
+		}
+
+		// Returns false if `id` was already in the set
+		bool insert(id_set& ids, sym::id id)
+		{
+			uint32_t i = (id * 2654435761u) & ids.mask;
+			while (ids.slots[i])
+			{
+				if (ids.slots[i] == id)
+					return false;
+				i = (i + 1) & ids.mask;
+			}
+			ids.slots[i] = id;
+			return true;
+		}
+
+		bool contains(id_set const& ids, sym::id id)
+		{
+			uint32_t i = (id * 2654435761u) & ids.mask;
+			while (ids.slots[i])
+			{
+				if (ids.slots[i] == id)
+					return true;
+				i = (i + 1) & ids.mask;
+			}
+			return false;
+		}
+
+		int32_t set_len(lua_State* L)
+		{
+			lua_pushinteger(L, check_set(L, 1)->size);
+			return 1;
+		}
+
+		// Files of both sets, in order of the first one then the second one
+		int32_t set_union(lua_State* L)
+		{
+			set const* lhs = check_set(L, 1);
+			set const* rhs = check_set(L, 2);
+			set*       res = push(L, lhs->size + rhs->size);
+
+			id_set ids = create_id_set(lhs->size + rhs->size);
+			for (uint32_t i {0}; i < lhs->size; ++i)
+				if (insert(ids, lhs->files[i]))
+					res->files[res->size++] = lhs->files[i];
+			for (uint32_t i {0}; i < rhs->size; ++i)
+				if (insert(ids, rhs->files[i]))
+					res->files[res->size++] = rhs->files[i];
+			tfree(ids.slots);
+			return 1;
+		}
+
+		// Files of the first set absent from the second one
+		int32_t set_difference(lua_State* L)
+		{
+			set const* lhs = check_set(L, 1);
+			set const* rhs = check_set(L, 2);
+			set*       res = push(L, lhs->size);
+
+			id_set ids = create_id_set(rhs->size);
+			for (uint32_t i {0}; i < rhs->size; ++i)
+				insert(ids, rhs->files[i]);
+			for (uint32_t i {0}; i < lhs->size; ++i)
+				if (!contains(ids, lhs->files[i]))
+					res->files[res->size++] = lhs->files[i];
+			tfree(ids.slots);
+			return 1;
+		}
+
+		// Keeps the files matched by glob patterns, resolved from the running script, or
+		// for which a function returns true
+		int32_t set_filter(lua_State* L)
+		{
+			set const* s = check_set(L, 1);
+			luaL_argcheck(L,
+			              lua_isstring(L, 2) || lua_istable(L, 2) || lua_isfunction(L, 2), 2,
+			              "'string', 'array' or 'function' expected");
+
+			if (lua_isfunction(L, 2))
+			{
+				set* res = push(L, s->size);
+				for (uint32_t i {0}; i < s->size; ++i)
+				{
+					lua_pushvalue(L, 2);
+					push_file(L, s->files[i]);
+					lua_call(L, 1, 1);
+					if (lua_toboolean(L, -1))
+						res->files[res->size++] = s->files[i];
+					lua_pop(L, 1);
+				}
+				return 1;
+			}
+
+			// Allocated by Lua, as compiling the patterns raises an error if one is invalid
+			uint32_t     patterns_size = lua_istable(L, 2) ? lua_rawlen(L, 2) : 1;
+			char const** patterns = static_cast<char const**>(
+				lua_newuserdatauv(L, sizeof(char const*) * patterns_size, 0));
+			if (lua_istable(L, 2))
+			{
+				for (uint32_t i {0}; i < patterns_size; ++i)
+				{
+					lua_rawgeti(L, 2, i + 1);
+					if (!lua_isstring(L, -1))
+						luaL_argerror(L, 2, "'string' expected in array");
+					// Strings stay referenced by the array while used
+					patterns[i] = lua_tostring(L, -1);
+					lua_pop(L, 1);
+				}
+			}
+			else
+				patterns[0] = lua_tostring(L, 2);
+
+			glob::matcher* matcher =
+				lua::compile_globs(L, patterns, patterns_size, nullptr, 0);
+			lua_pop(L, 1);
+
+			set* res = push(L, s->size);
+			for (uint32_t i {0}; i < s->size; ++i)
+			{
+				sym::id file = s->files[i];
+				if (glob::match(matcher, sym::str(file), sym::len(file)))
+					res->files[res->size++] = file;
+			}
+			glob::destroy(matcher);
+			return 1;
+		}
+
+		int32_t set_index(lua_State* L)
+		{
+			set const* s = check_set(L, 1);
+			if (lua_type(L, 2) == LUA_TNUMBER)
+			{
+				lua_Integer i = lua_tointeger(L, 2);
+				if (i >= 1 && i <= s->size)
+					push_file(L, s->files[i - 1]);
+				else
+					lua_pushnil(L);
+				return 1;
+			}
+
+			// Methods
+			lua_pushvalue(L, 2);
+			lua_rawget(L, lua_upvalueindex(1));
+			return 1;
+		}
+
+		int32_t set_next(lua_State* L)
+		{
+			set const*  s = check_set(L, 1);
+			lua_Integer i = luaL_optinteger(L, 2, 0);
+			if (i < 0 || i >= s->size)
+				return 0;
+
+			lua_pushinteger(L, i + 1);
+			push_file(L, s->files[i]);
+			return 2;
+		}
+
+		int32_t set_pairs(lua_State* L)
+		{
+			check_set(L, 1);
+			lua_pushcclosure(L, set_next, 0);
+			lua_pushvalue(L, 1);
+			lua_pushinteger(L, 0);
+			return 3;
+		}
+
+		int32_t set_tostring(lua_State* L)
+		{
+			lua_pushfstring(L, "file_set: %d files",
+			                static_cast<int32_t>(check_set(L, 1)->size));
+			return 1;
+		}
+	} // namespace
+
+	void init(lua_State* L)
+	{
+		luaL_newmetatable(L, set_name);
+
+		lua_newtable(L);
+		lua_pushcclosure(L, set_filter, 0);
+		lua_setfield(L, -2, "filter");
+		lua_pushcclosure(L, set_union, 0);
+		lua_setfield(L, -2, "union");
+		lua_pushcclosure(L, set_difference, 0);
+		lua_setfield(L, -2, "difference");
+		lua_pushcclosure(L, set_index, 1);
+		lua_setfield(L, -2, "__index");
+
+		lua_pushcclosure(L, set_len, 0);
+		lua_setfield(L, -2, "__len");
+		lua_pushcclosure(L, set_union, 0);
+		lua_setfield(L, -2, "__add");
+		lua_pushcclosure(L, set_difference, 0);
+		lua_setfield(L, -2, "__sub");
+		lua_pushcclosure(L, set_pairs, 0);
+		lua_setfield(L, -2, "__pairs");
+		lua_pushcclosure(L, set_tostring, 0);
+		lua_setfield(L, -2, "__tostring");
+
+		lua_pop(L, 1);
+	}
+
+	set* push(lua_State* L, uint32_t capacity)
+	{
+		// Files are stored right after the set, in the same block
+		set* res = static_cast<set*>(
+			lua_newuserdatauv(L, sizeof(set) + sizeof(sym::id) * capacity, 0));
+		res->files = reinterpret_cast<sym::id*>(res + 1);
+		res->size = 0;
+		luaL_setmetatable(L, set_name);
+		return res;
+	}
+
+	set const* to_set(lua_State* L, int32_t idx)
+	{
+		return static_cast<set const*>(luaL_testudata(L, idx, set_name));
+	}
+} // namespace fset
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "sym.hpp"
+
+#include <stdint.h>
+
+struct lua_State;
+
+namespace fset
+{
+	/// @brief Set of file paths, given to scripts as a userdata holding the interned
+	/// paths in a single block of Lua memory. Supports `#`, indexing and iteration like
+	/// an array of strings, as well as filtering, union (`+`) and difference (`-`).
+	struct set
+	{
+		sym::id* files;
+		uint32_t size;
+	};
+
+	/// @brief Creates the metatable of file sets. Must be called once per state, before
+	/// any set is created.
+	void init(lua_State* L);
+
+	/// @brief Pushes a new empty set, able to hold `capacity` files.
+	set* push(lua_State* L, uint32_t capacity);
+
+	/// @brief Retrieves the set at `idx`.
+	/// @return set const* Set, or nullptr if the value isn't a file set.
+	set const* to_set(lua_State* L, int32_t idx);
+} // namespace fset
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "fingerprint.hpp"
+
+#include "fs.hpp"
+#include "job.hpp"
+#include "map.hpp"
+#include "mem.hpp"
+#include "state.hpp"
+#include "string.hpp"
+#include "track.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace fp
+{
+	namespace
+	{
+		struct input
+		{
+			track::kind kind;
+			char*       path;
+		};
+
+		// Inputs of every configuration generated this run, without duplicates
+		struct fingerprint
+		{
+			input*       inputs {nullptr};
+			uint32_t     size {0};
+			uint32_t     capacity {0};
+			map::str_map index[track::kind::count];
+			bool         invalid {false};
+			// Taken before running the scripts, which set the default configuration
+			str::buffer key;
+		};
+
+		fingerprint current;
+
+		job::mutex lock;
+
+		bool init_lock()
+		{
+			job::init(lock);
+			return true;
+		}
+
+		// Initialized before main, as configurations add their inputs from their own
+		// thread
+		bool lock_init {init_lock()};
+
+		constexpr char     fp_magic[4] {'m', 'g', 'f', 'p'};
+		constexpr uint32_t fp_version = 1;
+
+		void add_input(track::kind k, char const* path)
+		{
+			uint32_t len = strlen(path);
+			if (map::find(current.index[k], path, len) != UINT32_MAX)
+				return;
+
+			if (current.size == current.capacity)
+			{
+				current.capacity = current.capacity ? current.capacity * 2 : 64;
+				current.inputs = trealloc(current.inputs, current.capacity);
+			}
+
+			char* copy = tmalloc<char>(len + 1);
+			memcpy(copy, path, len + 1);
+			current.inputs[current.size] = {k, copy};
+			map::insert(current.index[k], copy, current.size, len);
+			++current.size;
+		}
+
+		void release()
+		{
+			for (uint32_t i {0}; i < current.size; ++i)
+				tfree(current.inputs[i].path);
+			if (current.inputs)
+				tfree(current.inputs);
+			for (uint32_t i {0}; i < track::kind::count; ++i)
+				map::release(current.index[i]);
+			str::release(current.key);
+			current = {};
+		}
+
+		// The mingen binary, script and options the build files are generated with. The
+		// memory statistics don't change them.
+		void write_key(str::buffer& buf, char const* file)
+		{
+			char* exe_path = fs::get_current_executable_path();
+			// A rebuilt binary may generate differently
+			add_input(track::kind::file, exe_path);
+			str::append(buf, exe_path, strlen(exe_path) + 1);
+			tfree(exe_path);
+			str::append(buf, file, strlen(file) + 1);
+			char const* config = g.config_param ? g.config_param : "";
+			str::append(buf, config, strlen(config) + 1);
+			char flags[4] {g.gen_compile_db, g.gen_subninja, g.check_files, g.all_configs};
+			str::append(buf, flags, sizeof(flags));
+		}
+
+		bool read_u8(char const* data, uint64_t size, uint64_t& pos, uint8_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			value = static_cast<uint8_t>(data[pos++]);
+			return true;
+		}
+
+		bool read_u32(char const* data, uint64_t size, uint64_t& pos, uint32_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+
+		bool read_u64(char const* data, uint64_t size, uint64_t& pos, uint64_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+
+		// Checks the input at `pos` didn't change, and moves past it
+		bool check_input(char const* data, uint64_t size, uint64_t& pos)
+		{
+			uint8_t  k = 0;
+			uint32_t path_len = 0;
+			if (!read_u8(data, size, pos, k) || k >= track::kind::count ||
+			    !read_u32(data, size, pos, path_len) || size - pos < path_len + 1ull)
+				return false;
+			char const* path = data + pos;
+			pos += path_len + 1;
+
+			if (k == track::kind::env)
+			{
+				uint8_t  set = 0;
+				uint32_t value_len = 0;
+				if (!read_u8(data, size, pos, set) ||
+				    !read_u32(data, size, pos, value_len) || size - pos < value_len)
+					return false;
+				char const* value = data + pos;
+				pos += value_len;
+
+				char const* env = getenv(path);
+				if (!env)
+					return !set;
+				return set && strlen(env) == value_len && memcmp(env, value, value_len) == 0;
+			}
+
+			uint8_t   type = 0;
+			fs::stamp s {};
+			if (!read_u8(data, size, pos, type) || !read_u64(data, size, pos, s.id) ||
+			    !read_u64(data, size, pos, s.time) || !read_u64(data, size, pos, s.size))
+				return false;
+
+			// Only the existence of entries matters, not their content
+			fs::stamp now = fs::get_stamp(path);
+			if (k == track::kind::entry)
+				return static_cast<uint8_t>(now.type) == type;
+			return static_cast<uint8_t>(now.type) == type && now.id == s.id &&
+			       now.time == s.time && now.size == s.size;
+		}
+	} // namespace
+
+	bool is_up_to_date(char const* path, char const* file)
+	{
+		str::buffer& key = current.key;
+		write_key(key, file);
+
+		uint64_t    size = 0;
+		char const* data = fs::map_file(path, size);
+		if (!data)
+			return false;
+
+		uint32_t version = 0;
+		uint32_t key_size = 0;
+		uint64_t pos = sizeof(fp_magic);
+		bool     res = size >= pos && memcmp(data, fp_magic, sizeof(fp_magic)) == 0 &&
+		           read_u32(data, size, pos, version) && version == fp_version &&
+		           read_u32(data, size, pos, key_size) && key_size == key.size &&
+		           size - pos >= key_size && memcmp(data + pos, key.data, key_size) == 0;
+
+		if (res)
+			pos += key_size;
+		while (res && pos < size)
+			res = check_input(data, size, pos);
+
+		fs::unmap_file(data, size);
+		return res;
+	}
+
+	void add_inputs()
+	{
+		job::lock(lock);
+		for (uint32_t i {0}; i < track::kind::count; ++i)
+		{
+			track::inputs inputs = track::get(static_cast<track::kind>(i));
+			for (uint32_t j {0}; j < inputs.size; ++j)
+				add_input(static_cast<track::kind>(i), inputs.paths[j]);
+		}
+		job::unlock(lock);
+	}
+
+	void invalidate()
+	{
+		job::lock(lock);
+		current.invalid = true;
+		job::unlock(lock);
+	}
+
+	bool save(char const* path, bool succeeded)
+	{
+		str::buffer const& key = current.key;
+		str::buffer        buf;
+		str::append(buf, fp_magic, sizeof(fp_magic));
+		str::append(buf, reinterpret_cast<char const*>(&fp_version), sizeof(fp_version));
+		str::append(buf, reinterpret_cast<char const*>(&key.size), sizeof(key.size));
+		str::append(buf, key.data, key.size);
+
+		// Stamped once the build files are written, so they are saved as they are now.
+		// Inputs changed during the generation, or too recently, may change again
+		// without their stamp telling it.
+		bool valid = succeeded && !current.invalid;
+		for (uint32_t i {0}; valid && i < current.size; ++i)
+		{
+			input const& in = current.inputs[i];
+			uint8_t      k = static_cast<uint8_t>(in.kind);
+			uint32_t     path_len = strlen(in.path);
+			str::append(buf, reinterpret_cast<char const*>(&k), sizeof(k));
+			str::append(buf, reinterpret_cast<char const*>(&path_len), sizeof(path_len));
+			str::append(buf, in.path, path_len + 1);
+
+			if (in.kind == track::kind::env)
+			{
+				char const* env = getenv(in.path);
+				uint8_t     set = env != nullptr;
+				uint32_t    value_len = env ? strlen(env) : 0;
+				str::append(buf, reinterpret_cast<char const*>(&set), sizeof(set));
+				str::append(buf, reinterpret_cast<char const*>(&value_len),
+				            sizeof(value_len));
+				if (value_len)
+					str::append(buf, env, value_len);
+				continue;
+			}
+
+			fs::stamp s = fs::get_stamp(in.path);
+			if (in.kind <= track::kind::file && s.type != fs::entry_type::none &&
+			    fs::is_recent(s))
+				valid = false;
+
+			uint8_t type = static_cast<uint8_t>(s.type);
+			str::append(buf, reinterpret_cast<char const*>(&type), sizeof(type));
+			str::append(buf, reinterpret_cast<char const*>(&s.id), sizeof(s.id));
+			str::append(buf, reinterpret_cast<char const*>(&s.time), sizeof(s.time));
+			str::append(buf, reinterpret_cast<char const*>(&s.size), sizeof(s.size));
+		}
+		release();
+
+		bool res = true;
+		if (valid)
+			res = fs::write_file_if_changed(path, buf.data, buf.size);
+		else if (fs::file_exists(path))
+			res = fs::delete_file(path);
+		str::release(buf);
+		return res;
+	}
+} // namespace fp
\ No newline at end of file
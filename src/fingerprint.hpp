@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace fp
+{
+	/// @brief Checks the fingerprint saved at `path` by the previous generation: it is
+	/// up to date if the same mingen binary ran `file` with the same options, and none
+	/// of the inputs recorded then (scripts, directories and files read, paths checked,
+	/// environment variables read, and files written) changed since. Only stats the
+	/// inputs, without running any script. Must be called before generating, as the
+	/// options are kept for `save`.
+	/// @return true Generating again would give the same build files.
+	bool is_up_to_date(char const* path, char const* file);
+
+	/// @brief Adds the inputs recorded by the calling thread with `track` to the
+	/// fingerprint of the current generation. Can be called from multiple threads.
+	void add_inputs();
+
+	/// @brief Prevents saving the fingerprint of the current generation, as it depends
+	/// on something that can't be tracked, such as the result of a command. Can be
+	/// called from multiple threads.
+	void invalidate();
+
+	/// @brief Saves the fingerprint of the current generation to `path`, and frees it.
+	/// If the generation failed or was invalidated, or an input changed too recently to
+	/// be told apart from a future change, the fingerprint at `path` is deleted
+	/// instead, so the next run generates again.
+	/// @param path Path to the fingerprint file. Its directory must exist.
+	/// @param succeeded Whether the generation succeeded.
+	/// @return true Fingerprint saved or deleted.
+	/// @return false Fingerprint could not be written.
+	bool save(char const* path, bool succeeded);
+} // namespace fp
\ No newline at end of file
@@ -6,137 +6,344 @@
 #include <win32/misc.h>
 #elif defined(__linux__)
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <time.h>
 #include <unistd.h>
 #include <utime.h>
 #endif
 
+#include "glob.hpp"
+#include "job.hpp"
+#include "map.hpp"
 #include "mem.hpp"
 #include "string.hpp"
 
+#include <stdlib.h>
+
 namespace fs
 {
-#ifdef _WIN32
-	list_dirs_res list_dirs(char const* dir_filter)
+	namespace
 	{
-		uint32_t dirs_count {0};
-		STACK_CHAR_TO_WCHAR(dir_filter, wdir_tmp)
-		uint32_t tmp_len = wcslen(wdir_tmp);
-		wchar_t* wdir = tmalloc<wchar_t>(tmp_len + 2);
-		wcsncpy(wdir, wdir_tmp, tmp_len);
-		wdir[tmp_len] = L'*';
-		wdir[tmp_len + 1] = L'\0';
+		// Working directory, queried once until changed by `set_cwd`
+		char*    cached_cwd {nullptr};
+		uint32_t cached_cwd_len {0};
 
-		WIN32_FIND_DATAW entry_data;
+		// Workers of the calling thread, created by the first walk or stat batch needing
+		// them and kept until `clear_pool`, as scripts may walk many directories
+		thread_local job::pool* pool {nullptr};
 
-		HANDLE entry = FindFirstFileExW(wdir, FindExInfoBasic, &entry_data,
-		                                FindExSearchNameMatch, nullptr, 0);
+		job::pool* get_pool()
+		{
+			if (!pool)
+				pool = job::create_pool();
+			return pool;
+		}
 
-		if (entry == INVALID_HANDLE_VALUE)
+		int compare_paths(void const* lhs, void const* rhs)
 		{
-			tfree(wdir);
-			return {nullptr, 0};
+			return strcmp(*static_cast<char* const*>(lhs),
+			              *static_cast<char* const*>(rhs));
+		}
+
+		// Orders the files of a directory before the ones of its subdirectories, then by
+		// name, as a depth first walk listing the files of each directory would.
+		int compare_walk_paths(void const* lhs, void const* rhs)
+		{
+			char const* l = *static_cast<char* const*>(lhs);
+			char const* r = *static_cast<char* const*>(rhs);
+
+			uint32_t i {0};
+			while (l[i] && l[i] == r[i])
+				++i;
+
+			bool l_nested = strchr(l + i, '/');
+			bool r_nested = strchr(r + i, '/');
+			if (l_nested != r_nested)
+				return l_nested ? 1 : -1;
+
+			// Compares directory names, a name being ordered before its extensions
+			uint8_t l_char = l[i] == '/' ? '\0' : l[i];
+			uint8_t r_char = r[i] == '/' ? '\0' : r[i];
+			return l_char - r_char;
+		}
+
+		char* tmp_path(char const* path)
+		{
+			uint32_t len = strlen(path);
+			char*    tmp = tmalloc<char>(len + 5);
+			strcpy(tmp, path);
+			strcpy(tmp + len, ".tmp");
+			return tmp;
 		}
 
-		do
+		struct path_list
 		{
-			if (entry_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY &&
-			    wcscmp(entry_data.cFileName, L".") != 0 &&
-			    wcscmp(entry_data.cFileName, L"..") != 0)
+			char**   paths {nullptr};
+			uint32_t size {0};
+			uint32_t capacity {0};
+		};
+
+		void push(path_list& list, char* path)
+		{
+			if (list.size == list.capacity)
 			{
-				++dirs_count;
+				list.capacity = list.capacity ? list.capacity * 2 : 16;
+				list.paths = trealloc(list.paths, list.capacity);
 			}
+			list.paths[list.size++] = path;
 		}
-		while (FindNextFileW(entry, &entry_data) != 0);
 
-		if (!dirs_count)
+		char* join_path(char const* dir,
+		                uint32_t    dir_len,
+		                char const* name,
+		                uint32_t    name_len,
+		                bool        is_dir)
 		{
-			tfree(wdir);
-			return {nullptr, 0};
+			char* path = tmalloc<char>(dir_len + name_len + 2);
+			memcpy(path, dir, dir_len);
+			memcpy(path + dir_len, name, name_len);
+			if (is_dir)
+				path[dir_len + name_len++] = '/';
+			path[dir_len + name_len] = '\0';
+			return path;
 		}
 
-		char**   dirs {tmalloc<char*>(dirs_count)};
-		uint32_t i {0};
-		entry = FindFirstFileExW(wdir, FindExInfoBasic, &entry_data,
-		                         FindExSearchNameMatch, nullptr, 0);
-		do
+		// Listings hold the entries of a directory, each as a type ('d' for directories,
+		// 'f' for files) followed by its '\0' terminated name.
+		void add_listing_entry(str::buffer& listing, char const* name, bool is_dir)
 		{
-			if (entry_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY &&
-			    wcscmp(entry_data.cFileName, L".") != 0 &&
-			    wcscmp(entry_data.cFileName, L"..") != 0)
+			str::append(listing, is_dir ? "d" : "f", 1);
+			str::append(listing, name, strlen(name) + 1);
+		}
+
+		// Rules of the ignore files found in a directory, applying to its entries and
+		// the ones of its subdirectories. Each rule is matched on its own, as the last
+		// matching rule decides if a path is ignored.
+		struct ignore_scope
+		{
+			ignore_scope const* parent;
+
+			glob::matcher** rules;
+			bool*           negated;
+			uint32_t        size;
+		};
+
+		bool is_ignored(ignore_scope const* scope,
+		                char const*         path,
+		                uint32_t            len,
+		                bool                is_dir)
+		{
+			for (; scope; scope = scope->parent)
 			{
-				STACK_WCHAR_TO_CHAR(entry_data.cFileName, dn)
-				dirs[i] = tmalloc<char>(strlen(dir_filter) + strlen(dn) + 1);
-				strncpy(dirs[i], dir_filter, strlen(dir_filter));
-				strcpy(dirs[i] + strlen(dir_filter), dn);
-				++i;
+				for (uint32_t i {scope->size}; i-- > 0;)
+				{
+					// Directories are matched with and without their trailing '/', so
+					// rules ending with '/' only match directories
+					if (glob::match(scope->rules[i], path, len) ||
+					    (is_dir && glob::match(scope->rules[i], path, len - 1)))
+						return !scope->negated[i];
+				}
 			}
+			return false;
 		}
-		while (FindNextFileW(entry, &entry_data) != 0);
 
-		tfree(wdir);
-		return {dirs, dirs_count};
-	}
+		// Adds the entries of `listing` to `files` or `dirs` (as paths ending with '/'),
+		// if not ignored, and accepted by `filter`. Lists are optional.
+		void add_entries(char const*         dir,
+		                 uint32_t            dir_len,
+		                 char const*         listing,
+		                 uint32_t            listing_size,
+		                 walk_filter const&  filter,
+		                 ignore_scope const* scope,
+		                 path_list*          files,
+		                 path_list*          dirs)
+		{
+			for (uint32_t pos {0}; pos < listing_size;)
+			{
+				bool        is_dir = listing[pos] == 'd';
+				char const* name = listing + pos + 1;
+				uint32_t    name_len = strlen(name);
+				pos += name_len + 2;
+
+				path_list* list = is_dir ? dirs : files;
+				if (!list)
+					continue;
+
+				char*    path = join_path(dir, dir_len, name, name_len, is_dir);
+				uint32_t path_len = dir_len + name_len + is_dir;
+
+				bool (*accept)(char const*, uint32_t, void*) =
+					is_dir ? filter.dir : filter.file;
+				if (!is_ignored(scope, path, path_len, is_dir) &&
+				    (!accept || accept(path, path_len, filter.data)))
+					push(*list, path);
+				else
+					tfree(path);
+			}
+		}
 
-	list_files_res list_files(char const* dir_filter, char const* file_filter)
+		bool has_suffix(char const* path, [[maybe_unused]] uint32_t len, void* suffix)
+		{
+			return str::ends_with(path, static_cast<char const*>(suffix));
+		}
+	} // namespace
+
+#ifdef _WIN32
+	namespace
 	{
-		uint32_t files_count {0};
-		STACK_CHAR_TO_WCHAR(dir_filter, wdir_tmp)
-		uint32_t tmp_len = wcslen(wdir_tmp);
-		wchar_t* wdir = tmalloc<wchar_t>(tmp_len + 2);
-		wcsncpy(wdir, wdir_tmp, tmp_len);
-		wdir[tmp_len] = L'*';
-		wdir[tmp_len + 1] = L'\0';
+		// Directory stamps are in 100ns intervals
+		constexpr uint64_t racy_stamp_window = 20000000;
 
-		WIN32_FIND_DATAW entry_data;
-		HANDLE           entry = FindFirstFileExW(wdir, FindExInfoBasic, &entry_data,
-		                                          FindExSearchNameMatch, nullptr, 0);
-		if (entry == INVALID_HANDLE_VALUE)
+		uint64_t to_stamp(FILETIME const& time)
 		{
-			tfree(wdir);
-			return {nullptr, 0};
+			return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
 		}
 
-		do
+		uint64_t now_stamp()
 		{
-			STACK_WCHAR_TO_CHAR(entry_data.cFileName, fn)
-			if (!(entry_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
-			    (!file_filter || str::ends_with(fn, file_filter)))
+			FILETIME now;
+			GetSystemTimeAsFileTime(&now);
+			return to_stamp(now);
+		}
+
+		// NTFS has no inodes exposed through attributes, the creation time tells apart a
+		// directory recreated at the same path
+		bool dir_stamp(char const* dir, uint64_t& id, uint64_t& time)
+		{
+			STACK_CHAR_TO_WCHAR(dir[0] ? dir : ".", wdir)
+			WIN32_FILE_ATTRIBUTE_DATA data;
+			if (!GetFileAttributesExW(wdir, GetFileExInfoStandard, &data) ||
+			    !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				return false;
+
+			id = to_stamp(data.ftCreationTime);
+			time = to_stamp(data.ftLastWriteTime);
+			return true;
+		}
+
+		bool read_dir(char const* dir, str::buffer& listing)
+		{
+			STACK_CHAR_TO_WCHAR(dir, wdir_tmp)
+			uint32_t tmp_len = wcslen(wdir_tmp);
+			wchar_t* wdir = tmalloc<wchar_t>(tmp_len + 2);
+			wcsncpy(wdir, wdir_tmp, tmp_len);
+			wdir[tmp_len] = L'*';
+			wdir[tmp_len + 1] = L'\0';
+
+			WIN32_FIND_DATAW entry_data;
+			HANDLE           entry =
+				FindFirstFileExW(wdir, FindExInfoBasic, &entry_data, FindExSearchNameMatch,
+			                     nullptr, FIND_FIRST_EX_LARGE_FETCH);
+			tfree(wdir);
+			if (entry == INVALID_HANDLE_VALUE)
+				return false;
+
+			do
 			{
-				++files_count;
+				if (wcscmp(entry_data.cFileName, L".") == 0 ||
+				    wcscmp(entry_data.cFileName, L"..") == 0)
+					continue;
+
+				// Converted in a fixed buffer, as the stack conversion would grow the stack
+				// on each entry
+				char name[MAX_PATH * 4];
+				if (!WideCharToMultiByte(CP_UTF8, 0, entry_data.cFileName, -1, name,
+				                         sizeof(name), nullptr, nullptr))
+					continue;
+
+				add_listing_entry(listing, name,
+				                  entry_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
 			}
+			while (FindNextFileW(entry, &entry_data) != 0);
+
+			FindClose(entry);
+			return true;
 		}
-		while (FindNextFileW(entry, &entry_data) != 0);
 
-		if (!files_count)
+		entry_type get_entry_type(char const* path)
 		{
-			tfree(wdir);
-			return {nullptr, 0};
+			STACK_CHAR_TO_WCHAR(path, wpath);
+			uint32_t attr = GetFileAttributesW(wpath);
+			if (attr == INVALID_FILE_ATTRIBUTES)
+				return entry_type::none;
+			return attr & FILE_ATTRIBUTE_DIRECTORY ? entry_type::directory : entry_type::file;
 		}
 
-		char**   files {tmalloc<char*>(files_count)};
-		uint32_t i = 0;
-		entry = FindFirstFileExW(wdir, FindExInfoBasic, &entry_data,
-		                         FindExSearchNameMatch, nullptr, 0);
-		do
+		// No batched query is available, every path is queried from the worker threads
+		uint32_t get_entry_types_batched(char const* const*, uint32_t, entry_type*)
 		{
-			STACK_WCHAR_TO_CHAR(entry_data.cFileName, fn)
-			if (!(entry_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
-			    (!file_filter || str::ends_with(fn, file_filter)))
+			return 0;
+		}
+	} // namespace
+
+	char* read_file(char const* path, uint32_t* size)
+	{
+		STACK_CHAR_TO_WCHAR(path, wpath);
+		HANDLE h = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		char*         content = nullptr;
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(h, &file_size) && file_size.QuadPart < UINT32_MAX)
+		{
+			content = tmalloc<char>(file_size.QuadPart + 1);
+			DWORD read = 0;
+			if (file_size.QuadPart &&
+			    (!ReadFile(h, content, file_size.QuadPart, &read, nullptr) ||
+			     read != file_size.QuadPart))
 			{
-				files[i] = tmalloc<char>(strlen(dir_filter) + strlen(fn) + 1);
-				strncpy(files[i], dir_filter, strlen(dir_filter));
-				strcpy(files[i] + strlen(dir_filter), fn);
-				++i;
+				tfree(content);
+				content = nullptr;
+			}
+			else
+			{
+				content[file_size.QuadPart] = '\0';
+				*size = file_size.QuadPart;
+			}
+		}
+		CloseHandle(h);
+
+		return content;
+	}
+
+	char const* map_file(char const* path, uint64_t& size)
+	{
+		STACK_CHAR_TO_WCHAR(path, wpath)
+		HANDLE file = CreateFileW(wpath, GENERIC_READ,
+		                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		                          nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		void*         data = nullptr;
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart)
+		{
+			HANDLE mapping =
+				CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping)
+			{
+				data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
 			}
 		}
-		while (FindNextFileW(entry, &entry_data) != 0);
+		CloseHandle(file);
 
-		tfree(wdir);
-		return {files, files_count};
+		size = file_size.QuadPart;
+		return static_cast<char const*>(data);
+	}
+
+	void unmap_file(char const* data, uint64_t)
+	{
+		UnmapViewOfFile(data);
 	}
 
 	bool file_exists(char const* file)
@@ -155,6 +362,26 @@ namespace fs
 		return (attr != INVALID_FILE_ATTRIBUTES) && (attr & FILE_ATTRIBUTE_DIRECTORY);
 	}
 
+	stamp get_stamp(char const* path)
+	{
+		STACK_CHAR_TO_WCHAR(path[0] ? path : ".", wpath)
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExW(wpath, GetFileExInfoStandard, &data))
+			return {};
+
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			return {entry_type::directory, to_stamp(data.ftCreationTime),
+			        to_stamp(data.ftLastWriteTime), 0};
+		return {entry_type::file, to_stamp(data.ftCreationTime),
+		        to_stamp(data.ftLastWriteTime),
+		        (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow};
+	}
+
+	bool is_recent(stamp const& s)
+	{
+		return s.time + racy_stamp_window > now_stamp();
+	}
+
 	char* get_current_executable_path()
 	{
 		wchar_t wcurrent_path[512] {'\0'};
@@ -173,6 +400,11 @@ namespace fs
 	{
 		STACK_CHAR_TO_WCHAR(cwd, wcwd);
 		SetCurrentDirectoryW(wcwd);
+		if (cached_cwd)
+		{
+			tfree(cached_cwd);
+			cached_cwd = nullptr;
+		}
 	}
 
 	bool is_absolute(char const* path)
@@ -260,83 +492,393 @@ namespace fs
 		STACK_CHAR_TO_WCHAR(dst_path, wdst_path);
 		return MoveFileW(wsrc_path, wdst_path) != 0;
 	}
+
+	bool write_file_if_changed(char const* path,
+	                           char const* data,
+	                           uint32_t    size,
+	                           bool*       written)
+	{
+		if (written)
+			*written = false;
+
+		STACK_CHAR_TO_WCHAR(path, wpath);
+		HANDLE h = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h != INVALID_HANDLE_VALUE)
+		{
+			LARGE_INTEGER file_size;
+			bool          same = GetFileSizeEx(h, &file_size) &&
+			                     file_size.QuadPart == static_cast<int64_t>(size);
+			if (same && size)
+			{
+				char* content = tmalloc<char>(size);
+				DWORD read = 0;
+				same = ReadFile(h, content, size, &read, nullptr) && read == size &&
+				       memcmp(content, data, size) == 0;
+				tfree(content);
+			}
+			CloseHandle(h);
+
+			if (same)
+				return true;
+		}
+
+		char* tmp = tmp_path(path);
+		STACK_CHAR_TO_WCHAR(tmp, wtmp);
+		tfree(tmp);
+
+		h = CreateFileW(wtmp, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		                FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h == INVALID_HANDLE_VALUE)
+			return false;
+
+		DWORD file_written = 0;
+		bool  res = !size || (WriteFile(h, data, size, &file_written, nullptr) &&
+		                      file_written == size);
+		CloseHandle(h);
+
+		if (res)
+			res = MoveFileExW(wtmp, wpath, MOVEFILE_REPLACE_EXISTING) != 0;
+		else
+			DeleteFileW(wtmp);
+
+		if (res && written)
+			*written = true;
+		return res;
+	}
 #elif defined(__linux__)
-	list_dirs_res list_dirs(char const* dir_filter)
+	namespace
 	{
-		uint32_t dirs_count {0};
-		DIR*     dir_p = opendir(dir_filter);
+		// Directory stamps are in nanoseconds
+		constexpr uint64_t racy_stamp_window = 2000000000;
 
-		if (!dir_p)
-			return {nullptr, 0};
+		uint64_t to_stamp(timespec const& time)
+		{
+			return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+		}
 
-		dirent* entry {nullptr};
-		while ((entry = readdir(dir_p)))
-			if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 &&
-			    strcmp(entry->d_name, "..") != 0)
-				++dirs_count;
+		uint64_t now_stamp()
+		{
+			timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			return to_stamp(now);
+		}
 
-		closedir(dir_p);
+		bool dir_stamp(char const* dir, uint64_t& id, uint64_t& time)
+		{
+			struct stat dir_stat;
+			if (stat(dir[0] ? dir : ".", &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode))
+				return false;
 
-		if (!dirs_count)
-			return {nullptr, 0};
+			id = dir_stat.st_ino;
+			time = to_stamp(dir_stat.st_mtim);
+			return true;
+		}
 
-		char**   dirs {tmalloc<char*>(dirs_count)};
-		uint32_t i {0};
-		dir_p = opendir(dir_filter);
-		while ((entry = readdir(dir_p)))
+		struct linux_dirent64
+		{
+			ino64_t        d_ino;
+			off64_t        d_off;
+			unsigned short d_reclen;
+			unsigned char  d_type;
+			char           d_name[];
+		};
+
+		bool read_dir(char const* dir, str::buffer& listing)
 		{
-			if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 &&
-			    strcmp(entry->d_name, "..") != 0)
+			int fd = openat(AT_FDCWD, dir[0] ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd == -1)
+				return false;
+
+			// Entries are read in large batches, and their type is given by the
+			// filesystem, so a directory is read in a single pass without stat calls
+			alignas(linux_dirent64) char entries[16384];
+			while (true)
 			{
-				dirs[i] = tmalloc<char>(strlen(dir_filter) + strlen(entry->d_name) + 1);
-				strncpy(dirs[i], dir_filter, strlen(dir_filter));
-				strcpy(dirs[i] + strlen(dir_filter), entry->d_name);
-				++i;
+				long read = syscall(SYS_getdents64, fd, entries, sizeof(entries));
+				if (read <= 0)
+					break;
+
+				for (long pos {0}; pos < read;)
+				{
+					linux_dirent64* entry = reinterpret_cast<linux_dirent64*>(entries + pos);
+					pos += entry->d_reclen;
+
+					char const* name = entry->d_name;
+					if (name[0] == '.' &&
+					    (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+						continue;
+
+					// Some filesystems don't report types
+					uint8_t type = entry->d_type;
+					if (type == DT_UNKNOWN)
+					{
+						struct stat entry_stat;
+						if (fstatat(fd, name, &entry_stat, AT_SYMLINK_NOFOLLOW) != 0)
+							continue;
+						if (S_ISDIR(entry_stat.st_mode))
+							type = DT_DIR;
+						else if (S_ISREG(entry_stat.st_mode))
+							type = DT_REG;
+					}
+
+					if (type == DT_DIR || type == DT_REG)
+						add_listing_entry(listing, name, type == DT_DIR);
+				}
 			}
+
+			close(fd);
+			return true;
 		}
 
-		closedir(dir_p);
+		entry_type get_entry_type(char const* path)
+		{
+			struct stat path_stat;
+			if (stat(path, &path_stat) != 0)
+				return entry_type::none;
+			return S_ISDIR(path_stat.st_mode) ? entry_type::directory : entry_type::file;
+		}
 
-		return {dirs, dirs_count};
-	}
+		// Submission and completion rings of an io_uring instance, mapped from the kernel
+		struct uring
+		{
+			int fd {-1};
+
+			uint32_t*     sq_tail;
+			uint32_t*     sq_mask;
+			uint32_t*     sq_array;
+			io_uring_sqe* sqes;
+			uint32_t      sq_entries;
+
+			uint32_t*     cq_head;
+			uint32_t*     cq_tail;
+			uint32_t*     cq_mask;
+			io_uring_cqe* cqes;
+
+			void*  sq_ring;
+			size_t sq_ring_size;
+			void*  cq_ring;
+			size_t cq_ring_size;
+			size_t sqes_size;
+		};
+
+		void destroy_uring(uring& ring)
+		{
+			if (ring.sqes)
+				munmap(ring.sqes, ring.sqes_size);
+			if (ring.cq_ring && ring.cq_ring != ring.sq_ring)
+				munmap(ring.cq_ring, ring.cq_ring_size);
+			if (ring.sq_ring)
+				munmap(ring.sq_ring, ring.sq_ring_size);
+			close(ring.fd);
+		}
 
-	list_files_res list_files(char const* dir_filter, char const* file_filter)
-	{
-		uint32_t files_count {0};
-		DIR*     dir_p = opendir(dir_filter);
+		// Fails when io_uring is unavailable, such as on kernels older than 5.1 or when
+		// disabled by the system
+		bool create_uring(uring& ring, uint32_t entries)
+		{
+			io_uring_params params {};
+			ring = {};
+			ring.fd = syscall(__NR_io_uring_setup, entries, &params);
+			if (ring.fd < 0)
+				return false;
+
+			ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+			ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+			{
+				if (ring.cq_ring_size > ring.sq_ring_size)
+					ring.sq_ring_size = ring.cq_ring_size;
+				ring.cq_ring_size = ring.sq_ring_size;
+			}
 
-		if (!dir_p)
-			return {nullptr, 0};
+			ring.sq_ring = mmap(nullptr, ring.sq_ring_size, PROT_READ | PROT_WRITE,
+			                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+			if (ring.sq_ring == MAP_FAILED)
+			{
+				ring.sq_ring = nullptr;
+				destroy_uring(ring);
+				return false;
+			}
+
+			ring.cq_ring = ring.sq_ring;
+			if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+			{
+				ring.cq_ring = mmap(nullptr, ring.cq_ring_size, PROT_READ | PROT_WRITE,
+				                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+				if (ring.cq_ring == MAP_FAILED)
+				{
+					ring.cq_ring = nullptr;
+					destroy_uring(ring);
+					return false;
+				}
+			}
 
-		dirent* entry {nullptr};
-		while ((entry = readdir(dir_p)))
-			if (entry->d_type == DT_REG &&
-			    (!file_filter || str::ends_with(entry->d_name, file_filter)))
-				++files_count;
+			ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+			ring.sqes = static_cast<io_uring_sqe*>(
+				mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE,
+			         MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES));
+			if (ring.sqes == MAP_FAILED)
+			{
+				ring.sqes = nullptr;
+				destroy_uring(ring);
+				return false;
+			}
 
-		closedir(dir_p);
+			char* sq = static_cast<char*>(ring.sq_ring);
+			ring.sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+			ring.sq_mask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+			ring.sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+			ring.sq_entries = params.sq_entries;
+
+			char* cq = static_cast<char*>(ring.cq_ring);
+			ring.cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+			ring.cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+			ring.cq_mask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+			ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+			return true;
+		}
 
-		if (!files_count)
-			return {nullptr, 0};
+		// Queries paths with statx requests, a whole batch submitted and waited for with
+		// a single system call. Returns the number of paths queried, less than `size` if
+		// io_uring or its statx operation (Linux 5.6) is unavailable.
+		uint32_t get_entry_types_batched(char const* const* paths,
+		                                 uint32_t           size,
+		                                 entry_type*        types)
+		{
+			constexpr uint32_t batch_size = 256;
+			if (size < 2)
+				return 0;
+
+			uring ring;
+			if (!create_uring(ring, batch_size))
+				return 0;
+
+			struct statx* results = tmalloc<struct statx>(ring.sq_entries);
+			uint32_t      done = 0;
+			bool          supported = true;
+			while (done < size && supported)
+			{
+				uint32_t batch = size - done;
+				if (batch > ring.sq_entries)
+					batch = ring.sq_entries;
+
+				uint32_t tail = *ring.sq_tail;
+				for (uint32_t i {0}; i < batch; ++i)
+				{
+					uint32_t      index = (tail + i) & *ring.sq_mask;
+					io_uring_sqe& sqe = ring.sqes[index];
+					memset(&sqe, 0, sizeof(sqe));
+					sqe.opcode = IORING_OP_STATX;
+					sqe.fd = AT_FDCWD;
+					sqe.addr = reinterpret_cast<uint64_t>(paths[done + i]);
+					sqe.len = STATX_TYPE;
+					sqe.off = reinterpret_cast<uint64_t>(results + i);
+					sqe.user_data = i;
+					ring.sq_array[index] = index;
+				}
+				__atomic_store_n(ring.sq_tail, tail + batch, __ATOMIC_RELEASE);
+
+				uint32_t submitted = 0;
+				uint32_t completed = 0;
+				while (completed < batch)
+				{
+					int res = syscall(__NR_io_uring_enter, ring.fd, batch - submitted,
+					                  batch - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+					if (res < 0 && errno != EINTR)
+					{
+						supported = false;
+						break;
+					}
+					if (res > 0)
+						submitted += res;
+
+					uint32_t head = *ring.cq_head;
+					uint32_t cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+					for (; head != cq_tail; ++head, ++completed)
+					{
+						io_uring_cqe const& cqe = ring.cqes[head & *ring.cq_mask];
+						uint32_t            i = cqe.user_data;
+						if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+							supported = false;
+						else if (cqe.res < 0)
+							types[done + i] = entry_type::none;
+						else
+							types[done + i] = S_ISDIR(results[i].stx_mode) ?
+							                      entry_type::directory :
+							                      entry_type::file;
+					}
+					__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+				}
+
+				if (supported)
+					done += batch;
+			}
+
+			tfree(results);
+			destroy_uring(ring);
+			return done;
+		}
+	} // namespace
+
+	char* read_file(char const* path, uint32_t* size)
+	{
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return nullptr;
 
-		char**   files {tmalloc<char*>(files_count)};
-		uint32_t i {0};
-		dir_p = opendir(dir_filter);
-		while ((entry = readdir(dir_p)))
+		char*       content = nullptr;
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) == 0 && file_stat.st_size < UINT32_MAX)
 		{
-			if (entry->d_type == DT_REG &&
-			    (!file_filter || str::ends_with(entry->d_name, file_filter)))
+			content = tmalloc<char>(file_stat.st_size + 1);
+			uint32_t pos = 0;
+			while (pos < file_stat.st_size)
 			{
-				files[i] = tmalloc<char>(strlen(dir_filter) + strlen(entry->d_name) + 1);
-				strncpy(files[i], dir_filter, strlen(dir_filter));
-				strcpy(files[i] + strlen(dir_filter), entry->d_name);
-				++i;
+				ssize_t res = read(fd, content + pos, file_stat.st_size - pos);
+				if (res <= 0)
+					break;
+				pos += res;
+			}
+
+			if (pos == file_stat.st_size)
+			{
+				content[pos] = '\0';
+				*size = pos;
+			}
+			else
+			{
+				tfree(content);
+				content = nullptr;
 			}
 		}
+		close(fd);
+
+		return content;
+	}
 
-		closedir(dir_p);
+	char const* map_file(char const* path, uint64_t& size)
+	{
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return nullptr;
+
+		// The mapping stays valid once the file is closed
+		void*       data = MAP_FAILED;
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) == 0 && file_stat.st_size)
+			data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+			return nullptr;
+
+		size = file_stat.st_size;
+		return static_cast<char const*>(data);
+	}
 
-		return {files, files_count};
+	void unmap_file(char const* data, uint64_t size)
+	{
+		munmap(const_cast<char*>(data), size);
 	}
 
 	bool file_exists(char const* file)
@@ -352,6 +894,36 @@ namespace fs
 		return err == 0 && S_ISDIR(res.st_mode);
 	}
 
+	stamp get_stamp(char const* path)
+	{
+		struct stat res;
+		if (stat(path[0] ? path : ".", &res) != 0)
+			return {};
+
+		if (S_ISDIR(res.st_mode))
+			return {entry_type::directory, res.st_ino, to_stamp(res.st_mtim), 0};
+		return {entry_type::file, res.st_ino, to_stamp(res.st_mtim),
+		        static_cast<uint64_t>(res.st_size)};
+	}
+
+	bool is_recent(stamp const& s)
+	{
+		return s.time + racy_stamp_window > now_stamp();
+	}
+
+	char* get_current_executable_path()
+	{
+		char    path[4096];
+		ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+		if (len < 0)
+			len = 0;
+
+		char* res = tmalloc<char>(len + 1);
+		strncpy(res, path, len);
+		res[len] = '\0';
+		return res;
+	}
+
 	char* get_cwd()
 	{
 		return get_current_dir_name();
@@ -360,6 +932,11 @@ namespace fs
 	void set_cwd(char const* cwd)
 	{
 		/*int res = */ chdir(cwd);
+		if (cached_cwd)
+		{
+			tfree(cached_cwd);
+			cached_cwd = nullptr;
+		}
 	}
 
 	bool is_absolute(char const* path)
@@ -422,7 +999,716 @@ namespace fs
 			return false;
 		return delete_file(src_path);
 	}
+
+	bool write_file_if_changed(char const* path,
+	                           char const* data,
+	                           uint32_t    size,
+	                           bool*       written)
+	{
+		if (written)
+			*written = false;
+
+		int fd = open(path, O_RDONLY);
+		if (fd != -1)
+		{
+			struct stat file_stat;
+			bool same = fstat(fd, &file_stat) == 0 && file_stat.st_size == size;
+			if (same && size)
+			{
+				void* content = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				same = content != MAP_FAILED && memcmp(content, data, size) == 0;
+				if (content != MAP_FAILED)
+					munmap(content, size);
+			}
+			close(fd);
+
+			if (same)
+				return true;
+		}
+
+		char* tmp = tmp_path(path);
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1)
+		{
+			tfree(tmp);
+			return false;
+		}
+
+		uint32_t pos = 0;
+		while (pos < size)
+		{
+			ssize_t res = write(fd, data + pos, size - pos);
+			if (res <= 0)
+				break;
+			pos += res;
+		}
+		close(fd);
+
+		bool res = pos == size && rename(tmp, path) == 0;
+		if (!res)
+			unlink(tmp);
+		tfree(tmp);
+
+		if (res && written)
+			*written = true;
+		return res;
+	}
 #else
 #error "Unsupported platform"
 #endif
+
+	namespace
+	{
+		// Directory listings of the previous generations, keyed by directory path, and
+		// valid as long as the directory stamps match
+		struct dir_cache
+		{
+			struct dir
+			{
+				char const* path;
+				uint64_t    id;
+				uint64_t    time;
+				char const* listing;
+				uint32_t    listing_size;
+				// Allocated this run, instead of pointing in `file`
+				bool owns_path;
+				bool owns_listing;
+				// Walked this run, and saved back
+				bool used;
+			};
+
+			bool       enabled {false};
+			job::mutex lock;
+
+			char* file {nullptr};
+
+			dir*         dirs {nullptr};
+			uint32_t     dirs_size {0};
+			uint32_t     dirs_capacity {0};
+			map::str_map paths;
+
+			// Replaced listings, still read by other walks, such as the ones of other
+			// configurations, and freed when the cache is saved
+			char const** stale {nullptr};
+			uint32_t     stale_size {0};
+			uint32_t     stale_capacity {0};
+		};
+
+		dir_cache cache;
+
+		constexpr char     cache_magic[4] {'m', 'g', 'd', 'c'};
+		constexpr uint32_t cache_version = 1;
+
+		// Adds or replaces the listing of `path`. Owned paths and listings were allocated
+		// this run, and are copied or freed by the cache, while the other ones point in
+		// the loaded file. Replaced listings stay valid until the cache is saved.
+		void cache_dir(char const* path,
+		               uint32_t    path_len,
+		               uint64_t    id,
+		               uint64_t    time,
+		               char const* listing,
+		               uint32_t    listing_size,
+		               bool        owned)
+		{
+			uint32_t i = map::find(cache.paths, path, path_len);
+			if (i != UINT32_MAX)
+			{
+				dir_cache::dir& dir = cache.dirs[i];
+				if (dir.owns_listing)
+				{
+					if (cache.stale_size == cache.stale_capacity)
+					{
+						cache.stale_capacity =
+							cache.stale_capacity ? cache.stale_capacity * 2 : 16;
+						cache.stale = trealloc(cache.stale, cache.stale_capacity);
+					}
+					cache.stale[cache.stale_size++] = dir.listing;
+				}
+				dir.id = id;
+				dir.time = time;
+				dir.listing = listing;
+				dir.listing_size = listing_size;
+				dir.owns_listing = owned;
+				dir.used = owned;
+				return;
+			}
+
+			if (cache.dirs_size == cache.dirs_capacity)
+			{
+				cache.dirs_capacity = cache.dirs_capacity ? cache.dirs_capacity * 2 : 64;
+				cache.dirs = trealloc(cache.dirs, cache.dirs_capacity);
+			}
+
+			if (owned)
+			{
+				char* path_copy = tmalloc<char>(path_len + 1);
+				memcpy(path_copy, path, path_len);
+				path_copy[path_len] = '\0';
+				path = path_copy;
+			}
+
+			i = cache.dirs_size++;
+			cache.dirs[i] = {path, id, time, listing, listing_size, owned, owned, owned};
+			map::insert(cache.paths, path, i, path_len);
+		}
+
+		// Lists the entries of `dir`, from the cache if the directory didn't change.
+		// `read` holds the listing read when the cache is disabled, and must be released
+		// once the listing is used.
+		bool get_listing(char const*  dir,
+		                 uint32_t     dir_len,
+		                 str::buffer& read,
+		                 char const*& listing,
+		                 uint32_t&    listing_size)
+		{
+			if (!cache.enabled)
+			{
+				if (!read_dir(dir, read))
+					return false;
+				listing = read.data;
+				listing_size = read.size;
+				return true;
+			}
+
+			uint64_t id = 0;
+			uint64_t time = 0;
+			if (!dir_stamp(dir, id, time))
+				return false;
+
+			bool hit = false;
+			job::lock(cache.lock);
+			uint32_t i = map::find(cache.paths, dir, dir_len);
+			if (i != UINT32_MAX && cache.dirs[i].id == id && cache.dirs[i].time == time)
+			{
+				cache.dirs[i].used = true;
+				listing = cache.dirs[i].listing;
+				listing_size = cache.dirs[i].listing_size;
+				hit = true;
+			}
+			job::unlock(cache.lock);
+
+			// A listing replaced by another thread meanwhile is kept until the cache is
+			// saved, so it can still be read
+			if (hit)
+				return true;
+
+			if (!read_dir(dir, read))
+				return false;
+
+			// Listings are stored in their own allocation, even empty
+			uint32_t stored_size = read.size;
+			char*    stored = tmalloc<char>(stored_size + 1);
+			if (stored_size)
+				memcpy(stored, read.data, stored_size);
+
+			job::lock(cache.lock);
+			cache_dir(dir, dir_len, id, time, stored, stored_size, true);
+			job::unlock(cache.lock);
+
+			listing = stored;
+			listing_size = stored_size;
+			return true;
+		}
+
+		bool scan_dir(char const*        dir,
+		              walk_filter const& filter,
+		              path_list*         files,
+		              path_list*         dirs)
+		{
+			uint32_t    dir_len = strlen(dir);
+			str::buffer read;
+			char const* listing = nullptr;
+			uint32_t    listing_size = 0;
+			bool        res = get_listing(dir, dir_len, read, listing, listing_size);
+			if (res)
+				add_entries(dir, dir_len, listing, listing_size, filter, nullptr, files, dirs);
+			str::release(read);
+			return res;
+		}
+
+		bool read_u32(char const* data, uint32_t size, uint32_t& pos, uint32_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+
+		bool read_u64(char const* data, uint32_t size, uint32_t& pos, uint64_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+	} // namespace
+
+	char const* get_cached_cwd(uint32_t* len)
+	{
+		if (!cached_cwd)
+		{
+			cached_cwd = get_cwd();
+			cached_cwd_len = strlen(cached_cwd);
+		}
+		if (len)
+			*len = cached_cwd_len;
+		return cached_cwd;
+	}
+
+	namespace
+	{
+		struct entry_types_task
+		{
+			char const* const* paths;
+			uint32_t           size;
+			entry_type*        types;
+		};
+
+		void get_entry_types_task(void* data)
+		{
+			entry_types_task* task = static_cast<entry_types_task*>(data);
+			for (uint32_t i {0}; i < task->size; ++i)
+				task->types[i] = get_entry_type(task->paths[i]);
+		}
+	} // namespace
+
+	void get_entry_types(char const* const* paths, uint32_t size, entry_type* types)
+	{
+		uint32_t done = get_entry_types_batched(paths, size, types);
+		paths += done;
+		types += done;
+		size -= done;
+
+		constexpr uint32_t chunk_size = 64;
+		if (size <= chunk_size)
+		{
+			entry_types_task task {paths, size, types};
+			get_entry_types_task(&task);
+			return;
+		}
+
+		uint32_t          tasks_size = (size + chunk_size - 1) / chunk_size;
+		entry_types_task* tasks = tmalloc<entry_types_task>(tasks_size);
+		job::pool*        workers = get_pool();
+		for (uint32_t i {0}; i < tasks_size; ++i)
+		{
+			uint32_t first = i * chunk_size;
+			uint32_t count = size - first < chunk_size ? size - first : chunk_size;
+			tasks[i] = {paths + first, count, types + first};
+			job::submit(workers, get_entry_types_task, tasks + i);
+		}
+		job::wait(workers);
+		tfree(tasks);
+	}
+
+	void load_dir_cache(char const* path)
+	{
+		job::init(cache.lock);
+		cache.enabled = true;
+
+		uint32_t size = 0;
+		char*    file = read_file(path, &size);
+		if (!file)
+			return;
+
+		uint32_t version = 0;
+		uint32_t pos = sizeof(cache_magic);
+		if (size < pos || memcmp(file, cache_magic, sizeof(cache_magic)) != 0 ||
+		    !read_u32(file, size, pos, version) || version != cache_version)
+		{
+			tfree(file);
+			return;
+		}
+
+		// Entries point in the loaded file, which is kept until saved
+		cache.file = file;
+		while (pos < size)
+		{
+			uint32_t path_len = 0;
+			uint64_t id = 0;
+			uint64_t time = 0;
+			uint32_t listing_size = 0;
+			if (!read_u32(file, size, pos, path_len) || size - pos < path_len + 1)
+				break;
+			char const* dir_path = file + pos;
+			pos += path_len + 1;
+
+			if (!read_u64(file, size, pos, id) || !read_u64(file, size, pos, time) ||
+			    !read_u32(file, size, pos, listing_size) || size - pos < listing_size)
+				break;
+			char const* listing = file + pos;
+			pos += listing_size;
+
+			cache_dir(dir_path, path_len, id, time, listing, listing_size, false);
+		}
+	}
+
+	bool save_dir_cache(char const* path)
+	{
+		if (!cache.enabled)
+			return true;
+
+		// Directories changed too recently may change again within the same stamp, and
+		// are read again next time
+		uint64_t    now = now_stamp();
+		str::buffer buf;
+		str::append(buf, cache_magic, sizeof(cache_magic));
+		str::append(buf, reinterpret_cast<char const*>(&cache_version),
+		            sizeof(cache_version));
+		for (uint32_t i {0}; i < cache.dirs_size; ++i)
+		{
+			dir_cache::dir const& dir = cache.dirs[i];
+			if (!dir.used || dir.time + racy_stamp_window > now)
+				continue;
+
+			uint32_t path_len = strlen(dir.path);
+			str::append(buf, reinterpret_cast<char const*>(&path_len), sizeof(path_len));
+			str::append(buf, dir.path, path_len + 1);
+			str::append(buf, reinterpret_cast<char const*>(&dir.id), sizeof(dir.id));
+			str::append(buf, reinterpret_cast<char const*>(&dir.time), sizeof(dir.time));
+			str::append(buf, reinterpret_cast<char const*>(&dir.listing_size),
+			            sizeof(dir.listing_size));
+			str::append(buf, dir.listing, dir.listing_size);
+		}
+
+		bool res = write_file_if_changed(path, buf.data, buf.size);
+		str::release(buf);
+
+		for (uint32_t i {0}; i < cache.dirs_size; ++i)
+		{
+			if (cache.dirs[i].owns_path)
+				tfree(cache.dirs[i].path);
+			if (cache.dirs[i].owns_listing)
+				tfree(cache.dirs[i].listing);
+		}
+		for (uint32_t i {0}; i < cache.stale_size; ++i)
+			tfree(cache.stale[i]);
+		if (cache.stale)
+			tfree(cache.stale);
+		if (cache.dirs)
+			tfree(cache.dirs);
+		if (cache.file)
+			tfree(cache.file);
+		map::release(cache.paths);
+		job::destroy(cache.lock);
+		cache = {};
+
+		return res;
+	}
+
+	list_dirs_res list_dirs(char const* dir_filter)
+	{
+		path_list dirs;
+		scan_dir(dir_filter, {}, nullptr, &dirs);
+		if (!dirs.size)
+			return {nullptr, 0};
+
+		// Listed directories don't end with a separator
+		for (uint32_t i {0}; i < dirs.size; ++i)
+			dirs.paths[i][strlen(dirs.paths[i]) - 1] = '\0';
+
+		qsort(dirs.paths, dirs.size, sizeof(char*), compare_paths);
+		return {dirs.paths, dirs.size};
+	}
+
+	list_files_res list_files(char const* dir_filter, char const* file_filter)
+	{
+		walk_filter filter;
+		if (file_filter)
+		{
+			filter.file = has_suffix;
+			filter.data = const_cast<char*>(file_filter);
+		}
+
+		path_list files;
+		scan_dir(dir_filter, filter, &files, nullptr);
+		if (!files.size)
+			return {nullptr, 0};
+
+		qsort(files.paths, files.size, sizeof(char*), compare_paths);
+		return {files.paths, files.size};
+	}
+
+	namespace
+	{
+		struct walk_state
+		{
+			walk_filter const* filter;
+			job::pool*         pool;
+
+			job::mutex lock;
+			path_list  files;
+			path_list  dirs;
+			path_list  ignore_files;
+
+			ignore_scope** scopes;
+			uint32_t       scopes_size;
+		};
+
+		struct walk_task
+		{
+			walk_state*         state;
+			char*               dir;
+			ignore_scope const* scope;
+		};
+
+		// Converts the line of an ignore file of `dir` to a glob pattern, following the
+		// gitignore format. Returns nullptr for blank lines and comments.
+		char* ignore_pattern(char const* dir,
+		                     uint32_t    dir_len,
+		                     char const* line,
+		                     uint32_t    len,
+		                     bool&       negated)
+		{
+			while (len && (line[len - 1] == ' ' || line[len - 1] == '\r'))
+				--len;
+			if (!len || line[0] == '#')
+				return nullptr;
+
+			negated = line[0] == '!';
+			if (negated || line[0] == '\\')
+			{
+				++line;
+				--len;
+			}
+
+			bool dir_only = len && line[len - 1] == '/';
+			if (dir_only)
+				--len;
+			if (!len)
+				return nullptr;
+
+			// Patterns without separator match at any depth, others are anchored to the
+			// directory of the ignore file
+			bool anchored = false;
+			for (uint32_t i {0}; i < len && !anchored; ++i)
+				anchored = line[i] == '/';
+			if (line[0] == '/')
+			{
+				++line;
+				--len;
+			}
+
+			str::buffer pattern;
+			str::append(pattern, dir, dir_len);
+			if (!anchored)
+				str::append(pattern, "**/", 3);
+			str::append(pattern, line, len);
+			if (dir_only)
+				str::append(pattern, "/", 1);
+			return pattern.data;
+		}
+
+		ignore_scope* load_ignore_file(walk_state&         state,
+		                               char const*         dir,
+		                               uint32_t            dir_len,
+		                               char const*         name,
+		                               ignore_scope const* parent,
+		                               ignore_scope*       scope)
+		{
+			char*    path = join_path(dir, dir_len, name, strlen(name), false);
+			uint32_t size = 0;
+			char*    content = read_file(path, &size);
+			if (!content)
+			{
+				tfree(path);
+				return scope;
+			}
+
+			job::lock(state.lock);
+			push(state.ignore_files, path);
+			job::unlock(state.lock);
+
+			if (!scope)
+			{
+				scope = tmalloc<ignore_scope>();
+				*scope = {parent, nullptr, nullptr, 0};
+			}
+
+			for (uint32_t begin {0}; begin < size;)
+			{
+				uint32_t end = begin;
+				while (end < size && content[end] != '\n')
+					++end;
+
+				bool  negated = false;
+				char* pattern = ignore_pattern(dir, dir_len, content + begin, end - begin,
+				                               negated);
+				begin = end + 1;
+				if (!pattern)
+					continue;
+
+				glob::matcher* rule = glob::compile(&pattern, 1, nullptr);
+				tfree(pattern);
+				if (!rule)
+					continue;
+
+				scope->rules = trealloc(scope->rules, scope->size + 1);
+				scope->negated = trealloc(scope->negated, scope->size + 1);
+				scope->rules[scope->size] = rule;
+				scope->negated[scope->size] = negated;
+				++scope->size;
+			}
+			tfree(content);
+
+			return scope;
+		}
+
+		// Loads the ignore files present in `listing`, found without any additional
+		// filesystem access. Returns `parent` if there are none.
+		ignore_scope const* load_ignore_scope(walk_state&         state,
+		                                      char const*         dir,
+		                                      uint32_t            dir_len,
+		                                      char const*         listing,
+		                                      uint32_t            listing_size,
+		                                      ignore_scope const* parent)
+		{
+			ignore_scope* scope = nullptr;
+			for (uint32_t i {0}; i < state.filter->ignore_files_size; ++i)
+			{
+				char const* name = state.filter->ignore_files[i];
+				for (uint32_t pos {0}; pos < listing_size;)
+				{
+					char const* entry = listing + pos + 1;
+					if (listing[pos] == 'f' && strcmp(entry, name) == 0)
+					{
+						scope = load_ignore_file(state, dir, dir_len, name, parent, scope);
+						break;
+					}
+					pos += strlen(entry) + 2;
+				}
+			}
+
+			if (!scope)
+				return parent;
+
+			job::lock(state.lock);
+			state.scopes = trealloc(state.scopes, state.scopes_size + 1);
+			state.scopes[state.scopes_size++] = scope;
+			job::unlock(state.lock);
+			return scope;
+		}
+
+		void walk_dir(void* data)
+		{
+			walk_task*  task = static_cast<walk_task*>(data);
+			walk_state& state = *task->state;
+
+			uint32_t            dir_len = strlen(task->dir);
+			str::buffer         read;
+			char const*         listing = nullptr;
+			uint32_t            listing_size = 0;
+			path_list           files;
+			path_list           sub_dirs;
+			ignore_scope const* scope = task->scope;
+			bool walked = get_listing(task->dir, dir_len, read, listing, listing_size);
+			if (walked)
+			{
+				scope = load_ignore_scope(state, task->dir, dir_len, listing, listing_size,
+				                          scope);
+				add_entries(task->dir, dir_len, listing, listing_size, *state.filter, scope,
+				            &files, &sub_dirs);
+			}
+			str::release(read);
+
+			job::lock(state.lock);
+			for (uint32_t i {0}; i < files.size; ++i)
+				push(state.files, files.paths[i]);
+			if (walked)
+				push(state.dirs, task->dir);
+			job::unlock(state.lock);
+
+			if (!walked)
+				tfree(task->dir);
+			if (files.paths)
+				tfree(files.paths);
+
+			// Only the root directory is walked before the pool is set, and subdirectories
+			// are only worth threads if there are any
+			if (sub_dirs.size && !state.pool)
+				state.pool = get_pool();
+
+			for (uint32_t i {0}; i < sub_dirs.size; ++i)
+			{
+				walk_task* sub_task = tmalloc<walk_task>();
+				*sub_task = {&state, sub_dirs.paths[i], scope};
+				job::submit(state.pool, walk_dir, sub_task);
+			}
+			if (sub_dirs.paths)
+				tfree(sub_dirs.paths);
+			tfree(task);
+		}
+	} // namespace
+
+	void clear_pool()
+	{
+		if (pool)
+			job::destroy_pool(pool);
+		pool = nullptr;
+	}
+
+	walk_res walk(char const* dir, walk_filter const& filter)
+	{
+		walk_state state {&filter, nullptr};
+		job::init(state.lock);
+
+		// Ignore files of the directories containing `dir` apply to it as well
+		uint32_t            dir_len = strlen(dir);
+		ignore_scope const* scope = nullptr;
+		for (uint32_t i {0}; i < dir_len && filter.ignore_files_size; ++i)
+		{
+			uint32_t parent_len = 0;
+			if (dir[i] == '/' && i + 1 < dir_len)
+				parent_len = i + 1;
+			else if (i != 0 || is_absolute(dir))
+				continue;
+
+			char*       parent = join_path(dir, parent_len, "", 0, false);
+			str::buffer read;
+			char const* listing = nullptr;
+			uint32_t    listing_size = 0;
+			if (get_listing(parent, parent_len, read, listing, listing_size))
+				scope = load_ignore_scope(state, parent, parent_len, listing, listing_size,
+				                          scope);
+			str::release(read);
+			tfree(parent);
+		}
+
+		walk_task* root = tmalloc<walk_task>();
+		*root = {&state, join_path(dir, dir_len, "", 0, false), scope};
+		walk_dir(root);
+
+		if (state.pool)
+			job::wait(state.pool);
+		job::destroy(state.lock);
+
+		for (uint32_t i {0}; i < state.scopes_size; ++i)
+		{
+			for (uint32_t j {0}; j < state.scopes[i]->size; ++j)
+				glob::destroy(state.scopes[i]->rules[j]);
+			if (state.scopes[i]->rules)
+			{
+				tfree(state.scopes[i]->rules);
+				tfree(state.scopes[i]->negated);
+			}
+			tfree(state.scopes[i]);
+		}
+		if (state.scopes)
+			tfree(state.scopes);
+
+		if (state.files.size)
+			qsort(state.files.paths, state.files.size, sizeof(char*), compare_walk_paths);
+		if (state.dirs.size)
+			qsort(state.dirs.paths, state.dirs.size, sizeof(char*), compare_paths);
+		return {state.files.paths,        state.files.size,       state.dirs.paths,
+		        state.dirs.size,          state.ignore_files.paths, state.ignore_files.size};
+	}
+
+	void sort_walk_paths(char** paths, uint32_t size)
+	{
+		if (size)
+			qsort(paths, size, sizeof(char*), compare_walk_paths);
+	}
 } // namespace fs
\ No newline at end of file
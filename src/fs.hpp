@@ -19,8 +19,8 @@ namespace fs
 	/// @brief Lists directories contained in `dir`.
 	/// @param dir String indicating the directory filter to read. A null or not '\0'
 	/// terminated string results in undefined behavior
-	/// @return list_dirs_res List of directories contained in `dir`. If no directories
-	/// are present, `dirs = nullptr` and `size = 0`.
+	/// @return list_dirs_res List of directories contained in `dir`, sorted by name. If
+	/// no directories are present, `dirs = nullptr` and `size = 0`.
 	list_dirs_res list_dirs(char const* dir_filter);
 
 	/// @brief Lists files contained in `dir_filter`, filtered by `file_filter`.
@@ -30,9 +30,123 @@ namespace fs
 	/// process files discovered by `dir_filter` to read. If null, the files are not
 	/// filtered.
 	/// @return list_files_res List of files present in `dir_filter`, matching
-	/// `file_filter`. If no files match, `files = nullptr` and `size = 0`.
+	/// `file_filter`, sorted by name. If no files match, `files = nullptr` and
+	/// `size = 0`.
 	list_files_res list_files(char const* dir_filter, char const* file_filter);
 
+	/// @brief Filters applied by `walk`. Null callbacks accept every entry.
+	struct walk_filter
+	{
+		/// @brief Returns true if the directory `path`, ending with '/', must be walked.
+		bool (*dir)(char const* path, uint32_t len, void* data) {nullptr};
+		/// @brief Returns true if the file `path` must be listed.
+		bool (*file)(char const* path, uint32_t len, void* data) {nullptr};
+		void* data {nullptr};
+
+		/// @brief Names of the ignore files honored while walking (e.g. ".gitignore"),
+		/// following the gitignore format. Their rules apply to the directory they are
+		/// found in and its subdirectories, and ignored directories are never opened.
+		char const* const* ignore_files {nullptr};
+		uint32_t           ignore_files_size {0};
+	};
+
+	struct walk_res
+	{
+		char**   files;
+		uint32_t size;
+		char**   dirs;
+		uint32_t dirs_size;
+		char**   ignore_files;
+		uint32_t ignore_files_size;
+	};
+
+	/// @brief Recursively lists files contained in `dir` and its subdirectories. Each
+	/// directory is read once, and subdirectories are walked in parallel, so `filter`
+	/// callbacks may be called concurrently.
+	/// @param dir Directory to walk, empty or ending with '/'. An empty string walks the
+	/// current working directory.
+	/// @param filter Filters of the walked directories and listed files.
+	/// @return walk_res Files found, prefixed by `dir`, with the files of a directory
+	/// sorted by name and listed before the ones of its subdirectories. `dirs` lists the
+	/// walked directories, ending with '/', sorted by name, and `ignore_files` the ignore
+	/// files read.
+	walk_res walk(char const* dir, walk_filter const& filter);
+
+	/// @brief Destroys the workers of the calling thread, created by the first call
+	/// needing them and reused by the next ones. Must be called once its generation is
+	/// done.
+	void clear_pool();
+
+	/// @brief Sorts `paths` in the order `walk` lists files: the files of a directory
+	/// sorted by name, before the ones of its subdirectories.
+	void sort_walk_paths(char** paths, uint32_t size);
+
+	/// @brief Enables the persistent cache of directory listings, used by `list_dirs`,
+	/// `list_files` and `walk`, and loads the listings saved at `path` if any. Listings
+	/// are reused as long as the directory (identified by its path and inode, or
+	/// creation time on Windows) has the same last write time, without reading it again.
+	/// @param path Path to the cache file.
+	void load_dir_cache(char const* path);
+
+	/// @brief Saves the listings of the directories read since `load_dir_cache` to
+	/// `path`, and disables the cache. Directories written too recently to be told apart
+	/// from a future change are not saved.
+	/// @param path Path to the cache file. Its directory must exist.
+	/// @return true Cache saved, or not enabled.
+	/// @return false Cache could not be written.
+	bool save_dir_cache(char const* path);
+
+	/// @brief Reads a whole file.
+	/// @param path Path to the file to read.
+	/// @param size Set to the size of the file, in bytes.
+	/// @return char* File content, '\0' terminated, or nullptr if the file could not be
+	/// read. Must be freed by the caller.
+	char* read_file(char const* path, uint32_t* size);
+
+	/// @brief Maps a whole file in memory, read only. The mapping stays valid until
+	/// `unmap_file`, even if the file is replaced meanwhile.
+	/// @param path Path to the file to map.
+	/// @param size Set to the size of the file, in bytes.
+	/// @return char const* File content, not '\0' terminated, or nullptr if the file could
+	/// not be mapped or is empty. Must be unmapped with `unmap_file`.
+	char const* map_file(char const* path, uint64_t& size);
+
+	void unmap_file(char const* data, uint64_t size);
+
+	enum class entry_type : uint8_t
+	{
+		none,
+		file,
+		directory,
+	};
+
+	/// @brief Retrieves the type of many paths at once, following symbolic links. On
+	/// Linux, the requests are submitted in batches through io_uring, and otherwise
+	/// spread on the workers of the calling thread, see `clear_pool`.
+	/// @param paths Paths to query, relative to the working directory or absolute.
+	/// @param types Set to the type of each path, `none` if it doesn't exist.
+	void get_entry_types(char const* const* paths, uint32_t size, entry_type* types);
+
+	/// @brief Identity and last change of a file or directory, telling apart two
+	/// versions of it without reading it.
+	struct stamp
+	{
+		entry_type type;
+		uint64_t   id;   // Inode, or creation time on Windows
+		uint64_t   time; // Last write time
+		uint64_t   size; // 0 for directories
+	};
+
+	/// @brief Retrieves the stamp of `path`, following symbolic links.
+	/// @param path Path to query, relative to the working directory or absolute. An
+	/// empty string queries the working directory.
+	/// @return stamp Stamp of `path`, zeroed with type `none` if it doesn't exist.
+	stamp get_stamp(char const* path);
+
+	/// @brief Checks if `s` was written too recently to be told apart from a change
+	/// happening right after, within the same last write time.
+	bool is_recent(stamp const& s);
+
 	/// @brief Verifies `file` presence in the filesystem.
 	/// @param file String pointing to the file to verify. The file path is verified as
 	/// is, meaning it will use current working directory for relative path.
@@ -55,6 +169,12 @@ namespace fs
 	/// @return char* The working directory as a full path.
 	char* get_cwd();
 
+	/// @brief Gets the current working directory, queried once and kept until `set_cwd`
+	/// changes it. Not thread safe.
+	/// @param len (Optional) Set to the length of the returned path.
+	/// @return char const* The working directory as a full path, owned by fs.
+	char const* get_cached_cwd(uint32_t* len = nullptr);
+
 	/// @brief Sets the current working directory.
 	/// @param cwd The current working directory.
 	void set_cwd(char const* cwd);
@@ -104,4 +224,18 @@ namespace fs
 	/// @return true Move succeeded.
 	/// @return false Move failed.
 	bool move(char* const src_path, char* const dst_path);
+
+	/// @brief Writes `data` to `path`, only if the file content differs. The new
+	/// content is written to a temporary file first, then moved over `path`, so readers
+	/// never see a partially written file. Unchanged files keep their last write time.
+	/// @param path Path to the file to write.
+	/// @param data Content to write.
+	/// @param size Size of `data`, in bytes.
+	/// @param written (Optional) Set to true if the file was rewritten, false otherwise.
+	/// @return true File is up to date.
+	/// @return false File could not be written.
+	bool write_file_if_changed(char const* path,
+	                           char const* data,
+	                           uint32_t    size,
+	                           bool*       written = nullptr);
 }; // namespace fs
\ No newline at end of file
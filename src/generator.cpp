@@ -1,10 +1,16 @@
 #include "generator.hpp"
 
+#include "alloc.hpp"
 #include "fs.hpp"
+#include "job.hpp"
 #include "lua_env.hpp"
+#include "map.hpp"
 #include "mem.hpp"
+#include "project.hpp"
 #include "state.hpp"
 #include "string.hpp"
+#include "sym.hpp"
+#include "track.hpp"
 
 extern "C"
 {
@@ -15,16 +21,17 @@ extern "C"
 
 #include <malloc.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 namespace gen
 {
 	namespace
 	{
-		char* unesc_str(char const* str)
+		char* unesc_str(alloc::arena& a, char const* str)
 		{
 			uint32_t len = strlen(str);
-			char*    unescaped = tmalloc<char>(len * 2);
+			char*    unescaped = alloc::push<char>(a, len * 2 + 1);
 			uint32_t pos = 0;
 			for (uint32_t i {0}; i < len; ++i)
 			{
@@ -84,137 +91,440 @@ namespace gen
 			return unescaped;
 		}
 
-		void generate_db(lua::output* outs, uint32_t outs_size)
+		// Path of the file `name` in the build directory
+		char* build_path(alloc::arena& a, char const* name)
 		{
-			FILE* file = fopen("build/compile_commands.json", "w");
-			char* cwd = fs::get_cwd();
-			char* unesc_cwd = unesc_str(cwd);
+			uint32_t dir_len = strlen(g.build_dir);
+			uint32_t name_len = strlen(name);
+			char*    res = alloc::push<char>(a, dir_len + name_len + 1);
+			memcpy(res, g.build_dir, dir_len);
+			memcpy(res + dir_len, name, name_len + 1);
+			return res;
+		}
+
+		// Length of the path from the build directory to the working directory, without
+		// its trailing '/'
+		int32_t root_len()
+		{
+			return static_cast<int32_t>(strlen(g.build_to_root)) - 1;
+		}
+
+		void generate_db(alloc::arena&             a,
+		                 lua::output const* const* outs,
+		                 uint32_t                  outs_size)
+		{
+			str::buffer buf;
+			char*       cwd = fs::get_cwd();
+			char*       unesc_cwd = unesc_str(a, cwd);
+			int32_t     dir_len = static_cast<int32_t>(strlen(g.build_dir)) - 1;
 			tfree(cwd);
-			fwrite("[\n", 1, 2, file);
+			str::append(buf, "[\n", 2);
 			for (uint32_t i {0}; i < outs_size; ++i)
 			{
-				for (uint32_t j {0}; j < outs[i].sources_size; ++j)
+				for (uint32_t j {0}; j < outs[i]->sources_size; ++j)
 				{
-					fwrite("	{\n", 1, 3, file);
+					str::append(buf, "	{\n", 3);
 #ifdef _WIN32
-					fprintf(file, "		\"directory\": \"%s\\\\build\",\n", unesc_cwd);
+					str::appendf(buf, "		\"directory\": \"%s\\\\%.*s\",\n", unesc_cwd,
+					             dir_len, g.build_dir);
 #elif defined(__linux__)
-					fprintf(file, "		\"directory\": \"%s/build\",\n", unesc_cwd);
+					str::appendf(buf, "		\"directory\": \"%s/%.*s\",\n", unesc_cwd,
+					             dir_len, g.build_dir);
 #endif
-					char* unesc_options =
-						unesc_str(outs[i].sources[j].compile_options
-					                  ? outs[i].sources[j].compile_options
-					                  : outs[i].compile_options);
-					fprintf(file, "		\"command\": \"clang++ %s\",\n", unesc_options);
-					tfree(unesc_options);
-					fprintf(file, "		\"file\": \"../%s\"\n", outs[i].sources[j].file);
-					if (i == outs_size - 1 && j == outs[i].sources_size - 1)
-						fwrite("	}\n", 1, 3, file);
+					sym::id options = outs[i]->sources[j].compile_options
+					                      ? outs[i]->sources[j].compile_options
+					                      : outs[i]->compile_options;
+					char*   unesc_options = unesc_str(a, options ? sym::str(options) : "");
+					str::appendf(buf, "		\"command\": \"clang++ %s\",\n", unesc_options);
+					str::appendf(buf, "		\"output\": \"obj/%s/%s\",\n",
+					             sym::str(outs[i]->name), outs[i]->objs[j]);
+					str::appendf(buf, "		\"file\": \"%s%s\"\n", g.build_to_root,
+					             sym::str(outs[i]->sources[j].file));
+					if (i == outs_size - 1 && j == outs[i]->sources_size - 1)
+						str::append(buf, "	}\n", 3);
 					else
-						fwrite("	},\n", 1, 4, file);
+						str::append(buf, "	},\n", 4);
 				}
 			}
-			fwrite("]", 1, 1, file);
+			str::append(buf, "]", 1);
+
+			char const* path = build_path(a, "compile_commands.json");
+			track::add(track::output, path);
+			fs::write_file_if_changed(path, buf.data, buf.size);
 
-			tfree(unesc_cwd);
-			fclose(file);
+			str::release(buf);
 		}
 
-		char** collect_objs(lua::output const& out)
+		// Computes the object files of a project once, and caches them on the project.
+		// Objects are named after their source, relative to the deepest directory common
+		// to all sources, and are allocated in a single block.
+		void compute_objs(lua::output& out)
 		{
-			char**   objs = tmalloc<char*>(out.sources_size);
-			uint32_t path_start {UINT32_MAX};
-			for (uint32_t i {0}; i < out.sources_size; ++i)
+			if (out.objs || !out.sources_size)
+				return;
+
+			char const* first = sym::str(out.sources[0].file);
+			uint32_t    path_start = str::rfind(first, "/");
+			path_start = path_start == UINT32_MAX ? 0 : path_start + 1;
+			for (uint32_t i {1}; i < out.sources_size && path_start; ++i)
 			{
-				uint32_t file_start {str::rfind(out.sources[i].file, "/")};
-				if (file_start == UINT32_MAX)
-				{
-					path_start = 0;
-					break;
-				}
-				else
-				{
-					if (path_start == UINT32_MAX)
-						path_start = file_start;
+				char const* file = sym::str(out.sources[i].file);
+				uint32_t    common = 0;
+				while (common < path_start && file[common] == first[common])
+					++common;
+				while (common > 0 && first[common - 1] != '/')
+					--common;
+				path_start = common;
+			}
 
-					if (strlen(out.sources[i].file) > path_start &&
-					    strncmp(out.sources[0].file, out.sources[i].file, path_start) !=
-					        0)
-					{
-						do
-						{
-							file_start = str::rfind(out.sources[i].file, "/", path_start);
-						}
-						while (file_start != UINT32_MAX &&
-						       strncmp(out.sources[0].file, out.sources[i].file,
-						               file_start) != 0);
+			uint32_t* objs_len = tmalloc<uint32_t>(out.sources_size);
+			uint32_t  objs_size = 0;
+			for (uint32_t i {0}; i < out.sources_size; ++i)
+			{
+				char const* file = sym::str(out.sources[i].file) + path_start;
+				uint32_t    file_len = sym::len(out.sources[i].file) - path_start;
+				uint32_t    file_ext = str::rfind(file, ".", file_len);
+				uint32_t    file_name = str::rfind(file, "/", file_len);
+				if (file_ext == UINT32_MAX ||
+				    (file_name != UINT32_MAX && file_ext < file_name))
+					file_ext = file_len;
+
+				objs_len[i] = file_ext;
+				objs_size += file_ext + 3 /*.o\0*/;
+			}
 
-						if (file_start == UINT32_MAX)
-						{
-							path_start = 0;
-							break;
-						}
-					}
-				}
+			out.objs = tmalloc<char*>(out.sources_size);
+			char* objs_data = tmalloc<char>(objs_size);
+			for (uint32_t i {0}; i < out.sources_size; ++i)
+			{
+				out.objs[i] = objs_data;
+				strncpy(objs_data, sym::str(out.sources[i].file) + path_start, objs_len[i]);
+				strcpy(objs_data + objs_len[i], ".o");
+				objs_data += objs_len[i] + 3;
 			}
+			tfree(objs_len);
+		}
 
-			if (path_start != 0)
-				++path_start;
+		// Projects to generate, each appearing once, with dependencies ordered before
+		// their dependents. Nodes point into the project registry, and are looked up by
+		// name, as a project table given more than once is parsed in distinct projects.
+		struct project_graph
+		{
+			enum node_state : uint8_t
+			{
+				visiting,
+				visited
+			};
 
-			for (uint32_t i {0}; i < out.sources_size; ++i)
+			lua::output** order {nullptr};
+			uint32_t      order_size {0};
+
+			lua::output** nodes {nullptr};
+			node_state*   states {nullptr};
+			// Last project whose link dependencies included the node
+			uint32_t*     marks {nullptr};
+			uint32_t      nodes_size {0};
+			uint32_t      nodes_capacity {0};
+
+			map::str_map names;
+		};
+
+		uint32_t find(map::str_map const& map, sym::id key)
+		{
+			return map::find(map, sym::str(key), sym::len(key), sym::hash(key));
+		}
+
+		uint32_t insert(map::str_map& map, sym::id key, uint32_t value)
+		{
+			return map::insert(map, sym::str(key), value, sym::len(key), sym::hash(key));
+		}
+
+		// Computes the projects linked with `out`, whose dependencies were all added: each
+		// dependency followed by its own link dependencies, keeping the last occurrence of
+		// every project, so it still comes after all the ones depending on it.
+		void compute_link_deps(project_graph& graph, lua::output& out, uint32_t node)
+		{
+			if (out.link_deps)
+				tfree(out.link_deps);
+			out.link_deps = nullptr;
+			out.link_deps_size = 0;
+
+			uint32_t size = 0;
+			for (uint32_t i {0}; i < out.deps_size; ++i)
+				size += 1 + out.deps[i]->link_deps_size;
+			if (!size)
+				return;
+
+			// Dependencies given by table are resolved to the project of the graph
+			lua::output** all = tmalloc<lua::output*>(size);
+			uint32_t      pos = 0;
+			for (uint32_t i {0}; i < out.deps_size; ++i)
 			{
-				uint32_t file_ext {str::rfind(out.sources[i].file, ".")};
-				if (file_ext != UINT32_MAX)
-				{
-					objs[i] = tmalloc<char>(file_ext - path_start + 3);
-					strncpy(objs[i], out.sources[i].file + path_start,
-					        file_ext - path_start);
-					strcpy(objs[i] + file_ext - path_start, ".o");
-				}
-				else
-				{
-					objs[i] = tmalloc<char>(strlen(out.sources[i].file) - path_start + 3);
-					strcpy(objs[i], out.sources[i].file + path_start);
-					strcpy(objs[i] + strlen(out.sources[i].file) - path_start, ".o");
-				}
+				lua::output* dep = graph.nodes[find(graph.names, out.deps[i]->name)];
+				all[pos++] = dep;
+				memcpy(all + pos, dep->link_deps, dep->link_deps_size * sizeof(*all));
+				pos += dep->link_deps_size;
+			}
+
+			// Kept projects are moved to the end, behind the ones left to check
+			uint32_t kept = 0;
+			for (uint32_t i {size}; i-- > 0;)
+			{
+				uint32_t dep_node = find(graph.names, all[i]->name);
+				if (graph.marks[dep_node] == node)
+					continue;
+				graph.marks[dep_node] = node;
+				all[size - 1 - kept++] = all[i];
 			}
 
-			return objs;
+			out.link_deps = tmalloc<lua::output*>(kept);
+			memcpy(out.link_deps, all + size - kept, kept * sizeof(*all));
+			out.link_deps_size = kept;
+			tfree(all);
 		}
 
-		void write_deps(lua::output const& out, FILE* file)
+		void add_project(lua_State* L, project_graph& graph, lua::output& out)
 		{
+			uint32_t node = find(graph.names, out.name);
+			if (node != UINT32_MAX)
+			{
+				if (graph.states[node] == project_graph::visiting)
+					luaL_error(L, "dependency cycle detected on project '%s'",
+					           sym::str(out.name));
+				return;
+			}
+
+			if (graph.nodes_size == graph.nodes_capacity)
+			{
+				graph.nodes_capacity = graph.nodes_capacity ? graph.nodes_capacity * 2 : 16;
+				graph.nodes = trealloc(graph.nodes, graph.nodes_capacity);
+				graph.states = trealloc(graph.states, graph.nodes_capacity);
+				graph.marks = trealloc(graph.marks, graph.nodes_capacity);
+				graph.order = trealloc(graph.order, graph.nodes_capacity);
+			}
+
+			node = graph.nodes_size++;
+			graph.nodes[node] = &out;
+			graph.states[node] = project_graph::visiting;
+			graph.marks[node] = UINT32_MAX;
+			insert(graph.names, out.name, node);
+
 			for (uint32_t i {0}; i < out.deps_size; ++i)
+				add_project(L, graph, *out.deps[i]);
+
+			compute_objs(out);
+			compute_link_deps(graph, out, node);
+			graph.states[node] = project_graph::visited;
+			graph.order[graph.order_size++] = &out;
+		}
+
+		void release(project_graph& graph)
+		{
+			if (graph.order)
+				tfree(graph.order);
+			if (graph.nodes)
+				tfree(graph.nodes);
+			if (graph.states)
+				tfree(graph.states);
+			if (graph.marks)
+				tfree(graph.marks);
+			map::release(graph.names);
+			graph = {};
+		}
+
+		struct expected_input
+		{
+			char const*    path;
+			fs::entry_type type;
+			char const*    kind;
+			char const*    project;
+		};
+
+		void add_expected(expected_input*& inputs,
+		                  uint32_t&        size,
+		                  uint32_t&        capacity,
+		                  expected_input   input)
+		{
+			if (size == capacity)
 			{
-				switch (out.deps[i].type)
+				capacity = capacity ? capacity * 2 : 256;
+				inputs = trealloc(inputs, capacity);
+			}
+			inputs[size++] = input;
+		}
+
+		// Adds `input`, unless it is a built artifact or the output of a command, which
+		// don't exist yet
+		void add_expected(expected_input*&    inputs,
+		                  uint32_t&           size,
+		                  uint32_t&           capacity,
+		                  expected_input      input,
+		                  map::str_map const& cmd_outputs)
+		{
+			if (!str::starts_with(input.path, "build/") &&
+			    map::find(cmd_outputs, input.path) == UINT32_MAX)
+				add_expected(inputs, size, capacity, input);
+		}
+
+		void add_expected(expected_input*&            inputs,
+		                  uint32_t&                   size,
+		                  uint32_t&                   capacity,
+		                  lua::custom_command const*  cmds,
+		                  uint32_t                    cmds_size,
+		                  map::str_map const&         cmd_outputs,
+		                  char const*                 project)
+		{
+			for (uint32_t i {0}; i < cmds_size; ++i)
+				for (uint32_t j {0}; j < cmds[i].in_len; ++j)
+					add_expected(inputs, size, capacity,
+					             {sym::str(cmds[i].in[j]), fs::entry_type::file,
+					              "command input", project},
+					             cmd_outputs);
+		}
+
+		// Verifies every source, include directory and command input of the generated
+		// projects exists, so missing files are reported at generation instead of during
+		// the build. Raises an error listing all of them, if any.
+		void check_inputs(lua_State* L, project_graph const& graph, alloc::arena& a)
+		{
+			map::str_map cmd_outputs;
+			for (uint32_t i {0}; i < graph.order_size; ++i)
+			{
+				lua::output const& out = *graph.order[i];
+				for (uint32_t j {0}; j < out.pre_build_cmd_size; ++j)
+					for (uint32_t k {0}; k < out.pre_build_cmds[j].out_len; ++k)
+						insert(cmd_outputs, out.pre_build_cmds[j].out[k], 0);
+				for (uint32_t j {0}; j < out.post_build_cmd_size; ++j)
+					for (uint32_t k {0}; k < out.post_build_cmds[j].out_len; ++k)
+						insert(cmd_outputs, out.post_build_cmds[j].out[k], 0);
+			}
+
+			expected_input* inputs = nullptr;
+			uint32_t        size = 0;
+			uint32_t        capacity = 0;
+			for (uint32_t i {0}; i < graph.order_size; ++i)
+			{
+				lua::output const& out = *graph.order[i];
+				char const*        name = sym::str(out.name);
+				for (uint32_t j {0}; j < out.sources_size; ++j)
+					add_expected(inputs, size, capacity,
+					             {sym::str(out.sources[j].file), fs::entry_type::file,
+					              "source", name},
+					             cmd_outputs);
+				for (uint32_t j {0}; j < out.include_dirs_size; ++j)
+					add_expected(inputs, size, capacity,
+					             {sym::str(out.include_dirs[j]), fs::entry_type::directory,
+					              "include directory", name},
+					             cmd_outputs);
+				add_expected(inputs, size, capacity, out.pre_build_cmds,
+				             out.pre_build_cmd_size, cmd_outputs, name);
+				add_expected(inputs, size, capacity, out.post_build_cmds,
+				             out.post_build_cmd_size, cmd_outputs, name);
+			}
+			map::release(cmd_outputs);
+
+			char const**    paths = alloc::push<char const*>(a, size);
+			fs::entry_type* types = alloc::push<fs::entry_type>(a, size);
+			for (uint32_t i {0}; i < size; ++i)
+				paths[i] = inputs[i].path;
+			fs::get_entry_types(paths, size, types);
+			for (uint32_t i {0}; i < size; ++i)
+				track::add(track::entry, paths[i]);
+
+			uint32_t missing = 0;
+			for (uint32_t i {0}; i < size; ++i)
+			{
+				if (types[i] == inputs[i].type)
+					continue;
+				printf("'%s': missing %s of project '%s'\n", inputs[i].path, inputs[i].kind,
+				       inputs[i].project);
+				++missing;
+			}
+			if (inputs)
+				tfree(inputs);
+
+			if (missing)
+				luaL_error(L, "%d missing input%s", static_cast<int32_t>(missing),
+				           missing > 1 ? "s" : "");
+		}
+
+		void write_deps(lua::output const& out, str::buffer& buf)
+		{
+			for (uint32_t i {0}; i < out.link_deps_size; ++i)
+			{
+				lua::output const& dep = *out.link_deps[i];
+				switch (dep.type)
 				{
 					case lua::project_type::sources:
 					{
-						char** objs = collect_objs(out.deps[i]);
-
-						for (uint32_t j {0}; j < out.deps[i].sources_size; ++j)
-							fprintf(file, "obj/%s/%s ", out.deps[i].name, objs[j]);
-
-						for (uint32_t j {0}; j < out.deps[i].sources_size; ++j)
-							tfree(objs[j]);
-						tfree(objs);
+						for (uint32_t j {0}; j < dep.sources_size; ++j)
+							str::appendf(buf, "obj/%s/%s ", sym::str(dep.name), dep.objs[j]);
 						break;
 					}
 					case lua::project_type::shared_library:
 					{
-						fprintf(file, "lib/%s.a ", out.deps[i].name);
+						str::appendf(buf, "lib/%s.a ", sym::str(dep.name));
 						break;
 					}
 					case lua::project_type::static_library:
 					{
-						fprintf(file, "lib/%s.a ", out.deps[i].name);
+						str::appendf(buf, "lib/%s.a ", sym::str(dep.name));
 						break;
 					}
 					case lua::project_type::executable: [[fallthrough]];
 					default: break;
 				}
+			}
+		}
+
+		int compare_names(void const* lhs, void const* rhs)
+		{
+			return strcmp(*static_cast<char const* const*>(lhs),
+			              *static_cast<char const* const*>(rhs));
+		}
+
+		// Writes the implicit dependencies of a link edge, sorted by name to keep the
+		// output stable. Removes the trailing space left by the inputs if there are none.
+		void write_implicit_deps(lua::output const& out, str::buffer& buf, alloc::arena& a)
+		{
+			if (!out.deps_size)
+			{
+				--buf.size;
+				buf.data[buf.size] = '\0';
+				return;
+			}
+
+			char const** names = alloc::push<char const*>(a, out.deps_size);
+			for (uint32_t i {0}; i < out.deps_size; ++i)
+				names[i] = sym::str(out.deps[i]->name);
+			qsort(names, out.deps_size, sizeof(char const*), compare_names);
+
+			str::append(buf, "|", 1);
+			for (uint32_t i {0}; i < out.deps_size; ++i)
+				str::appendf(buf, " %s", names[i]);
+		}
 
-				write_deps(out.deps[i], file);
+		// Writes `path` as seen from the build directory.
+		void write_path(str::buffer& buf, char const* path)
+		{
+			if (fs::is_absolute(path))
+				str::append(buf, path);
+			else if (str::starts_with(path, g.build_dir))
+				str::append(buf, path + strlen(g.build_dir));
+			else
+			{
+				str::append(buf, g.build_to_root);
+				str::append(buf, path);
+			}
+		}
+
+		void write_paths(str::buffer& buf, sym::id const* paths, uint32_t paths_size)
+		{
+			for (uint32_t i {0}; i < paths_size; ++i)
+			{
+				if (i != 0)
+					str::append(buf, " ", 1);
+				str::append(buf, sym::str(paths[i]), sym::len(paths[i]));
 			}
 		}
 
@@ -235,7 +545,7 @@ namespace gen
 
 		void write_custom_command(lua::custom_command* cmds,
 		                          uint32_t             cmd_size,
-		                          FILE*                file,
+		                          str::buffer&         buf,
 		                          char const*          cmd_chain = nullptr)
 		{
 			// TODO handle null output
@@ -244,208 +554,193 @@ namespace gen
 			{
 				if (cmds[i].cmd)
 				{
+					char const* cmd = sym::str(cmds[i].cmd);
 					for (uint32_t j {0}; j < cmds[i].out_len; ++j)
 					{
 						if (j == 0)
-							fwrite("build", 1, 5, file);
-						if (fs::is_absolute(cmds[i].out[j]))
-							fprintf(file, " %s", cmds[i].out[j]);
-						else if (str::starts_with(cmds[i].out[j], "build"))
-							fprintf(file, " %s", cmds[i].out[j] + 6);
-						else
-							fprintf(file, " ../%s", cmds[i].out[j]);
+							str::append(buf, "build", 5);
+						str::append(buf, " ", 1);
+						write_path(buf, sym::str(cmds[i].out[j]));
 					}
-					fwrite(": cmd", 1, 5, file);
+					str::append(buf, ": cmd", 5);
 					for (uint32_t j {0}; j < cmds[i].in_len; ++j)
-						if (fs::is_absolute(cmds[i].in[j]))
-							fprintf(file, " %s", cmds[i].in[j]);
-						else if (str::starts_with(cmds[i].in[j], "build"))
-							fprintf(file, " %s", cmds[i].in[j] + 6);
-						else
-							fprintf(file, " ../%s", cmds[i].in[j]);
+					{
+						str::append(buf, " ", 1);
+						write_path(buf, sym::str(cmds[i].in[j]));
+					}
 
 					if (i > 0 || cmd_chain)
-						fwrite(" ||", 1, 3, file);
+						str::append(buf, " ||", 3);
 					if (i > 0)
 					{
-						if (fs::is_absolute(cmds[i - 1].out[0]))
-							fprintf(file, " %s", cmds[i - 1].out[0]);
-						else if (str::starts_with(cmds[i - 1].out[0], "build"))
-							fprintf(file, " %s", cmds[i - 1].out[0] + 6);
-						else
-							fprintf(file, " ../%s", cmds[i - 1].out[0]);
+						str::append(buf, " ", 1);
+						write_path(buf, sym::str(cmds[i - 1].out[0]));
 					}
 					if (cmd_chain)
-						fprintf(file, " %s", cmd_chain);
+						str::appendf(buf, " %s", cmd_chain);
 
-					uint32_t in_pos = str::find(cmds[i].cmd, "${in}");
-					uint32_t out_pos = str::find(cmds[i].cmd, "${out}");
+					uint32_t in_pos = str::find(cmd, "${in}");
+					uint32_t out_pos = str::find(cmd, "${out}");
 					if (in_pos != UINT32_MAX || out_pos != UINT32_MAX)
 					{
 						uint32_t first_pos = 0;
 						uint32_t second_pos = 0;
 						if (in_pos < out_pos)
 						{
-							fprintf(file, "\n    cmd = %.*s", in_pos, cmds[i].cmd);
+							str::appendf(buf, "\n    cmd = %.*s", in_pos, cmd);
 							first_pos = in_pos;
 							second_pos = out_pos;
 						}
 						else
 						{
-							fprintf(file, "\n    cmd = %.*s", out_pos, cmds[i].cmd);
+							str::appendf(buf, "\n    cmd = %.*s", out_pos, cmd);
 							first_pos = out_pos;
 							second_pos = in_pos;
 						}
 
 						if (first_pos == in_pos)
-							for (uint32_t j {0}; j < cmds[i].in_len; ++j)
-								if (j == 0)
-									fprintf(file, "%s", cmds[i].in[j]);
-								else
-									fprintf(file, " %s", cmds[i].in[j]);
+							write_paths(buf, cmds[i].in, cmds[i].in_len);
 						else
-							for (uint32_t j {0}; j < cmds[i].out_len; ++j)
-								if (j == 0)
-									fprintf(file, "%s", cmds[i].out[j]);
-								else
-									fprintf(file, " %s", cmds[i].out[j]);
+							write_paths(buf, cmds[i].out, cmds[i].out_len);
 
 						if (second_pos != UINT32_MAX)
 						{
 							if (first_pos == in_pos)
 							{
-								fprintf(file, "%.*s", second_pos - first_pos - 5,
-								        cmds[i].cmd + first_pos + 5 /*${in}*/);
-								for (uint32_t j {0}; j < cmds[i].out_len; ++j)
-									if (j == 0)
-										fprintf(file, "%s", cmds[i].out[j]);
-									else
-										fprintf(file, " %s", cmds[i].out[j]);
-								fprintf(file, "%s",
-								        cmds[i].cmd + second_pos + 6 /*${out}*/);
+								str::appendf(buf, "%.*s", second_pos - first_pos - 5,
+								             cmd + first_pos + 5 /*${in}*/);
+								write_paths(buf, cmds[i].out, cmds[i].out_len);
+								str::append(buf, cmd + second_pos + 6 /*${out}*/);
 							}
 							else
 							{
-								fprintf(file, " %.*s", second_pos - first_pos - 6,
-								        cmds[i].cmd + first_pos + 6 /*${out}*/);
-								for (uint32_t j {0}; j < cmds[i].in_len; ++j)
-									if (j == 0)
-										fprintf(file, "%s", cmds[i].in[j]);
-									else
-										fprintf(file, " %s", cmds[i].in[j]);
-								fprintf(file, "%s",
-								        cmds[i].cmd + second_pos + 5 /*${in}*/);
+								str::appendf(buf, " %.*s", second_pos - first_pos - 6,
+								             cmd + first_pos + 6 /*${out}*/);
+								write_paths(buf, cmds[i].in, cmds[i].in_len);
+								str::append(buf, cmd + second_pos + 5 /*${in}*/);
 							}
 						}
 						else
 						{
-							fprintf(file, "%s", cmds[i].cmd + first_pos + 5 /*${in}*/);
+							str::append(buf, cmd + first_pos + 5 /*${in}*/);
 						}
-						fwrite("\n", 1, 1, file);
+						str::append(buf, "\n", 1);
 					}
 					else
-						fprintf(file, "\n    cmd = %s\n", cmds[i].cmd);
+						str::appendf(buf, "\n    cmd = %s\n", cmd);
 				}
 				else
 				{
-					fwrite("build ", 1, 6, file);
-					if (fs::is_absolute(cmds[i].out[0]))
-						fprintf(file, "%s: copy ", cmds[i].out[0]);
-					else if (str::starts_with(cmds[i].out[0], "build"))
-						fprintf(file, "%s: copy ", cmds[i].out[0] + 6);
-					else
-						fprintf(file, "../%s: copy ", cmds[i].out[0]);
-
-					if (fs::is_absolute(cmds[i].in[0]))
-						fprintf(file, "%s", cmds[i].in[0]);
-					else if (str::starts_with(cmds[i].in[0], "build"))
-						fprintf(file, "%s", cmds[i].in[0] + 6);
-					else
-						fprintf(file, "../%s", cmds[i].in[0]);
+					str::append(buf, "build ", 6);
+					write_path(buf, sym::str(cmds[i].out[0]));
+					str::append(buf, ": copy ", 7);
+					write_path(buf, sym::str(cmds[i].in[0]));
 
 					if (i > 0 || cmd_chain)
-						fwrite(" ||", 1, 3, file);
+						str::append(buf, " ||", 3);
 
 					if (i > 0)
 					{
-						if (fs::is_absolute(cmds[i - 1].out[0]))
-							fprintf(file, " %s", cmds[i - 1].out[0]);
-						else if (str::starts_with(cmds[i - 1].out[0], "build"))
-							fprintf(file, " %s", cmds[i - 1].out[0] + 6);
-						else
-							fprintf(file, " ../%s", cmds[i - 1].out[0]);
+						str::append(buf, " ", 1);
+						write_path(buf, sym::str(cmds[i - 1].out[0]));
 					}
 					if (cmd_chain)
-						fprintf(file, " %s\n", cmd_chain);
+						str::appendf(buf, " %s\n", cmd_chain);
 					else
-						fwrite("\n", 1, 1, file);
+						str::append(buf, "\n", 1);
 				}
 			}
 
 			if (cmd_size)
-				fwrite("\n", 1, 1, file);
+				str::append(buf, "\n", 1);
 		}
 
-		void generate(lua::output const& out, FILE* file)
+		// Distinct flags of an emission unit (the manifest, or a project file with
+		// --subninja), each declared once as a top-level variable referenced by the edges,
+		// instead of being repeated under every edge.
+		struct flag_sets
 		{
-			char* cwd = get_ninja_cwd();
+			map::str_map cxx;
+			map::str_map cxx_absolute;
+			map::str_map link;
+			uint32_t     cxx_size {0};
+			uint32_t     link_size {0};
+
+			str::buffer vars;
+		};
 
-			write_custom_command(out.pre_build_cmds, out.pre_build_cmd_size, file);
+		uint32_t intern_cxxflags(flag_sets& sets, sym::id options, bool absolute_source)
+		{
+			if (!options)
+				options = sym::intern("", 0);
+
+			map::str_map& names = absolute_source ? sets.cxx_absolute : sets.cxx;
+			uint32_t      id = insert(names, options, sets.cxx_size);
+			if (id != sets.cxx_size)
+				return id;
+
+			++sets.cxx_size;
+			str::appendf(sets.vars, "cxxflags_%u =", id);
+			// TODO absolute path ?
+			if (!absolute_source)
+				str::appendf(sets.vars, " -fmacro-prefix-map=\"%s=\"", g.build_to_root);
+			if (sym::len(options))
+				str::appendf(sets.vars, " %s", sym::str(options));
+			str::append(sets.vars, "\n", 1);
+			return id;
+		}
 
-			char** objs = collect_objs(out);
+		uint32_t intern_lflags(flag_sets& sets, sym::id options)
+		{
+			uint32_t id = insert(sets.link, options, sets.link_size);
+			if (id != sets.link_size)
+				return id;
+
+			++sets.link_size;
+			str::appendf(sets.vars, "lflags_%u = %s\n", id, sym::str(options));
+			return id;
+		}
+
+		void release(flag_sets& sets)
+		{
+			map::release(sets.cxx);
+			map::release(sets.cxx_absolute);
+			map::release(sets.link);
+			str::release(sets.vars);
+		}
+
+		void generate(lua::output const& out,
+		              flag_sets&         sets,
+		              str::buffer&       buf,
+		              alloc::arena&      a)
+		{
+			char*       cwd = get_ninja_cwd();
+			char const* name = sym::str(out.name);
+
+			write_custom_command(out.pre_build_cmds, out.pre_build_cmd_size, buf);
+
+			char* const* objs = out.objs;
 			for (uint32_t i {0}; i < out.sources_size; ++i)
 			{
-				if (fs::is_absolute(out.sources[i].file))
-					fprintf(file, "build obj/%s/%s: cxx %s", out.name, objs[i],
-					        out.sources[i].file);
-				else if (str::starts_with(out.sources[i].file, "build"))
-					fprintf(file, "build obj/%s/%s: cxx %s", out.name, objs[i],
-					        out.sources[i].file + 6);
-				else
-					fprintf(file, "build obj/%s/%s: cxx ../%s", out.name, objs[i],
-					        out.sources[i].file);
+				char const* file = sym::str(out.sources[i].file);
+				str::appendf(buf, "build obj/%s/%s: cxx ", name, objs[i]);
+				write_path(buf, file);
 
 				if (out.pre_build_cmd_size)
 				{
-					if (fs::is_absolute(
-							out.pre_build_cmds[out.pre_build_cmd_size - 1].out[0]))
-					{
-						fprintf(file, " || %s\n",
-						        out.pre_build_cmds[out.pre_build_cmd_size - 1].out[0]);
-					}
-					else if (str::starts_with(
-								 out.pre_build_cmds[out.pre_build_cmd_size - 1].out[0],
-								 "build"))
-					{
-						fprintf(file, " || %s\n",
-						        out.pre_build_cmds[out.pre_build_cmd_size - 1].out[0] +
-						            6);
-					}
-					else
-					{
-						fprintf(file, " || ../%s\n",
-						        out.pre_build_cmds[out.pre_build_cmd_size - 1].out[0]);
-					}
-				}
-
-				else
-					fwrite("\n", 1, 1, file);
-
-				if (fs::is_absolute(out.sources[i].file))
-				{
-					fprintf(file, "    cxxflags = %s\n",
-					        out.sources[i].compile_options
-					            ? out.sources[i].compile_options
-					            : out.compile_options);
-				}
-				else
-				{
-					// TODO absolute path ?
-					fprintf(
-						file, "    cxxflags = -fmacro-prefix-map=\"../=\" %s\n", /*cwd,*/
-						out.sources[i].compile_options ? out.sources[i].compile_options
-													   : out.compile_options);
+					lua::custom_command const& last =
+						out.pre_build_cmds[out.pre_build_cmd_size - 1];
+					str::append(buf, " || ", 4);
+					write_path(buf, sym::str(last.out[0]));
 				}
+				str::append(buf, "\n", 1);
+
+				uint32_t flags = intern_cxxflags(sets,
+				                                 out.sources[i].compile_options
+				                                     ? out.sources[i].compile_options
+				                                     : out.compile_options,
+				                                 fs::is_absolute(file));
+				str::appendf(buf, "    cxxflags = $cxxflags_%u\n", flags);
 			}
 
 			char* build_out = nullptr;
@@ -454,34 +749,26 @@ namespace gen
 				case lua::project_type::executable:
 				{
 #ifdef _WIN32
-					int32_t result = snprintf(nullptr, 0, "bin/%s.exe", out.name);
-					build_out = tmalloc<char>(result + 1);
-					snprintf(build_out, result + 1, "bin/%s.exe", out.name);
+					int32_t result = snprintf(nullptr, 0, "bin/%s.exe", name);
+					build_out = alloc::push<char>(a, result + 1);
+					snprintf(build_out, result + 1, "bin/%s.exe", name);
 #elif defined(__linux__)
-					int32_t result = snprintf(nullptr, 0, "bin/%s", out.name);
-					build_out = tmalloc<char>(result + 1);
-					snprintf(build_out, result + 1, "bin/%s", out.name);
+					int32_t result = snprintf(nullptr, 0, "bin/%s", name);
+					build_out = alloc::push<char>(a, result + 1);
+					snprintf(build_out, result + 1, "bin/%s", name);
 #endif
 
-					fprintf(file, "build %s: link ", build_out);
+					str::appendf(buf, "build %s: link ", build_out);
 					for (uint32_t i {0}; i < out.sources_size; ++i)
-						fprintf(file, "obj/%s/%s ", out.name, objs[i]);
+						str::appendf(buf, "obj/%s/%s ", name, objs[i]);
 
-					write_deps(out, file);
-					if (out.deps_size)
-					{
-						fwrite("|", 1, 1, file);
-						for (uint32_t i {0}; i < out.deps_size; ++i)
-							fprintf(file, " %s", out.deps[i].name);
-					}
-					else
-					{
-						fseek(file, -1, SEEK_CUR);
-					}
+					write_deps(out, buf);
+					write_implicit_deps(out, buf, a);
 					if (out.link_options)
-						fprintf(file, "\n    lflags = %s\n\n", out.link_options);
+						str::appendf(buf, "\n    lflags = $lflags_%u\n\n",
+						             intern_lflags(sets, out.link_options));
 					else
-						fwrite("\n\n", 1, 2, file);
+						str::append(buf, "\n\n", 2);
 
 					break;
 				}
@@ -490,76 +777,59 @@ namespace gen
 				case lua::project_type::shared_library:
 				{
 #ifdef _WIN32
-					int32_t result = snprintf(nullptr, 0, "bin/%s.dll", out.name);
-					build_out = tmalloc<char>(result + 1);
-					snprintf(build_out, result + 1, "bin/%s.dll", out.name);
+					int32_t result = snprintf(nullptr, 0, "bin/%s.dll", name);
+					build_out = alloc::push<char>(a, result + 1);
+					snprintf(build_out, result + 1, "bin/%s.dll", name);
 #elif defined(__linux__)
-					int32_t result = snprintf(nullptr, 0, "bin/%s.so", out.name);
-					build_out = tmalloc<char>(result + 1);
-					snprintf(build_out, result, "bin/%s.so", out.name);
+					int32_t result = snprintf(nullptr, 0, "bin/%s.so", name);
+					build_out = alloc::push<char>(a, result + 1);
+					snprintf(build_out, result, "bin/%s.so", name);
 #endif
 
-					fprintf(file, "build %s: link ", build_out);
+					str::appendf(buf, "build %s: link ", build_out);
 					for (uint32_t i {0}; i < out.sources_size; ++i)
-						fprintf(file, "obj/%s ", objs[i]);
+						str::appendf(buf, "obj/%s ", objs[i]);
 
-					write_deps(out, file);
-					if (out.deps_size)
-					{
-						fwrite("|", 1, 1, file);
-						for (uint32_t i {0}; i < out.deps_size; ++i)
-							fprintf(file, " %s", out.deps[i].name);
-					}
-					else
-					{
-						fseek(file, -1, SEEK_CUR);
-					}
+					write_deps(out, buf);
+					write_implicit_deps(out, buf, a);
 					if (out.link_options)
-						fprintf(file, "\n    lflags = %s\n\n", out.link_options);
+						str::appendf(buf, "\n    lflags = $lflags_%u\n\n",
+						             intern_lflags(sets, out.link_options));
 					else
-						fwrite("\n\n", 1, 2, file);
+						str::append(buf, "\n\n", 2);
 					break;
 				}
 				case lua::project_type::static_library:
 				{
-					int32_t result = snprintf(nullptr, 0, "lib/%s.s", out.name);
-					build_out = tmalloc<char>(result + 1);
-					snprintf(build_out, result + 1, "lib/%s.a", out.name);
+					int32_t result = snprintf(nullptr, 0, "lib/%s.s", name);
+					build_out = alloc::push<char>(a, result + 1);
+					snprintf(build_out, result + 1, "lib/%s.a", name);
 
-					fprintf(file, "build %s: lib ", build_out);
+					str::appendf(buf, "build %s: lib ", build_out);
 					for (uint32_t i {0}; i < out.sources_size; ++i)
-						fprintf(file, "obj/%s/%s ", out.name, objs[i]);
+						str::appendf(buf, "obj/%s/%s ", name, objs[i]);
 
-					write_deps(out, file);
-					if (out.deps_size)
-					{
-						fwrite("|", 1, 1, file);
-						for (uint32_t i {0}; i < out.deps_size; ++i)
-							fprintf(file, " %s", out.deps[i].name);
-					}
-					else
-					{
-						fseek(file, -1, SEEK_CUR);
-					}
-					fwrite("\n    lflags = rscu\n\n", 1, 19, file);
+					write_deps(out, buf);
+					write_implicit_deps(out, buf, a);
+					str::append(buf, "\n    lflags = rscu\n\n", 19);
 
 					break;
 				}
 				case lua::project_type::sources:
 				{
 					uint32_t result = 0;
-					uint32_t name_len = strlen(out.name);
+					uint32_t name_len = sym::len(out.name);
 					for (uint32_t i {0}; i < out.sources_size; ++i)
 						result += 4 /*obj/*/ + name_len + 1 /*/*/ + strlen(objs[i]) + 1;
 
-					build_out = tmalloc<char>(result);
+					build_out = alloc::push<char>(a, result);
 					memset(build_out, 0, result);
 					uint32_t pos = 0;
 					for (uint32_t i {0}; i < out.sources_size; ++i)
 					{
 						strncpy(build_out + pos, "obj/", 4);
 						pos += 4;
-						strncpy(build_out + pos, out.name, name_len);
+						strncpy(build_out + pos, name, name_len);
 						pos += name_len;
 						build_out[pos] = '/';
 						++pos;
@@ -579,48 +849,146 @@ namespace gen
 				}
 				default:
 				{
-					fwrite("\n", 1, 1, file);
+					str::append(buf, "\n", 1);
 					break;
 				}
 			}
 
-			write_custom_command(out.post_build_cmds, out.post_build_cmd_size, file,
+			write_custom_command(out.post_build_cmds, out.post_build_cmd_size, buf,
 			                     build_out);
 
 			if (build_out)
 			{
 				if (out.post_build_cmd_size)
 				{
-					if (fs::is_absolute(
-							out.post_build_cmds[out.post_build_cmd_size - 1].out[0]))
-					{
-						fprintf(file, "build %s: phony %s\n\n", out.name,
-						        out.post_build_cmds[out.post_build_cmd_size - 1].out[0]);
-					}
-					else if (str::starts_with(
-								 out.post_build_cmds[out.post_build_cmd_size - 1].out[0],
-								 "build"))
-					{
-						fprintf(file, "build %s: phony %s\n\n", out.name,
-						        out.post_build_cmds[out.post_build_cmd_size - 1].out[0] +
-						            6);
-					}
+					str::appendf(buf, "build %s: phony ", name);
+					write_path(
+						buf,
+						sym::str(out.post_build_cmds[out.post_build_cmd_size - 1].out[0]));
+					str::append(buf, "\n\n", 2);
+				}
+				else
+					str::appendf(buf, "build %s: phony %s\n\n", name, build_out);
+			}
+
+			tfree(cwd);
+		}
+
+		// Writes the edge regenerating the build files when an input of the generation
+		// changes. Inputs discovered while running the scripts (scripts loaded, directories
+		// globbed) are written in a depfile, so ninja skips running mingen entirely if
+		// none of them changed. restat avoids looping on the edge when the regenerated
+		// manifest is identical, and thus not rewritten.
+		bool write_regen_edge(str::buffer& buf, alloc::arena& a)
+		{
+			char* mingen_path = fs::get_current_executable_path();
+#ifdef _WIN32
+			str::appendf(buf, "rule regen\n    description = Regenerating build files\n"
+			                  "    command = cmd /c cd %.*s && ",
+			             root_len(), g.build_to_root);
+#elif defined(__linux__)
+			str::appendf(buf, "rule regen\n    description = Regenerating build files\n"
+			                  "    command = cd %.*s && ",
+			             root_len(), g.build_to_root);
+#endif
+			// Any configuration regenerates all of them, as they are run together
+			if (g.all_configs)
+				str::appendf(buf, "\"%s\" -f \"%s\" --all-configurations", mingen_path,
+				             g.file);
+			else
+				str::appendf(buf, "\"%s\" -f \"%s\" -c %s", mingen_path, g.file,
+				             g.config_param);
+			if (g.gen_compile_db)
+				str::append(buf, " --compile-db");
+			if (g.gen_subninja)
+				str::append(buf, " --subninja");
+			str::append(buf, "\n    generator = 1\n    restat = 1\n"
+			                 "    depfile = build.ninja.d\n\n");
+
+			str::append(buf, "build build.ninja: regen ");
+			write_path(buf, g.file);
+			str::appendf(buf, " | %s\n\n", mingen_path);
+			tfree(mingen_path);
+
+			str::buffer depfile;
+			str::append(depfile, "build.ninja:");
+			for (uint32_t i {0}; i <= track::kind::file; ++i)
+			{
+				track::inputs inputs = track::get(static_cast<track::kind>(i));
+				for (uint32_t j {0}; j < inputs.size; ++j)
+				{
+					str::buffer path;
+					if (inputs.paths[j][0] == '\0')
+						str::append(path, g.build_to_root, root_len());
 					else
+						write_path(path, inputs.paths[j]);
+
+					// Directories are given with a trailing separator
+					if (path.size > 1 &&
+					    (path.data[path.size - 1] == '/' || path.data[path.size - 1] == '\\'))
+						path.data[--path.size] = '\0';
+
+					str::append(depfile, " \\\n ");
+					for (uint32_t k {0}; k < path.size; ++k)
 					{
-						fprintf(file, "build %s: phony ../%s\n\n", out.name,
-						        out.post_build_cmds[out.post_build_cmd_size - 1].out[0]);
+						if (path.data[k] == ' ')
+							str::append(depfile, "\\", 1);
+						str::append(depfile, path.data + k, 1);
 					}
+					str::release(path);
 				}
-				else
-					fprintf(file, "build %s: phony %s\n\n", out.name, build_out);
-
-				tfree(build_out);
 			}
+			str::append(depfile, "\n", 1);
 
-			for (uint32_t i {0}; i < out.sources_size; ++i)
-				tfree(objs[i]);
-			tfree(objs);
-			tfree(cwd);
+			char const* path = build_path(a, "build.ninja.d");
+			track::add(track::output, path);
+			bool res = fs::write_file_if_changed(path, depfile.data, depfile.size);
+			str::release(depfile);
+			return res;
+		}
+
+		struct fragment
+		{
+			lua::output const*  out;
+			mingen_state const* state;
+			bool                res;
+			// Of the content generated, written in the root manifest
+			uint32_t size;
+			uint32_t hash;
+		};
+
+		// Generates a project in its own build/<project>.ninja file. Run on a worker of
+		// the generation pool.
+		void generate_fragment(void* data)
+		{
+			fragment* frag = static_cast<fragment*>(data);
+			// Workers take the state of the thread generating the configuration
+			g = *frag->state;
+
+			flag_sets    sets;
+			str::buffer  body;
+			alloc::arena temp;
+			generate(*frag->out, sets, body, temp);
+
+			str::buffer buf;
+			str::reserve(buf, sets.vars.size + 1 + body.size);
+			str::append(buf, sets.vars.data, sets.vars.size);
+			str::append(buf, "\n", 1);
+			str::append(buf, body.data, body.size);
+			str::release(body);
+			release(sets);
+
+			char const* name = sym::str(frag->out->name);
+			int32_t     path_len = snprintf(nullptr, 0, "%s%s.ninja", g.build_dir, name);
+			char*       path = alloc::push<char>(temp, path_len + 1);
+			snprintf(path, path_len + 1, "%s%s.ninja", g.build_dir, name);
+
+			frag->size = buf.size;
+			frag->hash = map::hash(buf.data, buf.size);
+			frag->res = fs::write_file_if_changed(path, buf.data, buf.size);
+
+			alloc::release(temp);
+			str::release(buf);
 		}
 	} // namespace
 
@@ -634,11 +1002,16 @@ namespace gen
 
 		if (!fs::dir_exists("build/"))
 			fs::create_dir("build/");
+		if (!fs::dir_exists(g.build_dir))
+			fs::create_dir(g.build_dir);
 
-		FILE* file = fopen("build/build.ninja", "w");
+		// Temporaries of the generation, freed at once when done
+		alloc::arena temp;
 
-		if (!file)
-			luaL_error(L, "failed to open file for write");
+		// The whole manifest is rendered in memory, and only written if it differs from
+		// the one on disk. This keeps its last write time untouched when nothing changed,
+		// so ninja doesn't need to reload it.
+		str::buffer buf;
 
 		// create rules
 		constexpr char rules[] =
@@ -662,7 +1035,7 @@ rule link
 		constexpr char cmd_rule[] =
 			R"(rule cmd
     description = Running ${cmd}
-    command = cmd /c pushd .. && ${cmd}
+    command = cmd /c pushd %.*s && ${cmd}
 
 rule copy
     description = Copying ${in} to ${out}
@@ -670,91 +1043,138 @@ rule copy
 
 )";
 		char* mingen_path = fs::get_current_executable_path();
-		fprintf(file, cmd_rule, mingen_path);
+		str::appendf(buf, cmd_rule, root_len(), g.build_to_root, mingen_path);
+		tfree(mingen_path);
 #elif defined(__linux__)
 		constexpr char cmd_rule[] =
 			R"(rule cmd
     description = Running ${cmd}
-    command = pushd .. && ${cmd}
+    command = pushd %.*s && ${cmd}
 
 rule copy
     description = Copying ${in} to ${out}
     command = cp ${in} ${out}
 
 )";
-		fwrite(cmd_rule, 1, sizeof(cmd_rule) - 1, file);
+		str::appendf(buf, cmd_rule, root_len(), g.build_to_root);
 #endif
 
-		fwrite(rules, 1, sizeof(rules) - 1, file);
-
-		uint32_t* original_outputs = tmalloc<uint32_t>(len);
+		str::append(buf, rules, sizeof(rules) - 1);
 
-		lua::output* outputs = tmalloc<lua::output>(len);
-		uint32_t     outputs_size = 0;
-		uint32_t     outputs_capacity = len;
+		if (!write_regen_edge(buf, temp))
+			luaL_error(L, "failed to write '%sbuild.ninja.d'", g.build_dir);
 
+		lua::output** outputs = alloc::push<lua::output*>(temp, len);
 		for (uint32_t i {0}; i < len; ++i)
 		{
 			lua_rawgeti(L, 1, i + 1);
-			lua::output out = lua::parse_output(L);
-			if (out.type == lua::project_type::prebuilt)
+			outputs[i] = prj::check_project(L, -1);
+			if (outputs[i]->type == lua::project_type::prebuilt)
 			{
 				luaL_error(L,
 				           "Cannot ask for prebuilt projet '%s' to be explicitly built",
-				           out.name);
+				           sym::str(outputs[i]->name));
 			}
-			for (uint32_t j {0}; j < out.deps_size; ++j)
-			{
-				bool write {true};
-				for (uint32_t k {0}; k < outputs_size; ++k)
-				{
-					if (strcmp(outputs[k].name, out.deps[j].name) == 0)
-					{
-						write = false;
-						break;
-					}
-				}
+			lua_pop(L, 1);
+		}
 
-				if (write)
-				{
-					if (outputs_capacity == outputs_size)
-					{
-						outputs = trealloc(outputs, outputs_capacity * 2);
-						outputs_capacity *= 2;
-					}
-					outputs[outputs_size] = out.deps[j];
-					++outputs_size;
-				}
+		// Resolves the whole dependency closure once, so every project reachable from the
+		// requested ones is emitted exactly once, after its dependencies.
+		project_graph graph;
+		for (uint32_t i {0}; i < len; ++i)
+			add_project(L, graph, *outputs[i]);
+
+		if (g.check_files)
+			check_inputs(L, graph, temp);
+
+		fragment* fragments = nullptr;
+		if (g.gen_subninja)
+		{
+			// Each project is generated in parallel in its own file, only rewritten if its
+			// content changed. The root manifest references them with the size and hash of
+			// their content, so it changes along with any of them: ninja only reloads the
+			// manifests after regenerating if the root one was rewritten.
+			for (uint32_t i {0}; i < graph.order_size; ++i)
+			{
+				if (strcmp(sym::str(graph.order[i]->name), "build") == 0)
+					luaL_error(L, "project name 'build' is reserved with --subninja");
 			}
 
-			if (outputs_capacity == outputs_size)
+			fragments = alloc::push<fragment>(temp, graph.order_size);
+			uint32_t   threads = job::core_count();
+			job::pool* pool =
+				job::create_pool(threads < graph.order_size ? threads : graph.order_size);
+			for (uint32_t i {0}; i < graph.order_size; ++i)
 			{
-				outputs = trealloc(outputs, outputs_capacity * 2);
-				outputs_capacity *= 2;
+				fragments[i] = {graph.order[i], &g, false, 0, 0};
+				job::submit(pool, generate_fragment, fragments + i);
 			}
-			outputs[outputs_size] = out;
-			original_outputs[i] = outputs_size;
-			++outputs_size;
 
-			lua_pop(L, 1);
-		}
+			if (g.gen_compile_db)
+				generate_db(temp, graph.order, graph.order_size);
 
-		if (g.gen_compile_db)
-			generate_db(outputs, outputs_size);
+			job::destroy_pool(pool);
 
-		for (uint32_t i {0}; i < outputs_size; ++i)
-			generate(outputs[i], file);
+			for (uint32_t i {0}; i < graph.order_size; ++i)
+			{
+				char const* name = sym::str(fragments[i].out->name);
+				str::appendf(buf, "# %s.ninja: %u %08x\nsubninja %s.ninja\n", name,
+				             fragments[i].size, fragments[i].hash, name);
+			}
+			str::append(buf, "\n", 1);
+		}
+		else
+		{
+			if (g.gen_compile_db)
+				generate_db(temp, graph.order, graph.order_size);
+
+			flag_sets   sets;
+			str::buffer body;
+			for (uint32_t i {0}; i < graph.order_size; ++i)
+				generate(*graph.order[i], sets, body, temp);
+
+			// Variables must be declared before the edges using them
+			str::append(buf, sets.vars.data, sets.vars.size);
+			str::append(buf, "\n", 1);
+			str::append(buf, body.data, body.size);
+			str::release(body);
+			release(sets);
+		}
 
-		fwrite("default", 1, 7, file);
+		str::append(buf, "default", 7);
 		for (uint32_t i {0}; i < len; ++i)
-			fprintf(file, " %s", outputs[original_outputs[i]].name);
-		fwrite("\n", 1, 1, file);
+			str::appendf(buf, " %s", sym::str(outputs[i]->name));
+		str::append(buf, "\n", 1);
+
+		char const* path = build_path(temp, "build.ninja");
+		track::add(track::output, path);
+		bool res = fs::write_file_if_changed(path, buf.data, buf.size);
+		str::release(buf);
+
+		char const* failed_fragment = nullptr;
+		if (fragments)
+		{
+			for (uint32_t i {0}; i < graph.order_size; ++i)
+			{
+				if (!fragments[i].res)
+					failed_fragment = sym::str(fragments[i].out->name);
+				// Recorded from this thread, as workers don't keep track of their writes
+				str::buffer fragment_path;
+				str::appendf(fragment_path, "%s%s.ninja", g.build_dir,
+				             sym::str(fragments[i].out->name));
+				track::add(track::output, fragment_path.data, fragment_path.size);
+				str::release(fragment_path);
+			}
+		}
+
+		if (!res)
+			luaL_error(L, "failed to write '%sbuild.ninja'", g.build_dir);
+		if (failed_fragment)
+			luaL_error(L, "failed to write '%s%s.ninja'", g.build_dir, failed_fragment);
+
+		release(graph);
+		alloc::release(temp);
 
-		for (uint32_t i {0}; i < len; ++i)
-			lua::free_output(outputs[original_outputs[i]]);
-		tfree(outputs);
-		tfree(original_outputs);
-		fclose(file);
 		return 0;
 	}
 } // namespace gen
\ No newline at end of file
@@ -0,0 +1,445 @@
+#include "git.hpp"
+
+#ifdef _WIN32
+#include <win32/file.h>
+#include <win32/io.h>
+#include <win32/misc.h>
+#endif
+
+#include "job.hpp"
+#include "mem.hpp"
+#include "string.hpp"
+#include "track.hpp"
+
+#include <stdlib.h>
+
+namespace git
+{
+	namespace
+	{
+		// Tracked paths of a repository, relative to its work tree, sorted by name
+		struct repo
+		{
+			char*     work_tree;
+			char*     index_path;
+			bool      valid;
+			char*     paths;
+			uint32_t* offsets;
+			uint32_t  size;
+		};
+
+		// Repositories are allocated one by one, so they are never moved once loaded
+		repo**   repos {nullptr};
+		uint32_t repos_size {0};
+
+		job::mutex lock;
+
+		bool init_lock()
+		{
+			job::init(lock);
+			return true;
+		}
+
+		// Initialized before main, as the first use can happen from any thread when
+		// configurations are generated in parallel
+		bool lock_init {init_lock()};
+
+		job::mutex& get_lock()
+		{
+			return lock;
+		}
+
+#ifdef _WIN32
+		// Returns the absolute path of `dir` with '/' separators and no trailing '/'
+		char* absolute_path(char const* dir)
+		{
+			STACK_CHAR_TO_WCHAR(dir[0] ? dir : ".", wdir)
+			wchar_t wpath[1024];
+			uint32_t wlen = GetFullPathNameW(wdir, 1024, wpath, nullptr);
+			if (!wlen || wlen >= 1024)
+				return nullptr;
+
+			char* path = wchar_to_char(wpath);
+			for (char* c = path; *c; ++c)
+				if (*c == '\\')
+					*c = '/';
+			return path;
+		}
+#elif defined(__linux__)
+		// Returns the absolute path of `dir` with no trailing '/'
+		char* absolute_path(char const* dir)
+		{
+			return realpath(dir[0] ? dir : ".", nullptr);
+		}
+#else
+#error "Unsupported platform"
+#endif
+
+		uint32_t read_u32(uint8_t const* data)
+		{
+			return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) |
+			       (data[2] << 8) | data[3];
+		}
+
+		uint16_t read_u16(uint8_t const* data)
+		{
+			return (data[0] << 8) | data[1];
+		}
+
+		// Reads the path of the git directory from the `.git` file of a linked work tree
+		// or submodule, "gitdir: <path>", relative to the work tree if not absolute
+		char* read_gitdir_file(char const* work_tree, uint32_t work_tree_len, char const* path)
+		{
+			uint32_t size = 0;
+			char*    content = fs::read_file(path, &size);
+			if (!content)
+				return nullptr;
+
+			char* gitdir = nullptr;
+			if (str::starts_with(content, "gitdir: "))
+			{
+				char*    value = content + 8;
+				uint32_t len = strlen(value);
+				while (len && (value[len - 1] == '\n' || value[len - 1] == '\r'))
+					--len;
+				value[len] = '\0';
+
+				bool relative = !fs::is_absolute(value);
+				gitdir = tmalloc<char>(relative * (work_tree_len + 1) + len + 1);
+				if (relative)
+				{
+					memcpy(gitdir, work_tree, work_tree_len);
+					gitdir[work_tree_len] = '/';
+				}
+				strcpy(gitdir + relative * (work_tree_len + 1), value);
+			}
+			tfree(content);
+			return gitdir;
+		}
+
+		// Reads the entries of an index in version 2, 3 or 4. Conflicting entries are
+		// listed once, and entries not checked out (skip-worktree) or of submodules are
+		// skipped. Sparse indexes, holding whole directories as entries, are not supported.
+		bool parse_index(repo& r, uint8_t const* data, uint64_t size)
+		{
+			constexpr uint32_t header_size = 12;
+			constexpr uint32_t entry_size = 62;
+			constexpr uint32_t hash_size = 20;
+
+			if (size < header_size + hash_size || memcmp(data, "DIRC", 4) != 0)
+				return false;
+			uint32_t version = read_u32(data + 4);
+			uint32_t count = read_u32(data + 8);
+			if (version < 2 || version > 4 || count > (size - header_size) / entry_size)
+				return false;
+
+			str::buffer paths;
+			str::buffer prev;
+			r.offsets = tmalloc<uint32_t>(count ? count : 1);
+			r.size = 0;
+
+			uint64_t end = size - hash_size;
+			uint64_t pos = header_size;
+			bool     valid = true;
+			for (uint32_t i {0}; i < count && valid; ++i)
+			{
+				if (pos + entry_size > end)
+				{
+					valid = false;
+					break;
+				}
+
+				uint8_t const* entry = data + pos;
+				uint32_t       mode = read_u32(entry + 24);
+				uint16_t       flags = read_u16(entry + 60);
+				uint16_t       extended_flags = 0;
+				uint64_t       name_pos = pos + entry_size;
+				if (flags & 0x4000)
+				{
+					if (version < 3 || name_pos + 2 > end)
+					{
+						valid = false;
+						break;
+					}
+					extended_flags = read_u16(data + name_pos);
+					name_pos += 2;
+				}
+
+				// Version 4 prefix compresses paths: the entry holds how many bytes to
+				// remove from the end of the previous path, before appending its own
+				uint32_t strip = 0;
+				if (version == 4)
+				{
+					uint8_t  c = 0;
+					uint64_t value = 0;
+					do
+					{
+						if (name_pos >= end || value > UINT32_MAX)
+						{
+							valid = false;
+							break;
+						}
+						c = data[name_pos++];
+						value = (value << 7) + (c & 127);
+						if (c & 128)
+							++value;
+					}
+					while (c & 128);
+					if (!valid || value > prev.size)
+					{
+						valid = false;
+						break;
+					}
+					strip = value;
+				}
+
+				uint8_t const* name = data + name_pos;
+				uint8_t const* name_end =
+					static_cast<uint8_t const*>(memchr(name, '\0', end - name_pos));
+				if (!name_end)
+				{
+					valid = false;
+					break;
+				}
+				uint32_t name_len = name_end - name;
+
+				if (version == 4)
+					pos = name_pos + name_len + 1;
+				else
+					pos += (name_pos - pos + name_len + 8) & ~7ull;
+
+				// Directories are only found in sparse indexes
+				uint32_t type = mode >> 12;
+				if (type == 04)
+				{
+					valid = false;
+					break;
+				}
+
+				if (version != 4)
+					prev.size = 0;
+				else
+					prev.size -= strip;
+				str::append(prev, reinterpret_cast<char const*>(name), name_len);
+
+				// Conflicting entries follow each other, one per merge stage. Submodules
+				// are directories of other repositories.
+				bool skip = type == 016 || (extended_flags & 0x4000) ||
+				            (r.size && strcmp(prev.data, paths.data + r.offsets[r.size - 1]) == 0);
+				if (!skip)
+				{
+					r.offsets[r.size++] = paths.size;
+					str::append(paths, prev.data, prev.size + 1);
+				}
+			}
+			str::release(prev);
+
+			r.paths = paths.data;
+			return valid;
+		}
+
+		// Loads the index of a repository once, even when listed from multiple threads
+		repo* load_repo(char const* work_tree, char const* gitdir)
+		{
+			job::mutex& m = get_lock();
+			job::lock(m);
+			for (uint32_t i {0}; i < repos_size; ++i)
+			{
+				if (strcmp(repos[i]->work_tree, work_tree) == 0)
+				{
+					job::unlock(m);
+					return repos[i];
+				}
+			}
+
+			repos = trealloc(repos, repos_size + 1);
+			repos[repos_size] = tmalloc<repo>();
+			repo& r = *repos[repos_size++];
+			r = {};
+			r.work_tree = tmalloc<char>(strlen(work_tree) + 1);
+			strcpy(r.work_tree, work_tree);
+
+			uint32_t gitdir_len = strlen(gitdir);
+			r.index_path = tmalloc<char>(gitdir_len + 7);
+			strcpy(r.index_path, gitdir);
+			strcpy(r.index_path + gitdir_len, "/index");
+
+			uint64_t    size = 0;
+			char const* data = fs::map_file(r.index_path, size);
+			if (data)
+			{
+				r.valid = parse_index(r, reinterpret_cast<uint8_t const*>(data), size);
+				fs::unmap_file(data, size);
+			}
+			job::unlock(m);
+			return &r;
+		}
+
+		// Finds the repository containing the absolute directory `path`, the closest
+		// parent holding a `.git` directory or file
+		repo* find_repo(char* path, uint32_t& work_tree_len)
+		{
+			uint32_t    len = strlen(path);
+			str::buffer candidate;
+			repo*       r = nullptr;
+			while (true)
+			{
+				candidate.size = 0;
+				str::append(candidate, path, len);
+				str::append(candidate, "/.git");
+
+				// A repository created later in a closer parent would be found instead
+				track::add(track::entry, candidate.data);
+				char* gitdir = nullptr;
+				if (fs::dir_exists(candidate.data))
+				{
+					gitdir = candidate.data;
+					candidate = {};
+				}
+				else if (fs::file_exists(candidate.data))
+					gitdir = read_gitdir_file(path, len, candidate.data);
+
+				if (gitdir)
+				{
+					char saved = path[len];
+					path[len] = '\0';
+					r = load_repo(path, gitdir);
+					path[len] = saved;
+					tfree(gitdir);
+					work_tree_len = len;
+					break;
+				}
+
+				uint32_t parent = str::rfind(path, "/", len);
+				if (parent == UINT32_MAX)
+					break;
+				len = parent;
+			}
+			str::release(candidate);
+			return r;
+		}
+	} // namespace
+
+	bool list_files(char const* dir, fs::walk_filter const& filter, list_res& res)
+	{
+		res = {};
+
+		char* path = absolute_path(dir);
+		if (!path)
+			return false;
+		uint32_t path_len = strlen(path);
+		if (path_len && path[path_len - 1] == '/')
+			path[--path_len] = '\0';
+
+		uint32_t work_tree_len = 0;
+		repo*    r = find_repo(path, work_tree_len);
+		if (!r || !r->valid)
+		{
+			tfree(path);
+			return false;
+		}
+
+		// Entries of `dir` are the ones starting with its path relative to the work tree
+		str::buffer sub;
+		str::reserve(sub, path_len - work_tree_len + 1);
+		sub.data[0] = '\0';
+		if (work_tree_len < path_len)
+		{
+			str::append(sub, path + work_tree_len + 1, path_len - work_tree_len - 1);
+			str::append(sub, "/");
+		}
+		tfree(path);
+
+		uint32_t first = 0;
+		uint32_t last = r->size;
+		while (first < last)
+		{
+			uint32_t mid = first + (last - first) / 2;
+			if (strcmp(r->paths + r->offsets[mid], sub.data) < 0)
+				first = mid + 1;
+			else
+				last = mid;
+		}
+
+		// Directories of the entries are filtered once per directory: `checked_len`
+		// is the length of the last directory accepted, and `rejected_len` the one of
+		// the last rejected, in the previous entry
+		uint32_t    dir_len = strlen(dir);
+		str::buffer full;
+		str::append(full, dir, dir_len);
+		char const* prev = "";
+		uint32_t    checked_len = 0;
+		uint32_t    rejected_len = 0;
+		uint32_t    capacity = 0;
+		for (uint32_t i {first}; i < r->size; ++i)
+		{
+			char const* entry = r->paths + r->offsets[i];
+			if (!str::starts_with(entry, sub.data, sub.size))
+				break;
+			char const* rel = entry + sub.size;
+			uint32_t    rel_len = strlen(rel);
+
+			uint32_t common = 0;
+			for (uint32_t j {0}; rel[j] && rel[j] == prev[j]; ++j)
+				if (rel[j] == '/')
+					common = j + 1;
+			prev = rel;
+
+			if (rejected_len && rejected_len <= common)
+				continue;
+			rejected_len = 0;
+			if (checked_len > common)
+				checked_len = common;
+
+			full.size = dir_len;
+			str::append(full, rel, rel_len);
+			for (uint32_t j {checked_len}; j < rel_len && !rejected_len; ++j)
+			{
+				if (rel[j] != '/')
+					continue;
+				if (filter.dir && !filter.dir(full.data, dir_len + j + 1, filter.data))
+					rejected_len = j + 1;
+				else
+					checked_len = j + 1;
+			}
+			if (rejected_len)
+				continue;
+
+			if (filter.file && !filter.file(full.data, full.size, filter.data))
+				continue;
+
+			if (res.size == capacity)
+			{
+				capacity = capacity ? capacity * 2 : 64;
+				res.files = trealloc(res.files, capacity);
+			}
+			res.files[res.size] = tmalloc<char>(full.size + 1);
+			memcpy(res.files[res.size], full.data, full.size + 1);
+			++res.size;
+		}
+		str::release(full);
+		str::release(sub);
+
+		fs::sort_walk_paths(res.files, res.size);
+		res.index_path = r->index_path;
+		return true;
+	}
+
+	void clear()
+	{
+		for (uint32_t i {0}; i < repos_size; ++i)
+		{
+			tfree(repos[i]->work_tree);
+			tfree(repos[i]->index_path);
+			if (repos[i]->paths)
+				tfree(repos[i]->paths);
+			if (repos[i]->offsets)
+				tfree(repos[i]->offsets);
+			tfree(repos[i]);
+		}
+		if (repos)
+			tfree(repos);
+		repos = nullptr;
+		repos_size = 0;
+	}
+} // namespace git
\ No newline at end of file
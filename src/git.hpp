@@ -0,0 +1,34 @@
+#pragma once
+
+#include "fs.hpp"
+
+#include <stdint.h>
+
+namespace git
+{
+	struct list_res
+	{
+		char**      files;
+		uint32_t    size;
+		char const* index_path;
+	};
+
+	/// @brief Lists the files of `dir` and its subdirectories tracked by the git
+	/// repository containing it, from the entries of the repository index instead of
+	/// the filesystem. Untracked files are not listed, and ignore files are not read.
+	/// The index of each repository is read once, and kept until `clear`. Can be called
+	/// from multiple threads.
+	/// @param dir Directory to list, empty or ending with '/'. An empty string lists the
+	/// current working directory.
+	/// @param filter Filters of the listed files and their directories. Ignore files are
+	/// not used.
+	/// @param res Files found, prefixed by `dir` and sorted by path, and path of the index
+	/// read.
+	/// @return true Files listed from the index.
+	/// @return false `dir` is not in a git repository, or its index can't be read, so the
+	/// filesystem must be walked instead.
+	bool list_files(char const* dir, fs::walk_filter const& filter, list_res& res);
+
+	/// @brief Frees the indexes read by `list_files`.
+	void clear();
+} // namespace git
\ No newline at end of file
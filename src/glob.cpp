@@ -0,0 +1,536 @@
+#include "glob.hpp"
+
+#include "mem.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace glob
+{
+	namespace
+	{
+		enum class token_type : uint8_t
+		{
+			literal,
+			any,
+			set,
+			star,
+			globstar,
+		};
+
+		struct token
+		{
+			token_type type;
+			uint8_t    c;
+			uint16_t   set;
+		};
+
+		// Characters of a `[...]` set, one bit per character
+		struct char_set
+		{
+			uint64_t bits[4];
+		};
+
+		// States of the automaton are positions in the tokens, the last one accepting.
+		// Tokens are bounded, so states are held in a fixed bitset.
+		constexpr uint32_t max_tokens = 255;
+
+		struct states
+		{
+			uint64_t bits[4];
+		};
+
+		void set_state(states& s, uint32_t i)
+		{
+			s.bits[i / 64] |= uint64_t(1) << (i % 64);
+		}
+
+		bool has_state(states const& s, uint32_t i)
+		{
+			return s.bits[i / 64] & (uint64_t(1) << (i % 64));
+		}
+
+		bool is_empty(states const& s)
+		{
+			return !(s.bits[0] | s.bits[1] | s.bits[2] | s.bits[3]);
+		}
+
+		// A pattern without braces, split between its literal start, compared as is, and
+		// the tokens following the first wildcard.
+		struct alternative
+		{
+			char*    prefix;
+			uint32_t prefix_len;
+			// Length of the directory part of `prefix`, including its trailing '/'
+			uint32_t root_len;
+
+			token*   tokens;
+			uint32_t tokens_size;
+			// First token from which only `**` remain, matching anything
+			uint32_t match_all;
+
+			bool exclude;
+		};
+
+		struct string_list
+		{
+			char**   strs {nullptr};
+			uint32_t size {0};
+			uint32_t capacity {0};
+		};
+
+		void push(string_list& list, char* str)
+		{
+			if (list.size == list.capacity)
+			{
+				list.capacity = list.capacity ? list.capacity * 2 : 8;
+				list.strs = trealloc(list.strs, list.capacity);
+			}
+			list.strs[list.size++] = str;
+		}
+
+		char* concat(char const* a,
+		             uint32_t    a_len,
+		             char const* b,
+		             uint32_t    b_len,
+		             char const* c,
+		             uint32_t    c_len)
+		{
+			char* res = tmalloc<char>(a_len + b_len + c_len + 1);
+			memcpy(res, a, a_len);
+			memcpy(res + a_len, b, b_len);
+			memcpy(res + a_len + b_len, c, c_len);
+			res[a_len + b_len + c_len] = '\0';
+			return res;
+		}
+
+		// Expands the first `{...}` group of `pattern` in each of its alternatives,
+		// recursively, until no group remains.
+		void expand_braces(char* pattern, string_list& out)
+		{
+			uint32_t len = strlen(pattern);
+			uint32_t open = UINT32_MAX;
+			uint32_t close = UINT32_MAX;
+			uint32_t depth = 0;
+			for (uint32_t i {0}; i < len && close == UINT32_MAX; ++i)
+			{
+				if (pattern[i] == '{')
+				{
+					if (!depth)
+						open = i;
+					++depth;
+				}
+				else if (pattern[i] == '}' && depth)
+				{
+					--depth;
+					if (!depth)
+						close = i;
+				}
+			}
+
+			// Unbalanced braces are kept as literals
+			if (close == UINT32_MAX)
+			{
+				push(out, pattern);
+				return;
+			}
+
+			uint32_t option = open + 1;
+			depth = 0;
+			for (uint32_t i {open + 1}; i <= close; ++i)
+			{
+				if (pattern[i] == '{')
+					++depth;
+				else if (pattern[i] == '}' && depth)
+					--depth;
+				else if ((pattern[i] == ',' && !depth) || i == close)
+				{
+					expand_braces(concat(pattern, open, pattern + option, i - option,
+					                     pattern + close + 1, len - close - 1),
+					              out);
+					option = i + 1;
+				}
+			}
+			tfree(pattern);
+		}
+
+		// Expands each `**/` starting a path segment in a variant matching no directory,
+		// and one matching at least one, where `**` is kept.
+		void expand_globstars(char* pattern, uint32_t from, string_list& out)
+		{
+			uint32_t len = strlen(pattern);
+			for (uint32_t i {from}; i + 2 < len; ++i)
+			{
+				if (pattern[i] == '*' && pattern[i + 1] == '*' && pattern[i + 2] == '/' &&
+				    (i == 0 || pattern[i - 1] == '/'))
+				{
+					char* none = concat(pattern, i, pattern + i + 3, len - i - 3, "", 0);
+					expand_globstars(none, i, out);
+					expand_globstars(pattern, i + 3, out);
+					return;
+				}
+			}
+			push(out, pattern);
+		}
+
+		bool is_wildcard(char c)
+		{
+			return c == '*' || c == '?' || c == '[' || c == '{';
+		}
+
+		// Parses the `[...]` set starting at `pattern[pos]`. Returns the position after
+		// the set, or UINT32_MAX if the set is not closed.
+		uint32_t parse_set(char const* pattern, uint32_t pos, char_set& set)
+		{
+			set = {};
+			uint32_t i = pos + 1;
+			bool     negate = pattern[i] == '!' || pattern[i] == '^';
+			if (negate)
+				++i;
+
+			uint32_t first = i;
+			for (; pattern[i] && (pattern[i] != ']' || i == first); ++i)
+			{
+				uint8_t begin = pattern[i];
+				uint8_t end = begin;
+				if (pattern[i + 1] == '-' && pattern[i + 2] && pattern[i + 2] != ']')
+				{
+					end = pattern[i + 2];
+					i += 2;
+				}
+				for (uint32_t c {begin}; c <= end; ++c)
+					set.bits[c / 64] |= uint64_t(1) << (c % 64);
+			}
+
+			if (pattern[i] != ']')
+				return UINT32_MAX;
+
+			if (negate)
+			{
+				for (uint32_t j {0}; j < 4; ++j)
+					set.bits[j] = ~set.bits[j];
+			}
+			return i + 1;
+		}
+	} // namespace
+
+	struct matcher
+	{
+		alternative* alts;
+		uint32_t     alts_size;
+
+		char_set* sets;
+		uint32_t  sets_size;
+
+		char**   roots;
+		uint32_t roots_size;
+	};
+
+	namespace
+	{
+		bool
+		compile_alternative(matcher& m, char* pattern, bool exclude, alternative& alt)
+		{
+			uint32_t len = strlen(pattern);
+			uint32_t prefix_len = 0;
+			while (prefix_len < len && !is_wildcard(pattern[prefix_len]))
+				++prefix_len;
+
+			alt = {pattern, prefix_len, 0, nullptr, 0, 0, exclude};
+			for (uint32_t i {0}; i < prefix_len; ++i)
+				if (pattern[i] == '/')
+					alt.root_len = i + 1;
+
+			alt.tokens = tmalloc<token>(len - prefix_len + 1);
+			for (uint32_t i {prefix_len}; i < len;)
+			{
+				if (alt.tokens_size == max_tokens)
+					return false;
+
+				token& t = alt.tokens[alt.tokens_size++];
+				t = {token_type::literal, static_cast<uint8_t>(pattern[i]), 0};
+				if (pattern[i] == '*')
+				{
+					t.type = token_type::star;
+					++i;
+					if (pattern[i] == '*')
+					{
+						t.type = token_type::globstar;
+						while (pattern[i] == '*')
+							++i;
+					}
+				}
+				else if (pattern[i] == '?')
+				{
+					t.type = token_type::any;
+					++i;
+				}
+				else if (pattern[i] == '[')
+				{
+					char_set set;
+					uint32_t end = parse_set(pattern, i, set);
+					if (end == UINT32_MAX)
+						++i;
+					else
+					{
+						t.type = token_type::set;
+						t.set = m.sets_size;
+						m.sets = trealloc(m.sets, m.sets_size + 1);
+						m.sets[m.sets_size++] = set;
+						i = end;
+					}
+				}
+				else
+					++i;
+			}
+
+			alt.match_all = alt.tokens_size;
+			while (alt.match_all > 0 &&
+			       alt.tokens[alt.match_all - 1].type == token_type::globstar)
+				--alt.match_all;
+			return true;
+		}
+
+		// Adds the states reachable without consuming characters: wildcards matching
+		// empty runs.
+		void close_states(alternative const& alt, states& s)
+		{
+			for (uint32_t i {0}; i < alt.tokens_size; ++i)
+			{
+				if (has_state(s, i) && (alt.tokens[i].type == token_type::star ||
+				                        alt.tokens[i].type == token_type::globstar))
+					set_state(s, i + 1);
+			}
+		}
+
+		// Runs the automaton over `str`, after the literal prefix was matched.
+		states
+		run(matcher const& m, alternative const& alt, char const* str, uint32_t len)
+		{
+			states current {};
+			set_state(current, 0);
+			close_states(alt, current);
+
+			for (uint32_t i {0}; i < len && !is_empty(current); ++i)
+			{
+				uint8_t c = str[i];
+				states  next {};
+				for (uint32_t j {0}; j < alt.tokens_size; ++j)
+				{
+					if (!has_state(current, j))
+						continue;
+
+					token const& t = alt.tokens[j];
+					switch (t.type)
+					{
+						case token_type::literal:
+							if (c == t.c)
+								set_state(next, j + 1);
+							break;
+						case token_type::any:
+							if (c != '/')
+								set_state(next, j + 1);
+							break;
+						case token_type::set:
+							if (c != '/' &&
+							    (m.sets[t.set].bits[c / 64] & (uint64_t(1) << (c % 64))))
+								set_state(next, j + 1);
+							break;
+						case token_type::star:
+							if (c != '/')
+								set_state(next, j);
+							break;
+						case token_type::globstar:
+							set_state(next, j);
+							break;
+					}
+				}
+				close_states(alt, next);
+				current = next;
+			}
+
+			return current;
+		}
+
+		bool
+		match(matcher const& m, alternative const& alt, char const* path, uint32_t len)
+		{
+			if (len < alt.prefix_len || memcmp(path, alt.prefix, alt.prefix_len) != 0)
+				return false;
+
+			states s = run(m, alt, path + alt.prefix_len, len - alt.prefix_len);
+			return has_state(s, alt.tokens_size);
+		}
+
+		// Checks if files under `dir` can be matched by `alt`: the directory can still
+		// lead to the literal prefix, or leaves the automaton alive.
+		bool
+		may_match(matcher const& m, alternative const& alt, char const* dir, uint32_t len)
+		{
+			if (len <= alt.prefix_len)
+				return memcmp(dir, alt.prefix, len) == 0;
+			if (memcmp(dir, alt.prefix, alt.prefix_len) != 0)
+				return false;
+
+			return !is_empty(run(m, alt, dir + alt.prefix_len, len - alt.prefix_len));
+		}
+
+		// Checks if every file under `dir` is matched by `alt`.
+		bool
+		match_all(matcher const& m, alternative const& alt, char const* dir, uint32_t len)
+		{
+			if (match(m, alt, dir, len - 1) || match(m, alt, dir, len))
+				return true;
+
+			if (len < alt.prefix_len || memcmp(dir, alt.prefix, alt.prefix_len) != 0)
+				return false;
+
+			states s = run(m, alt, dir + alt.prefix_len, len - alt.prefix_len);
+			for (uint32_t i {alt.match_all}; i < alt.tokens_size; ++i)
+				if (has_state(s, i))
+					return true;
+			return false;
+		}
+
+		int compare_roots(void const* lhs, void const* rhs)
+		{
+			return strcmp(*static_cast<char* const*>(lhs),
+			              *static_cast<char* const*>(rhs));
+		}
+	} // namespace
+
+	bool has_wildcards(char const* pattern, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = strlen(pattern);
+
+		if (len && pattern[0] == '!')
+			return true;
+		for (uint32_t i {0}; i < len; ++i)
+			if (is_wildcard(pattern[i]))
+				return true;
+		return false;
+	}
+
+	matcher* compile(char const* const* patterns, uint32_t size, char const** error)
+	{
+		matcher* m = tmalloc<matcher>();
+		*m = {};
+
+		for (uint32_t i {0}; i < size; ++i)
+		{
+			bool        exclude = patterns[i][0] == '!';
+			char const* pattern = patterns[i] + exclude;
+			uint32_t    len = strlen(pattern);
+
+			string_list braces;
+			expand_braces(concat(pattern, len, "", 0, "", 0), braces);
+			string_list expanded;
+			for (uint32_t j {0}; j < braces.size; ++j)
+				expand_globstars(braces.strs[j], 0, expanded);
+			if (braces.strs)
+				tfree(braces.strs);
+
+			m->alts = trealloc(m->alts, m->alts_size + expanded.size);
+			bool valid = true;
+			for (uint32_t j {0}; j < expanded.size; ++j)
+			{
+				if (valid)
+				{
+					valid = compile_alternative(*m, expanded.strs[j], exclude,
+					                            m->alts[m->alts_size]);
+					++m->alts_size;
+				}
+				else
+					tfree(expanded.strs[j]);
+			}
+			if (expanded.strs)
+				tfree(expanded.strs);
+
+			if (!valid)
+			{
+				if (error)
+					*error = "pattern has too many wildcards";
+				destroy(m);
+				return nullptr;
+			}
+		}
+
+		// Walking a directory already walks the ones nested in it
+		char**   roots = tmalloc<char*>(m->alts_size);
+		uint32_t roots_size = 0;
+		for (uint32_t i {0}; i < m->alts_size; ++i)
+		{
+			if (!m->alts[i].exclude)
+				roots[roots_size++] =
+					concat(m->alts[i].prefix, m->alts[i].root_len, "", 0, "", 0);
+		}
+		qsort(roots, roots_size, sizeof(char*), compare_roots);
+
+		m->roots = roots;
+		for (uint32_t i {0}; i < roots_size; ++i)
+		{
+			if (m->roots_size &&
+			    strncmp(roots[i], m->roots[m->roots_size - 1],
+			            strlen(m->roots[m->roots_size - 1])) == 0)
+				tfree(roots[i]);
+			else
+				m->roots[m->roots_size++] = roots[i];
+		}
+
+		return m;
+	}
+
+	void destroy(matcher* m)
+	{
+		for (uint32_t i {0}; i < m->alts_size; ++i)
+		{
+			tfree(m->alts[i].prefix);
+			tfree(m->alts[i].tokens);
+		}
+		if (m->alts)
+			tfree(m->alts);
+		if (m->sets)
+			tfree(m->sets);
+		for (uint32_t i {0}; i < m->roots_size; ++i)
+			tfree(m->roots[i]);
+		if (m->roots)
+			tfree(m->roots);
+		tfree(m);
+	}
+
+	bool match(matcher const* m, char const* path, uint32_t len)
+	{
+		bool included = false;
+		for (uint32_t i {0}; i < m->alts_size && !included; ++i)
+			included = !m->alts[i].exclude && match(*m, m->alts[i], path, len);
+
+		if (!included)
+			return false;
+
+		for (uint32_t i {0}; i < m->alts_size; ++i)
+			if (m->alts[i].exclude && match(*m, m->alts[i], path, len))
+				return false;
+		return true;
+	}
+
+	bool match_dir(matcher const* m, char const* dir, uint32_t len)
+	{
+		bool included = false;
+		for (uint32_t i {0}; i < m->alts_size && !included; ++i)
+			included = !m->alts[i].exclude && may_match(*m, m->alts[i], dir, len);
+
+		if (!included)
+			return false;
+
+		for (uint32_t i {0}; i < m->alts_size; ++i)
+			if (m->alts[i].exclude && match_all(*m, m->alts[i], dir, len))
+				return false;
+		return true;
+	}
+
+	roots get_roots(matcher const* m)
+	{
+		return {m->roots, m->roots_size};
+	}
+} // namespace glob
\ No newline at end of file
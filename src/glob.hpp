@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace glob
+{
+	/// @brief Glob patterns compiled into automatons, matching paths in a single pass
+	/// without backtracking. Supported syntax:
+	/// - `?` matches any character except '/'.
+	/// - `[abc]`, `[a-z]` match a character of the set, `[!abc]` or `[^abc]` a
+	///   character out of it, except '/'.
+	/// - `{a,b}` matches any of the comma separated alternatives, which can be nested.
+	/// - `*` matches any run of characters except '/'.
+	/// - `**/` matches zero or more directories.
+	/// - `**` anywhere else matches any run of characters, including '/' (e.g.
+	///   `src/**.cpp` matches every `.cpp` file under `src/`).
+	/// - Patterns starting with `!` exclude the paths they match from the ones matched by
+	///   the other patterns. A pattern matching a directory (with or without its
+	///   trailing '/') excludes its whole content.
+	struct matcher;
+
+	/// @brief Checks if `pattern` contains wildcards, or is a plain path.
+	bool has_wildcards(char const* pattern, uint32_t len = UINT32_MAX);
+
+	/// @brief Compiles `patterns` into a single matcher.
+	/// @param error Set to a description of the first invalid pattern, if any.
+	/// @return matcher* Compiled matcher, or nullptr if a pattern is invalid. Must be
+	/// destroyed with `destroy`.
+	matcher* compile(char const* const* patterns, uint32_t size, char const** error);
+
+	void destroy(matcher* m);
+
+	/// @brief Checks if the file `path` is matched. Can be called from multiple threads.
+	bool match(matcher const* m, char const* path, uint32_t len);
+
+	/// @brief Checks if files under the directory `dir`, ending with '/', can be matched,
+	/// so directories that can't are never walked. Can be called from multiple threads.
+	bool match_dir(matcher const* m, char const* dir, uint32_t len);
+
+	struct roots
+	{
+		char const* const* dirs;
+		uint32_t           size;
+	};
+
+	/// @brief Retrieves the directories to walk for finding every matched file: the
+	/// literal directories the patterns start with, sorted by name, without the ones
+	/// nested in another. Each is empty or ends with '/'.
+	roots get_roots(matcher const* m);
+} // namespace glob
\ No newline at end of file
@@ -0,0 +1,428 @@
+#include "job.hpp"
+
+#include "mem.hpp"
+
+#ifdef _WIN32
+#include <win32/sysinfo.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+namespace job
+{
+	namespace
+	{
+#ifdef _WIN32
+		using thread = HANDLE;
+
+		struct condition
+		{
+			CONDITION_VARIABLE handle;
+		};
+
+		void init(condition& c)
+		{
+			InitializeConditionVariable(&c.handle);
+		}
+
+		void destroy([[maybe_unused]] condition& c)
+		{
+		}
+
+		void wait(condition& c, mutex& m)
+		{
+			SleepConditionVariableCS(&c.handle, &m.handle, INFINITE);
+		}
+
+		void signal(condition& c)
+		{
+			WakeConditionVariable(&c.handle);
+		}
+
+		void broadcast(condition& c)
+		{
+			WakeAllConditionVariable(&c.handle);
+		}
+#elif defined(__linux__)
+		using thread = pthread_t;
+
+		struct condition
+		{
+			pthread_cond_t handle;
+		};
+
+		void init(condition& c)
+		{
+			pthread_cond_init(&c.handle, nullptr);
+		}
+
+		void destroy(condition& c)
+		{
+			pthread_cond_destroy(&c.handle);
+		}
+
+		void wait(condition& c, mutex& m)
+		{
+			pthread_cond_wait(&c.handle, &m.handle);
+		}
+
+		void signal(condition& c)
+		{
+			pthread_cond_signal(&c.handle);
+		}
+
+		void broadcast(condition& c)
+		{
+			pthread_cond_broadcast(&c.handle);
+		}
+#endif
+
+		struct task
+		{
+			func  fn;
+			void* data;
+		};
+	} // namespace
+
+	namespace
+	{
+		// Double ended queue of tasks. Its owner pushes and pops at the back, so the most
+		// recently submitted (and likely cache hot) work runs first, while other threads
+		// steal the oldest tasks from the front.
+		struct queue
+		{
+			mutex    lock;
+			task*    tasks;
+			uint32_t capacity;
+			uint32_t begin;
+			uint32_t size;
+		};
+
+		void init(queue& q)
+		{
+			init(q.lock);
+			q.capacity = 64;
+			q.tasks = tmalloc<task>(q.capacity);
+			q.begin = 0;
+			q.size = 0;
+		}
+
+		void destroy(queue& q)
+		{
+			destroy(q.lock);
+			tfree(q.tasks);
+		}
+
+		void push_back(queue& q, task const& t)
+		{
+			lock(q.lock);
+			if (q.size == q.capacity)
+			{
+				// Unrolls the ring buffer in the new allocation
+				task* tasks = tmalloc<task>(q.capacity * 2);
+				for (uint32_t i {0}; i < q.size; ++i)
+					tasks[i] = q.tasks[(q.begin + i) % q.capacity];
+				tfree(q.tasks);
+				q.tasks = tasks;
+				q.capacity *= 2;
+				q.begin = 0;
+			}
+
+			q.tasks[(q.begin + q.size) % q.capacity] = t;
+			++q.size;
+			unlock(q.lock);
+		}
+
+		bool pop_back(queue& q, task& t)
+		{
+			lock(q.lock);
+			bool res = q.size;
+			if (res)
+				t = q.tasks[(q.begin + --q.size) % q.capacity];
+			unlock(q.lock);
+			return res;
+		}
+
+		bool pop_front(queue& q, task& t)
+		{
+			lock(q.lock);
+			bool res = q.size;
+			if (res)
+			{
+				t = q.tasks[q.begin];
+				q.begin = (q.begin + 1) % q.capacity;
+				--q.size;
+			}
+			unlock(q.lock);
+			return res;
+		}
+	} // namespace
+
+	struct pool
+	{
+		thread*  threads;
+		uint32_t threads_size;
+
+		// One queue per worker, and a last one for tasks submitted from other threads
+		queue* queues;
+
+		mutex     lock;
+		condition has_tasks;
+		condition done;
+
+		// Tasks in the queues
+		uint32_t queued;
+		// Queued and running tasks
+		uint32_t pending;
+		bool     exit;
+	};
+
+	namespace
+	{
+		struct worker_data
+		{
+			pool*    p;
+			uint32_t index;
+		};
+
+		// Pool and queue of the worker running on the current thread, if any
+		thread_local pool*    current_pool {nullptr};
+		thread_local uint32_t current_queue {0};
+
+		uint32_t own_queue(pool* p)
+		{
+			return current_pool == p ? current_queue : p->threads_size;
+		}
+
+		// Pops from the own queue first, then steals from the others.
+		bool find_task(pool* p, uint32_t self, task& t)
+		{
+			if (pop_back(p->queues[self], t))
+				return true;
+
+			uint32_t queues_size = p->threads_size + 1;
+			for (uint32_t i {1}; i < queues_size; ++i)
+			{
+				if (pop_front(p->queues[(self + i) % queues_size], t))
+					return true;
+			}
+			return false;
+		}
+
+		void run_task(pool* p, task const& t)
+		{
+			lock(p->lock);
+			--p->queued;
+			unlock(p->lock);
+
+			t.fn(t.data);
+
+			lock(p->lock);
+			--p->pending;
+			if (!p->pending)
+				broadcast(p->done);
+			unlock(p->lock);
+		}
+
+		void worker(worker_data* data)
+		{
+			pool*    p = data->p;
+			uint32_t self = data->index;
+			tfree(data);
+
+			current_pool = p;
+			current_queue = self;
+			while (true)
+			{
+				task t;
+				if (find_task(p, self, t))
+				{
+					run_task(p, t);
+					continue;
+				}
+
+				lock(p->lock);
+				while (!p->queued && !p->exit)
+					wait(p->has_tasks, p->lock);
+				bool exit = !p->queued && p->exit;
+				unlock(p->lock);
+
+				if (exit)
+					break;
+			}
+		}
+
+#ifdef _WIN32
+		DWORD WINAPI worker_entry(void* data)
+		{
+			worker(static_cast<worker_data*>(data));
+			return 0;
+		}
+#elif defined(__linux__)
+		void* worker_entry(void* data)
+		{
+			worker(static_cast<worker_data*>(data));
+			return nullptr;
+		}
+#endif
+	} // namespace
+
+#ifdef _WIN32
+	void init(mutex& m)
+	{
+		InitializeCriticalSection(&m.handle);
+	}
+
+	void destroy(mutex& m)
+	{
+		DeleteCriticalSection(&m.handle);
+	}
+
+	void lock(mutex& m)
+	{
+		EnterCriticalSection(&m.handle);
+	}
+
+	void unlock(mutex& m)
+	{
+		LeaveCriticalSection(&m.handle);
+	}
+
+	uint32_t core_count()
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+	}
+#elif defined(__linux__)
+	void init(mutex& m)
+	{
+		pthread_mutex_init(&m.handle, nullptr);
+	}
+
+	void destroy(mutex& m)
+	{
+		pthread_mutex_destroy(&m.handle);
+	}
+
+	void lock(mutex& m)
+	{
+		pthread_mutex_lock(&m.handle);
+	}
+
+	void unlock(mutex& m)
+	{
+		pthread_mutex_unlock(&m.handle);
+	}
+
+	uint32_t core_count()
+	{
+		cpu_set_t set;
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+			return CPU_COUNT(&set) ? CPU_COUNT(&set) : 1;
+
+		long count = sysconf(_SC_NPROCESSORS_ONLN);
+		return count > 0 ? count : 1;
+	}
+#endif
+
+	pool* create_pool(uint32_t threads)
+	{
+		if (!threads)
+			threads = core_count();
+
+		pool* p = tmalloc<pool>();
+		p->threads = tmalloc<thread>(threads);
+		p->threads_size = threads;
+		p->queues = tmalloc<queue>(threads + 1);
+		for (uint32_t i {0}; i < threads + 1; ++i)
+			init(p->queues[i]);
+		init(p->lock);
+		init(p->has_tasks);
+		init(p->done);
+		p->queued = 0;
+		p->pending = 0;
+		p->exit = false;
+
+		for (uint32_t i {0}; i < threads; ++i)
+		{
+			worker_data* data = tmalloc<worker_data>();
+			*data = {p, i};
+#ifdef _WIN32
+			p->threads[i] = CreateThread(nullptr, 0, worker_entry, data, 0, nullptr);
+#elif defined(__linux__)
+			pthread_create(p->threads + i, nullptr, worker_entry, data);
+#endif
+		}
+
+		return p;
+	}
+
+	void destroy_pool(pool* p, bool run_jobs)
+	{
+		wait(p, run_jobs);
+
+		lock(p->lock);
+		p->exit = true;
+		broadcast(p->has_tasks);
+		unlock(p->lock);
+
+		for (uint32_t i {0}; i < p->threads_size; ++i)
+		{
+#ifdef _WIN32
+			WaitForSingleObject(p->threads[i], INFINITE);
+			CloseHandle(p->threads[i]);
+#elif defined(__linux__)
+			pthread_join(p->threads[i], nullptr);
+#endif
+		}
+
+		destroy(p->done);
+		destroy(p->has_tasks);
+		destroy(p->lock);
+		for (uint32_t i {0}; i < p->threads_size + 1; ++i)
+			destroy(p->queues[i]);
+		tfree(p->queues);
+		tfree(p->threads);
+		tfree(p);
+	}
+
+	void submit(pool* p, func fn, void* data)
+	{
+		// Counted before being visible, so the task can't complete before being pending
+		lock(p->lock);
+		++p->queued;
+		++p->pending;
+		unlock(p->lock);
+
+		push_back(p->queues[own_queue(p)], {fn, data});
+
+		lock(p->lock);
+		signal(p->has_tasks);
+		unlock(p->lock);
+	}
+
+	void wait(pool* p, bool run_jobs)
+	{
+		uint32_t self = own_queue(p);
+		while (true)
+		{
+			task t;
+			if (run_jobs && find_task(p, self, t))
+			{
+				run_task(p, t);
+				continue;
+			}
+
+			lock(p->lock);
+			while (p->pending && (!run_jobs || !p->queued))
+				wait(p->done, p->lock);
+			bool done = !p->pending;
+			unlock(p->lock);
+
+			if (done)
+				break;
+		}
+	}
+} // namespace job
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <win32/threads.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+namespace job
+{
+	struct mutex
+	{
+#ifdef _WIN32
+		CRITICAL_SECTION handle;
+#elif defined(__linux__)
+		pthread_mutex_t handle;
+#endif
+	};
+
+	void init(mutex& m);
+	void destroy(mutex& m);
+	void lock(mutex& m);
+	void unlock(mutex& m);
+
+	/// @brief Retrieves the number of logical cores available to the process.
+	/// @return uint32_t Core count, at least 1.
+	uint32_t core_count();
+
+	using func = void (*)(void* data);
+
+	struct pool;
+
+	/// @brief Creates a pool of worker threads, running submitted jobs in parallel.
+	/// @param threads Number of worker threads. If 0, defaults to the core count.
+	/// @return pool* The created pool.
+	pool* create_pool(uint32_t threads = 0);
+
+	/// @brief Waits for all submitted jobs, and destroys the pool.
+	/// @param run_jobs Whether the calling thread runs queued jobs while waiting, as in
+	/// `wait`.
+	void destroy_pool(pool* p, bool run_jobs = true);
+
+	/// @brief Queues `fn` to be run with `data` by a worker. Jobs can submit other jobs
+	/// to the same pool: they are queued on the submitting worker, which runs them first,
+	/// while idle workers steal them.
+	void submit(pool* p, func fn, void* data);
+
+	/// @brief Blocks until every submitted job is completed, including the ones submitted
+	/// while waiting. Must not be called from a job of the same pool.
+	/// @param run_jobs Whether the calling thread runs queued jobs while waiting. Jobs
+	/// relying on thread-local state must not run on a thread already using it.
+	void wait(pool* p, bool run_jobs = true);
+} // namespace job
\ No newline at end of file
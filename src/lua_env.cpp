@@ -3,119 +3,106 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.hpp"
+#include "bytecode.hpp"
+#include "file_set.hpp"
+#include "fingerprint.hpp"
 #include "generator.hpp"
+#include "glob.hpp"
+#include "job.hpp"
+#include "map.hpp"
 #include "mem.hpp"
 #include "net.hpp"
 #include "os.hpp"
 #include "project.hpp"
 #include "state.hpp"
 #include "string.hpp"
+#include "task.hpp"
+#include "track.hpp"
 
 #include "fs.hpp"
+#include "git.hpp"
 
 namespace lua
 {
 
 	namespace
 	{
-		void* lua_alloc(void* ud, void* ptr, [[maybe_unused]] size_t osize, size_t nsize)
+		int32_t collect_files(lua_State* L)
 		{
-			if (!nsize)
+			luaL_argcheck(L, lua_isstring(L, 1) || lua_istable(L, 1), 1,
+			              "'string' or 'array' expected");
+			lua_settop(L, 2);
+
+			// Allocated by Lua, as globbing raises an error if a pattern is invalid
+			uint32_t     patterns_size = lua_istable(L, 1) ? lua_rawlen(L, 1) : 1;
+			char const** patterns = static_cast<char const**>(
+				lua_newuserdatauv(L, sizeof(char const*) * patterns_size, 0));
+			if (lua_istable(L, 1))
 			{
-				if (ptr)
-					tfree(ptr);
-				return nullptr;
+				for (uint32_t i {0}; i < patterns_size; ++i)
+				{
+					lua_rawgeti(L, 1, i + 1);
+					if (!lua_isstring(L, -1))
+						luaL_argerror(L, 1, "'string' expected in array");
+					// Strings stay referenced by the array while used
+					patterns[i] = lua_tostring(L, -1);
+					lua_pop(L, 1);
+				}
 			}
 			else
+				patterns[0] = lua_tostring(L, 1);
+
+			char const** excludes = nullptr;
+			uint32_t     excludes_size = 0;
+			if (!lua_isnoneornil(L, 2))
 			{
-				if (!ptr)
-					return malloc(nsize);
+				luaL_argcheck(L, lua_istable(L, 2), 2, "'table' expected");
 
-				return realloc(ptr, nsize);
+				lua_getfield(L, 2, "exclude");
+				if (lua_istable(L, -1))
+				{
+					excludes_size = lua_rawlen(L, -1);
+					excludes = static_cast<char const**>(
+						lua_newuserdatauv(L, sizeof(char const*) * excludes_size, 0));
+					for (uint32_t i {0}; i < excludes_size; ++i)
+					{
+						lua_rawgeti(L, -2, i + 1);
+						if (!lua_isstring(L, -1))
+							luaL_argerror(L, 2, "exclude: 'string' expected in array");
+						excludes[i] = lua_tostring(L, -1);
+						lua_pop(L, 1);
+					}
+				}
+				else if (!lua_isnil(L, -1))
+					luaL_argerror(L, 2, "exclude: 'array' expected");
+				// The array stays referenced by the options table while used
 			}
-		}
 
-		void collect_files(lua_State*  L,
-		                   uint32_t&   res_idx,
-		                   char const* dir_filter,
-		                   char const* file_filter)
-		{
-			fs::list_files_res files = fs::list_files(dir_filter, file_filter);
-			for (uint32_t i {0}; i < files.size; ++i)
-			{
-				lua_pushstring(L, files.files[i]);
-				lua_rawseti(L, -2, res_idx++);
-			}
-			if (files.size)
-				tfree(files.files);
+			uint32_t files_size = 0;
+			char**   files = glob_files(L, patterns, patterns_size, excludes, excludes_size,
+			                            &files_size);
 
-			fs::list_dirs_res sub_dirs = fs::list_dirs(dir_filter);
-			for (uint32_t i {0}; i < sub_dirs.size; ++i)
+			fset::set* res = fset::push(L, files_size);
+			for (uint32_t i {0}; i < files_size; ++i)
 			{
-				uint32_t dir_len = static_cast<uint32_t>(strlen(sub_dirs.dirs[i]));
-				char*    filter = tmalloc<char>(dir_len + 2);
-				strcpy(filter, sub_dirs.dirs[i]);
-				strcpy(filter + dir_len, "/");
-				collect_files(L, res_idx, filter, file_filter);
-
-				tfree(filter);
-				tfree(sub_dirs.dirs[i]);
+				res->files[i] = sym::intern(files[i]);
+				tfree(files[i]);
 			}
-			if (sub_dirs.size)
-				tfree(sub_dirs.dirs);
+			res->size = files_size;
+			if (files)
+				tfree(files);
+			return 1;
 		}
 
-		int32_t collect_files(lua_State* L)
+		bool match_file(char const* path, uint32_t len, void* matcher)
 		{
-			luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
-			char const* lua_filter = lua_tostring(L, 1);
-			uint32_t    lua_filter_len = strlen(lua_filter);
-
-			lua_newtable(L);
-			uint32_t res_idx = 1;
+			return glob::match(static_cast<glob::matcher const*>(matcher), path, len);
+		}
 
-			uint32_t pos = UINT32_MAX;
-			if ((pos = str::rfind(lua_filter, "**", lua_filter_len)) != UINT32_MAX)
-			{
-				char* filter = nullptr;
-				if (fs::is_absolute(lua_filter))
-				{
-					filter = tmalloc<char>(pos + 1);
-					strncpy(filter, lua_filter, pos);
-					filter[pos] = '\0';
-				}
-				else
-				{
-					filter = lua::resolve_path_from_script(L, lua_filter, pos);
-				}
-				collect_files(L, res_idx, filter, lua_filter + pos + 2);
-				tfree(filter);
-			}
-			else if ((pos = str::rfind(lua_filter, "*", lua_filter_len)) != UINT32_MAX)
-			{
-				char* filter = nullptr;
-				if (fs::is_absolute(lua_filter))
-				{
-					filter = tmalloc<char>(pos + 1);
-					strncpy(filter, lua_filter, pos);
-					filter[pos] = '\0';
-				}
-				else
-				{
-					filter = lua::resolve_path_from_script(L, lua_filter, pos);
-				}
-				fs::list_files_res files = fs::list_files(filter, lua_filter + pos + 1);
-				for (uint32_t i {0}; i < files.size; ++i)
-				{
-					lua_pushstring(L, files.files[i]);
-					lua_rawseti(L, -2, res_idx++);
-					tfree(files.files[i]);
-				}
-				if (files.size)
-					tfree(files.files);
-				tfree(filter);
-			}
-			return 1;
+		bool match_dir(char const* path, uint32_t len, void* matcher)
+		{
+			return glob::match_dir(static_cast<glob::matcher const*>(matcher), path, len);
 		}
 
 		int32_t resolve_path(lua_State* L)
@@ -130,10 +117,79 @@ namespace lua
 			return 1;
 		}
 
+		// Configuration generated by its own thread and Lua state with
+		// --all-configurations
+		struct config_run
+		{
+			char*       config;
+			char*       build_dir;
+			char const* file;
+			int32_t     res;
+		};
+
+		job::pool*  config_pool {nullptr};
+		config_run* config_runs {nullptr};
+		uint32_t    config_runs_size {0};
+
+		// Base state of the threads, with the flags of the main thread
+		mingen_state config_state {};
+
+		void run_configuration(void* data)
+		{
+			config_run* run = static_cast<config_run*>(data);
+			g = config_state;
+			g.config_param = run->config;
+			g.build_dir = run->build_dir;
+			create();
+			run->res = run_file(run->file);
+			destroy();
+		}
+
+		// Runs the script for every configuration but the first one on other threads,
+		// while the calling thread goes on with the first one. Each configuration writes
+		// to build/<config>/, while caches and interned strings are shared.
+		void start_configurations()
+		{
+			config_runs_size = g.config_size;
+			config_runs = tmalloc<config_run>(config_runs_size);
+			for (uint32_t i {0}; i < config_runs_size; ++i)
+			{
+				config_run& run = config_runs[i];
+				uint32_t    len = strlen(g.configs[i]);
+				run.config = tmalloc<char>(len + 1);
+				strcpy(run.config, g.configs[i]);
+				run.build_dir = tmalloc<char>(len + 8);
+				snprintf(run.build_dir, len + 8, "build/%s/", g.configs[i]);
+				run.file = g.file;
+				run.res = 0;
+			}
+
+			g.config_param = config_runs[0].config;
+			g.build_dir = config_runs[0].build_dir;
+			g.build_to_root = "../../";
+			config_state = g;
+			config_state.L = nullptr;
+			config_state.configs = nullptr;
+			config_state.config_size = 0;
+
+			if (config_runs_size < 2)
+				return;
+
+			// Queried once before, as it is not thread safe
+			fs::get_cached_cwd();
+			config_pool = job::create_pool(config_runs_size - 1);
+			for (uint32_t i {1}; i < config_runs_size; ++i)
+				job::submit(config_pool, run_configuration, config_runs + i);
+		}
+
 		int32_t configurations(lua_State* L)
 		{
 			luaL_argcheck(L, lua_istable(L, 1), 1, "'array' expected");
 
+			// Scripts run with mg.require keep the configurations of the main script
+			if (g.configs)
+				return 0;
+
 			g.config_size = lua_rawlen(L, 1);
 
 			luaL_argcheck(L, g.config_size > 0, 1,
@@ -151,23 +207,47 @@ namespace lua
 				lua_pop(L, 1);
 			}
 
-			if (!g.config_param)
+			// Threads of the other configurations don't start any
+			if (g.all_configs && !config_runs)
+				start_configurations();
+			else if (!g.config_param)
 				g.config_param = g.configs[0];
 			return 0;
 		}
 
-		int32_t add_pre_build_cmd(lua_State* L)
+		// Adds the command table on top of the stack to the project at index 1, either a
+		// project handle or a project table
+		void add_command(lua_State* L, bool post)
 		{
-			luaL_argcheck(L, lua_istable(L, 1), 1, "'table' expected");
-			luaL_argcheck(L, lua_istable(L, 2), 2, "'table' expected");
+			output* out = prj::to_project(L, 1);
+			if (out)
+			{
+				custom_command*& cmds = post ? out->post_build_cmds : out->pre_build_cmds;
+				uint32_t& size = post ? out->post_build_cmd_size : out->pre_build_cmd_size;
+				cmds = trealloc(cmds, size + 1);
+				cmds[size++] = parse_custom_command(L);
+				lua_pop(L, 1);
+				return;
+			}
 
-			lua_getfield(L, 1, "pre_build_cmds");
-			uint32_t len = lua_rawlen(L, -1);
+			char const* key = post ? "post_build_cmds" : "pre_build_cmds";
+			lua_getfield(L, 1, key);
 			if (lua_isnil(L, -1))
 			{
 				lua_pop(L, 1);
 				lua_newtable(L);
 			}
+			lua_insert(L, -2);
+			lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+			lua_setfield(L, 1, key);
+		}
+
+		int32_t add_pre_build_cmd(lua_State* L)
+		{
+			luaL_argcheck(L, lua_istable(L, 1) || prj::to_project(L, 1), 1,
+			              "'project' expected");
+			luaL_argcheck(L, lua_istable(L, 2), 2, "'table' expected");
+			lua_settop(L, 2);
 
 			lua_newtable(L);
 			lua_getfield(L, 2, "input");
@@ -297,24 +377,16 @@ namespace lua
 				lua_pop(L, 1);
 			}
 
-			lua_rawseti(L, 3, len + 1);
-			lua_setfield(L, 1, "pre_build_cmds");
-
+			add_command(L, false);
 			return 0;
 		}
 
 		int32_t add_pre_build_copy(lua_State* L)
 		{
-			luaL_argcheck(L, lua_istable(L, 1), 1, "'table' expected");
+			luaL_argcheck(L, lua_istable(L, 1) || prj::to_project(L, 1), 1,
+			              "'project' expected");
 			luaL_argcheck(L, lua_istable(L, 2), 2, "'table' expected");
-
-			lua_getfield(L, 1, "pre_build_cmds");
-			uint32_t len = lua_rawlen(L, -1);
-			if (lua_isnil(L, -1))
-			{
-				lua_pop(L, 1);
-				lua_newtable(L);
-			}
+			lua_settop(L, 2);
 
 			char* input = nullptr;
 			char* output = nullptr;
@@ -351,23 +423,16 @@ namespace lua
 			tfree(output);
 			tfree(input);
 
-			lua_rawseti(L, 3, len + 1);
-			lua_setfield(L, 1, "pre_build_cmds");
+			add_command(L, false);
 			return 0;
 		}
 
 		int32_t add_post_build_cmd(lua_State* L)
 		{
-			luaL_argcheck(L, lua_istable(L, 1), 1, "'table' expected");
+			luaL_argcheck(L, lua_istable(L, 1) || prj::to_project(L, 1), 1,
+			              "'project' expected");
 			luaL_argcheck(L, lua_istable(L, 2), 2, "'table' expected");
-
-			lua_getfield(L, 1, "post_build_cmds");
-			uint32_t len = lua_rawlen(L, -1);
-			if (lua_isnil(L, -1))
-			{
-				lua_pop(L, 1);
-				lua_newtable(L);
-			}
+			lua_settop(L, 2);
 
 			lua_newtable(L);
 			lua_getfield(L, 2, "input");
@@ -465,24 +530,16 @@ namespace lua
 				lua_pop(L, 1);
 			}
 
-			lua_rawseti(L, 3, len + 1);
-			lua_setfield(L, 1, "post_build_cmds");
-
+			add_command(L, true);
 			return 0;
 		}
 
 		int32_t add_post_build_copy(lua_State* L)
 		{
-			luaL_argcheck(L, lua_istable(L, 1), 1, "'table' expected");
+			luaL_argcheck(L, lua_istable(L, 1) || prj::to_project(L, 1), 1,
+			              "'project' expected");
 			luaL_argcheck(L, lua_istable(L, 2), 2, "'table' expected");
-
-			lua_getfield(L, 1, "post_build_cmds");
-			uint32_t len = lua_rawlen(L, -1);
-			if (lua_isnil(L, -1))
-			{
-				lua_pop(L, 1);
-				lua_newtable(L);
-			}
+			lua_settop(L, 2);
 
 			char* input = nullptr;
 			char* output = nullptr;
@@ -519,11 +576,200 @@ namespace lua
 			tfree(output);
 			tfree(input);
 
-			lua_rawseti(L, 3, len + 1);
-			lua_setfield(L, 1, "post_build_cmds");
+			add_command(L, true);
 			return 0;
 		}
 
+		// Replaces the Lua file searcher of `require`, to record the loaded scripts and
+		// load them through the bytecode cache. The package table is the upvalue.
+		int32_t script_searcher(lua_State* L)
+		{
+			char const* name = luaL_checkstring(L, 1);
+			lua_getfield(L, lua_upvalueindex(1), "searchpath");
+			lua_pushvalue(L, 1);
+			lua_getfield(L, lua_upvalueindex(1), "path");
+			if (!lua_isstring(L, -1))
+				luaL_error(L, "'package.path' must be a string");
+			lua_call(L, 2, 2);
+
+			// On failure, returns the files tried
+			if (lua_isnil(L, -2))
+				return 1;
+
+			char const* file = lua_tostring(L, -2);
+			track::add(track::script, file);
+			if (bc::load_file(L, file) != LUA_OK)
+				luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, file,
+				           lua_tostring(L, -1));
+
+			// The loader is given the file path
+			lua_pushvalue(L, -3);
+			return 2;
+		}
+
+		// Replaces `dofile` and `loadfile`, to record the loaded scripts and load them
+		// through the bytecode cache. The replaced function is the upvalue, still used
+		// for reading stdin or restricting the chunk mode.
+		int32_t script_loadfile(lua_State* L)
+		{
+			if (lua_type(L, 1) == LUA_TSTRING)
+				track::add(track::script, lua_tostring(L, 1));
+
+			if (lua_type(L, 1) != LUA_TSTRING || !lua_isnoneornil(L, 2))
+			{
+				int32_t top = lua_gettop(L);
+				lua_pushvalue(L, lua_upvalueindex(1));
+				lua_insert(L, 1);
+				lua_call(L, top, LUA_MULTRET);
+				return lua_gettop(L);
+			}
+
+			if (bc::load_file(L, lua_tostring(L, 1)) != LUA_OK)
+			{
+				lua_pushnil(L);
+				lua_insert(L, -2);
+				return 2;
+			}
+
+			// The environment replaces the first upvalue, _ENV
+			if (!lua_isnone(L, 3))
+			{
+				lua_pushvalue(L, 3);
+				if (!lua_setupvalue(L, -2, 1))
+					lua_pop(L, 1);
+			}
+			return 1;
+		}
+
+		int32_t script_dofile(lua_State* L)
+		{
+			if (lua_type(L, 1) != LUA_TSTRING)
+			{
+				int32_t top = lua_gettop(L);
+				lua_pushvalue(L, lua_upvalueindex(1));
+				lua_insert(L, 1);
+				lua_call(L, top, LUA_MULTRET);
+				return lua_gettop(L);
+			}
+
+			lua_settop(L, 1);
+			track::add(track::script, lua_tostring(L, 1));
+			if (bc::load_file(L, lua_tostring(L, 1)) != LUA_OK)
+				return lua_error(L);
+			lua_call(L, 0, LUA_MULTRET);
+			return lua_gettop(L) - 1;
+		}
+
+		// Replaces `os.getenv`, to record the variables read. The replaced function is
+		// the upvalue.
+		int32_t script_getenv(lua_State* L)
+		{
+			track::add(track::env, luaL_checkstring(L, 1));
+			lua_pushvalue(L, lua_upvalueindex(1));
+			lua_pushvalue(L, 1);
+			lua_call(L, 1, 1);
+			return 1;
+		}
+
+		// Calls the function replaced by a script_* function, its upvalue, with the same
+		// arguments. If `read_path`, a string first argument is a file read: it is
+		// recorded as a file if it could be opened, or only checked for existence.
+		int32_t call_replaced(lua_State* L, bool read_path)
+		{
+			int32_t top = lua_gettop(L);
+			bool    tracked = read_path && lua_type(L, 1) == LUA_TSTRING;
+
+			// The path is kept below the results
+			int32_t first = 1;
+			if (tracked)
+			{
+				lua_pushvalue(L, 1);
+				lua_insert(L, 1);
+				first = 2;
+			}
+			lua_pushvalue(L, lua_upvalueindex(1));
+			lua_insert(L, first);
+			lua_call(L, top, LUA_MULTRET);
+			if (!tracked)
+				return lua_gettop(L);
+
+			bool opened = lua_gettop(L) >= 2 && !lua_isnil(L, 2);
+			track::add(opened ? track::file : track::entry, lua_tostring(L, 1));
+			lua_remove(L, 1);
+			return lua_gettop(L);
+		}
+
+		// Replaces `io.open`. What a script writes can't be tracked, so opening a file for
+		// writing prevents skipping the next generation.
+		int32_t script_open(lua_State* L)
+		{
+			char const* mode = lua_type(L, 2) == LUA_TSTRING ? lua_tostring(L, 2) : "r";
+			bool        write = strpbrk(mode, "wa+") != nullptr;
+			if (write)
+				fp::invalidate();
+			return call_replaced(L, !write);
+		}
+
+		// Replaces `io.lines` and `io.input`, reading the file given as path
+		int32_t script_read(lua_State* L)
+		{
+			return call_replaced(L, true);
+		}
+
+		// Replaces `io.output`, writing the file given as path
+		int32_t script_write(lua_State* L)
+		{
+			if (lua_type(L, 1) == LUA_TSTRING)
+				fp::invalidate();
+			return call_replaced(L, false);
+		}
+
+		// Replaces `io.popen`, as what a command reads can't be tracked
+		int32_t script_popen(lua_State* L)
+		{
+			fp::invalidate();
+			return call_replaced(L, false);
+		}
+
+		void track_file_reads(lua_State* L)
+		{
+			lua_getglobal(L, "io");
+			lua_getfield(L, -1, "open");
+			lua_pushcclosure(L, script_open, 1);
+			lua_setfield(L, -2, "open");
+			lua_getfield(L, -1, "lines");
+			lua_pushcclosure(L, script_read, 1);
+			lua_setfield(L, -2, "lines");
+			lua_getfield(L, -1, "input");
+			lua_pushcclosure(L, script_read, 1);
+			lua_setfield(L, -2, "input");
+			lua_getfield(L, -1, "output");
+			lua_pushcclosure(L, script_write, 1);
+			lua_setfield(L, -2, "output");
+			lua_getfield(L, -1, "popen");
+			lua_pushcclosure(L, script_popen, 1);
+			lua_setfield(L, -2, "popen");
+			lua_pop(L, 1);
+		}
+
+		void track_script_loads(lua_State* L)
+		{
+			lua_getglobal(L, "package");
+			lua_getfield(L, -1, "searchers");
+			lua_pushvalue(L, -2);
+			lua_pushcclosure(L, script_searcher, 1);
+			lua_rawseti(L, -2, 2);
+			lua_pop(L, 2);
+
+			lua_getglobal(L, "dofile");
+			lua_pushcclosure(L, script_dofile, 1);
+			lua_setglobal(L, "dofile");
+
+			lua_getglobal(L, "loadfile");
+			lua_pushcclosure(L, script_loadfile, 1);
+			lua_setglobal(L, "loadfile");
+		}
+
 		int32_t platform(lua_State* L)
 		{
 #ifdef _WIN32
@@ -536,6 +782,20 @@ namespace lua
 			return 1;
 		}
 
+		int32_t use_gitignore(lua_State* L)
+		{
+			luaL_argcheck(L, lua_isboolean(L, 1), 1, "'boolean' expected");
+			g.use_gitignore = lua_toboolean(L, 1);
+			return 0;
+		}
+
+		int32_t use_git_index(lua_State* L)
+		{
+			luaL_argcheck(L, lua_isboolean(L, 1), 1, "'boolean' expected");
+			g.use_git_index = lua_toboolean(L, 1);
+			return 0;
+		}
+
 		int32_t need_generate(lua_State* L)
 		{
 			lua_Debug info;
@@ -549,25 +809,297 @@ namespace lua
 
 		int32_t get_build_dir(lua_State* L)
 		{
-			char* build_dir = resolve_path_to_script(L, "build/");
+			char* build_dir = resolve_path_to_script(L, g.build_dir);
 
 			lua_pushstring(L, build_dir);
 
 			tfree(build_dir);
 			return 1;
 		}
+
+		// Results of the scripts run by mg.require, by path then by configuration
+		constexpr char const* modules_name {"mg.require.modules"};
+
+		// Marks a script being run, to detect scripts requiring themselves
+		char const loading_module {0};
+
+		// Runs a script, resolved from the calling one, with the given configuration.
+		// Each script runs once per configuration, the next calls return its result.
+		int32_t require_script(lua_State* L)
+		{
+			luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
+			luaL_argcheck(L, lua_isnoneornil(L, 2) || lua_istable(L, 2), 2,
+			              "'table' expected");
+			if (!g.config_param)
+				luaL_error(L, "configurations must be declared before requiring scripts");
+
+			lua_settop(L, 2);
+			if (lua_istable(L, 2))
+			{
+				lua_getfield(L, 2, "configuration");
+				if (lua_isnil(L, -1))
+				{
+					lua_pop(L, 1);
+					lua_pushstring(L, g.config_param);
+				}
+				else if (lua_type(L, -1) != LUA_TSTRING)
+					luaL_error(L, "configuration: expecting string");
+			}
+			else
+				lua_pushstring(L, g.config_param);
+			// Kept on the stack while the script runs
+			char const* config = lua_tostring(L, 3);
+
+			// Scripts can be given without their extension, as with require
+			char* path = resolve_path_from_script(L, lua_tostring(L, 1));
+			if (!str::ends_with(path, ".lua"))
+			{
+				track::add(track::entry, path);
+				if (!fs::file_exists(path))
+				{
+					uint32_t len = strlen(path);
+					path = trealloc(path, len + 5);
+					strcpy(path + len, ".lua");
+				}
+			}
+			lua_pushstring(L, path);
+			tfree(path);
+			char const* file = lua_tostring(L, 4);
+
+			lua_getfield(L, LUA_REGISTRYINDEX, modules_name);
+			lua_pushvalue(L, 4);
+			if (lua_rawget(L, 5) == LUA_TNIL)
+			{
+				lua_pop(L, 1);
+				lua_newtable(L);
+				lua_pushvalue(L, 4);
+				lua_pushvalue(L, -2);
+				lua_rawset(L, 5);
+			}
+
+			lua_pushvalue(L, 3);
+			if (lua_rawget(L, 6) != LUA_TNIL)
+			{
+				if (lua_touserdata(L, -1) == &loading_module)
+					luaL_error(L, "'%s' requires itself with configuration '%s'", file,
+					           config);
+				return 1;
+			}
+			lua_pop(L, 1);
+
+			lua_pushvalue(L, 3);
+			lua_pushlightuserdata(L, const_cast<char*>(&loading_module));
+			lua_rawset(L, 6);
+
+			// Projects are parsed when created, so the configuration only needs to be
+			// changed while the script runs
+			track::add(track::script, file);
+			char const* previous_config = g.config_param;
+			g.config_param = config;
+			int32_t res = bc::load_file(L, file);
+			if (res == LUA_OK)
+			{
+				lua_pushvalue(L, 4);
+				res = lua_pcall(L, 1, 1, 0);
+			}
+			g.config_param = previous_config;
+
+			if (res != LUA_OK)
+			{
+				lua_pushvalue(L, 3);
+				lua_pushnil(L);
+				lua_rawset(L, 6);
+				return lua_error(L);
+			}
+
+			// As with require, scripts returning nothing are recorded as true
+			if (lua_isnil(L, -1))
+			{
+				lua_pop(L, 1);
+				lua_pushboolean(L, true);
+			}
+			lua_pushvalue(L, 3);
+			lua_pushvalue(L, -2);
+			lua_rawset(L, 6);
+			return 1;
+		}
+
+		bool is_separator(char c)
+		{
+#ifdef _WIN32
+			return c == '/' || c == '\\';
+#elif defined(__linux__)
+			return c == '/';
+#endif
+		}
+
+		// Length of the root of absolute paths, "C:/" or "/"
+		uint32_t root_length()
+		{
+#ifdef _WIN32
+			return 3;
+#elif defined(__linux__)
+			return 1;
+#endif
+		}
+
+		// Appends the components of `path` to the normalized directory held by `res`,
+		// empty or ending with '/'. "." components are skipped, and ".." ones remove the
+		// last directory of `res`, except for its first `root_len` bytes. `res` must have
+		// room for `len + 1` more bytes. Returns the new length of `res`.
+		uint32_t append_normalized(char*       res,
+		                           uint32_t    res_len,
+		                           uint32_t    root_len,
+		                           char const* path,
+		                           uint32_t    len)
+		{
+			uint32_t pos = 0;
+			while (pos < len)
+			{
+				uint32_t end = pos;
+				while (end < len && !is_separator(path[end]))
+					++end;
+				uint32_t component_len = end - pos;
+
+				if (component_len == 2 && path[pos] == '.' && path[pos + 1] == '.')
+				{
+					// Only leading components of relative paths can be ".."
+					bool up_only =
+						res_len >= root_len + 3 && strncmp(res + res_len - 3, "../", 3) == 0;
+					if (res_len > root_len && !up_only)
+					{
+						--res_len;
+						while (res_len > root_len && res[res_len - 1] != '/')
+							--res_len;
+					}
+					else if (!root_len)
+					{
+						memcpy(res + res_len, "../", 3);
+						res_len += 3;
+					}
+				}
+				else if (component_len && (component_len != 1 || path[pos] != '.'))
+				{
+					memcpy(res + res_len, path + pos, component_len);
+					res_len += component_len;
+					if (end < len)
+						res[res_len++] = '/';
+				}
+				pos = end + 1;
+			}
+			return res_len;
+		}
+
+		// Directory of a script, relative to the working directory or absolute if out of
+		// it, computed once per chunk source
+		struct script_dir
+		{
+			char*    source;
+			char*    prefix;
+			uint32_t len;
+			uint32_t root_len;
+		};
+
+		thread_local map::str_map script_dirs_index;
+		thread_local script_dir*  script_dirs {nullptr};
+		thread_local uint32_t     script_dirs_size {0};
+
+		script_dir const& get_script_dir(char const* source, uint32_t source_len)
+		{
+			uint32_t index = map::find(script_dirs_index, source, source_len);
+			if (index != UINT32_MAX)
+				return script_dirs[index];
+
+			index = script_dirs_size++;
+			script_dirs = trealloc(script_dirs, script_dirs_size);
+			script_dir& dir = script_dirs[index];
+			dir.source = tmalloc<char>(source_len + 1);
+			memcpy(dir.source, source, source_len);
+			dir.source[source_len] = '\0';
+			map::insert(script_dirs_index, dir.source, index, source_len);
+
+			// Chunks not loaded from a file resolve from the working directory
+			char const* file = source[0] == '@' ? source + 1 : "";
+			uint32_t    file_len = source[0] == '@' ? source_len - 1 : 0;
+			while (file_len && !is_separator(file[file_len - 1]))
+				--file_len;
+
+			dir.root_len = 0;
+			if (file_len && fs::is_absolute(file))
+			{
+				uint32_t    cwd_len = 0;
+				char const* cwd = fs::get_cached_cwd(&cwd_len);
+				uint32_t    skip = is_separator(cwd[cwd_len - 1]) ? cwd_len : cwd_len + 1;
+				if (file_len >= skip && strncmp(file, cwd, cwd_len) == 0 &&
+				    is_separator(file[skip - 1]))
+				{
+					file += skip;
+					file_len -= skip;
+				}
+				else
+					dir.root_len = root_length();
+			}
+
+			dir.prefix = tmalloc<char>(file_len + 1);
+			if (dir.root_len)
+			{
+				memcpy(dir.prefix, file, dir.root_len);
+				dir.prefix[dir.root_len - 1] = '/';
+			}
+			dir.len = append_normalized(dir.prefix, dir.root_len, dir.root_len,
+			                            file + dir.root_len, file_len - dir.root_len);
+			dir.prefix[dir.len] = '\0';
+			return dir;
+		}
+
+		// Directory of the script calling the running C function
+		script_dir const& get_calling_script_dir(lua_State* L)
+		{
+			static script_dir const cwd_dir {nullptr, const_cast<char*>(""), 0, 0};
+
+			lua_Debug info;
+			if (!lua_getstack(L, 1, &info) || !lua_getinfo(L, "S", &info))
+				return cwd_dir;
+			return get_script_dir(info.source, info.srclen);
+		}
+
+		void free_script_dirs()
+		{
+			for (uint32_t i {0}; i < script_dirs_size; ++i)
+			{
+				tfree(script_dirs[i].source);
+				tfree(script_dirs[i].prefix);
+			}
+			if (script_dirs)
+				tfree(script_dirs);
+			script_dirs = nullptr;
+			script_dirs_size = 0;
+			map::release(script_dirs_index);
+		}
 	} // namespace
 
 	void create()
 	{
-		lua_State* L = lua_newstate(lua_alloc, nullptr);
+		lua_State* L = lua_newstate(alloc::lua_alloc, alloc::create_lua_heap());
 		luaL_openlibs(L);
+		track_script_loads(L);
+		track_file_reads(L);
+		prj::init(L);
+		fset::init(L);
+		task::init(L);
 
 		lua_getglobal(L, "os");
+		lua_getfield(L, -1, "getenv");
+		lua_pushcclosure(L, script_getenv, 1);
+		lua_setfield(L, -2, "getenv");
 		lua_pushcclosure(L, os::execute, 0);
 		lua_setfield(L, -2, "execute");
 		lua_pushcclosure(L, os::copy_file, 0);
 		lua_setfield(L, -2, "copy_file");
+		lua_pushcclosure(L, os::spawn, 0);
+		lua_setfield(L, -2, "spawn");
+		lua_pushcclosure(L, os::execute_cached, 0);
+		lua_setfield(L, -2, "execute_cached");
 
 		lua_newtable(L);
 
@@ -590,6 +1122,12 @@ namespace lua
 		lua_pushcclosure(L, resolve_path, 0);
 		lua_setfield(L, -2, "resolve_path");
 
+		lua_pushcclosure(L, use_gitignore, 0);
+		lua_setfield(L, -2, "use_gitignore");
+
+		lua_pushcclosure(L, use_git_index, 0);
+		lua_setfield(L, -2, "use_git_index");
+
 		lua_pushcclosure(L, add_pre_build_cmd, 0);
 		lua_setfield(L, -2, "add_pre_build_cmd");
 		lua_pushcclosure(L, add_pre_build_copy, 0);
@@ -608,6 +1146,12 @@ namespace lua
 		lua_pushcclosure(L, platform, 0);
 		lua_setfield(L, -2, "platform");
 
+		lua_pushcclosure(L, require_script, 0);
+		lua_setfield(L, -2, "require");
+
+		lua_pushcclosure(L, task::wait_all, 0);
+		lua_setfield(L, -2, "wait_all");
+
 		lua_pushcclosure(L, need_generate, 0);
 		lua_setfield(L, -2, "need_generate");
 
@@ -619,15 +1163,33 @@ namespace lua
 		lua_newtable(L);
 		lua_pushcclosure(L, net::download, 0);
 		lua_setfield(L, -2, "download");
+		lua_pushcclosure(L, net::download_async, 0);
+		lua_setfield(L, -2, "download_async");
+		lua_pushcclosure(L, net::download_many, 0);
+		lua_setfield(L, -2, "download_many");
 
 		lua_setglobal(L, "net");
 
+		lua_newtable(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, modules_name);
+
 		g.L = L;
 	}
 
 	void destroy()
 	{
+		void* heap = nullptr;
+		lua_getallocf(g.L, &heap);
+		// Waits for the tasks the scripts didn't wait for
+		task::clear();
+		fs::clear_pool();
 		lua_close(g.L);
+		alloc::destroy_lua_heap(static_cast<alloc::lua_heap*>(heap));
+		prj::clear();
+		// The inputs of every configuration make the fingerprint of the generation
+		fp::add_inputs();
+		track::clear();
+		free_script_dirs();
 		if (g.config_size)
 		{
 			for (uint32_t i {0}; i < g.config_size; ++i)
@@ -636,10 +1198,33 @@ namespace lua
 		}
 	}
 
+	int32_t wait_configurations()
+	{
+		// The calling thread still holds the state of the first configuration, so it
+		// can't run the other ones
+		if (config_pool)
+			job::destroy_pool(config_pool, false);
+		config_pool = nullptr;
+
+		int32_t res = 0;
+		for (uint32_t i {0}; i < config_runs_size; ++i)
+		{
+			res |= config_runs[i].res;
+			tfree(config_runs[i].config);
+			tfree(config_runs[i].build_dir);
+		}
+		if (config_runs)
+			tfree(config_runs);
+		config_runs = nullptr;
+		config_runs_size = 0;
+		return res;
+	}
+
 	int32_t run_file(char const* filename)
 	{
 		g.file = filename;
-		if (luaL_dofile(g.L, filename))
+		track::add(track::script, filename);
+		if (bc::load_file(g.L, filename) || lua_pcall(g.L, 0, LUA_MULTRET, 0))
 		{
 			printf("%s", lua_tostring(g.L, -1));
 			g.file = nullptr;
@@ -650,174 +1235,141 @@ namespace lua
 		return 0;
 	}
 
-	char* resolve_path_from_script(lua_State* L, char const* path, uint32_t len)
+	glob::matcher* compile_globs(lua_State*         L,
+	                             char const* const* patterns,
+	                             uint32_t           patterns_size,
+	                             char const* const* excludes,
+	                             uint32_t           excludes_size)
 	{
-		if (len == UINT32_MAX)
-			len = strlen(path);
-		if (fs::is_absolute(path))
+		// Only the literal directories patterns start with are resolved, the remaining
+		// is kept as is. Excludes are given to the matcher as negated patterns.
+		uint32_t resolved_size = patterns_size + excludes_size;
+		char**   resolved = tmalloc<char*>(resolved_size);
+		for (uint32_t i {0}; i < resolved_size; ++i)
 		{
-			char* new_path = tmalloc<char>(len + 1);
-			strncpy(new_path, path, len);
-			new_path[len] = '\0';
-			return new_path;
+			char const* pattern =
+				i < patterns_size ? patterns[i] : excludes[i - patterns_size];
+			bool exclude = i >= patterns_size || pattern[0] == '!';
+			if (pattern[0] == '!')
+				++pattern;
+
+			uint32_t root_len = 0;
+			for (uint32_t j {0}; pattern[j] && !strchr("*?[{", pattern[j]); ++j)
+				if (pattern[j] == '/')
+					root_len = j + 1;
+
+			char*    root = lua::resolve_path_from_script(L, pattern, root_len);
+			uint32_t resolved_root_len = strlen(root);
+			uint32_t rest_len = strlen(pattern + root_len);
+			resolved[i] = tmalloc<char>(exclude + resolved_root_len + rest_len + 1);
+			if (exclude)
+				resolved[i][0] = '!';
+			memcpy(resolved[i] + exclude, root, resolved_root_len);
+			strcpy(resolved[i] + exclude + resolved_root_len, pattern + root_len);
+			tfree(root);
 		}
 
-		lua_Debug info;
-		lua_getstack(L, 1, &info);
-		lua_getinfo(L, "Sl", &info);
+		char const*    error = nullptr;
+		glob::matcher* matcher = glob::compile(resolved, resolved_size, &error);
+		for (uint32_t i {0}; i < resolved_size; ++i)
+			tfree(resolved[i]);
+		tfree(resolved);
+		if (!matcher)
+			luaL_error(L, "invalid pattern: %s", error);
+		return matcher;
+	}
 
-		uint32_t pos = 0;
-		if (str::starts_with(info.short_src, "./") ||
-		    str::starts_with(info.short_src, ".\\"))
-			pos = 2;
-		else
+	char** glob_files(lua_State*         L,
+	                  char const* const* patterns,
+	                  uint32_t           patterns_size,
+	                  char const* const* excludes,
+	                  uint32_t           excludes_size,
+	                  uint32_t*          files_size)
+	{
+		glob::matcher* matcher =
+			compile_globs(L, patterns, patterns_size, excludes, excludes_size);
+
+		char const* ignore_files[] {".mingenignore", ".gitignore"};
+
+		fs::walk_filter filter;
+		filter.dir = match_dir;
+		filter.file = match_file;
+		filter.data = matcher;
+		filter.ignore_files = ignore_files;
+		filter.ignore_files_size = g.use_gitignore ? 2 : 1;
+
+		char**      files = nullptr;
+		uint32_t    size = 0;
+		glob::roots roots = glob::get_roots(matcher);
+		for (uint32_t i {0}; i < roots.size; ++i)
 		{
-			char* cwd = fs::get_cwd();
-			if (str::starts_with(info.short_src, cwd))
-			{
-				if (str::ends_with(cwd, "/") || str::ends_with(cwd, "\\"))
-					pos = strlen(cwd);
-				else
-					pos = strlen(cwd) + 1;
-			}
-			else if (str::find(info.short_src, "/"))
+			// Tracked files are listed from the index of the repository, when there is
+			// one, which changes whenever files are added or removed
+			git::list_res git_res;
+			if (g.use_git_index && git::list_files(roots.dirs[i], filter, git_res))
 			{
-				char* new_path = tmalloc<char>(len + 1);
-				strncpy(new_path, path, len);
-				new_path[len] = '\0';
-				tfree(cwd);
-				return new_path;
+				if (git_res.size)
+				{
+					files = trealloc(files, size + git_res.size);
+					memcpy(files + size, git_res.files, git_res.size * sizeof(char*));
+					size += git_res.size;
+					tfree(git_res.files);
+				}
+				track::add(track::file, git_res.index_path);
+				continue;
 			}
-			else
+
+			fs::walk_res res = fs::walk(roots.dirs[i], filter);
+			if (res.size)
 			{
-				// TODO Generate absolute path
-				char* new_path = tmalloc<char>(len + 1);
-				strncpy(new_path, path, len);
-				new_path[len] = '\0';
-				tfree(cwd);
-				return new_path;
+				files = trealloc(files, size + res.size);
+				memcpy(files + size, res.files, res.size * sizeof(char*));
+				size += res.size;
+				tfree(res.files);
 			}
-			tfree(cwd);
-		}
-
-		struct str_view
-		{
-			char const* str {nullptr};
-			uint32_t    len {0};
-		};
-
-		str_view* path_fragments = tmalloc<str_view>(4);
-		uint32_t  path_fragments_len = 0;
-		uint32_t  path_fragments_cap = 4;
 
-		uint32_t find_pos = str::find(info.short_src + pos, "/");
-		uint32_t src_len {static_cast<uint32_t>(strlen(info.short_src))};
-		while (find_pos != UINT32_MAX && (find_pos + pos < src_len))
-		{
-			str_view frag {info.short_src + pos, find_pos + 1};
-			if (path_fragments_len == path_fragments_cap)
+			for (uint32_t j {0}; j < res.dirs_size; ++j)
 			{
-				path_fragments_cap *= 2;
-				path_fragments = trealloc(path_fragments, path_fragments_cap);
+				track::add(track::directory, res.dirs[j]);
+				tfree(res.dirs[j]);
 			}
+			if (res.dirs)
+				tfree(res.dirs);
 
-			path_fragments[path_fragments_len] = frag;
-			++path_fragments_len;
-
-			pos += find_pos + 1;
-			find_pos = str::find(info.short_src + pos, "/");
-		}
-
-		if (str::starts_with(path, "./") || str::starts_with(path, ".\\"))
-			pos = 2;
-		else
-			pos = 0;
-
-		find_pos = str::find(path + pos, "/");
-		while (find_pos != UINT32_MAX && (find_pos + pos < len))
-		{
-			str_view frag {path + pos, find_pos + 1};
-			if (path_fragments_len == path_fragments_cap)
+			for (uint32_t j {0}; j < res.ignore_files_size; ++j)
 			{
-				path_fragments_cap *= 2;
-				path_fragments = trealloc(path_fragments, path_fragments_cap);
+				track::add(track::file, res.ignore_files[j]);
+				tfree(res.ignore_files[j]);
 			}
-
-			path_fragments[path_fragments_len] = frag;
-			++path_fragments_len;
-
-			pos += find_pos + 1;
-			find_pos = str::find(path + pos, "/");
-		}
-
-		if (path_fragments_len == path_fragments_cap)
-		{
-			path_fragments_cap *= 2;
-			path_fragments = trealloc(path_fragments, path_fragments_cap);
-		}
-
-		if (len - pos > 0)
-		{
-			str_view last_path_frag {path + pos, len - pos};
-			path_fragments[path_fragments_len] = last_path_frag;
-			++path_fragments_len;
+			if (res.ignore_files)
+				tfree(res.ignore_files);
 		}
+		glob::destroy(matcher);
 
-		uint32_t res_path_cap {len};
-		uint32_t res_path_len {0};
-		char*    res_path = tmalloc<char>(res_path_cap + 1);
+		*files_size = size;
+		return files;
+	}
 
-		int32_t frag_pos {0};
-		bool    need_add {false};
-		for (uint32_t i {0}; i < path_fragments_len; ++i)
+	char* resolve_path_from_script(lua_State* L, char const* path, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = strlen(path);
+		if (fs::is_absolute(path))
 		{
-			need_add = false;
-
-			str_view* frag = path_fragments + i;
-			if (strncmp(frag->str, "../", frag->len) == 0)
-			{
-				if (frag_pos > 0)
-				{
-					uint32_t last_frag = str::rfind(res_path, "/", res_path_len - 1);
-					if (last_frag == UINT32_MAX)
-						res_path_len = 0;
-					else
-						res_path_len = last_frag;
-				}
-				else
-				{
-					need_add = true;
-				}
-
-				--frag_pos;
-			}
-			else
-			{
-				++frag_pos;
-				need_add = true;
-			}
-
-			if (need_add)
-			{
-				if (res_path_len + frag->len > res_path_cap)
-				{
-					while (res_path_len + frag->len > res_path_cap)
-						res_path_cap *= 2;
-					res_path = trealloc(res_path, res_path_cap + 1);
-				}
-
-				strncpy(res_path + res_path_len, frag->str, frag->len);
-				res_path_len += frag->len;
-			}
+			char* new_path = tmalloc<char>(len + 1);
+			strncpy(new_path, path, len);
+			new_path[len] = '\0';
+			return new_path;
 		}
 
-		tfree(path_fragments);
-
-		res_path[res_path_len] = '\0';
-		return res_path;
+		script_dir const& dir = get_calling_script_dir(L);
+		char*             res = tmalloc<char>(dir.len + len + 2);
+		memcpy(res, dir.prefix, dir.len);
+		uint32_t res_len = append_normalized(res, dir.len, dir.root_len, path, len);
+		res[res_len] = '\0';
+		return res;
 	}
 
-	// TODO re-verify func
 	char* resolve_path_to_script(lua_State* L, char const* path, uint32_t len)
 	{
 		if (len == UINT32_MAX)
@@ -830,219 +1382,127 @@ namespace lua
 			return new_path;
 		}
 
-		lua_Debug info;
-		lua_getstack(L, 1, &info);
-		lua_getinfo(L, "Sl", &info);
-
-		uint32_t pos = 0;
-		if (str::starts_with(info.short_src, "./") ||
-		    str::starts_with(info.short_src, ".\\"))
-			pos = 2;
-		else
+		// The working directory is reached by going up once per directory of the script,
+		// or from its absolute path when the script is out of it
+		script_dir const& dir = get_calling_script_dir(L);
+		if (dir.root_len || str::starts_with(dir.prefix, "../"))
 		{
-			char* cwd = fs::get_cwd();
-			if (str::starts_with(info.short_src, cwd))
-			{
-				if (str::ends_with(cwd, "/") || str::ends_with(cwd, "\\"))
-					pos = strlen(cwd);
-				else
-					pos = strlen(cwd) + 1;
-			}
-			else if (str::find(info.short_src, "/"))
-			{
-				char* new_path = tmalloc<char>(len + 1);
-				strncpy(new_path, path, len);
-				new_path[len] = '\0';
-				tfree(cwd);
-				return new_path;
-			}
-			else
-			{
-				// TODO Generate absolute path
-				char* new_path = tmalloc<char>(len + 1);
-				strncpy(new_path, path, len);
-				new_path[len] = '\0';
-				tfree(cwd);
-				return new_path;
-			}
-			tfree(cwd);
+			uint32_t    cwd_len = 0;
+			char const* cwd = fs::get_cached_cwd(&cwd_len);
+			char*       res = tmalloc<char>(cwd_len + len + 3);
+			memcpy(res, cwd, cwd_len);
+			if (!is_separator(cwd[cwd_len - 1]))
+				res[cwd_len++] = '/';
+			uint32_t res_len = append_normalized(res, cwd_len, root_length(), path, len);
+			res[res_len] = '\0';
+			return res;
 		}
 
-		uint32_t res_path_capacity = len;
-		uint32_t res_path_size = 0;
-		char*    res_path = tmalloc<char>(res_path_capacity + 1);
+		uint32_t depth = 0;
+		for (uint32_t i {0}; i < dir.len; ++i)
+			depth += dir.prefix[i] == '/';
 
-		uint32_t current_script_dir_count = 0;
-		uint32_t path_dir_count = 0;
+		char* res = tmalloc<char>(depth * 3 + len + 2);
+		for (uint32_t i {0}; i < depth; ++i)
+			memcpy(res + i * 3, "../", 3);
+		uint32_t res_len = append_normalized(res, depth * 3, 0, path, len);
+		res[res_len] = '\0';
+		return res;
+	}
 
-		for (uint32_t i {pos}; i < strlen(info.short_src); ++i)
-			if (info.short_src[i] == '/' || info.short_src[i] == '\\')
-				++current_script_dir_count;
+	// NOLINTBEGIN(clang-analyzer-unix.Malloc)
 
-		while (current_script_dir_count > 0)
+	namespace
+	{
+		sym::id to_sym(lua_State* L, int32_t idx)
 		{
-			if (res_path_capacity < res_path_size + 3 /*../*/)
-			{
-				while (res_path_capacity < res_path_size + 3)
-					res_path_capacity *= 2;
-				res_path = trealloc(res_path, res_path_capacity + 1);
-			}
-
-			strncpy(res_path + res_path_size, "../", 3);
-			res_path_size += 3;
-			--current_script_dir_count;
-			uint32_t find_pos = str::find(info.short_src + pos, "/");
-			if (find_pos == UINT32_MAX)
-				find_pos = str::find(info.short_src + pos, "\\");
-			pos += find_pos + 1;
+			size_t      len = 0;
+			char const* str = lua_tolstring(L, idx, &len);
+			return sym::intern(str, static_cast<uint32_t>(len));
 		}
 
-		uint32_t find_pos = str::rfind(info.short_src + pos, "/");
-		if (find_pos == UINT32_MAX)
-			find_pos = str::rfind(info.short_src + pos, "\\");
+		void push_sym(lua_State* L, sym::id s)
+		{
+			lua_pushlstring(L, sym::str(s), sym::len(s));
+		}
 
-		if (find_pos != UINT32_MAX)
+		// Appends the strings of the array on top of the stack to `arr`
+		void parse_string_array(lua_State*  L,
+		                        char const* key,
+		                        int32_t     value_type,
+		                        sym::id*&   arr,
+		                        uint32_t&   size)
 		{
-			if (res_path_capacity < res_path_size + find_pos + 1 + len)
-			{
-				while (res_path_capacity < res_path_size + find_pos + 1 + len)
-					res_path_capacity *= 2;
-				res_path = trealloc(res_path, res_path_capacity + 1);
-			}
+			if (value_type != LUA_TTABLE)
+				luaL_error(L, "%s: expecting array", key);
 
-			strncpy(res_path + res_path_size, info.short_src + pos, find_pos + 1);
-			res_path_size += find_pos + 1;
+			uint32_t len = lua_rawlen(L, -1);
+			if (!len)
+				return;
+			arr = trealloc(arr, size + len);
+			for (uint32_t i {0}; i < len; ++i)
+			{
+				lua_rawgeti(L, -1, i + 1);
+				if (!lua_isstring(L, -1))
+					luaL_error(L, "%s: expecting string in array", key);
+				arr[size + i] = to_sym(L, -1);
+				lua_pop(L, 1);
+			}
+			size += len;
 		}
-		else if (res_path_capacity < res_path_size + len)
+
+		void add_source_set(input& in, fset::set const* set)
 		{
-			while (res_path_capacity < res_path_size + len)
-				res_path_capacity *= 2;
-			res_path = trealloc(res_path, res_path_capacity + 1);
+			in.source_sets = trealloc(in.source_sets, in.source_sets_size + 1);
+			in.source_sets[in.source_sets_size++] = set;
 		}
-		strncpy(res_path + res_path_size, path, len);
-		res_path[res_path_size + len] = '\0';
-		return res_path;
-	}
-
-	// NOLINTBEGIN(clang-analyzer-unix.Malloc)
 
-	namespace
-	{
-		bool
-		parse_config_input(lua_State* L, char const* key, int32_t value_type, input& in)
+		// Sources are either an array of patterns and file sets, or a single file set
+		void parse_sources(lua_State* L, int32_t value_type, input& in)
 		{
-			if (strcmp(key, "sources") == 0)
+			fset::set const* set = fset::to_set(L, -1);
+			if (set)
 			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "sources: expecting array");
-
-				uint32_t len = lua_rawlen(L, -1);
-				if (!len)
-					return true;
-				in.sources = trealloc(in.sources, in.sources_size + len);
-				for (uint32_t i {in.sources_size}; i < in.sources_size + len; ++i)
-				{
-					lua_rawgeti(L, -1, i + 1);
-					if (lua_isstring(L, -1))
-					{
-						char const* lua_str = lua_tostring(L, -1);
-						char*       str = tmalloc<char>(strlen(lua_str) + 1);
-						strcpy(str, lua_str);
-						in.sources[i] = str;
-					}
-					else
-						luaL_error(L, "sources: expecting string in array");
-					lua_pop(L, 1);
-				}
-				in.sources_size += len;
-
-				return true;
+				add_source_set(in, set);
+				return;
 			}
-			else if (strcmp(key, "includes") == 0)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "includes: expecting array");
 
-				uint32_t len = lua_rawlen(L, -1);
-				if (!len)
-					return true;
-				in.includes = trealloc(in.includes, in.includes_size + len);
-				for (uint32_t i {in.includes_size}; i < in.includes_size + len; ++i)
-				{
-					lua_rawgeti(L, -1, i - in.includes_size + 1);
-					if (lua_isstring(L, -1))
-					{
-						char const* lua_str = lua_tostring(L, -1);
-						char*       str = tmalloc<char>(strlen(lua_str) + 1);
-						strcpy(str, lua_str);
-						in.includes[i] = str;
-					}
-					else
-						luaL_error(L, "includes: expecting string in array");
-					lua_pop(L, 1);
-				}
-				in.includes_size += len;
+			if (value_type != LUA_TTABLE)
+				luaL_error(L, "sources: expecting array or file set");
 
-				return true;
+			uint32_t len = lua_rawlen(L, -1);
+			if (!len)
+				return;
+			in.sources = trealloc(in.sources, in.sources_size + len);
+			for (uint32_t i {0}; i < len; ++i)
+			{
+				lua_rawgeti(L, -1, i + 1);
+				set = fset::to_set(L, -1);
+				if (set)
+					add_source_set(in, set);
+				else if (lua_isstring(L, -1))
+					in.sources[in.sources_size++] = to_sym(L, -1);
+				else
+					luaL_error(L, "sources: expecting string or file set in array");
+				lua_pop(L, 1);
 			}
-			else if (strcmp(key, "compile_options") == 0)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "compile_options: expecting array");
-
-				uint32_t len = lua_rawlen(L, -1);
-				if (!len)
-					return true;
-				in.compile_options =
-					trealloc(in.compile_options, in.compile_options_size + len);
-				for (uint32_t i {in.compile_options_size};
-				     i < in.compile_options_size + len; ++i)
-				{
-					lua_rawgeti(L, -1, i - in.compile_options_size + 1);
-					if (lua_isstring(L, -1))
-					{
-						char const* lua_str = lua_tostring(L, -1);
-						char*       str = tmalloc<char>(strlen(lua_str) + 1);
-						strcpy(str, lua_str);
-						in.compile_options[i] = str;
-					}
-					else
-						luaL_error(L, "compile_options: expecting string in array");
-					lua_pop(L, 1);
-				}
-				in.compile_options_size += len;
+		}
 
-				return true;
-			}
+		bool
+		parse_config_input(lua_State* L, char const* key, int32_t value_type, input& in)
+		{
+			if (strcmp(key, "sources") == 0)
+				parse_sources(L, value_type, in);
+			else if (strcmp(key, "exclude") == 0)
+				parse_string_array(L, key, value_type, in.excludes, in.excludes_size);
+			else if (strcmp(key, "includes") == 0)
+				parse_string_array(L, key, value_type, in.includes, in.includes_size);
+			else if (strcmp(key, "compile_options") == 0)
+				parse_string_array(L, key, value_type, in.compile_options,
+				                   in.compile_options_size);
 			else if (strcmp(key, "link_options") == 0)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "link_options: expecting array");
-
-				uint32_t len = lua_rawlen(L, -1);
-				if (!len)
-					return true;
-				in.link_options = trealloc(in.link_options, in.link_options_size + len);
-				for (uint32_t i {in.link_options_size}; i < in.link_options_size + len;
-				     ++i)
-				{
-					lua_rawgeti(L, -1, i - in.link_options_size + 1);
-					if (lua_isstring(L, -1))
-					{
-						char const* lua_str = lua_tostring(L, -1);
-						char*       str = tmalloc<char>(strlen(lua_str) + 1);
-						strcpy(str, lua_str);
-						in.link_options[i] = str;
-					}
-					else
-						luaL_error(L, "link_options: expecting string in array");
-					lua_pop(L, 1);
-				}
-
-				in.link_options_size += len;
-
-				return true;
-			}
+				parse_string_array(L, key, value_type, in.link_options,
+				                   in.link_options_size);
 			else if (strcmp(key, "dependencies") == 0)
 			{
 				if (value_type != LUA_TTABLE)
@@ -1055,85 +1515,95 @@ namespace lua
 				for (uint32_t i {in.deps_size}; i < in.deps_size + len; ++i)
 				{
 					lua_rawgeti(L, -1, i - in.deps_size + 1);
-					if (lua_istable(L, -1))
-						in.deps[i] = parse_output(L);
-					else
-						luaL_error(L, "dependencies: expecting table in array");
+					if (!lua_istable(L, -1) && !prj::to_project(L, -1))
+						luaL_error(L, "dependencies: expecting project in array");
+					in.deps[i] = prj::check_project(L, -1);
 					lua_pop(L, 1);
 				}
 
 				in.deps_size += len;
-
-				return true;
 			}
 			else if (strcmp(key, "static_libraries") == 0 &&
 			         in.type == project_type::prebuilt)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "static_libraries: expecting array");
+				parse_string_array(L, key, value_type, in.static_libraries,
+				                   in.static_libraries_size);
+			else if (strcmp(key, "static_library_directories") == 0 &&
+			         in.type == project_type::prebuilt)
+				parse_string_array(L, key, value_type, in.static_library_directories,
+				                   in.static_library_directories_size);
+			else
+				return false;
 
-				uint32_t len = lua_rawlen(L, -1);
-				if (!len)
-					return true;
+			return true;
+		}
+
+		constexpr char const* config_keys[] {"sources",
+		                                     "exclude",
+		                                     "includes",
+		                                     "compile_options",
+		                                     "link_options",
+		                                     "dependencies",
+		                                     "static_libraries",
+		                                     "static_library_directories"};
+
+		void parse_config_keys(lua_State* L, input& in)
+		{
+			for (char const* key : config_keys)
+			{
+				lua_getfield(L, -1, key);
+				int32_t value_type = lua_type(L, -1);
+				if (value_type != LUA_TNIL)
+					parse_config_input(L, key, value_type, in);
+				lua_pop(L, 1);
+			}
+		}
 
-				in.static_libraries =
-					trealloc(in.static_libraries, in.static_libraries_size + len);
-				for (uint32_t i {in.static_libraries_size};
-				     i < in.static_libraries_size + len; ++i)
+		bool is_known_key(char const* key, input const& in, bool config_scope)
+		{
+			for (char const* config_key : config_keys)
+			{
+				if (strcmp(key, config_key) == 0)
 				{
-					lua_rawgeti(L, -1, i - in.static_libraries_size + 1);
-					if (lua_isstring(L, -1))
-					{
-						char const* lua_str = lua_tostring(L, -1);
-						char*       str = tmalloc<char>(strlen(lua_str) + 1);
-						strcpy(str, lua_str);
-						in.static_libraries[i] = str;
-					}
-					else
-						luaL_error(L, "static_libraries: expecting string in array");
-					lua_pop(L, 1);
+					// Prebuilt only keys
+					if (strcmp(key, "static_libraries") == 0 ||
+					    strcmp(key, "static_library_directories") == 0)
+						return in.type == project_type::prebuilt;
+					return true;
 				}
+			}
 
-				in.static_libraries_size += len;
+			if (config_scope)
+				return false;
 
+			if (strcmp(key, "name") == 0 || strcmp(key, "type") == 0)
 				return true;
-			}
-			else if (strcmp(key, "static_library_directories") == 0 &&
-			         in.type == project_type::prebuilt)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "static_library_directories: expecting array");
 
-				uint32_t len = lua_rawlen(L, -1);
-				if (!len)
+			for (uint32_t i {0}; i < g.config_size; ++i)
+				if (strcmp(key, g.configs[i]) == 0)
 					return true;
 
-				in.static_library_directories =
-					trealloc(in.static_library_directories,
-				             in.static_library_directories_size + len);
-				for (uint32_t i {in.static_library_directories_size};
-				     i < in.static_library_directories_size + len; ++i)
+			// Configuration given to mg.require, possibly not declared by the main script
+			return strcmp(key, g.config_param) == 0;
+		}
+
+		void warn_unknown_keys(lua_State* L, input const& in, bool config_scope)
+		{
+			lua_pushnil(L);
+			while (lua_next(L, -2))
+			{
+				if (lua_type(L, -2) == LUA_TSTRING)
 				{
-					lua_rawgeti(L, -1, i - in.static_library_directories_size + 1);
-					if (lua_isstring(L, -1))
+					char const* key = lua_tostring(L, -2);
+					if (!is_known_key(key, in, config_scope))
 					{
-						char const* lua_str = lua_tostring(L, -1);
-						char*       str = tmalloc<char>(strlen(lua_str) + 1);
-						strcpy(str, lua_str);
-						in.static_library_directories[i] = str;
+						luaL_where(L, 1);
+						char const* src = lua_tostring(L, -1);
+						printf("%s: Unknown key: %s\n", src, key);
+						lua_pop(L, 1);
 					}
-					else
-						luaL_error(
-							L, "static_library_directories: expecting string in array");
-					lua_pop(L, 1);
 				}
-
-				in.static_library_directories_size += len;
-
-				return true;
+				lua_pop(L, 1);
 			}
-
-			return false;
 		}
 	} // namespace
 
@@ -1144,8 +1614,6 @@ namespace lua
 
 		if (idx != -1)
 			lua_pushvalue(L, idx);
-		// TODO manually read allowed configs before iterating on table, because lua_next
-		// doesn't order the values in initialisation order
 
 		lua_getfield(L, -1, "type");
 		if (lua_type(L, -1) == LUA_TTABLE)
@@ -1165,73 +1633,29 @@ namespace lua
 		}
 		lua_pop(L, 1);
 
-		lua_pushnil(L);
-
-		while (lua_next(L, -2))
-		{
-			char const* key = lua_tostring(L, -2);
-			int32_t     value_type = lua_type(L, -1);
-			if (strcmp(key, "name") == 0)
-			{
-				if (value_type != LUA_TSTRING)
-					luaL_error(L, "name: expecting string");
-
-				char const* lua_name = lua_tostring(L, -1);
-				char*       name = tmalloc<char>(strlen(lua_name) + 1);
-				strcpy(name, lua_name);
-				in.name = name;
-			}
-			else if (strcmp(key, "type") == 0)
-			{
-			}
-			else if (strcmp(key, g.config_param) == 0)
-			{
-				if (value_type != LUA_TTABLE)
-				{
-					luaL_error(L, "%s: expecting table", key);
-				}
-				else
-				{
-					lua_pushnil(L);
-
-					while (lua_next(L, -2))
-					{
-						char const* config_key = lua_tostring(L, -2);
-						int32_t     config_value_type = lua_type(L, -1);
-						if (!parse_config_input(L, config_key, config_value_type, in))
-						{
-							luaL_where(L, 1);
-							char const* src = lua_tostring(L, -1);
-							printf("%s: Unknown key: %s\n", src, key);
-							lua_pop(L, 1);
-						}
-						lua_pop(L, 1);
-					}
-				}
-			}
-			else if (!parse_config_input(L, key, value_type, in))
-			{
-				bool err {true};
+		lua_getfield(L, -1, "name");
+		if (lua_type(L, -1) == LUA_TSTRING)
+			in.name = to_sym(L, -1);
+		else if (lua_type(L, -1) != LUA_TNIL)
+			luaL_error(L, "name: expecting string");
+		lua_pop(L, 1);
 
-				for (uint32_t i {0}; i < g.config_size; ++i)
-				{
-					if (strcmp(key, g.configs[i]) == 0)
-					{
-						err = false;
-						break;
-					}
-				}
+		// Keys are read in a fixed order instead of iterating with lua_next, which
+		// doesn't follow the initialisation order, and changes between runs. This keeps
+		// the options order, and the generated files, stable.
+		parse_config_keys(L, in);
 
-				if (err)
-				{
-					luaL_where(L, 1);
-					char const* src = lua_tostring(L, -1);
-					printf("%s: Unknown key: %s\n", src, key);
-					lua_pop(L, 1);
-				}
-			}
-			lua_pop(L, 1);
+		lua_getfield(L, -1, g.config_param);
+		if (lua_type(L, -1) == LUA_TTABLE)
+		{
+			parse_config_keys(L, in);
+			warn_unknown_keys(L, in, true);
 		}
+		else if (lua_type(L, -1) != LUA_TNIL)
+			luaL_error(L, "%s: expecting table", g.config_param);
+		lua_pop(L, 1);
+
+		warn_unknown_keys(L, in, false);
 
 		if (!in.name)
 			luaL_error(L, "missing key: name");
@@ -1245,568 +1669,409 @@ namespace lua
 
 	void free_input(input const& in)
 	{
-		if (in.name)
-			tfree(in.name);
-
 		if (in.sources)
-		{
-			for (uint32_t i {0}; i < in.sources_size; ++i)
-				if (in.sources[i])
-					tfree(in.sources[i]);
 			tfree(in.sources);
-		}
-
+		if (in.source_sets)
+			tfree(in.source_sets);
+		if (in.excludes)
+			tfree(in.excludes);
 		if (in.includes)
-		{
-			for (uint32_t i {0}; i < in.includes_size; ++i)
-				if (in.includes[i])
-					tfree(in.includes[i]);
 			tfree(in.includes);
-		}
-
 		if (in.compile_options)
-		{
-			for (uint32_t i {0}; i < in.compile_options_size; ++i)
-				if (in.compile_options[i])
-					tfree(in.compile_options[i]);
 			tfree(in.compile_options);
-		}
-
 		if (in.link_options)
-		{
-			for (uint32_t i {0}; i < in.link_options_size; ++i)
-				if (in.link_options[i])
-					tfree(in.link_options[i]);
 			tfree(in.link_options);
-		}
 
 		if (in.deps)
-		{
-			for (uint32_t i {0}; i < in.deps_size; ++i)
-				free_output(in.deps[i]);
 			tfree(in.deps);
-		}
 
 		if (in.static_libraries)
-		{
-			for (uint32_t i {0}; i < in.static_libraries_size; ++i)
-				if (in.static_libraries[i])
-					tfree(in.static_libraries[i]);
 			tfree(in.static_libraries);
-		}
-
 		if (in.static_library_directories)
-		{
-			for (uint32_t i {0}; i < in.static_library_directories_size; ++i)
-				if (in.static_library_directories[i])
-					tfree(in.static_library_directories[i]);
 			tfree(in.static_library_directories);
-		}
 	}
 
-	void dump_output(lua_State* L, output const& out)
+	namespace
 	{
-		lua_newtable(L);
+		void push_sym_array(lua_State* L, sym::id const* arr, uint32_t size)
+		{
+			lua_createtable(L, size, 0);
+			for (uint32_t i {0}; i < size; ++i)
+			{
+				push_sym(L, arr[i]);
+				lua_rawseti(L, -2, i + 1);
+			}
+		}
 
-		lua_pushstring(L, out.name);
-		lua_setfield(L, -2, "name");
+		void push_custom_commands(lua_State* L, custom_command const* cmds, uint32_t size)
+		{
+			lua_createtable(L, size, 0);
+			for (uint32_t i {0}; i < size; ++i)
+			{
+				custom_command const& cmd = cmds[i];
+				lua_newtable(L);
+				if (cmd.in_len != 0)
+				{
+					if (cmd.in_len == 1)
+						push_sym(L, cmd.in[0]);
+					else
+						push_sym_array(L, cmd.in, cmd.in_len);
+					lua_setfield(L, -2, "input");
+				}
 
-		lua_newtable(L);
-		lua_pushinteger(L, static_cast<int32_t>(out.type));
-		lua_setfield(L, -2, "__project_type_enum_value");
-		lua_setfield(L, -2, "type");
+				if (cmd.out_len != 0)
+				{
+					if (cmd.out_len == 1)
+						push_sym(L, cmd.out[0]);
+					else
+						push_sym_array(L, cmd.out, cmd.out_len);
+					lua_setfield(L, -2, "output");
+				}
 
-		if (out.sources)
+				if (cmd.cmd)
+				{
+					push_sym(L, cmd.cmd);
+					lua_setfield(L, -2, "cmd");
+				}
+
+				lua_rawseti(L, -2, i + 1);
+			}
+		}
+	} // namespace
+
+	bool push_output_field(lua_State* L, output const& out, char const* key)
+	{
+		if (strcmp(key, "name") == 0)
+		{
+			if (!out.name)
+				return false;
+			push_sym(L, out.name);
+		}
+		else if (strcmp(key, "type") == 0)
 		{
 			lua_newtable(L);
+			lua_pushinteger(L, static_cast<int32_t>(out.type));
+			lua_setfield(L, -2, "__project_type_enum_value");
+		}
+		else if (strcmp(key, "sources") == 0)
+		{
+			if (!out.sources)
+				return false;
+			lua_createtable(L, out.sources_size, 0);
 			for (uint32_t i {0}; i < out.sources_size; ++i)
 			{
 				lua_newtable(L);
-				lua_pushstring(L, out.sources[i].file);
+				push_sym(L, out.sources[i].file);
 				lua_setfield(L, -2, "file");
 
 				if (out.sources[i].compile_options)
 				{
-					lua_pushstring(L, out.sources[i].compile_options);
+					push_sym(L, out.sources[i].compile_options);
 					lua_setfield(L, -2, "compile_options");
 				}
 				lua_rawseti(L, -2, i + 1);
 			}
-			lua_setfield(L, -2, "sources");
 		}
-
-		if (out.compile_options)
+		else if (strcmp(key, "compile_options") == 0)
 		{
-			lua_pushstring(L, out.compile_options);
-			lua_setfield(L, -2, "compile_options");
+			if (!out.compile_options)
+				return false;
+			push_sym(L, out.compile_options);
 		}
-
-		if (out.link_options)
+		else if (strcmp(key, "link_options") == 0)
 		{
-			lua_pushstring(L, out.link_options);
-			lua_setfield(L, -2, "link_options");
+			if (!out.link_options)
+				return false;
+			push_sym(L, out.link_options);
 		}
-
-		if (out.deps)
+		else if (strcmp(key, "include_dirs") == 0)
 		{
-			lua_newtable(L);
+			if (!out.include_dirs)
+				return false;
+			push_sym_array(L, out.include_dirs, out.include_dirs_size);
+		}
+		else if (strcmp(key, "dependencies") == 0)
+		{
+			if (!out.deps)
+				return false;
+			lua_createtable(L, out.deps_size, 0);
 			for (uint32_t i {0}; i < out.deps_size; ++i)
 			{
-				dump_output(L, out.deps[i]);
+				prj::push_project(L, out.deps[i]);
 				lua_rawseti(L, -2, i + 1);
 			}
-			lua_setfield(L, -2, "dependencies");
 		}
+		else if (strcmp(key, "pre_build_cmds") == 0)
+		{
+			if (!out.pre_build_cmds)
+				return false;
+			push_custom_commands(L, out.pre_build_cmds, out.pre_build_cmd_size);
+		}
+		else if (strcmp(key, "post_build_cmds") == 0)
+		{
+			if (!out.post_build_cmds)
+				return false;
+			push_custom_commands(L, out.post_build_cmds, out.post_build_cmd_size);
+		}
+		else
+			return false;
 
-		if (out.pre_build_cmds)
+		return true;
+	}
+
+	// NOLINTBEGIN(clang-analyzer-unix.Malloc)
+
+	namespace
+	{
+		// Reads the input or output of a command, either a string or an array of strings.
+		// An empty string stands for no path.
+		void parse_command_paths(lua_State*  L,
+		                         char const* key,
+		                         sym::id*&   paths,
+		                         uint32_t&   size)
 		{
-			lua_newtable(L);
-			uint32_t lua_idx {0};
-			for (uint32_t i {0}; i < out.pre_build_cmd_size; ++i)
+			paths = nullptr;
+			size = 0;
+			if (lua_type(L, -1) == LUA_TSTRING)
 			{
-				custom_command* cmd = out.pre_build_cmds + i;
-				lua_newtable(L);
-				if (cmd->in_len != 0)
+				if (lua_rawlen(L, -1))
 				{
-					if (cmd->in_len == 1)
-					{
-						lua_pushstring(L, cmd->in[0]);
-					}
-					else
-					{
-						lua_newtable(L);
-						uint32_t lua_idx2 {1};
-						for (uint32_t j {0}; j < cmd->in_len; ++j)
-						{
-							lua_pushstring(L, cmd->in[j]);
-							lua_rawseti(L, -2, lua_idx2);
-							++lua_idx2;
-						}
-					}
-
-					lua_setfield(L, -2, "input");
+					paths = tmalloc<sym::id>(1);
+					paths[0] = to_sym(L, -1);
+					size = 1;
 				}
-
-				if (cmd->out_len != 0)
+			}
+			else if (lua_istable(L, -1))
+			{
+				uint32_t len = lua_rawlen(L, -1);
+				if (!len)
+					return;
+				paths = tmalloc<sym::id>(len);
+				for (uint32_t i {0}; i < len; ++i)
 				{
-					if (cmd->out_len == 1)
-					{
-						lua_pushstring(L, cmd->out[0]);
-					}
-					else
+					lua_rawgeti(L, -1, i + 1);
+					if (!lua_isstring(L, -1))
 					{
-						lua_newtable(L);
-						uint32_t lua_idx2 {1};
-						for (uint32_t j {0}; j < cmd->out_len; ++j)
-						{
-							lua_pushstring(L, cmd->out[j]);
-							lua_rawseti(L, -2, lua_idx2);
-							++lua_idx2;
-						}
+						tfree(paths);
+						luaL_error(L, "%s: expecting string in array", key);
 					}
-
-					lua_setfield(L, -2, "output");
-				}
-
-				if (cmd->cmd)
-				{
-					lua_pushstring(L, cmd->cmd);
-					lua_setfield(L, -2, "cmd");
+					paths[i] = to_sym(L, -1);
+					lua_pop(L, 1);
 				}
-
-				lua_rawseti(L, -2, lua_idx);
-				++lua_idx;
+				size = len;
 			}
-
-			lua_setfield(L, -2, "pre_build_cmds");
 		}
 
-		if (out.post_build_cmds)
+		void free_custom_commands(custom_command const* cmds, uint32_t size)
 		{
-			lua_newtable(L);
-			uint32_t lua_idx {0};
-			for (uint32_t i {0}; i < out.post_build_cmd_size; ++i)
+			for (uint32_t i {0}; i < size; ++i)
 			{
-				custom_command* cmd = out.post_build_cmds + i;
-				if (cmd->in_len != 0)
-				{
-					if (cmd->in_len == 1)
-					{
-						lua_pushstring(L, cmd->in[0]);
-					}
-					else
-					{
-						lua_newtable(L);
-						uint32_t lua_idx2 {1};
-						for (uint32_t j {0}; j < cmd->in_len; ++j)
-						{
-							lua_pushstring(L, cmd->in[j]);
-							lua_rawseti(L, -2, lua_idx2);
-							++lua_idx2;
-						}
-					}
-
-					lua_setfield(L, -2, "input");
-				}
+				if (cmds[i].in)
+					tfree(cmds[i].in);
+				if (cmds[i].out)
+					tfree(cmds[i].out);
+			}
+			tfree(cmds);
+		}
 
-				if (cmd->out_len != 0)
-				{
-					if (cmd->out_len == 1)
-					{
-						lua_pushstring(L, cmd->out[0]);
-					}
-					else
-					{
-						lua_newtable(L);
-						uint32_t lua_idx2 {1};
-						for (uint32_t j {0}; j < cmd->out_len; ++j)
-						{
-							lua_pushstring(L, cmd->out[j]);
-							lua_rawseti(L, -2, lua_idx2);
-							++lua_idx2;
-						}
-					}
+		void parse_custom_commands(lua_State*       L,
+		                           char const*      key,
+		                           custom_command*& cmds,
+		                           uint32_t&        size)
+		{
+			if (!lua_istable(L, -1))
+				luaL_error(L, "%s: expecting array", key);
 
-					lua_setfield(L, -2, "output");
-				}
+			if (cmds)
+				free_custom_commands(cmds, size);
+			cmds = nullptr;
+			size = 0;
 
-				if (cmd->cmd)
-				{
-					lua_pushstring(L, cmd->cmd);
-					lua_setfield(L, -2, "cmd");
-				}
+			uint32_t len = lua_rawlen(L, -1);
+			if (!len)
+				return;
 
-				lua_rawseti(L, -2, lua_idx);
-				++lua_idx;
+			cmds = tmalloc<custom_command>(len);
+			memset(cmds, 0, sizeof(custom_command) * len);
+			size = len;
+			for (uint32_t i {0}; i < len; ++i)
+			{
+				lua_rawgeti(L, -1, i + 1);
+				if (lua_istable(L, -1))
+					cmds[i] = parse_custom_command(L);
+				lua_pop(L, 1);
 			}
-
-			lua_setfield(L, -2, "post_build_cmds");
 		}
-	}
-
-	// NOLINTBEGIN(clang-analyzer-unix.Malloc)
+	} // namespace
 
-	output parse_output(lua_State* L, int32_t idx)
+	custom_command parse_custom_command(lua_State* L)
 	{
-		output out {};
+		custom_command cmd {};
 
-		if (idx != -1)
-			lua_pushvalue(L, idx);
+		lua_getfield(L, -1, "input");
+		parse_command_paths(L, "input", cmd.in, cmd.in_len);
+		lua_pop(L, 1);
 
-		lua_pushnil(L);
+		lua_getfield(L, -1, "output");
+		parse_command_paths(L, "output", cmd.out, cmd.out_len);
+		lua_pop(L, 1);
 
-		while (lua_next(L, -2))
+		lua_getfield(L, -1, "cmd");
+		if (lua_isstring(L, -1))
+			cmd.cmd = to_sym(L, -1);
+		lua_pop(L, 1);
+
+		return cmd;
+	}
+
+	bool parse_output_field(lua_State* L, char const* key, output& out)
+	{
+		int32_t value_type = lua_type(L, -1);
+		if (strcmp(key, "name") == 0)
 		{
-			char const* key = lua_tostring(L, -2);
-			int32_t     value_type = lua_type(L, -1);
-			if (strcmp(key, "name") == 0)
-			{
-				if (value_type != LUA_TSTRING)
-					luaL_error(L, "name: expecting string");
+			if (value_type != LUA_TSTRING)
+				luaL_error(L, "name: expecting string");
 
-				char const* lua_name = lua_tostring(L, -1);
-				char*       name = tmalloc<char>(strlen(lua_name) + 1);
-				strcpy(name, lua_name);
-				out.name = name;
-			}
-			else if (strcmp(key, "type") == 0)
+			out.name = to_sym(L, -1);
+		}
+		else if (strcmp(key, "type") == 0)
+		{
+			if (value_type != LUA_TTABLE)
+				luaL_error(L, "type: expecting project_type enum");
+
+			lua_getfield(L, -1, "__project_type_enum_value");
+			if (lua_isnil(L, -1))
+				luaL_error(L, "type: expecting project_type enum");
+			out.type = static_cast<project_type>(lua_tointeger(L, -1));
+			lua_pop(L, 1);
+		}
+		else if (strcmp(key, "sources") == 0)
+		{
+			if (value_type != LUA_TTABLE)
+				luaL_error(L, "sources: expecting array");
+
+			// Objects are computed from the sources
+			if (out.objs)
 			{
-				if (value_type != LUA_TTABLE)
-				{
-					luaL_error(L, "type: expecting project_type enum");
-				}
-				else
-				{
-					lua_getfield(L, -1, "__project_type_enum_value");
-					if (lua_isnil(L, -1))
-						luaL_error(L, "type: expecting project_type enum");
-					out.type = static_cast<project_type>(lua_tointeger(L, -1));
-				}
-				lua_pop(L, 1);
+				tfree(out.objs[0]);
+				tfree(out.objs);
+				out.objs = nullptr;
 			}
-			else if (strcmp(key, "sources") == 0)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "sources: expecting array");
+			if (out.sources)
+				tfree(out.sources);
+			out.sources = nullptr;
+			out.sources_size = out.sources_capacity = 0;
 
-				uint32_t len = lua_rawlen(L, -1);
-				if (len)
+			uint32_t len = lua_rawlen(L, -1);
+			if (len)
+			{
+				out.sources_size = out.sources_capacity = len;
+				out.sources = tmalloc<output::source>(len);
+				for (uint32_t i {0}; i < len; ++i)
 				{
-					out.sources_size = out.sources_capacity = len;
-					out.sources = tmalloc<output::source>(len);
-					for (uint32_t i {0}; i < len; ++i)
+					out.sources[i] = {};
+					lua_rawgeti(L, -1, i + 1);
+					if (lua_istable(L, -1))
 					{
-						lua_rawgeti(L, -1, i + 1);
-						if (lua_istable(L, -1))
-						{
-							lua_getfield(L, -1, "file");
-							if (lua_isstring(L, -1))
-							{
-								char const* lua_file = lua_tostring(L, -1);
-								char*       file = tmalloc<char>(strlen(lua_file) + 1);
-								strcpy(file, lua_file);
-								out.sources[i].file = file;
-							}
-							lua_getfield(L, -2, "compile_options");
-							if (lua_isstring(L, -1))
-							{
-								char const* lua_compile_options = lua_tostring(L, -1);
-								char*       compile_options =
-									tmalloc<char>(strlen(lua_compile_options) + 1);
-								strcpy(compile_options, lua_compile_options);
-								out.sources[i].compile_options = compile_options;
-							}
-							else
-							{
-								out.sources[i].compile_options = nullptr;
-							}
-							lua_pop(L, 2);
-						}
-						lua_pop(L, 1);
+						lua_getfield(L, -1, "file");
+						if (lua_isstring(L, -1))
+							out.sources[i].file = to_sym(L, -1);
+						lua_getfield(L, -2, "compile_options");
+						if (lua_isstring(L, -1))
+							out.sources[i].compile_options = to_sym(L, -1);
+						lua_pop(L, 2);
 					}
+					lua_pop(L, 1);
 				}
 			}
-			else if (strcmp(key, "compile_options") == 0)
-			{
-				if (value_type != LUA_TSTRING)
-					luaL_error(L, "compile_options: expecting string");
+		}
+		else if (strcmp(key, "compile_options") == 0)
+		{
+			if (value_type != LUA_TSTRING)
+				luaL_error(L, "compile_options: expecting string");
 
-				char const* lua_compile_options = lua_tostring(L, -1);
-				char* compile_options = tmalloc<char>(strlen(lua_compile_options) + 1);
-				strcpy(compile_options, lua_compile_options);
-				out.compile_options = compile_options;
-			}
-			else if (strcmp(key, "link_options") == 0)
-			{
-				if (value_type != LUA_TSTRING)
-					luaL_error(L, "link_options: expecting string");
+			out.compile_options = to_sym(L, -1);
+		}
+		else if (strcmp(key, "include_dirs") == 0)
+		{
+			if (value_type != LUA_TTABLE)
+				luaL_error(L, "include_dirs: expecting array");
 
-				char const* lua_link_options = lua_tostring(L, -1);
-				char*       link_options = tmalloc<char>(strlen(lua_link_options) + 1);
-				strcpy(link_options, lua_link_options);
-				out.link_options = link_options;
-			}
-			else if (strcmp(key, "dependencies") == 0)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "dependencies: expecting array");
+			if (out.include_dirs)
+				tfree(out.include_dirs);
+			out.include_dirs = nullptr;
+			out.include_dirs_size = 0;
 
-				uint32_t len = lua_rawlen(L, -1);
-				if (len)
-				{
-					out.deps_size = len;
-					out.deps = tmalloc<output>(len);
-					for (uint32_t i {0}; i < len; ++i)
-					{
-						lua_rawgeti(L, -1, i + 1);
-						if (lua_istable(L, -1))
-							out.deps[i] = parse_output(L);
-						lua_pop(L, 1);
-					}
-				}
-			}
-			else if (strcmp(key, "pre_build_cmds") == 0)
+			uint32_t len = lua_rawlen(L, -1);
+			if (len)
 			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "pre_build_cmds: expecting array");
-
-				uint32_t len = lua_rawlen(L, -1);
-				if (len)
+				out.include_dirs = tmalloc<sym::id>(len);
+				for (uint32_t i {0}; i < len; ++i)
 				{
-					out.pre_build_cmd_size = len;
-					out.pre_build_cmds = tmalloc<custom_command>(len);
-					for (uint32_t i {0}; i < len; ++i)
-					{
-						lua_rawgeti(L, -1, i + 1);
-						if (lua_istable(L, -1))
-						{
-							lua_getfield(L, -1, "input");
-							if (!lua_isnil(L, -1))
-							{
-								if (lua_isstring(L, -1))
-								{
-									char const* lua_input = lua_tostring(L, -1);
-									if (strlen(lua_input))
-									{
-										char* input =
-											tmalloc<char>(strlen(lua_input) + 1);
-										strcpy(input, lua_input);
-										out.pre_build_cmds[i].in =
-											tmalloc<char const*>(1);
-										out.pre_build_cmds[i].in_len = 1;
-										out.pre_build_cmds[i].in[0] = input;
-									}
-								}
-								else if (lua_istable(L, -1))
-								{
-									out.pre_build_cmds[i].in_len = lua_rawlen(L, -1);
-									out.pre_build_cmds[i].in = tmalloc<char const*>(
-										out.pre_build_cmds[i].in_len);
-									for (uint32_t j {0}; j < out.pre_build_cmds[i].in_len;
-									     ++j)
-									{
-										lua_rawgeti(L, -1, j + 1);
-										char const* lua_input = lua_tostring(L, -1);
-										char*       input =
-											tmalloc<char>(strlen(lua_input) + 1);
-										strcpy(input, lua_input);
-										out.pre_build_cmds[i].in[j] = input;
-										lua_pop(L, 1);
-									}
-								}
-							}
-							else
-							{
-								out.pre_build_cmds[i].in_len = 0;
-								out.pre_build_cmds[i].in = nullptr;
-							}
-							lua_getfield(L, -2, "output");
-							if (lua_isstring(L, -1))
-							{
-								char const* lua_output = lua_tostring(L, -1);
-								if (strlen(lua_output))
-								{
-									char* output = tmalloc<char>(strlen(lua_output) + 1);
-									strcpy(output, lua_output);
-									out.pre_build_cmds[i].out = tmalloc<char const*>(1);
-									out.pre_build_cmds[i].out_len = 1;
-									out.pre_build_cmds[i].out[0] = output;
-								}
-							}
-							else if (lua_istable(L, -1))
-							{
-								out.pre_build_cmds[i].out_len = lua_rawlen(L, -1);
-								out.pre_build_cmds[i].out =
-									tmalloc<char const*>(out.pre_build_cmds[i].out_len);
-								for (uint32_t j {0}; j < out.pre_build_cmds[i].out_len;
-								     ++j)
-								{
-									lua_rawgeti(L, -1, j + 1);
-									char const* lua_output = lua_tostring(L, -1);
-									char* output = tmalloc<char>(strlen(lua_output) + 1);
-									strcpy(output, lua_output);
-									out.pre_build_cmds[i].out[j] = output;
-									lua_pop(L, 1);
-								}
-							}
-
-							lua_getfield(L, -3, "cmd");
-							if (!lua_isnil(L, -1))
-							{
-								char const* lua_cmd = lua_tostring(L, -1);
-								char*       cmd = tmalloc<char>(strlen(lua_cmd) + 1);
-								strcpy(cmd, lua_cmd);
-								out.pre_build_cmds[i].cmd = cmd;
-							}
-							else
-								out.pre_build_cmds[i].cmd = nullptr;
-							lua_pop(L, 3);
-						}
-						lua_pop(L, 1);
-					}
+					lua_rawgeti(L, -1, i + 1);
+					if (!lua_isstring(L, -1))
+						luaL_error(L, "include_dirs: expecting string in array");
+					out.include_dirs[i] = to_sym(L, -1);
+					lua_pop(L, 1);
 				}
+				out.include_dirs_size = len;
 			}
-			else if (strcmp(key, "post_build_cmds") == 0)
-			{
-				if (value_type != LUA_TTABLE)
-					luaL_error(L, "post_build_cmds: expecting array");
+		}
+		else if (strcmp(key, "link_options") == 0)
+		{
+			if (value_type != LUA_TSTRING)
+				luaL_error(L, "link_options: expecting string");
 
-				uint32_t len = lua_rawlen(L, -1);
-				if (len)
+			out.link_options = to_sym(L, -1);
+		}
+		else if (strcmp(key, "dependencies") == 0)
+		{
+			if (value_type != LUA_TTABLE)
+				luaL_error(L, "dependencies: expecting array");
+
+			if (out.deps)
+				tfree(out.deps);
+			out.deps = nullptr;
+			out.deps_size = 0;
+
+			uint32_t len = lua_rawlen(L, -1);
+			if (len)
+			{
+				out.deps = tmalloc<output*>(len);
+				for (uint32_t i {0}; i < len; ++i)
 				{
-					out.post_build_cmd_size = len;
-					out.post_build_cmds = tmalloc<custom_command>(len);
-					for (uint32_t i {0}; i < len; ++i)
-					{
-						lua_rawgeti(L, -1, i + 1);
-						if (lua_istable(L, -1))
-						{
-							lua_getfield(L, -1, "input");
-							if (!lua_isnil(L, -1))
-							{
-								if (lua_isstring(L, -1))
-								{
-									char const* lua_input = lua_tostring(L, -1);
-									if (strlen(lua_input))
-									{
-										char* input =
-											tmalloc<char>(strlen(lua_input) + 1);
-										strcpy(input, lua_input);
-										out.post_build_cmds[i].in =
-											tmalloc<char const*>(1);
-										out.post_build_cmds[i].in_len = 1;
-										out.post_build_cmds[i].in[0] = input;
-									}
-								}
-								else if (lua_istable(L, -1))
-								{
-									out.post_build_cmds[i].in_len = lua_rawlen(L, -1);
-									out.post_build_cmds[i].in = tmalloc<char const*>(
-										out.post_build_cmds[i].in_len);
-									for (uint32_t j {0};
-									     j < out.post_build_cmds[i].in_len; ++j)
-									{
-										lua_rawgeti(L, -1, j + 1);
-										char const* lua_input = lua_tostring(L, -1);
-										char*       input =
-											tmalloc<char>(strlen(lua_input) + 1);
-										strcpy(input, lua_input);
-										out.post_build_cmds[i].in[j] = input;
-										lua_pop(L, 1);
-									}
-								}
-							}
-							else
-							{
-								out.post_build_cmds[i].in_len = 0;
-								out.post_build_cmds[i].in = nullptr;
-							}
-							lua_getfield(L, -2, "output");
-							if (lua_isstring(L, -1))
-							{
-								char const* lua_output = lua_tostring(L, -1);
-								if (strlen(lua_output))
-								{
-									char* output = tmalloc<char>(strlen(lua_output) + 1);
-									strcpy(output, lua_output);
-									out.post_build_cmds[i].out = tmalloc<char const*>(1);
-									out.post_build_cmds[i].out_len = 1;
-									out.post_build_cmds[i].out[0] = output;
-								}
-							}
-							else if (lua_istable(L, -1))
-							{
-								out.post_build_cmds[i].out_len = lua_rawlen(L, -1);
-								out.post_build_cmds[i].out =
-									tmalloc<char const*>(out.post_build_cmds[i].out_len);
-								for (uint32_t j {0}; j < out.post_build_cmds[i].out_len;
-								     ++j)
-								{
-									lua_rawgeti(L, -1, j + 1);
-									char const* lua_output = lua_tostring(L, -1);
-									char* output = tmalloc<char>(strlen(lua_output) + 1);
-									strcpy(output, lua_output);
-									out.post_build_cmds[i].out[j] = output;
-									lua_pop(L, 1);
-								}
-							}
-
-							lua_getfield(L, -3, "cmd");
-							if (!lua_isnil(L, -1))
-							{
-								char const* lua_cmd = lua_tostring(L, -1);
-								char*       cmd = tmalloc<char>(strlen(lua_cmd) + 1);
-								strcpy(cmd, lua_cmd);
-								out.post_build_cmds[i].cmd = cmd;
-							}
-							else
-								out.post_build_cmds[i].cmd = nullptr;
-							lua_pop(L, 3);
-						}
-						lua_pop(L, 1);
-					}
+					lua_rawgeti(L, -1, i + 1);
+					if (!lua_istable(L, -1) && !prj::to_project(L, -1))
+						luaL_error(L, "dependencies: expecting project in array");
+					out.deps[i] = prj::check_project(L, -1);
+					lua_pop(L, 1);
 				}
+				out.deps_size = len;
 			}
+		}
+		else if (strcmp(key, "pre_build_cmds") == 0)
+			parse_custom_commands(L, key, out.pre_build_cmds, out.pre_build_cmd_size);
+		else if (strcmp(key, "post_build_cmds") == 0)
+			parse_custom_commands(L, key, out.post_build_cmds, out.post_build_cmd_size);
+		else
+			return false;
+
+		return true;
+	}
+
+	output parse_output(lua_State* L, int32_t idx)
+	{
+		output out {};
+
+		if (idx != -1)
+			lua_pushvalue(L, idx);
+
+		lua_pushnil(L);
+
+		while (lua_next(L, -2))
+		{
+			if (lua_type(L, -2) == LUA_TSTRING)
+				parse_output_field(L, lua_tostring(L, -2), out);
 			lua_pop(L, 1);
 		}
 
@@ -1820,61 +2085,28 @@ namespace lua
 
 	void free_output(output const& out)
 	{
-		if (out.name)
-			tfree(out.name);
-
-		if (out.sources)
+		if (out.objs)
 		{
-			for (uint32_t i {0}; i < out.sources_size; ++i)
-			{
-				tfree(out.sources[i].file);
-				if (out.sources[i].compile_options)
-					tfree(out.sources[i].compile_options);
-			}
-			tfree(out.sources);
+			tfree(out.objs[0]);
+			tfree(out.objs);
 		}
 
-		if (out.compile_options)
-			tfree(out.compile_options);
+		if (out.link_deps)
+			tfree(out.link_deps);
 
-		if (out.link_options)
-			tfree(out.link_options);
+		if (out.sources)
+			tfree(out.sources);
+
+		if (out.include_dirs)
+			tfree(out.include_dirs);
 
 		if (out.deps)
-		{
-			for (uint32_t i {0}; i < out.deps_size; ++i)
-				free_output(out.deps[i]);
 			tfree(out.deps);
-		}
 
 		if (out.pre_build_cmds)
-		{
-			for (uint32_t i {0}; i < out.pre_build_cmd_size; ++i)
-			{
-				for (uint32_t j {0}; j < out.pre_build_cmds[i].in_len; ++j)
-					tfree(out.pre_build_cmds[i].in[j]);
-				tfree(out.pre_build_cmds[i].in);
-				for (uint32_t j {0}; j < out.pre_build_cmds[i].out_len; ++j)
-					tfree(out.pre_build_cmds[i].out[j]);
-				tfree(out.pre_build_cmds[i].out);
-				tfree(out.pre_build_cmds[i].cmd);
-			}
-			tfree(out.pre_build_cmds);
-		}
+			free_custom_commands(out.pre_build_cmds, out.pre_build_cmd_size);
 
 		if (out.post_build_cmds)
-		{
-			for (uint32_t i {0}; i < out.post_build_cmd_size; ++i)
-			{
-				for (uint32_t j {0}; j < out.post_build_cmds[i].in_len; ++j)
-					tfree(out.post_build_cmds[i].in[j]);
-				tfree(out.post_build_cmds[i].in);
-				for (uint32_t j {0}; j < out.post_build_cmds[i].out_len; ++j)
-					tfree(out.post_build_cmds[i].out[j]);
-				tfree(out.post_build_cmds[i].out);
-				tfree(out.post_build_cmds[i].cmd);
-			}
-			tfree(out.post_build_cmds);
-		}
+			free_custom_commands(out.post_build_cmds, out.post_build_cmd_size);
 	}
 } // namespace lua
\ No newline at end of file
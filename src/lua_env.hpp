@@ -1,5 +1,7 @@
 #pragma once
 
+#include "sym.hpp"
+
 #include <stdint.h>
 
 extern "C"
@@ -9,17 +11,50 @@ extern "C"
 #include <lua/lualib.h>
 }
 
+namespace fset
+{
+	struct set;
+}
+
+namespace glob
+{
+	struct matcher;
+}
+
 namespace lua
 {
 	void    create();
 	void    destroy();
 	int32_t run_file(char const* filename);
 
+	// Waits for the configurations generated by other threads with
+	// --all-configurations. Returns 0 if all of them succeeded.
+	int32_t wait_configurations();
+
 	char*
 	resolve_path_from_script(lua_State* L, char const* path, uint32_t len = UINT32_MAX);
 	char*
 	resolve_path_to_script(lua_State* L, char const* path, uint32_t len = UINT32_MAX);
 
+	// Compiles the glob `patterns` and `excludes` into a single matcher, resolving them
+	// from the running script. Raises an error on invalid patterns.
+	glob::matcher* compile_globs(lua_State*         L,
+	                             char const* const* patterns,
+	                             uint32_t           patterns_size,
+	                             char const* const* excludes,
+	                             uint32_t           excludes_size);
+
+	// Lists the files matched by the glob `patterns` and not by `excludes`, resolved from
+	// the running script. Only directories that can hold matches, and not ignored by an
+	// ignore file, are walked, and tracked as generation inputs. Raises an error on
+	// invalid patterns.
+	char** glob_files(lua_State*         L,
+	                  char const* const* patterns,
+	                  uint32_t           patterns_size,
+	                  char const* const* excludes,
+	                  uint32_t           excludes_size,
+	                  uint32_t*          files_size);
+
 	enum project_type
 	{
 		sources,
@@ -35,40 +70,49 @@ namespace lua
 
 	struct output;
 
+	// Strings of the project model are interned, see sym.hpp
+
 	struct input
 	{
-		char const*  name;
+		sym::id      name;
 		project_type type;
 
-		char const** sources;
-		uint32_t     sources_size;
-		char const** includes;
-		uint32_t     includes_size;
-		char const** compile_options;
-		uint32_t     compile_options_size;
+		sym::id* sources;
+		uint32_t sources_size;
+
+		// File sets given in sources, referenced by the input table while used
+		fset::set const** source_sets;
+		uint32_t          source_sets_size;
 
-		output*  deps;
+		sym::id* excludes;
+		uint32_t excludes_size;
+		sym::id* includes;
+		uint32_t includes_size;
+		sym::id* compile_options;
+		uint32_t compile_options_size;
+
+		output** deps;
 		uint32_t deps_size;
 
-		char const** link_options;
-		uint32_t     link_options_size;
+		sym::id* link_options;
+		uint32_t link_options_size;
 
 		// Specific to prebuilt type
-		char const** static_library_directories;
-		uint32_t     static_library_directories_size;
-		char const** static_libraries;
-		uint32_t     static_libraries_size;
+		sym::id* static_library_directories;
+		uint32_t static_library_directories_size;
+		sym::id* static_libraries;
+		uint32_t static_libraries_size;
 
 		// TODO dynamic_libraries to auto post_build_copy, only for prebuilt_input
 	};
 
 	struct custom_command
 	{
-		char const** in;
-		uint32_t     in_len;
-		char const** out;
-		uint32_t     out_len;
-		char const*  cmd;
+		sym::id* in;
+		uint32_t in_len;
+		sym::id* out;
+		uint32_t out_len;
+		sym::id  cmd;
 	};
 
 	struct output
@@ -76,22 +120,28 @@ namespace lua
 	{
 		struct source
 		{
-			char const* file;
+			sym::id file;
 			// Empty by default, but can be written manually in projects files
-			char const* compile_options;
+			sym::id compile_options;
 		};
 
-		char const*  name;
+		sym::id      name;
 		project_type type;
 
 		source*  sources;
 		uint32_t sources_capacity;
 		uint32_t sources_size;
 
-		char const* compile_options;
-		char const* link_options;
+		sym::id compile_options;
+		sym::id link_options;
+
+		// Include directories given to the compile options, relative to the working
+		// directory or absolute
+		sym::id* include_dirs;
+		uint32_t include_dirs_size;
 
-		output*  deps;
+		// Projects of the registry, see project.hpp
+		output** deps;
 		uint32_t deps_size;
 
 		// TODO dynamic_libraries to auto post_build_copy, only for prebuilt_input
@@ -100,12 +150,30 @@ namespace lua
 		uint32_t        pre_build_cmd_size;
 		custom_command* post_build_cmds;
 		uint32_t        post_build_cmd_size;
+
+		// Object files of the sources, computed at generation
+		char** objs;
+
+		// Projects linked with this one, directly or not, each appearing once and after
+		// all the ones depending on it. Computed at generation
+		output** link_deps;
+		uint32_t link_deps_size;
 	};
 
 	input parse_input(lua_State* L, int32_t idx = -1);
 	void  free_input(input const& in);
 
-	void   dump_output(lua_State* L, output const& out);
+	// Pushes the value of the field `key` of `out`, as written in a project table.
+	// Returns false and pushes nothing if the field is unknown or unset.
+	bool push_output_field(lua_State* L, output const& out, char const* key);
+	// Replaces the field `key` of `out` by the value on top of the stack. Returns false
+	// if the field is unknown.
+	bool parse_output_field(lua_State* L, char const* key, output& out);
+
+	// Parses a project table, as created by earlier versions of mg.project
 	output parse_output(lua_State* L, int32_t idx = -1);
 	void   free_output(output const& out);
+
+	// Parses the command table on top of the stack
+	custom_command parse_custom_command(lua_State* L);
 } // namespace lua
\ No newline at end of file
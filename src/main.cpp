@@ -1,12 +1,19 @@
+#include "alloc.hpp"
+#include "bytecode.hpp"
+#include "fingerprint.hpp"
 #include "fs.hpp"
+#include "git.hpp"
 #include "lua_env.hpp"
+#include "os.hpp"
 #include "project.hpp"
 #include "state.hpp"
 #include "string.hpp"
+#include "sym.hpp"
+#include "task.hpp"
 
 #include <stdio.h>
 
-mingen_state g {};
+thread_local mingen_state g {};
 
 #define ITALIC "\x1b[3m"
 #define DEFAULT "\x1b[0m"
@@ -36,6 +43,18 @@ void help()
 "	--compile-db\n"
 "		Generates a JSON Compilation Database with the ninja file\n"
 "\n"
+"	--subninja\n"
+"		Generates each project in its own build/<project>.ninja file, in parallel, included by build/build.ninja\n"
+"\n"
+"	--check-files\n"
+"		Verifies sources, include directories and command inputs of the generated projects exist, and fails listing the missing ones\n"
+"\n"
+"	--all-configurations\n"
+"		Generates every declared configuration in parallel, each in its own build/<config>/ directory\n"
+"\n"
+"	--mem-stats\n"
+"		Prints the allocation counts and peak memory of the Lua heap and of the generation arenas when done\n"
+"\n"
 "\n"
 "Miscellaneous: \n"
 "\n"
@@ -147,6 +166,22 @@ int main(int argc, char** argv)
 		{
 			g.gen_compile_db = true;
 		}
+		else if (str::starts_with(argv[i], "--subninja"))
+		{
+			g.gen_subninja = true;
+		}
+		else if (str::starts_with(argv[i], "--check-files"))
+		{
+			g.check_files = true;
+		}
+		else if (str::starts_with(argv[i], "--all-configurations"))
+		{
+			g.all_configs = true;
+		}
+		else if (str::starts_with(argv[i], "--mem-stats"))
+		{
+			g.mem_stats = true;
+		}
 		else if (strcmp(argv[i], "cp") == 0)
 		{
 			if (i > argc - 3)
@@ -180,6 +215,14 @@ int main(int argc, char** argv)
 	if (dir)
 		fs::set_cwd(dir);
 
+	// Nothing read by the previous generation changed, its build files are up to date
+	if (fp::is_up_to_date("build/.mingen/fingerprint", file))
+	{
+		if (g.mem_stats)
+			printf("no memory stats: nothing changed since the last generation, skipped\n");
+		return 0;
+	}
+
 	lua::create();
 	if (!fs::file_exists(file))
 	{
@@ -187,8 +230,50 @@ int main(int argc, char** argv)
 		help();
 		return 1;
 	}
+
+	// Directory listings are kept between generations, so globs only read the
+	// directories that changed since
+	fs::load_dir_cache("build/.mingen/dirs");
+	// Scripts are loaded from the bytecode saved by the previous generation, unless
+	// they changed since
+	bc::load_cache("build/.mingen/bc");
+	// Results of the commands run by `os.execute_cached`, reused while their inputs
+	// don't change
+	os::load_cmd_cache("build/.mingen/cmds");
 	int32_t res = lua::run_file(file);
+	res |= lua::wait_configurations();
+	if (fs::dir_exists("build/"))
+	{
+		if (!fs::dir_exists("build/.mingen/"))
+			fs::create_dir("build/.mingen/");
+		fs::save_dir_cache("build/.mingen/dirs");
+		bc::save_cache("build/.mingen/bc");
+		os::save_cmd_cache("build/.mingen/cmds");
+	}
 
 	lua::destroy();
+	// Shared by the configurations, freed once the last one completed
+	task::clear_effects();
+	git::clear();
+	sym::clear();
+
+	// Saved once every configuration added its inputs
+	if (fs::dir_exists("build/.mingen/"))
+		fp::save("build/.mingen/fingerprint", res == 0);
+
+	if (g.mem_stats)
+	{
+		alloc::stats lua_stats = alloc::get_lua_stats();
+		alloc::stats arena_stats = alloc::get_arena_stats();
+		printf("lua heap: %llu allocations, %llu pooled, %llu frees, %llu peak bytes\n",
+		       static_cast<unsigned long long>(lua_stats.allocations),
+		       static_cast<unsigned long long>(lua_stats.pooled),
+		       static_cast<unsigned long long>(lua_stats.frees),
+		       static_cast<unsigned long long>(lua_stats.peak_bytes));
+		printf("arenas: %llu allocations, %llu blocks, %llu peak bytes\n",
+		       static_cast<unsigned long long>(arena_stats.allocations),
+		       static_cast<unsigned long long>(arena_stats.pooled),
+		       static_cast<unsigned long long>(arena_stats.peak_bytes));
+	}
 	return res;
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "map.hpp"
+
+#include "mem.hpp"
+
+#include <string.h>
+
+namespace map
+{
+	namespace
+	{
+		uint32_t find_slot(str_map const& map,
+		                   char const*    key,
+		                   uint32_t       len,
+		                   uint32_t       hash)
+		{
+			uint32_t mask = map.capacity - 1;
+			uint32_t i = hash & mask;
+			while (map.slots[i].key)
+			{
+				if (map.slots[i].hash == hash && map.slots[i].len == len &&
+				    (map.slots[i].key == key || memcmp(map.slots[i].key, key, len) == 0))
+					break;
+				i = (i + 1) & mask;
+			}
+
+			return i;
+		}
+
+		void grow(str_map& map)
+		{
+			str_map::slot* old_slots = map.slots;
+			uint32_t       old_capacity = map.capacity;
+
+			map.capacity = old_capacity ? old_capacity * 2 : 16;
+			map.slots = tmalloc<str_map::slot>(map.capacity);
+			memset(map.slots, 0, sizeof(str_map::slot) * map.capacity);
+
+			for (uint32_t i {0}; i < old_capacity; ++i)
+			{
+				if (!old_slots[i].key)
+					continue;
+
+				uint32_t mask = map.capacity - 1;
+				uint32_t j = old_slots[i].hash & mask;
+				while (map.slots[j].key)
+					j = (j + 1) & mask;
+				map.slots[j] = old_slots[i];
+			}
+
+			if (old_slots)
+				tfree(old_slots);
+		}
+	} // namespace
+
+	uint32_t hash(char const* str, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(str));
+
+		uint32_t res = 2166136261u;
+		for (uint32_t i {0}; i < len; ++i)
+		{
+			res ^= static_cast<uint8_t>(str[i]);
+			res *= 16777619u;
+		}
+
+		return res;
+	}
+
+	uint32_t find(str_map const& map, char const* key, uint32_t len)
+	{
+		if (!map.size)
+			return UINT32_MAX;
+
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(key));
+
+		return find(map, key, len, hash(key, len));
+	}
+
+	uint32_t find(str_map const& map, char const* key, uint32_t len, uint32_t key_hash)
+	{
+		if (!map.size)
+			return UINT32_MAX;
+
+		uint32_t i = find_slot(map, key, len, key_hash);
+		return map.slots[i].key ? map.slots[i].value : UINT32_MAX;
+	}
+
+	uint32_t insert(str_map& map, char const* key, uint32_t value, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(key));
+
+		return insert(map, key, value, len, hash(key, len));
+	}
+
+	uint32_t
+	insert(str_map& map, char const* key, uint32_t value, uint32_t len, uint32_t key_hash)
+	{
+		// Keeps the load factor under 3/4
+		if ((map.size + 1) * 4 > map.capacity * 3)
+			grow(map);
+
+		uint32_t i = find_slot(map, key, len, key_hash);
+		if (map.slots[i].key)
+			return map.slots[i].value;
+
+		map.slots[i] = {key, len, key_hash, value};
+		++map.size;
+		return value;
+	}
+
+	void release(str_map& map)
+	{
+		if (map.slots)
+			tfree(map.slots);
+		map = {};
+	}
+} // namespace map
\ No newline at end of file
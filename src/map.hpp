@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace map
+{
+	/// @brief Hashes a string, using FNV-1a.
+	/// @param str String to hash.
+	/// @param len Length of `str`. If UINT32_MAX, `str` must be '\0' terminated.
+	/// @return uint32_t Hash of the string.
+	uint32_t hash(char const* str, uint32_t len = UINT32_MAX);
+
+	/// @brief Open addressing hash table, associating strings to 32 bits values
+	/// (usually indices in another array). Keys are not copied, and must outlive the
+	/// table.
+	struct str_map
+	{
+		struct slot
+		{
+			char const* key;
+			uint32_t    len;
+			uint32_t    hash;
+			uint32_t    value;
+		};
+
+		slot*    slots {nullptr};
+		uint32_t capacity {0};
+		uint32_t size {0};
+	};
+
+	/// @brief Finds the value associated to `key`.
+	/// @param len Length of `key`. If UINT32_MAX, `key` must be '\0' terminated.
+	/// @return uint32_t Value associated to `key`, or UINT32_MAX if `key` is absent.
+	uint32_t find(str_map const& map, char const* key, uint32_t len = UINT32_MAX);
+
+	/// @brief Finds the value associated to `key`, whose length and hash are already
+	/// known, such as interned strings.
+	uint32_t find(str_map const& map, char const* key, uint32_t len, uint32_t key_hash);
+
+	/// @brief Associates `value` to `key`, if `key` is absent from the table.
+	/// @param len Length of `key`. If UINT32_MAX, `key` must be '\0' terminated.
+	/// @return uint32_t Value associated to `key`: `value` if it was inserted, or the
+	/// value previously associated otherwise.
+	uint32_t
+	insert(str_map& map, char const* key, uint32_t value, uint32_t len = UINT32_MAX);
+
+	/// @brief Associates `value` to `key`, whose length and hash are already known.
+	uint32_t
+	insert(str_map& map, char const* key, uint32_t value, uint32_t len, uint32_t key_hash);
+
+	/// @brief Frees the memory held by `map`, and resets it to an empty table.
+	void release(str_map& map);
+} // namespace map
\ No newline at end of file
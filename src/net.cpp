@@ -1,9 +1,13 @@
 #include "net.hpp"
 
+#include "fingerprint.hpp"
 #include "fs.hpp"
+#include "job.hpp"
 #include "lua_env.hpp"
+#include "map.hpp"
 #include "mem.hpp"
 #include "string.hpp"
+#include "task.hpp"
 
 extern "C"
 {
@@ -32,6 +36,7 @@ extern "C"
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <wchar.h>
 
 namespace net
@@ -40,7 +45,40 @@ namespace net
 	{
 #ifdef _WIN32
 		wchar_t const user_agent[] {L"mingen/1.0 (win-wininet)"};
+#elif defined(__linux__)
+		job::mutex curl_lock;
+		bool       curl_init {false};
+
+		bool init_lock()
+		{
+			job::init(curl_lock);
+			return true;
+		}
+
+		// Initialized before main, as downloads can start from any thread
+		bool lock_init {init_lock()};
+
+		// curl_easy_init initializes curl on its first call, which is not thread safe
+		void init_curl()
+		{
+			job::lock(curl_lock);
+			if (!curl_init)
+				curl_init = curl_global_init(CURL_GLOBAL_DEFAULT) == CURLE_OK;
+			job::unlock(curl_lock);
+		}
+
+		CURL* create_curl()
+		{
+			init_curl();
+			CURL* curl = curl_easy_init();
+			if (!curl)
+				return nullptr;
 
+			curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+			// Error pages are not archives, and would replace the extracted one
+			curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+			return curl;
+		}
 #endif
 
 		struct hash
@@ -139,7 +177,7 @@ namespace net
 #ifdef __linux__
 		struct write_userdata
 		{
-			hash& h;
+			hash* h;
 			FILE* file;
 		};
 
@@ -149,7 +187,7 @@ namespace net
 			if (!nmemb)
 				return 0;
 
-			hash_add(ud->h, static_cast<uint8_t*>(ptr), nmemb);
+			hash_add(*ud->h, static_cast<uint8_t*>(ptr), nmemb);
 			size_t written = fwrite(ptr, 1, nmemb, ud->file);
 
 			return written;
@@ -226,8 +264,7 @@ namespace net
 			if (wcscmp(status, L"200") != 0)
 				return false;
 #elif defined(__linux__)
-			CURL* curl;
-			curl = curl_easy_init();
+			CURL* curl = create_curl();
 			if (!curl)
 				return false;
 
@@ -271,17 +308,20 @@ namespace net
 						break;
 				}
 #elif defined(__linux__)
-				write_userdata ud {h, file};
+				write_userdata ud {&h, file};
 				curl_easy_setopt(curl, CURLOPT_URL, url);
 				curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ud);
 				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
 				// curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
-				curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 
 				CURLcode res = curl_easy_perform(curl);
 				curl_easy_cleanup(curl);
 				if (res != CURLE_OK)
+				{
+					fclose(file);
+					hash_free(h);
 					return false;
+				}
 #endif
 
 				fclose(file);
@@ -310,239 +350,609 @@ namespace net
 
 			return hex_str;
 		}
-	} // namespace
 
-	int32_t download(lua_State* L)
-	{
-		luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
-		luaL_argcheck(L, lua_isstring(L, 2), 2, "'string' expected");
+		char* resolve_dest(lua_State* L, char const* dest)
+		{
+			if (!fs::is_absolute(dest))
+				return lua::resolve_path_from_script(L, dest);
 
-		char const* url = lua_tostring(L, 1);
-		char const* lua_dest = lua_tostring(L, 2);
-		uint32_t    dest_len = strlen(lua_dest);
-		bool        trailing_slash = str::ends_with(lua_dest, "/");
-		char*       dest = nullptr;
+			char* res = tmalloc<char>(strlen(dest) + 1);
+			strcpy(res, dest);
+			return res;
+		}
 
-		if (!fs::is_absolute(lua_dest))
+		// Pushes whether the archive was extracted, as returned by the download functions
+		int32_t push_fetch_res(lua_State* L, fetch_res res, char const* url)
 		{
-			dest = lua::resolve_path_from_script(L, lua_dest, dest_len);
-			dest_len = strlen(dest);
+			if (res == fetch_res::download_failed)
+				luaL_error(L, "Failed to download '%s'", url);
+			if (res == fetch_res::extract_failed)
+				luaL_error(L, "Failed to uncompress archive");
+			lua_pushboolean(L, res == fetch_res::updated);
+			return 1;
 		}
-		else
+
+		// Creates `dest` and its download cache, and returns the path the archive at `url`
+		// is downloaded to
+		char* prepare_dest(char const* url, char const* dest)
 		{
-			dest = tmalloc<char>(dest_len + 1);
-			strncpy(dest, lua_dest, dest_len);
-			dest[dest_len] = '\0';
+			uint32_t dest_len = strlen(dest);
+			bool     trailing_slash = str::ends_with(dest, "/");
+
+			if (!fs::dir_exists(dest))
+			{
+				char*    frag = tmalloc<char>(strlen(dest));
+				uint32_t dest_pos = 0;
+				uint32_t dir_pos = 0;
+				while ((dir_pos = str::find(dest + dest_pos, "/")) != UINT32_MAX)
+				{
+					strncpy(frag, dest, dir_pos + dest_pos);
+					frag[dir_pos + dest_pos] = '\0';
+					if (!fs::dir_exists(frag))
+						fs::create_dir(frag);
+
+					dest_pos += dir_pos + 1;
+				}
+				tfree(frag);
+				fs::create_dir(dest);
+			}
+
+			uint32_t archive_pos = str::rfind(url, "/") + 1;
+			char*    zip_dest = tmalloc<char>(dest_len + !trailing_slash + 10 /*.dl-cache/*/ +
+			                                  strlen(url + archive_pos) + 1);
+			strcpy(zip_dest, dest);
+			if (!trailing_slash)
+				zip_dest[dest_len] = '/';
+
+			strcpy(zip_dest + dest_len + !trailing_slash, ".dl-cache/");
+			if (!fs::dir_exists(zip_dest))
+				fs::create_dir(zip_dest);
+
+			strcpy(zip_dest + dest_len + !trailing_slash + 10, url + archive_pos);
+			return zip_dest;
 		}
 
-		if (!fs::dir_exists(dest))
+		// Extracts the archive downloaded at `zip_dest` in `dest`, unless its hash `h` is
+		// the one of the last archive extracted there, and frees the hash
+		fetch_res extract(char const* dest, char const* zip_dest, hash& h)
 		{
-			char*    frag = tmalloc<char>(strlen(dest));
-			uint32_t dest_pos = 0;
-			uint32_t dir_pos = 0;
-			while ((dir_pos = str::find(dest + dest_pos, "/")) != UINT32_MAX)
+			uint32_t dest_len = strlen(dest);
+			bool     trailing_slash = str::ends_with(dest, "/");
+
+			char* meta_dest =
+				tmalloc<char>(dest_len + !trailing_slash + 14 /*.dl-cache/meta*/ + 1);
+			strcpy(meta_dest, dest);
+			if (!trailing_slash)
+				meta_dest[dest_len] = '/';
+			strcpy(meta_dest + dest_len + !trailing_slash, ".dl-cache/meta");
+			char* checksum_str = bin_to_hex(h.hash, h.hash_size);
+			hash_free(h);
+
+			FILE* meta_file = fopen(meta_dest, "r+");
+			if (meta_file)
+			{
+				char     buf[1024] {'\0'};
+				uint32_t read = fread(buf, 1, 1024, meta_file);
+				if (read == h.hash_size * 2 &&
+				    strncmp(buf, checksum_str, h.hash_size * 2) == 0)
+				{
+					fclose(meta_file);
+					tfree(checksum_str);
+					tfree(meta_dest);
+					return fetch_res::unchanged;
+				}
+				fclose(meta_file);
+			}
+			meta_file = fopen(meta_dest, "w+");
+			if (meta_file)
+			{
+				fwrite(checksum_str, 1, h.hash_size * 2, meta_file);
+				fclose(meta_file);
+			}
+			tfree(checksum_str);
+			tfree(meta_dest);
+
+			fs::list_dirs_res dirs = fs::list_dirs(dest);
+			for (uint32_t i {0}; i < dirs.size; ++i)
+			{
+				if (str::find(dirs.dirs[i], ".dl-cache") == UINT32_MAX)
+				{
+					char* delete_dir = tmalloc<char>(strlen(dirs.dirs[i]) + 2);
+					strcpy(delete_dir, dirs.dirs[i]);
+					strcpy(delete_dir + strlen(dirs.dirs[i]), "/");
+
+					fs::delete_dir(delete_dir);
+					tfree(delete_dir);
+				}
+				tfree(dirs.dirs[i]);
+			}
+			tfree(dirs.dirs);
+
+			fs::list_files_res files = fs::list_files(dest, nullptr);
+			for (uint32_t i {0}; i < files.size; ++i)
+			{
+				fs::delete_file(files.files[i]);
+				tfree(files.files[i]);
+			}
+			tfree(files.files);
+
+			void* zip_handle = mz_zip_create();
+			void* zip_stream = mz_stream_os_create();
+			void* buf_stream = nullptr;
+
+			if (mz_stream_open(zip_stream, zip_dest, MZ_OPEN_MODE_READ) != MZ_OK)
+			{
+				mz_stream_delete(&zip_stream);
+				mz_zip_delete(&zip_handle);
+				return fetch_res::extract_failed;
+			}
+
+			buf_stream = mz_stream_buffered_create();
+			mz_stream_buffered_open(buf_stream, NULL, MZ_OPEN_MODE_READ);
+			mz_stream_set_base(buf_stream, zip_stream);
+
+			int32_t res = mz_zip_open(zip_handle, buf_stream, MZ_OPEN_MODE_READ);
+			if (res != MZ_OK)
+			{
+				mz_stream_buffered_close(buf_stream);
+				mz_stream_buffered_delete(&buf_stream);
+				mz_zip_delete(&zip_handle);
+				return fetch_res::extract_failed;
+			}
+
+			mz_zip_goto_first_entry(zip_handle);
+			mz_zip_file* info;
+			mz_zip_entry_get_info(zip_handle, &info);
+			bool main_dir = false;
+
+			char     main_dir_name[128] {'\0'};
+			uint32_t main_dir_size = 0;
+			if (mz_zip_attrib_is_dir(info->external_fa, info->version_madeby) == MZ_OK)
+			{
+				strcpy(main_dir_name, info->filename);
+				main_dir_size = info->filename_size;
+			}
+			mz_zip_goto_next_entry(zip_handle);
+			mz_zip_entry_get_info(zip_handle, &info);
+			if (str::find(info->filename, main_dir_name) != UINT32_MAX)
+				main_dir = true;
+			mz_zip_goto_first_entry(zip_handle);
+
+			char     buf[4096];
+			int32_t  err = MZ_OK;
+			int32_t  bytes_read = 0;
+			uint32_t local_filename_len = strlen(dest) + !trailing_slash;
+			char*    local_filename = tmalloc<char>(local_filename_len + 1);
+			strcpy(local_filename, dest);
+			if (!trailing_slash)
+			{
+				local_filename[local_filename_len - 1] = '/';
+				local_filename[local_filename_len] = '\0';
+				++dest_len;
+			}
+
+			do
 			{
-				strncpy(frag, dest, dir_pos + dest_pos);
-				frag[dir_pos + dest_pos] = '\0';
-				if (!fs::dir_exists(frag))
-					fs::create_dir(frag);
+				mz_zip_entry_get_info(zip_handle, &info);
+				uint32_t new_len = dest_len;
+				if (main_dir)
+					new_len += info->filename_size - main_dir_size;
+				else
+					new_len += info->filename_size;
+				if (new_len > local_filename_len)
+				{
+					local_filename = trealloc(local_filename, new_len + 1);
+					local_filename_len = new_len;
+				}
 
-				dest_pos += dir_pos + 1;
+				if (main_dir)
+					strcpy(local_filename + dest_len, info->filename + main_dir_size);
+				else
+					strcpy(local_filename + dest_len, info->filename);
+				if (mz_zip_attrib_is_dir(info->external_fa, info->version_madeby) == MZ_OK)
+				{
+					if (!fs::dir_exists(local_filename))
+						fs::create_dir(local_filename);
+				}
+				else
+				{
+					mz_zip_entry_read_open(zip_handle, 0, nullptr);
+					FILE* file = fopen(local_filename, "wb+");
+					if (file)
+					{
+						do
+						{
+							bytes_read = mz_zip_entry_read(zip_handle, buf, sizeof(buf));
+							if (bytes_read < 0)
+								err = bytes_read;
+
+							fwrite(buf, 1, bytes_read, file);
+						}
+						while (err == MZ_OK && bytes_read > 0);
+						fclose(file);
+					}
+					mz_zip_entry_close(zip_handle);
+				}
 			}
-			tfree(frag);
-			fs::create_dir(dest);
+			while (mz_zip_goto_next_entry(zip_handle) == MZ_OK);
+
+			tfree(local_filename);
+			mz_zip_close(zip_handle);
+			mz_zip_delete(&zip_handle);
+			mz_stream_buffered_close(buf_stream);
+			mz_stream_buffered_delete(&buf_stream);
+			return fetch_res::updated;
 		}
 
-		uint32_t archive_pos = str::rfind(url, "/") + 1;
-		char*    zip_dest = tmalloc<char>(dest_len + !trailing_slash + 10 /*.dl-cache/*/ +
-		                                  strlen(url + archive_pos) + 1);
-		strcpy(zip_dest, dest);
-		if (!trailing_slash)
-			zip_dest[dest_len] = '/';
-
-		strcpy(zip_dest + dest_len + !trailing_slash, ".dl-cache/");
-		if (!fs::dir_exists(zip_dest))
-			fs::create_dir(zip_dest);
-
-		strcpy(zip_dest + dest_len + !trailing_slash + 10, url + archive_pos);
-
-		hash h;
-		if (!get_archive(url, zip_dest, h))
-			luaL_error(L, "Failed to download '%s'", url);
-
-		char* meta_dest =
-			tmalloc<char>(dest_len + !trailing_slash + 14 /*.dl-cache/meta*/ + 1);
-		strcpy(meta_dest, dest);
-		if (!trailing_slash)
-			meta_dest[dest_len] = '/';
-		strcpy(meta_dest + dest_len + !trailing_slash, ".dl-cache/meta");
-		char* checksum_str = bin_to_hex(h.hash, h.hash_size);
-		hash_free(h);
-
-		FILE* meta_file = fopen(meta_dest, "r+");
-		if (meta_file)
-		{
-			char     buf[1024] {'\0'};
-			uint32_t read = fread(buf, 1, 1024, meta_file);
-			if (read == h.hash_size * 2 &&
-			    strncmp(buf, checksum_str, h.hash_size * 2) == 0)
+		struct download_task
+		{
+			char*         url;
+			char*         dest;
+			task::effect* e;
+			fetch_res     res;
+		};
+
+		// Finds the effect downloading `url` to `dest`
+		task::effect* find_effect(char const* url, char const* dest)
+		{
+			str::buffer key;
+			str::appendf(key, "fetch\n%s\n%s", url, dest);
+			task::effect* res = task::find_effect(key.data, key.size);
+			str::release(key);
+			return res;
+		}
+
+		// Downloads `url` to `dest`, unless another configuration did it already with
+		// the effect `e`
+		fetch_res fetch_once(task::effect* e, char const* url, char const* dest)
+		{
+			if (!e)
+				return fetch(url, dest);
+
+			fetch_res res = fetch_res::download_failed;
+			if (task::lock_effect(e))
+				memcpy(&res, e->result.data, sizeof(res));
+			else
 			{
-				fclose(meta_file);
-				tfree(checksum_str);
-				tfree(meta_dest);
-				tfree(zip_dest);
-				tfree(dest);
-				lua_pushboolean(L, false);
-				return 1;
+				res = fetch(url, dest);
+				str::append(e->result, reinterpret_cast<char const*>(&res), sizeof(res));
 			}
-			fclose(meta_file);
+			task::unlock_effect(e);
+			return res;
 		}
-		meta_file = fopen(meta_dest, "w+");
-		if (meta_file)
+
+		struct pending_fetch
 		{
-			fwrite(checksum_str, 1, h.hash_size * 2, meta_file);
-			fclose(meta_file);
+			task::effect* e;
+			uint32_t      item;
+			bool          ran;
+		};
+
+		int compare_effects(void const* a, void const* b)
+		{
+			uintptr_t effect_a = reinterpret_cast<uintptr_t>(
+				static_cast<pending_fetch const*>(a)->e);
+			uintptr_t effect_b = reinterpret_cast<uintptr_t>(
+				static_cast<pending_fetch const*>(b)->e);
+			return effect_a < effect_b ? -1 : effect_a > effect_b;
 		}
-		tfree(checksum_str);
 
-		fs::list_dirs_res dirs = fs::list_dirs(dest);
-		for (uint32_t i {0}; i < dirs.size; ++i)
+		// Downloads `items` together, except the ones another configuration already
+		// downloaded
+		void fetch_many_once(fetch_item* items, uint32_t size, uint32_t max_connections)
 		{
-			if (str::find(dirs.dirs[i], ".dl-cache") == UINT32_MAX)
+			pending_fetch* pending = tmalloc<pending_fetch>(size ? size : 1);
+			for (uint32_t i {0}; i < size; ++i)
+				pending[i] = {find_effect(items[i].url, items[i].dest), i, false};
+			if (!size || !pending[0].e)
 			{
-				char* delete_dir = tmalloc<char>(strlen(dirs.dirs[i]) + 2);
-				strcpy(delete_dir, dirs.dirs[i]);
-				strcpy(delete_dir + strlen(dirs.dirs[i]), "/");
+				tfree(pending);
+				fetch_many(items, size, max_connections);
+				return;
+			}
 
-				fs::delete_dir(delete_dir);
-				tfree(delete_dir);
+			// Effects are locked in the same order by every thread, so two configurations
+			// downloading the same items don't wait for each other
+			qsort(pending, size, sizeof(pending_fetch), compare_effects);
+			fetch_item* run = tmalloc<fetch_item>(size);
+			uint32_t    run_size = 0;
+			for (uint32_t i {0}; i < size; ++i)
+			{
+				fetch_item& item = items[pending[i].item];
+				if (task::lock_effect(pending[i].e))
+					memcpy(&item.res, pending[i].e->result.data, sizeof(item.res));
+				else
+				{
+					pending[i].ran = true;
+					run[run_size++] = item;
+				}
 			}
-			tfree(dirs.dirs[i]);
+
+			fetch_many(run, run_size, max_connections);
+
+			// Downloaded items are in the order of `pending`
+			run_size = 0;
+			for (uint32_t i {0}; i < size; ++i)
+			{
+				task::effect* e = pending[i].e;
+				if (pending[i].ran)
+				{
+					fetch_res res = run[run_size++].res;
+					items[pending[i].item].res = res;
+					str::append(e->result, reinterpret_cast<char const*>(&res), sizeof(res));
+				}
+				task::unlock_effect(e);
+			}
+			tfree(run);
+			tfree(pending);
 		}
-		tfree(dirs.dirs);
 
-		fs::list_files_res files = fs::list_files(dest, nullptr);
-		for (uint32_t i {0}; i < files.size; ++i)
+		void run_download(void* data)
 		{
-			fs::delete_file(files.files[i]);
-			tfree(files.files[i]);
+			download_task* t = static_cast<download_task*>(data);
+			t->res = fetch_once(t->e, t->url, t->dest);
 		}
-		tfree(files.files);
 
-		void* zip_handle = mz_zip_create();
-		void* zip_stream = mz_stream_os_create();
-		void* buf_stream = nullptr;
+		int32_t push_download(lua_State* L, void* data)
+		{
+			download_task* t = static_cast<download_task*>(data);
+			return push_fetch_res(L, t->res, t->url);
+		}
 
-		if (mz_stream_open(zip_stream, zip_dest, MZ_OPEN_MODE_READ) != MZ_OK)
+		void release_download(void* data)
 		{
-			tfree(zip_dest);
-			tfree(dest);
-			mz_stream_delete(&zip_stream);
-			luaL_error(L, "Failed to uncompress archive");
-			return 0;
+			download_task* t = static_cast<download_task*>(data);
+			tfree(t->url);
+			tfree(t->dest);
+			tfree(t);
 		}
 
-		buf_stream = mz_stream_buffered_create();
-		mz_stream_buffered_open(buf_stream, NULL, MZ_OPEN_MODE_READ);
-		mz_stream_set_base(buf_stream, zip_stream);
+#ifdef _WIN32
+		void run_fetch(void* data)
+		{
+			fetch_item* item = static_cast<fetch_item*>(data);
+			item->res = fetch(item->url, item->dest);
+		}
+#elif defined(__linux__)
+		struct transfer
+		{
+			char*          zip_dest;
+			CURL*          curl;
+			hash           h;
+			write_userdata ud;
+			bool           done;
+		};
 
-		int32_t res = mz_zip_open(zip_handle, buf_stream, MZ_OPEN_MODE_READ);
-		if (res != MZ_OK)
+		// Starts the transfer of `item` on `multi`, unless its archive can't be written
+		bool add_transfer(CURLM* multi, fetch_item const& item, transfer& t)
 		{
-			tfree(zip_dest);
-			tfree(dest);
-			mz_stream_buffered_close(buf_stream);
-			mz_stream_buffered_delete(&buf_stream);
-			luaL_error(L, "Failed to uncompress archive");
-			return 0;
+			t.zip_dest = prepare_dest(item.url, item.dest);
+			t.curl = create_curl();
+			FILE* file = t.curl ? fopen(t.zip_dest, "wb+") : nullptr;
+			if (!file)
+			{
+				if (t.curl)
+					curl_easy_cleanup(t.curl);
+				t.curl = nullptr;
+				return false;
+			}
+
+			hash_init(t.h);
+			t.ud = {&t.h, file};
+			curl_easy_setopt(t.curl, CURLOPT_URL, item.url);
+			curl_easy_setopt(t.curl, CURLOPT_WRITEDATA, &t.ud);
+			curl_easy_setopt(t.curl, CURLOPT_WRITEFUNCTION, write_data);
+			curl_easy_setopt(t.curl, CURLOPT_PRIVATE, &t);
+			// Transfers to the same host share a single HTTP/2 connection when the server
+			// supports it, instead of opening one each. Only TLS connections can tell it,
+			// and waiting for plain ones would run the transfers one after the other.
+			curl_easy_setopt(t.curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+			if (strncmp(item.url, "https://", 8) == 0)
+				curl_easy_setopt(t.curl, CURLOPT_PIPEWAIT, 1L);
+			curl_multi_add_handle(multi, t.curl);
+			return true;
 		}
+#endif
+	} // namespace
+
+	fetch_res fetch(char const* url, char const* dest)
+	{
+		char*     zip_dest = prepare_dest(url, dest);
+		fetch_res res = fetch_res::download_failed;
+		hash      h;
+		if (get_archive(url, zip_dest, h))
+			res = extract(dest, zip_dest, h);
+		tfree(zip_dest);
+		return res;
+	}
 
-		mz_zip_goto_first_entry(zip_handle);
-		mz_zip_file* info;
-		mz_zip_entry_get_info(zip_handle, &info);
-		bool main_dir = false;
+	void fetch_many(fetch_item* items, uint32_t size, uint32_t max_connections)
+	{
+		for (uint32_t i {0}; i < size; ++i)
+			items[i].res = fetch_res::download_failed;
+		if (!size)
+			return;
 
-		char     main_dir_name[128] {'\0'};
-		uint32_t main_dir_size = 0;
-		if (mz_zip_attrib_is_dir(info->external_fa, info->version_madeby) == MZ_OK)
+#ifdef _WIN32
+		// WinINet has no multiplexing interface, so downloads run on their own thread
+		job::pool* pool = job::create_pool(size < max_connections ? size : max_connections);
+		for (uint32_t i {0}; i < size; ++i)
+			job::submit(pool, run_fetch, items + i);
+		job::destroy_pool(pool);
+#elif defined(__linux__)
+		init_curl();
+		CURLM* multi = curl_multi_init();
+		if (!multi)
+			return;
+
+		curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+		                  static_cast<long>(max_connections));
+		curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+		// Transfers over the connection limit are queued by curl
+		transfer* transfers = tmalloc<transfer>(size);
+		for (uint32_t i {0}; i < size; ++i)
 		{
-			strcpy(main_dir_name, info->filename);
-			main_dir_size = info->filename_size;
-		}
-		mz_zip_goto_next_entry(zip_handle);
-		mz_zip_entry_get_info(zip_handle, &info);
-		if (str::find(info->filename, main_dir_name) != UINT32_MAX)
-			main_dir = true;
-		mz_zip_goto_first_entry(zip_handle);
-
-		char     buf[4096];
-		int32_t  err = MZ_OK;
-		int32_t  bytes_read = 0;
-		uint32_t local_filename_len = strlen(dest) + !trailing_slash;
-		char*    local_filename = tmalloc<char>(local_filename_len + 1);
-		strcpy(local_filename, dest);
-		if (!trailing_slash)
-		{
-			local_filename[local_filename_len - 1] = '/';
-			local_filename[local_filename_len] = '\0';
-			++dest_len;
+			transfers[i] = {};
+			add_transfer(multi, items[i], transfers[i]);
 		}
 
+		int32_t running = 0;
 		do
 		{
-			mz_zip_entry_get_info(zip_handle, &info);
-			uint32_t new_len = dest_len;
-			if (main_dir)
-				new_len += info->filename_size - main_dir_size;
-			else
-				new_len += info->filename_size;
-			if (new_len > local_filename_len)
-			{
-				local_filename = trealloc(local_filename, new_len + 1);
-				local_filename_len = new_len;
-			}
+			if (curl_multi_perform(multi, &running) != CURLM_OK)
+				break;
 
-			if (main_dir)
-				strcpy(local_filename + dest_len, info->filename + main_dir_size);
-			else
-				strcpy(local_filename + dest_len, info->filename);
-			if (mz_zip_attrib_is_dir(info->external_fa, info->version_madeby) == MZ_OK)
+			int32_t  left = 0;
+			CURLMsg* msg = nullptr;
+			while ((msg = curl_multi_info_read(multi, &left)))
 			{
-				if (!fs::dir_exists(local_filename))
-					fs::create_dir(local_filename);
+				if (msg->msg != CURLMSG_DONE)
+					continue;
+
+				char* t = nullptr;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &t);
+				reinterpret_cast<transfer*>(t)->done = msg->data.result == CURLE_OK;
 			}
-			else
+
+			if (running && curl_multi_poll(multi, nullptr, 0, 1000, nullptr) != CURLM_OK)
+				break;
+		}
+		while (running);
+
+		// Archives are extracted once every download completed, as extracting blocks
+		// the transfers
+		for (uint32_t i {0}; i < size; ++i)
+		{
+			transfer& t = transfers[i];
+			if (t.curl)
 			{
-				mz_zip_entry_read_open(zip_handle, 0, nullptr);
-				FILE* file = fopen(local_filename, "wb+");
-				if (file)
+				curl_multi_remove_handle(multi, t.curl);
+				curl_easy_cleanup(t.curl);
+				fclose(t.ud.file);
+				if (t.done)
 				{
-					do
-					{
-						bytes_read = mz_zip_entry_read(zip_handle, buf, sizeof(buf));
-						if (bytes_read < 0)
-							err = bytes_read;
-
-						fwrite(buf, 1, bytes_read, file);
-					}
-					while (err == MZ_OK && bytes_read > 0);
-					fclose(file);
+					hash_complete(t.h);
+					items[i].res = extract(items[i].dest, t.zip_dest, t.h);
 				}
-				mz_zip_entry_close(zip_handle);
+				else
+					hash_free(t.h);
 			}
+			tfree(t.zip_dest);
 		}
-		while (mz_zip_goto_next_entry(zip_handle) == MZ_OK);
+		tfree(transfers);
+		curl_multi_cleanup(multi);
+#endif
+	}
 
-		tfree(local_filename);
-		mz_zip_close(zip_handle);
-		mz_zip_delete(&zip_handle);
-		mz_stream_buffered_close(buf_stream);
-		mz_stream_buffered_delete(&buf_stream);
-		tfree(zip_dest);
+	int32_t download(lua_State* L)
+	{
+		luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
+		luaL_argcheck(L, lua_isstring(L, 2), 2, "'string' expected");
+
+		// The archive is fetched again every time, to check if it changed remotely
+		fp::invalidate();
+
+		char const* url = lua_tostring(L, 1);
+		char*       dest = resolve_dest(L, lua_tostring(L, 2));
+		fetch_res   res = fetch_once(find_effect(url, dest), url, dest);
 		tfree(dest);
+		return push_fetch_res(L, res, url);
+	}
+
+	int32_t download_async(lua_State* L)
+	{
+		luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
+		luaL_argcheck(L, lua_isstring(L, 2), 2, "'string' expected");
 
-		lua_pushboolean(L, true);
+		fp::invalidate();
+
+		// The url string may be collected while the task runs
+		char const*    url = lua_tostring(L, 1);
+		download_task* t = tmalloc<download_task>();
+		*t = {tmalloc<char>(strlen(url) + 1), resolve_dest(L, lua_tostring(L, 2)), nullptr,
+		      fetch_res::download_failed};
+		strcpy(t->url, url);
+		// Found by the script thread, as effects are counted per configuration
+		t->e = find_effect(t->url, t->dest);
+
+		task::start(L, {run_download, push_download, release_download}, t);
+		return 1;
+	}
+
+	int32_t download_many(lua_State* L)
+	{
+		luaL_argcheck(L, lua_istable(L, 1), 1, "'array' expected");
+		lua_Integer max_connections = luaL_optinteger(L, 2, 8);
+		luaL_argcheck(L, max_connections > 0 && max_connections <= UINT32_MAX, 2,
+		              "positive connection count expected");
+
+		uint32_t size = lua_rawlen(L, 1);
+		for (uint32_t i {0}; i < size; ++i)
+		{
+			lua_rawgeti(L, 1, i + 1);
+			bool valid = lua_istable(L, -1) && lua_rawgeti(L, -1, 1) == LUA_TSTRING &&
+			             lua_rawgeti(L, -2, 2) == LUA_TSTRING;
+			if (!valid)
+				luaL_error(L, "download_many: '{url, dest}' expected at index %d", i + 1);
+			lua_pop(L, 3);
+		}
+
+		fp::invalidate();
+
+		// Urls are kept alive by the array
+		fetch_item* items = tmalloc<fetch_item>(size ? size : 1);
+		for (uint32_t i {0}; i < size; ++i)
+		{
+			lua_rawgeti(L, 1, i + 1);
+			lua_rawgeti(L, -1, 1);
+			lua_rawgeti(L, -2, 2);
+			items[i] = {lua_tostring(L, -2), resolve_dest(L, lua_tostring(L, -1)),
+			            fetch_res::download_failed};
+			lua_pop(L, 3);
+		}
+
+		// Each destination is extracted to once, "dir" and "dir/" being the same one
+		map::str_map dests;
+		uint32_t     duplicate = UINT32_MAX;
+		for (uint32_t i {0}; i < size && duplicate == UINT32_MAX; ++i)
+		{
+			uint32_t len = strlen(items[i].dest);
+			if (len > 1 && items[i].dest[len - 1] == '/')
+				--len;
+			if (map::insert(dests, items[i].dest, i, len) != i)
+				duplicate = i;
+		}
+		map::release(dests);
+		if (duplicate != UINT32_MAX)
+		{
+			lua_pushstring(L, items[duplicate].dest);
+			for (uint32_t i {0}; i < size; ++i)
+				tfree(items[i].dest);
+			tfree(items);
+			luaL_error(L, "download_many: destination '%s' given twice at index %d",
+			           lua_tostring(L, -1), duplicate + 1);
+		}
+
+		fetch_many_once(items, size, static_cast<uint32_t>(max_connections));
+
+		// Failures are raised once every download completed, so none is left half done
+		uint32_t failed = UINT32_MAX;
+		lua_createtable(L, size, 0);
+		for (uint32_t i {0}; i < size; ++i)
+		{
+			tfree(items[i].dest);
+			bool updated = items[i].res == fetch_res::updated;
+			if (failed == UINT32_MAX && !updated && items[i].res != fetch_res::unchanged)
+				failed = i;
+			lua_pushboolean(L, updated);
+			lua_rawseti(L, -2, i + 1);
+		}
+		fetch_item failed_item = failed != UINT32_MAX ? items[failed] : fetch_item {};
+		tfree(items);
 
+		if (failed != UINT32_MAX)
+			push_fetch_res(L, failed_item.res, failed_item.url);
 		return 1;
 	}
 } // namespace net
\ No newline at end of file
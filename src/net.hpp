@@ -6,5 +6,46 @@ struct lua_State;
 
 namespace net
 {
+	enum class fetch_res : uint8_t
+	{
+		updated,   // Archive downloaded and extracted
+		unchanged, // Archive identical to the one extracted by the last download
+		download_failed,
+		extract_failed,
+	};
+
+	/// @brief Downloads the zip archive at `url`, and extracts it in `dest`, replacing
+	/// its content, unless the archive is identical to the last one extracted there.
+	/// Can be called from multiple threads, with distinct destinations.
+	/// @param dest Destination directory, relative to the working directory or absolute.
+	/// Created if needed.
+	fetch_res fetch(char const* url, char const* dest);
+
+	struct fetch_item
+	{
+		char const* url;
+		char const* dest;
+		fetch_res   res;
+	};
+
+	/// @brief Fetches every item like `fetch`, downloading the archives in parallel
+	/// before extracting them. On Linux, downloads share a single thread with the curl
+	/// multi interface, and the ones to the same host share a connection with HTTP/2
+	/// when the server supports it. On Windows, each download runs on its own thread.
+	/// Destinations must differ.
+	/// @param max_connections Maximum count of downloads running at once, the other ones
+	/// waiting for one to complete.
+	void fetch_many(fetch_item* items, uint32_t size, uint32_t max_connections);
+
 	int32_t download(lua_State* L);
+
+	/// @brief `net.download_async(url, dest)`: starts the download as a task, and returns
+	/// its handle, the result of `net.download` once waited.
+	int32_t download_async(lua_State* L);
+
+	/// @brief `net.download_many(downloads [, max_connections])`: downloads an array of
+	/// `{url, dest}` at once, with `fetch_many`, and returns an array of the results of
+	/// `net.download`, in the same order. Raises an error before downloading when two
+	/// destinations are the same.
+	int32_t download_many(lua_State* L);
 }
\ No newline at end of file
@@ -9,53 +9,41 @@ extern "C"
 #include <lua/lualib.h>
 }
 
+#include <stdlib.h>
+#include <string.h>
+
 #ifdef _WIN32
 #include <win32/io.h>
 #include <win32/process.h>
 #include <win32/threads.h>
 #elif defined(__linux__)
-#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
 
+#include "fingerprint.hpp"
 #include "fs.hpp"
+#include "job.hpp"
 #include "lua_env.hpp"
+#include "map.hpp"
 #include "mem.hpp"
 #include "string.hpp"
+#include "task.hpp"
+#include "track.hpp"
 
 namespace os
 {
-	int execute(lua_State* L)
-	{
-		int top = lua_gettop(L);
-		luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
-		if (top == 2)
-			luaL_argcheck(L, lua_isstring(L, 2), 2, "'string' expected");
 #ifdef _WIN32
-		wchar_t* wworking_dir = nullptr;
-		wchar_t* wcmd = nullptr;
-
-		if (top == 2)
-		{
-			char const* working_dir = lua_tostring(L, 1);
-			uint32_t    working_dir_size = strlen(working_dir);
-			if (!fs::is_absolute(working_dir))
-			{
-				char* new_working_dir =
-					lua::resolve_path_from_script(L, working_dir, working_dir_size);
-
-				wworking_dir = char_to_wchar(new_working_dir);
-				tfree(new_working_dir);
-			}
-			else
-				wworking_dir = char_to_wchar(working_dir);
-
-			wcmd = char_to_wchar(lua_tostring(L, 2));
-		}
-		else
-			wcmd = char_to_wchar(lua_tostring(L, 1));
+	void run(char const* cmd, char const* working_dir, process_res& res)
+	{
+		res = {-1, {}, {}};
+		wchar_t* wworking_dir = working_dir ? char_to_wchar(working_dir) : nullptr;
+		wchar_t* wcmd = char_to_wchar(cmd);
 
 		DWORD        return_code = UINT32_MAX;
 		STARTUPINFOW info;
@@ -68,136 +56,764 @@ namespace os
 			CloseHandle(handles.hThread);
 			WaitForSingleObject(handles.hProcess, INFINITE);
 			GetExitCodeProcess(handles.hProcess, &return_code);
+			CloseHandle(handles.hProcess);
 		}
 
-		tfree(wworking_dir);
+		if (wworking_dir)
+			tfree(wworking_dir);
 		tfree(wcmd);
-
-		lua_pushinteger(L, return_code);
+		res.code = return_code;
+	}
 #elif defined(__linux__)
-		char*       working_dir = nullptr;
-		char const* cmd = nullptr;
+	namespace
+	{
+		// Pipes hold 64KB by default, read at once when full
+		constexpr uint32_t read_size {64 * 1024};
 
-		if (top == 2)
+		void close_pipe(int fds[2])
 		{
-			char const* lua_working_dir = lua_tostring(L, 1);
-			uint32_t    working_dir_size = strlen(lua_working_dir);
-			if (!fs::is_absolute(lua_working_dir))
+			close(fds[0]);
+			close(fds[1]);
+		}
+	} // namespace
+
+	void run(char const* cmd, char const* working_dir, process_res& res)
+	{
+		res = {-1, {}, {}};
+
+		// Closed on exec, so commands spawned meanwhile by other threads don't keep the
+		// write ends open, which would delay the end of the outputs
+		int out_fd[2];
+		int err_fd[2];
+		if (pipe2(out_fd, O_CLOEXEC) != 0)
+			return;
+		if (pipe2(err_fd, O_CLOEXEC) != 0)
+		{
+			close_pipe(out_fd);
+			return;
+		}
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, out_fd[1], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, err_fd[1], STDERR_FILENO);
+		if (working_dir)
+			posix_spawn_file_actions_addchdir_np(&actions, working_dir);
+
+		// Unlike fork, the pages of the Lua heap are neither copied nor remapped: the
+		// child borrows the memory of the process until it executes the shell
+		char const* argv[] {"sh", "-c", cmd, nullptr};
+		pid_t       pid = 0;
+		int         spawned = posix_spawn(&pid, "/bin/sh", &actions, nullptr,
+		                                  const_cast<char* const*>(argv), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		close(out_fd[1]);
+		close(err_fd[1]);
+		if (spawned != 0)
+		{
+			close(out_fd[0]);
+			close(err_fd[0]);
+			return;
+		}
+
+		// Both outputs are read as they come, so the command never blocks on a full pipe
+		pollfd       fds[2] {{out_fd[0], POLLIN, 0}, {err_fd[0], POLLIN, 0}};
+		str::buffer* bufs[2] {&res.out, &res.err};
+		uint32_t     open_fds = 2;
+		while (open_fds)
+		{
+			if (poll(fds, 2, -1) < 0)
 			{
-				char* new_working_dir =
-					lua::resolve_path_from_script(L, lua_working_dir, working_dir_size);
+				if (errno == EINTR)
+					continue;
+				break;
+			}
 
-				working_dir = new_working_dir;
+			for (uint32_t i {0}; i < 2; ++i)
+			{
+				if (fds[i].fd < 0 || !fds[i].revents)
+					continue;
+
+				str::buffer& buf = *bufs[i];
+				str::reserve(buf, read_size);
+				ssize_t len = read(fds[i].fd, buf.data + buf.size, read_size);
+				if (len > 0)
+				{
+					buf.size += len;
+					buf.data[buf.size] = '\0';
+				}
+				else if (len == 0 || errno != EINTR)
+				{
+					// Ignored by poll from now on
+					close(fds[i].fd);
+					fds[i].fd = -1;
+					--open_fds;
+				}
 			}
+		}
+		for (uint32_t i {0}; i < 2; ++i)
+			if (fds[i].fd >= 0)
+				close(fds[i].fd);
+
+		int status = 0;
+		while (waitpid(pid, &status, 0) < 0)
+		{
+			if (errno != EINTR)
+				return;
+		}
+		if (WIFEXITED(status))
+			res.code = WEXITSTATUS(status);
+	}
+#else
+#error "Unsupported platform"
+#endif
+
+	void release(process_res& res)
+	{
+		str::release(res.out);
+		str::release(res.err);
+	}
+
+	namespace
+	{
+		// Reads the `top` first arguments of the functions running commands: an optional
+		// working directory, resolved from the running script, and the command
+		char const* check_cmd(lua_State* L, int top, char*& working_dir)
+		{
+			luaL_argcheck(L, lua_isstring(L, 1), 1, "'string' expected");
+			if (top == 2)
+				luaL_argcheck(L, lua_isstring(L, 2), 2, "'string' expected");
+
+			working_dir = nullptr;
+			if (top != 2)
+				return lua_tostring(L, 1);
+
+			char const* lua_working_dir = lua_tostring(L, 1);
+			if (!fs::is_absolute(lua_working_dir))
+				working_dir = lua::resolve_path_from_script(L, lua_working_dir);
 			else
 			{
-				working_dir = tmalloc<char>(working_dir_size + 1);
+				working_dir = tmalloc<char>(strlen(lua_working_dir) + 1);
 				strcpy(working_dir, lua_working_dir);
 			}
+			return lua_tostring(L, 2);
+		}
+
+		void push_res(lua_State* L, process_res const& res)
+		{
+#ifdef _WIN32
+			lua_pushinteger(L, static_cast<DWORD>(res.code));
+#elif defined(__linux__)
+			lua_newtable(L);
+			lua_pushinteger(L, res.code);
+			lua_setfield(L, -2, "code");
 
-			cmd = lua_tostring(L, 2);
+			// Outputs may hold any byte, '\0' included
+			if (res.out.size)
+			{
+				lua_pushlstring(L, res.out.data, res.out.size);
+				lua_setfield(L, -2, "stdout");
+			}
+			if (res.err.size)
+			{
+				lua_pushlstring(L, res.err.data, res.err.size);
+				lua_setfield(L, -2, "stderr");
+			}
+#endif
 		}
-		else
-			cmd = lua_tostring(L, 1);
 
-		int stdout_fd[2];
-		int stderr_fd[2];
-		pipe(stdout_fd);
-		pipe(stderr_fd);
-		pid_t pid;
+		// Finds the effect running `cmd` in `working_dir`
+		task::effect* find_effect(char const* cmd, char const* working_dir)
+		{
+			str::buffer key;
+			str::appendf(key, "cmd\n%s\n%s", working_dir ? working_dir : "", cmd);
+			task::effect* res = task::find_effect(key.data, key.size);
+			str::release(key);
+			return res;
+		}
 
-		pid = fork();
-		switch (pid)
+		// Runs `cmd`, unless another configuration did it already with the effect `e`.
+		// Results are stored as the exit code, the size of the output, then both outputs.
+		void run_once(task::effect* e, char const* cmd, char const* working_dir,
+		              process_res& res)
 		{
-			case -1:
+			if (!e)
 			{
-				close(stdout_fd[0]);
-				close(stdout_fd[1]);
-				close(stderr_fd[0]);
-				close(stderr_fd[1]);
+				run(cmd, working_dir, res);
+				return;
+			}
 
-				lua_pushinteger(L, -1);
-				break;
+			if (task::lock_effect(e))
+			{
+				char const* data = e->result.data;
+				uint32_t    out_size = 0;
+				res = {-1, {}, {}};
+				memcpy(&res.code, data, sizeof(res.code));
+				memcpy(&out_size, data + sizeof(res.code), sizeof(out_size));
+				data += sizeof(res.code) + sizeof(out_size);
+				uint32_t err_size = e->result.size - (data - e->result.data) - out_size;
+				if (out_size)
+					str::append(res.out, data, out_size);
+				if (err_size)
+					str::append(res.err, data + out_size, err_size);
+			}
+			else
+			{
+				run(cmd, working_dir, res);
+				str::append(e->result, reinterpret_cast<char const*>(&res.code),
+				            sizeof(res.code));
+				str::append(e->result, reinterpret_cast<char const*>(&res.out.size),
+				            sizeof(res.out.size));
+				if (res.out.size)
+					str::append(e->result, res.out.data, res.out.size);
+				if (res.err.size)
+					str::append(e->result, res.err.data, res.err.size);
 			}
+			task::unlock_effect(e);
+		}
+
+		struct spawn_task
+		{
+			char*         cmd;
+			char*         working_dir;
+			task::effect* e;
+			process_res   res;
+		};
+
+		void run_spawn(void* data)
+		{
+			spawn_task* t = static_cast<spawn_task*>(data);
+			run_once(t->e, t->cmd, t->working_dir, t->res);
+		}
+
+		int32_t push_spawn(lua_State* L, void* data)
+		{
+			push_res(L, static_cast<spawn_task*>(data)->res);
+			return 1;
+		}
+
+		void release_spawn(void* data)
+		{
+			spawn_task* t = static_cast<spawn_task*>(data);
+			tfree(t->cmd);
+			if (t->working_dir)
+				tfree(t->working_dir);
+			release(t->res);
+			tfree(t);
+		}
+	} // namespace
+
+	int execute(lua_State* L)
+	{
+		char*       working_dir = nullptr;
+		char const* cmd = check_cmd(L, lua_gettop(L), working_dir);
+
+		// What a command reads or writes is unknown, so the scripts run it every time
+		fp::invalidate();
 
-			case 0:
+		process_res res;
+		run_once(find_effect(cmd, working_dir), cmd, working_dir, res);
+		if (working_dir)
+			tfree(working_dir);
+
+		push_res(L, res);
+		release(res);
+		return 1;
+	}
+
+	int spawn(lua_State* L)
+	{
+		char*       working_dir = nullptr;
+		char const* cmd = check_cmd(L, lua_gettop(L), working_dir);
+		fp::invalidate();
+
+		// The command string may be collected while the task runs
+		spawn_task* t = tmalloc<spawn_task>();
+		*t = {tmalloc<char>(strlen(cmd) + 1), working_dir, nullptr, {}};
+		strcpy(t->cmd, cmd);
+		// Found by the script thread, as effects are counted per configuration
+		t->e = find_effect(cmd, working_dir);
+
+		task::start(L, {run_spawn, push_spawn, release_spawn}, t);
+		return 1;
+	}
+
+	namespace
+	{
+		// Results of the commands run by `os.execute_cached` in the previous generations,
+		// keyed by command and working directory, and valid as long as their
+		// dependencies are the same
+		struct cmd_cache
+		{
+			struct cmd
 			{
-				close(stdout_fd[0]);
-				close(stderr_fd[0]);
+				char const* key;
+				uint32_t    key_size;
+				// Dependencies as serialized by `add_file_dep` and `add_env_dep`, compared
+				// as a whole
+				char const* deps;
+				uint32_t    deps_size;
+				int32_t     code;
+				char const* out;
+				uint32_t    out_size;
+				char const* err;
+				uint32_t    err_size;
+				// Allocated this run as a single block starting at `key`, instead of
+				// pointing in `file`
+				bool owned;
+				// Run or reused this run, and saved back
+				bool used;
+			};
+
+			bool       enabled {false};
+			job::mutex lock;
+
+			char const* file {nullptr};
+			uint64_t    file_size {0};
+
+			cmd*         cmds {nullptr};
+			uint32_t     cmds_size {0};
+			uint32_t     cmds_capacity {0};
+			map::str_map keys;
+
+			// Blocks of replaced commands, whose key is still used by the table, freed
+			// when the cache is saved
+			char const** stale {nullptr};
+			uint32_t     stale_size {0};
+			uint32_t     stale_capacity {0};
+		};
+
+		cmd_cache cache;
+
+		constexpr char     cache_magic[4] {'m', 'g', 'c', 'c'};
+		constexpr uint32_t cache_version = 1;
+
+		enum dep_kind : uint8_t
+		{
+			file_dep,
+			env_dep,
+		};
 
-				dup2(stdout_fd[1], 1);
-				dup2(stderr_fd[1], 2);
+		void append_u32(str::buffer& buf, uint32_t value)
+		{
+			str::append(buf, reinterpret_cast<char const*>(&value), sizeof(value));
+		}
 
-				close(stdout_fd[1]);
-				close(stderr_fd[1]);
+		void append_u64(str::buffer& buf, uint64_t value)
+		{
+			str::append(buf, reinterpret_cast<char const*>(&value), sizeof(value));
+		}
 
-				chdir(working_dir);
-				execl("/bin/sh", "sh", "-c", cmd, nullptr);
-				break;
-			}
+		bool read_u32(char const* data, uint64_t size, uint64_t& pos, uint32_t& value)
+		{
+			if (size - pos < sizeof(value))
+				return false;
+			memcpy(&value, data + pos, sizeof(value));
+			pos += sizeof(value);
+			return true;
+		}
+
+		// Reads a string prefixed by its size
+		bool read_str(char const*  data,
+		              uint64_t     size,
+		              uint64_t&    pos,
+		              char const*& str,
+		              uint32_t&    len)
+		{
+			if (!read_u32(data, size, pos, len) || size - pos < len)
+				return false;
+			str = data + pos;
+			pos += len;
+			return true;
 		}
-		tfree(working_dir);
 
-		int status;
-		waitpid(pid, &status, 0);
+		// Sets `recent` if the file changed too recently to be told apart from a change
+		// made while the command runs
+		void add_file_dep(str::buffer& deps, char const* path, bool& recent)
+		{
+			fs::stamp s = fs::get_stamp(path);
+			if (s.type != fs::entry_type::none && fs::is_recent(s))
+				recent = true;
+
+			char kind = file_dep;
+			str::append(deps, &kind, 1);
+			append_u32(deps, strlen(path));
+			str::append(deps, path);
+			char type = static_cast<char>(s.type);
+			str::append(deps, &type, 1);
+			append_u64(deps, s.id);
+			append_u64(deps, s.time);
+			append_u64(deps, s.size);
+		}
 
-		lua_newtable(L);
-		if (WIFEXITED(status))
-			lua_pushinteger(L, WEXITSTATUS(status));
-		else
-			lua_pushinteger(L, -1);
+		void add_env_dep(str::buffer& deps, char const* name)
+		{
+			char const* value = getenv(name);
+			char        kind = env_dep;
+			str::append(deps, &kind, 1);
+			append_u32(deps, strlen(name));
+			str::append(deps, name);
+			char set = value != nullptr;
+			str::append(deps, &set, 1);
+			append_u32(deps, value ? strlen(value) : 0);
+			if (value)
+				str::append(deps, value);
+		}
 
-		lua_setfield(L, -2, "code");
+		// Finds the binary run by `cmd`, its first word, from the working directory if
+		// it is a path, or in the directories of PATH otherwise
+		bool find_tool(char const* cmd, char const* working_dir, str::buffer& path)
+		{
+			while (*cmd == ' ' || *cmd == '\t')
+				++cmd;
+			char quote = *cmd == '"' || *cmd == '\'' ? *cmd++ : '\0';
+			uint32_t len = 0;
+			while (cmd[len] &&
+			       (quote ? cmd[len] != quote : cmd[len] != ' ' && cmd[len] != '\t'))
+				++len;
+			if (!len)
+				return false;
+
+			str::buffer name;
+			str::append(name, cmd, len);
+			if (strpbrk(name.data, "/\\"))
+			{
+				if (working_dir && !fs::is_absolute(name.data))
+					str::appendf(path, "%s/", working_dir);
+				str::append(path, name.data, name.size);
+				str::release(name);
+				return fs::get_stamp(path.data).type == fs::entry_type::file;
+			}
 
-		close(stdout_fd[1]);
-		close(stderr_fd[1]);
+#ifdef _WIN32
+			constexpr char separator {';'};
+#elif defined(__linux__)
+			constexpr char separator {':'};
+#endif
+			bool        found = false;
+			char const* dirs = getenv("PATH");
+			while (!found && dirs && *dirs)
+			{
+				uint32_t dir_len = 0;
+				while (dirs[dir_len] && dirs[dir_len] != separator)
+					++dir_len;
+
+				path.size = 0;
+				if (dir_len)
+					str::append(path, dirs, dir_len);
+				else
+					str::append(path, ".", 1);
+				str::append(path, "/", 1);
+				str::append(path, name.data, name.size);
+				found = fs::get_stamp(path.data).type == fs::entry_type::file;
+#ifdef _WIN32
+				if (!found)
+				{
+					str::append(path, ".exe", 4);
+					found = fs::get_stamp(path.data).type == fs::entry_type::file;
+				}
+#endif
+				dirs += dir_len + (dirs[dir_len] ? 1 : 0);
+			}
+			str::release(name);
+			return found;
+		}
 
-		char     tmp_buf[512] {'\0'};
-		uint32_t written {0};
+		// Adds or replaces the results of `key`. Owned commands were run this run, and are
+		// freed by the cache, while the other ones point in the mapped file.
+		void cache_cmd(cmd_cache::cmd const& c)
+		{
+			uint32_t i = map::find(cache.keys, c.key, c.key_size);
+			if (i != UINT32_MAX)
+			{
+				// The table keeps the key of the replaced command, equal to the new one
+				cmd_cache::cmd& old = cache.cmds[i];
+				if (old.owned)
+				{
+					if (cache.stale_size == cache.stale_capacity)
+					{
+						cache.stale_capacity =
+							cache.stale_capacity ? cache.stale_capacity * 2 : 16;
+						cache.stale = trealloc(cache.stale, cache.stale_capacity);
+					}
+					cache.stale[cache.stale_size++] = old.key;
+				}
+				old = c;
+				return;
+			}
 
-		char*    out_buf = tmalloc<char>(513);
-		uint32_t buf_size = 512;
-		memset(out_buf, 0, 513);
+			if (cache.cmds_size == cache.cmds_capacity)
+			{
+				cache.cmds_capacity = cache.cmds_capacity ? cache.cmds_capacity * 2 : 64;
+				cache.cmds = trealloc(cache.cmds, cache.cmds_capacity);
+			}
+			i = cache.cmds_size++;
+			cache.cmds[i] = c;
+			map::insert(cache.keys, c.key, i, c.key_size);
+		}
 
-		ssize_t readlen;
-		while ((readlen = read(stdout_fd[0], tmp_buf, sizeof(tmp_buf))) != 0)
+		// Copies the results of the command `key`, if it was run with the same
+		// dependencies
+		bool find_cmd(str::buffer const& key, str::buffer const& deps, process_res& res)
 		{
-			if (written + readlen > buf_size)
+			bool found = false;
+			job::lock(cache.lock);
+			uint32_t i = map::find(cache.keys, key.data, key.size);
+			if (i != UINT32_MAX && cache.cmds[i].deps_size == deps.size &&
+			    memcmp(cache.cmds[i].deps, deps.data, deps.size) == 0)
 			{
-				out_buf = trealloc(out_buf, buf_size + 512);
-				buf_size += 512;
+				cmd_cache::cmd& c = cache.cmds[i];
+				c.used = true;
+				res.code = c.code;
+				if (c.out_size)
+					str::append(res.out, c.out, c.out_size);
+				if (c.err_size)
+					str::append(res.err, c.err, c.err_size);
+				found = true;
 			}
-			strncpy(out_buf + written, tmp_buf, readlen);
-			written += readlen;
-			out_buf[written] = '\0';
+			job::unlock(cache.lock);
+			return found;
 		}
 
-		if (written > 0)
+		void
+		store_cmd(str::buffer const& key, str::buffer const& deps, process_res const& res)
 		{
-			lua_pushstring(L, out_buf);
-			lua_setfield(L, -2, "stdout");
+			uint32_t size = key.size + deps.size + res.out.size + res.err.size;
+			char*    block = tmalloc<char>(size ? size : 1);
+			char*    pos = block;
+
+			cmd_cache::cmd c {};
+			c.key = pos;
+			c.key_size = key.size;
+			memcpy(pos, key.data, key.size);
+			pos += key.size;
+			c.deps = pos;
+			c.deps_size = deps.size;
+			if (deps.size)
+				memcpy(pos, deps.data, deps.size);
+			pos += deps.size;
+			c.code = res.code;
+			c.out = pos;
+			c.out_size = res.out.size;
+			if (res.out.size)
+				memcpy(pos, res.out.data, res.out.size);
+			pos += res.out.size;
+			c.err = pos;
+			c.err_size = res.err.size;
+			if (res.err.size)
+				memcpy(pos, res.err.data, res.err.size);
+			c.owned = true;
+			c.used = true;
+
+			job::lock(cache.lock);
+			cache_cmd(c);
+			job::unlock(cache.lock);
 		}
 
-		written = 0;
-		while ((readlen = read(stderr_fd[0], tmp_buf, sizeof(tmp_buf))) != 0)
+		// Checks `field` of the options is a string or an array of strings
+		void check_names(lua_State* L, int32_t options, char const* field)
 		{
-			if (written + readlen > buf_size)
+			lua_getfield(L, options, field);
+			if (lua_istable(L, -1))
 			{
-				out_buf = trealloc(out_buf, buf_size + 512);
-				buf_size += 512;
+				uint32_t size = lua_rawlen(L, -1);
+				for (uint32_t i {0}; i < size; ++i)
+				{
+					if (lua_rawgeti(L, -1, i + 1) != LUA_TSTRING)
+						luaL_error(L, "'%s': 'string' expected at index %d", field, i + 1);
+					lua_pop(L, 1);
+				}
 			}
-			strncpy(out_buf + written, tmp_buf, readlen);
-			written += readlen;
-			out_buf[written] = '\0';
+			else if (!lua_isnil(L, -1) && lua_type(L, -1) != LUA_TSTRING)
+				luaL_error(L, "'%s': 'string' or 'array' expected", field);
+			lua_pop(L, 1);
 		}
 
-		if (written > 0)
+		// Calls `add` with each name of `field`, checked by `check_names`
+		void for_each_name(lua_State*  L,
+		                   int32_t     options,
+		                   char const* field,
+		                   void (*add)(lua_State* L, char const* name, void* data),
+		                   void* data)
 		{
-			lua_pushstring(L, out_buf);
-			lua_setfield(L, -2, "stderr");
+			lua_getfield(L, options, field);
+			if (lua_type(L, -1) == LUA_TSTRING)
+				add(L, lua_tostring(L, -1), data);
+			else if (lua_istable(L, -1))
+			{
+				uint32_t size = lua_rawlen(L, -1);
+				for (uint32_t i {0}; i < size; ++i)
+				{
+					lua_rawgeti(L, -1, i + 1);
+					add(L, lua_tostring(L, -1), data);
+					lua_pop(L, 1);
+				}
+			}
+			lua_pop(L, 1);
 		}
-		tfree(out_buf);
-#endif
+
+		struct deps_state
+		{
+			str::buffer deps;
+			bool        recent;
+		};
+
+		// Inputs are resolved from the running script, and tracked as inputs of the
+		// generation, so the fingerprint stays valid
+		void add_input(lua_State* L, char const* name, void* data)
+		{
+			deps_state& state = *static_cast<deps_state*>(data);
+			char*       path = lua::resolve_path_from_script(L, name);
+			add_file_dep(state.deps, path, state.recent);
+			track::add(track::file, path);
+			tfree(path);
+		}
+
+		void add_env(lua_State*, char const* name, void* data)
+		{
+			add_env_dep(static_cast<deps_state*>(data)->deps, name);
+			track::add(track::env, name);
+		}
+	} // namespace
+
+	void load_cmd_cache(char const* path)
+	{
+		job::init(cache.lock);
+		cache.enabled = true;
+
+		uint64_t    size = 0;
+		char const* file = fs::map_file(path, size);
+		if (!file)
+			return;
+
+		uint32_t version = 0;
+		uint64_t pos = sizeof(cache_magic);
+		if (size < pos || memcmp(file, cache_magic, sizeof(cache_magic)) != 0 ||
+		    !read_u32(file, size, pos, version) || version != cache_version)
+		{
+			fs::unmap_file(file, size);
+			return;
+		}
+
+		// Commands point in the mapped file, which is kept until saved
+		cache.file = file;
+		cache.file_size = size;
+		while (pos < size)
+		{
+			cmd_cache::cmd c {};
+			uint32_t       code = 0;
+			if (!read_str(file, size, pos, c.key, c.key_size) ||
+			    !read_str(file, size, pos, c.deps, c.deps_size) ||
+			    !read_u32(file, size, pos, code) ||
+			    !read_str(file, size, pos, c.out, c.out_size) ||
+			    !read_str(file, size, pos, c.err, c.err_size))
+				break;
+			c.code = static_cast<int32_t>(code);
+			cache_cmd(c);
+		}
+	}
+
+	bool save_cmd_cache(char const* path)
+	{
+		if (!cache.enabled)
+			return true;
+
+		// Only the commands still run are kept
+		str::buffer buf;
+		str::append(buf, cache_magic, sizeof(cache_magic));
+		append_u32(buf, cache_version);
+		for (uint32_t i {0}; i < cache.cmds_size; ++i)
+		{
+			cmd_cache::cmd const& c = cache.cmds[i];
+			if (!c.used)
+				continue;
+
+			append_u32(buf, c.key_size);
+			str::append(buf, c.key, c.key_size);
+			append_u32(buf, c.deps_size);
+			str::append(buf, c.deps, c.deps_size);
+			append_u32(buf, static_cast<uint32_t>(c.code));
+			append_u32(buf, c.out_size);
+			str::append(buf, c.out, c.out_size);
+			append_u32(buf, c.err_size);
+			str::append(buf, c.err, c.err_size);
+		}
+
+		for (uint32_t i {0}; i < cache.cmds_size; ++i)
+			if (cache.cmds[i].owned)
+				tfree(cache.cmds[i].key);
+		for (uint32_t i {0}; i < cache.stale_size; ++i)
+			tfree(cache.stale[i]);
+		if (cache.stale)
+			tfree(cache.stale);
+		if (cache.cmds)
+			tfree(cache.cmds);
+		// Unmapped before writing, as a mapped file can't be replaced on Windows
+		if (cache.file)
+			fs::unmap_file(cache.file, cache.file_size);
+		map::release(cache.keys);
+		job::destroy(cache.lock);
+		cache = {};
+
+		bool res = fs::write_file_if_changed(path, buf.data, buf.size);
+		str::release(buf);
+		return res;
+	}
+
+	int execute_cached(lua_State* L)
+	{
+		int32_t top = lua_gettop(L);
+		int32_t options = top > 1 && lua_istable(L, top) ? top : 0;
+		if (options)
+		{
+			check_names(L, options, "inputs");
+			check_names(L, options, "env");
+		}
+		char*       working_dir = nullptr;
+		char const* cmd = check_cmd(L, options ? top - 1 : top, working_dir);
+
+		// Stamped before running the command, so changes made while it runs are seen by
+		// the next generation
+		deps_state  state {{}, false};
+		str::buffer tool;
+		bool        found = find_tool(cmd, working_dir, tool);
+		if (found)
+		{
+			add_file_dep(state.deps, tool.data, state.recent);
+			track::add(track::file, tool.data);
+		}
+		// Without its binary, such as a shell builtin, what the command runs is unknown:
+		// it is run every time, as with os.execute
+		else
+			fp::invalidate();
+		str::release(tool);
+		if (options)
+		{
+			for_each_name(L, options, "inputs", add_input, &state);
+			for_each_name(L, options, "env", add_env, &state);
+		}
+
+		str::buffer key;
+		str::append(key, cmd, strlen(cmd) + 1);
+		if (working_dir)
+			str::append(key, working_dir);
+
+		// Found before the cache is checked, as effects are counted per configuration
+		task::effect* e = find_effect(cmd, working_dir);
+		process_res   res {-1, {}, {}};
+		if (!cache.enabled || !found || !find_cmd(key, state.deps, res))
+		{
+			run_once(e, cmd, working_dir, res);
+			if (cache.enabled && found && !state.recent)
+				store_cmd(key, state.deps, res);
+		}
+		if (working_dir)
+			tfree(working_dir);
+		str::release(key);
+		str::release(state.deps);
+
+		push_res(L, res);
+		release(res);
 		return 1;
 	}
 
@@ -231,6 +847,8 @@ namespace os
 			strcpy(resolved_dst_path, dst_path);
 		}
 
+		track::add(track::file, resolved_src_path);
+		track::add(track::output, resolved_dst_path);
 		bool res = fs::copy_file(resolved_src_path, resolved_dst_path, true);
 
 		tfree(resolved_src_path);
@@ -240,4 +858,4 @@ namespace os
 
 		return 1;
 	}
-} // namespace os
+} // namespace os
\ No newline at end of file
@@ -1,10 +1,55 @@
 #pragma once
 
+#include "string.hpp"
+
+#include <stdint.h>
+
 struct lua_State;
 
 namespace os
 {
+	struct process_res
+	{
+		int32_t     code;
+		str::buffer out;
+		str::buffer err;
+	};
+
+	/// @brief Runs `cmd` through the shell, and waits for it to exit. On Linux, the
+	/// command is spawned without duplicating the process, and its standard output and
+	/// error are captured, both read as they fill so it never blocks writing them. On
+	/// Windows, they are not captured. Can be called from multiple threads.
+	/// @param working_dir Directory the command runs in, or nullptr for the working
+	/// directory.
+	/// @param res Exit code of the command, -1 if it could not be run or didn't exit
+	/// normally, and its outputs. Must be released with `release`.
+	void run(char const* cmd, char const* working_dir, process_res& res);
+
+	void release(process_res& res);
+
 	int execute(lua_State* L);
 
+	/// @brief `os.spawn([working_dir,] cmd)`: starts `cmd` as a task, like `os.execute`,
+	/// and returns its handle, the result of `os.execute` once waited.
+	int spawn(lua_State* L);
+
+	/// @brief Loads the results of the commands run by `os.execute_cached` in the
+	/// previous generation, saved at `path`, and enables caching them. Missing or
+	/// invalid caches are ignored.
+	void load_cmd_cache(char const* path);
+
+	/// @brief Saves the results of the commands run by `os.execute_cached` in this
+	/// generation to `path`, dropping the other ones, and frees the cache.
+	/// @return true Cache saved, or not enabled.
+	/// @return false Cache could not be written.
+	bool save_cmd_cache(char const* path);
+
+	/// @brief `os.execute_cached([working_dir,] cmd [, options])`: runs `cmd` like
+	/// `os.execute`, unless it ran in a previous generation with the same working
+	/// directory, tool binary, `options.inputs` files and `options.env` variables, in
+	/// which case its saved results are returned. Doesn't prevent skipping the next
+	/// generation, as its dependencies are tracked.
+	int execute_cached(lua_State* L);
+
 	int copy_file(lua_State* L);
-}
+}
\ No newline at end of file
@@ -7,157 +7,193 @@ extern "C"
 #include <lua/lualib.h>
 }
 
+#include "file_set.hpp"
 #include "fs.hpp"
+#include "glob.hpp"
 #include "lua_env.hpp"
+#include "map.hpp"
 #include "mem.hpp"
+#include "state.hpp"
 #include "string.hpp"
+#include "sym.hpp"
+
+#include <string.h>
 
 namespace prj
 {
 	namespace
 	{
-		void fill_prebuilt_project(lua_State* L, lua::input const& in, lua::output& out)
-		{
-			if (in.static_libraries_size || in.static_library_directories_size)
-			{
-				uint32_t link_options_str_size {0};
-				uint32_t link_options_str_capacity {0};
-				for (uint32_t i {0}; i < in.static_library_directories_size; ++i)
-					link_options_str_capacity +=
-						strlen(in.static_library_directories[i]) + 3 /*-L"*/ + 2 /*" */;
-
-				link_options_str_capacity -= 1;
-				char* link_options = tmalloc<char>(link_options_str_capacity + 1);
-				for (uint32_t i {0}; i < in.static_library_directories_size; ++i)
-				{
-					uint32_t    pos = 0;
-					uint32_t    len = 0;
-					char const* path = nullptr;
-					if (!fs::is_absolute(in.static_library_directories[i]))
-					{
-						path = lua::resolve_path_from_script(
-							L, in.static_library_directories[i]);
-						len = strlen(path);
-					}
-					else
-					{
-						path = in.static_library_directories[i];
-						len = strlen(in.static_library_directories[i]);
-					}
+		constexpr char const* handle_name {"mg.project"};
 
-					if (link_options_str_capacity < link_options_str_size + len + 8)
-					{
-						while (link_options_str_capacity <
-						       link_options_str_size + len + 8)
-							link_options_str_capacity *= 2;
+		// Handles of the registry projects, indexed by project address
+		constexpr char const* handles_key {"mg.project.handles"};
 
-						link_options =
-							trealloc(link_options, link_options_str_capacity + 1);
-					}
+		// Projects of the Lua state of the calling thread
+		thread_local lua::output** projects {nullptr};
+		thread_local uint32_t      projects_size {0};
+		thread_local uint32_t      projects_capacity {0};
 
-					strncpy(link_options + link_options_str_size, "-L\"", 3);
-					link_options_str_size += 3;
+		// Configuration of the first project declared with each name. A script run by
+		// mg.require with another configuration can't reuse the names of the main one, as
+		// the generated targets are named after the projects.
+		thread_local map::str_map project_configs;
 
-					strncpy(link_options + link_options_str_size, path, len);
-					link_options_str_size += len;
+		// Raises an error if the string at `idx`, naming a project, already names a
+		// project of another configuration. Other values are reported when parsed.
+		void check_name(lua_State* L, int32_t idx)
+		{
+			if (lua_type(L, idx) != LUA_TSTRING)
+				return;
+
+			size_t      len = 0;
+			char const* str = lua_tolstring(L, idx, &len);
+			sym::id     name = sym::intern(str, static_cast<uint32_t>(len));
+			sym::id     config = g.config_param ? sym::intern(g.config_param) : sym::null;
+			sym::id     declared = map::insert(project_configs, sym::str(name), config,
+			                                   sym::len(name), sym::hash(name));
+			if (declared != config)
+				luaL_error(L, "project '%s' is already declared with configuration '%s'",
+				           sym::str(name), declared ? sym::str(declared) : "");
+		}
 
-					if (in.static_libraries_size ||
-					    i < in.static_library_directories_size - 1)
-					{
-						strncpy(link_options + link_options_str_size, "\" ", 2);
-						link_options_str_size += 2;
-					}
-					else
-					{
-						strncpy(link_options + link_options_str_size, "\"", 1);
-						link_options_str_size += 1;
-					}
+		// Checks the name of the project declared by the table at `idx`
+		void check_table_name(lua_State* L, int32_t idx)
+		{
+			lua_getfield(L, idx, "name");
+			check_name(L, -1);
+			lua_pop(L, 1);
+		}
 
-					if (!fs::is_absolute(in.static_library_directories[i]))
-						tfree(path);
-				}
+		// Adds `out` to the registry, and pushes its handle
+		lua::output* register_project(lua_State* L, lua::output const& out)
+		{
+			if (projects_size == projects_capacity)
+			{
+				projects_capacity = projects_capacity ? projects_capacity * 2 : 16;
+				projects = trealloc(projects, projects_capacity);
+			}
+			lua::output* res = tmalloc<lua::output>();
+			*res = out;
+			projects[projects_size++] = res;
+
+			lua::output** handle =
+				static_cast<lua::output**>(lua_newuserdatauv(L, sizeof(lua::output*), 0));
+			*handle = res;
+			luaL_setmetatable(L, handle_name);
+
+			lua_getfield(L, LUA_REGISTRYINDEX, handles_key);
+			lua_pushvalue(L, -2);
+			lua_rawsetp(L, -2, res);
+			lua_pop(L, 1);
+			return res;
+		}
 
-				for (uint32_t i {0}; i < in.static_libraries_size; ++i)
-				{
-					uint32_t len = strlen(in.static_libraries[i]);
-					if (link_options_str_capacity < link_options_str_size + len + 3)
-					{
-						while (link_options_str_capacity <
-						       link_options_str_size + len + 3)
-							link_options_str_capacity *= 2;
+		int32_t project_index(lua_State* L)
+		{
+			lua::output const* out =
+				*static_cast<lua::output**>(luaL_checkudata(L, 1, handle_name));
+			char const* key = luaL_checkstring(L, 2);
+			if (!lua::push_output_field(L, *out, key))
+				lua_pushnil(L);
+			return 1;
+		}
 
-						link_options =
-							trealloc(link_options, link_options_str_capacity + 1);
-					}
+		int32_t project_newindex(lua_State* L)
+		{
+			lua::output* out =
+				*static_cast<lua::output**>(luaL_checkudata(L, 1, handle_name));
+			char const* key = luaL_checkstring(L, 2);
+			lua_settop(L, 3);
+			if (strcmp(key, "name") == 0)
+				check_name(L, 3);
+			if (!lua::parse_output_field(L, key, *out))
+				luaL_error(L, "Unknown project key: %s", key);
+			return 0;
+		}
 
-					strncpy(link_options + link_options_str_size, "-l", 2);
-					link_options_str_size += 2;
+		int32_t project_tostring(lua_State* L)
+		{
+			lua::output const* out =
+				*static_cast<lua::output**>(luaL_checkudata(L, 1, handle_name));
+			lua_pushfstring(L, "project: %s", sym::str(out->name));
+			return 1;
+		}
 
-					strncpy(link_options + link_options_str_size, in.static_libraries[i],
-					        len);
-					link_options_str_size += len;
+		// Appends `option` to the space separated options of `buf`
+		void append_option(str::buffer& buf, char const* option, uint32_t len)
+		{
+			if (buf.size)
+				str::append(buf, " ", 1);
+			str::append(buf, option, len);
+		}
 
-					if (i < in.static_libraries_size - 1)
-					{
-						strncpy(link_options + link_options_str_size, " ", 1);
-						link_options_str_size += 1;
-					}
+		sym::id intern_options(str::buffer& buf)
+		{
+			sym::id res = buf.size ? sym::intern(buf.data, buf.size) : sym::null;
+			str::release(buf);
+			return res;
+		}
+
+		void fill_prebuilt_project(lua_State* L, lua::input const& in, lua::output& out)
+		{
+			str::buffer link_options;
+			for (uint32_t i {0}; i < in.static_library_directories_size; ++i)
+			{
+				sym::id dir = in.static_library_directories[i];
+				if (link_options.size)
+					str::append(link_options, " ", 1);
+				str::append(link_options, "-L\"", 3);
+				if (!fs::is_absolute(sym::str(dir)))
+				{
+					char* path =
+						lua::resolve_path_from_script(L, sym::str(dir), sym::len(dir));
+					str::append(link_options, path);
+					tfree(path);
 				}
+				else
+					str::append(link_options, sym::str(dir), sym::len(dir));
+				str::append(link_options, "\"", 1);
+			}
 
-				link_options[link_options_str_size] = '\0';
-				out.link_options = link_options;
+			for (uint32_t i {0}; i < in.static_libraries_size; ++i)
+			{
+				if (link_options.size)
+					str::append(link_options, " ", 1);
+				str::append(link_options, "-l", 2);
+				str::append(link_options, sym::str(in.static_libraries[i]),
+				            sym::len(in.static_libraries[i]));
 			}
+
+			out.link_options = intern_options(link_options);
 		}
 
-		void
-		fill_sources(char const* dir_filter, char const* file_filter, lua::output& out)
+		void add_sources(lua::output& out, sym::id const* files, uint32_t files_size)
 		{
-			fs::list_files_res files = fs::list_files(dir_filter, file_filter);
-			if (out.sources_capacity < out.sources_size + files.size)
+			if (out.sources_capacity < out.sources_size + files_size)
 			{
 				if (!out.sources_capacity)
 					out.sources_capacity = 1;
-				else
+				while (out.sources_capacity < out.sources_size + files_size)
 					out.sources_capacity *= 2;
-				lua::output::source* new_sources = trealloc(
-					out.sources, out.sources_capacity * sizeof(lua::output::source));
-				out.sources = new_sources;
+				out.sources = trealloc(out.sources, out.sources_capacity);
 			}
-			for (uint32_t i {0}; i < files.size; ++i)
-			{
-				out.sources[out.sources_size + i].file = files.files[i];
-				out.sources[out.sources_size + i].compile_options = nullptr;
-			}
-			out.sources_size += files.size;
-			if (files.size)
-				tfree(files.files);
-
-			fs::list_dirs_res sub_dirs = fs::list_dirs(dir_filter);
-			for (uint32_t i {0}; i < sub_dirs.size; ++i)
+			for (uint32_t i {0}; i < files_size; ++i)
 			{
-				uint32_t dir_len = static_cast<uint32_t>(strlen(sub_dirs.dirs[i]));
-				char*    filter = tmalloc<char>(dir_len + 2);
-				strcpy(filter, sub_dirs.dirs[i]);
-				strcpy(filter + dir_len, "/");
-				fill_sources(filter, file_filter, out);
-
-				tfree(filter);
-				tfree(sub_dirs.dirs[i]);
+				out.sources[out.sources_size + i].file = files[i];
+				out.sources[out.sources_size + i].compile_options = sym::null;
 			}
-			if (sub_dirs.size)
-				tfree(sub_dirs.dirs);
+			out.sources_size += files_size;
 		}
 	} // namespace
 
 	int new_project(lua_State* L)
 	{
 		luaL_argcheck(L, lua_istable(L, 1), 1, "'table' expected");
+		check_table_name(L, 1);
 		lua::input  in = lua::parse_input(L);
 		lua::output out {0};
 
 		out.name = in.name;
-		in.name = nullptr;
-
 		out.type = in.type;
 
 		if (in.type == lua::project_type::prebuilt)
@@ -166,297 +202,190 @@ namespace prj
 		}
 		else
 		{
+			// Excludes apply to every pattern of the project
+			char const** excludes =
+				tmalloc<char const*>(in.sources_size + in.excludes_size);
+			uint32_t excludes_size = 0;
 			for (uint32_t i {0}; i < in.sources_size; ++i)
 			{
-				uint32_t source_len {static_cast<uint32_t>(strlen(in.sources[i]))};
-				uint32_t pos {UINT32_MAX};
+				if (sym::str(in.sources[i])[0] == '!')
+					excludes[excludes_size++] = sym::str(in.sources[i]) + 1;
+			}
+			for (uint32_t i {0}; i < in.excludes_size; ++i)
+				excludes[excludes_size++] = sym::str(in.excludes[i]);
 
-				if ((pos = str::rfind(in.sources[i], "**", source_len)) != UINT32_MAX)
-				{
-					char* filter = nullptr;
-					if (fs::is_absolute(in.sources[i]))
-					{
-						filter = tmalloc<char>(pos + 1);
-						strncpy(filter, in.sources[i], pos);
-						filter[pos] = '\0';
-					}
-					else
-					{
-						filter = lua::resolve_path_from_script(L, in.sources[i], pos);
-					}
-					fill_sources(filter, in.sources[i] + pos + 2, out);
-					tfree(filter);
-				}
-				else if ((pos = str::rfind(in.sources[i], "*", source_len)) != UINT32_MAX)
+			for (uint32_t i {0}; i < in.sources_size; ++i)
+			{
+				char const* pattern = sym::str(in.sources[i]);
+				uint32_t    pattern_len = sym::len(in.sources[i]);
+
+				if (pattern[0] == '!')
+					continue;
+				else if (glob::has_wildcards(pattern, pattern_len))
 				{
-					char* filter = nullptr;
-					if (fs::is_absolute(in.sources[i]))
+					uint32_t files_size = 0;
+					char**   files = lua::glob_files(L, &pattern, 1, excludes,
+					                                 excludes_size, &files_size);
+					if (files)
 					{
-						filter = tmalloc<char>(pos + 1);
-						strncpy(filter, in.sources[i], pos);
-						filter[pos] = '\0';
-					}
-					else
-					{
-						filter = lua::resolve_path_from_script(L, in.sources[i], pos);
-					}
-					fs::list_files_res files =
-						fs::list_files(filter, in.sources[i] + pos + 1);
-					if (out.sources_capacity < out.sources_size + files.size)
-					{
-						if (!out.sources_capacity)
-							out.sources_capacity = 1;
-						else
-							out.sources_capacity *= 2;
-						lua::output::source* new_sources =
-							trealloc(out.sources,
-						             out.sources_capacity * sizeof(lua::output::source));
-						out.sources = new_sources;
-					}
-					for (uint32_t i {0}; i < files.size; ++i)
-					{
-						out.sources[out.sources_size + i].file = files.files[i];
-						out.sources[out.sources_size + i].compile_options = nullptr;
+						sym::id* file_ids = tmalloc<sym::id>(files_size);
+						for (uint32_t j {0}; j < files_size; ++j)
+						{
+							file_ids[j] = sym::intern(files[j]);
+							tfree(files[j]);
+						}
+						add_sources(out, file_ids, files_size);
+						tfree(file_ids);
+						tfree(files);
 					}
-					out.sources_size += files.size;
-					if (files.size)
-						tfree(files.files);
-					tfree(filter);
 				}
 				else
 				{
-					char const* source = nullptr;
-					if (!fs::is_absolute(in.sources[i]))
-					{
-						char* new_source =
-							lua::resolve_path_from_script(L, in.sources[i], source_len);
-						source = new_source;
-					}
-					else
+					sym::id source = in.sources[i];
+					if (!fs::is_absolute(pattern))
 					{
-						source = in.sources[i];
+						char* resolved =
+							lua::resolve_path_from_script(L, pattern, pattern_len);
+						source = sym::intern(resolved);
+						tfree(resolved);
 					}
 
 					// TODO Decide if file should already exists at declaration time or
 					// not
 					// if (fs::file_exists(source))
-					{
-						if (out.sources_capacity < out.sources_size + 1)
-						{
-							if (!out.sources_capacity)
-								out.sources_capacity = 1;
-							else
-								out.sources_capacity *= 2;
-							lua::output::source* new_sources =
-								trealloc(out.sources, out.sources_capacity *
-							                              sizeof(lua::output::source));
-							out.sources = new_sources;
-						}
-						out.sources[out.sources_size].file = source;
-						out.sources[out.sources_size].compile_options = nullptr;
-						++out.sources_size;
-
-						if (fs::is_absolute(source))
-							in.sources[i] = nullptr;
-					}
+					add_sources(out, &source, 1);
 				}
 			}
 
-			if (!out.sources_size)
-				luaL_error(L, "sources cannot be empty");
-
-			if (in.compile_options_size || in.includes_size)
-			{
-				uint32_t compile_options_str_size {0};
-				uint32_t compile_options_str_capacity {0};
-				char*    compile_options = tmalloc<char>(compile_options_str_capacity);
-				for (uint32_t i {0}; i < in.compile_options_size; ++i)
-				{
-					uint32_t len {static_cast<uint32_t>(strlen(in.compile_options[i]))};
-					if (compile_options_str_capacity < compile_options_str_size + len + 1)
-					{
-						if (!compile_options_str_capacity)
-							compile_options_str_capacity = len + 1;
-
-						while (compile_options_str_capacity <
-						       compile_options_str_size + len + 1)
-							compile_options_str_capacity *= 2;
-
-						compile_options =
-							trealloc(compile_options, compile_options_str_capacity + 1);
-					}
+			tfree(excludes);
 
-					strncpy(compile_options + compile_options_str_size,
-					        in.compile_options[i], len);
-					compile_options_str_size += len;
-					if (in.includes_size || i < in.compile_options_size - 1)
-					{
-						strncpy(compile_options + compile_options_str_size, " ", 1);
-						compile_options_str_size += 1;
-					}
-				}
+			// Files of file sets are already resolved, and are not filtered by excludes
+			for (uint32_t i {0}; i < in.source_sets_size; ++i)
+				add_sources(out, in.source_sets[i]->files, in.source_sets[i]->size);
 
-				for (uint32_t i {0}; i < in.includes_size; ++i)
-				{
-					uint32_t len {static_cast<uint32_t>(strlen(in.includes[i]))};
-					if (fs::is_absolute(in.includes[i]))
-					{
-						if (compile_options_str_capacity <
-						    compile_options_str_size + len + 3)
-						{
-							if (!compile_options_str_capacity)
-								compile_options_str_capacity = len + 3;
-
-							while (compile_options_str_capacity <
-							       compile_options_str_size + len + 3)
-								compile_options_str_capacity *= 2;
-
-							compile_options = trealloc(compile_options,
-							                           compile_options_str_capacity + 1);
-						}
-						strncpy(compile_options + compile_options_str_size, "-I\"", 3);
-						compile_options_str_size += 3;
-						strncpy(compile_options + compile_options_str_size,
-						        in.includes[i], len);
-						compile_options_str_size += len;
-					}
-					else
-					{
-						char const* include =
-							lua::resolve_path_from_script(L, in.includes[i], len);
-						len = strlen(include);
-						if (compile_options_str_capacity <
-						    compile_options_str_size + len + 6)
-						{
-							if (!compile_options_str_capacity)
-								compile_options_str_capacity = len + 6;
-
-							while (compile_options_str_capacity <
-							       compile_options_str_size + len + 6)
-								compile_options_str_capacity *= 2;
-
-							compile_options = trealloc(compile_options,
-							                           compile_options_str_capacity + 1);
-						}
-						strncpy(compile_options + compile_options_str_size, "-I\"../", 6);
-						compile_options_str_size += 6;
-						strncpy(compile_options + compile_options_str_size, include, len);
-						compile_options_str_size += len;
-						tfree(include);
-					}
+			if (!out.sources_size)
+				luaL_error(L, "sources cannot be empty");
 
-					if (i < in.includes_size - 1)
-					{
-						if (compile_options_str_capacity < compile_options_str_size + 2)
-						{
-							while (compile_options_str_capacity <
-							       compile_options_str_size + 2)
-								compile_options_str_capacity *= 2;
+			str::buffer compile_options;
+			for (uint32_t i {0}; i < in.compile_options_size; ++i)
+				append_option(compile_options, sym::str(in.compile_options[i]),
+				              sym::len(in.compile_options[i]));
 
-							compile_options = trealloc(compile_options,
-							                           compile_options_str_capacity + 1);
-						}
-						strncpy(compile_options + compile_options_str_size, "\" ", 2);
-						compile_options_str_size += 2;
-					}
-					else
-					{
-						if (compile_options_str_capacity < compile_options_str_size + 1)
-						{
-							while (compile_options_str_capacity <
-							       compile_options_str_size + 1)
-								compile_options_str_capacity *= 1;
-
-							compile_options = trealloc(compile_options,
-							                           compile_options_str_capacity + 1);
-						}
-						strncpy(compile_options + compile_options_str_size, "\"", 1);
-						compile_options_str_size += 1;
-					}
-				}
-				compile_options[compile_options_str_size] = '\0';
-				out.compile_options = compile_options;
+			if (in.includes_size)
+			{
+				out.include_dirs = tmalloc<sym::id>(in.includes_size);
+				out.include_dirs_size = in.includes_size;
 			}
-
-			if (in.link_options_size)
+			for (uint32_t i {0}; i < in.includes_size; ++i)
 			{
-				uint32_t link_options_str_size {0};
-				for (uint32_t i {0}; i < in.link_options_size; ++i)
-					link_options_str_size += strlen(in.link_options[i]) + 1;
-
-				char*    link_options = tmalloc<char>(link_options_str_size);
-				uint32_t pos {0};
-				for (uint32_t i {0}; i < in.link_options_size; ++i)
+				sym::id include = in.includes[i];
+				if (fs::is_absolute(sym::str(include)))
+					append_option(compile_options, "-I\"", 3);
+				else
 				{
-					uint32_t len {static_cast<uint32_t>(strlen(in.link_options[i]))};
-					strncpy(link_options + pos, in.link_options[i], len);
-					pos += len;
-					if (i < in.link_options_size - 1)
-					{
-						strncpy(link_options + pos, " ", 1);
-						pos += 1;
-					}
+					char* resolved = lua::resolve_path_from_script(L, sym::str(include),
+					                                               sym::len(include));
+					include = sym::intern(resolved);
+					tfree(resolved);
+					append_option(compile_options, "-I\"", 3);
+					str::append(compile_options, g.build_to_root);
 				}
-				link_options[link_options_str_size - 1] = '\0';
-				out.link_options = link_options;
+				str::append(compile_options, sym::str(include), sym::len(include));
+				str::append(compile_options, "\"", 1);
+				out.include_dirs[i] = include;
 			}
+			out.compile_options = intern_options(compile_options);
+
+			str::buffer link_options;
+			for (uint32_t i {0}; i < in.link_options_size; ++i)
+				append_option(link_options, sym::str(in.link_options[i]),
+				              sym::len(in.link_options[i]));
 
 			if (in.deps)
 			{
-				uint32_t     out_deps_size = in.deps_size;
-				uint32_t     out_deps_i = 0;
-				lua::output* out_deps = tmalloc<lua::output>(out_deps_size);
+				uint32_t      out_deps_size = 0;
+				lua::output** out_deps = tmalloc<lua::output*>(in.deps_size);
 				for (uint32_t i {0}; i < in.deps_size; ++i)
 				{
-					if (in.deps[i].type == lua::project_type::prebuilt)
+					// Prebuilt dependencies are only link options
+					lua::output const* dep = in.deps[i];
+					if (dep->type == lua::project_type::prebuilt)
 					{
-						if (in.deps[i].link_options)
-						{
-							char*    new_link_options = nullptr;
-							uint32_t out_link_option_size = 0;
-							if (out.link_options)
-							{
-								out_link_option_size = strlen(out.link_options);
-								new_link_options =
-									trealloc(const_cast<char*>(out.link_options),
-								             out_link_option_size +
-								                 strlen(in.deps[i].link_options) + 2);
-								new_link_options[strlen(new_link_options)] = ' ';
-								++out_link_option_size;
-							}
-							else
-							{
-								new_link_options =
-									tmalloc<char>(strlen(in.deps[i].link_options) + 1);
-							}
-							strcpy(new_link_options + out_link_option_size,
-							       in.deps[i].link_options);
-							--out_deps_size;
-							out.link_options = new_link_options;
-						}
-
-						lua::free_output(in.deps[i]);
+						if (dep->link_options)
+							append_option(link_options, sym::str(dep->link_options),
+							              sym::len(dep->link_options));
 					}
 					else
-					{
-						out_deps[out_deps_i] = in.deps[i];
-						++out_deps_i;
-					}
+						out_deps[out_deps_size++] = in.deps[i];
 				}
 
 				out.deps = out_deps;
 				out.deps_size = out_deps_size;
-
-				tfree(in.deps);
-				in.deps = nullptr;
-				in.deps_size = 0;
 			}
+			out.link_options = intern_options(link_options);
 		}
 
 		lua::free_input(in);
-		lua::dump_output(L, out);
-		lua::free_output(out);
+		register_project(L, out);
 
 		return 1;
 	}
-} // namespace prj
+
+	void init(lua_State* L)
+	{
+		luaL_newmetatable(L, handle_name);
+		lua_pushcclosure(L, project_index, 0);
+		lua_setfield(L, -2, "__index");
+		lua_pushcclosure(L, project_newindex, 0);
+		lua_setfield(L, -2, "__newindex");
+		lua_pushcclosure(L, project_tostring, 0);
+		lua_setfield(L, -2, "__tostring");
+		lua_pop(L, 1);
+
+		lua_newtable(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, handles_key);
+	}
+
+	lua::output* to_project(lua_State* L, int32_t idx)
+	{
+		void* handle = luaL_testudata(L, idx, handle_name);
+		return handle ? *static_cast<lua::output**>(handle) : nullptr;
+	}
+
+	lua::output* check_project(lua_State* L, int32_t idx)
+	{
+		lua::output* res = to_project(L, idx);
+		if (res)
+			return res;
+
+		if (!lua_istable(L, idx))
+			luaL_typeerror(L, idx, "project");
+
+		check_table_name(L, idx);
+		res = register_project(L, lua::parse_output(L, idx));
+		lua_pop(L, 1);
+		return res;
+	}
+
+	void push_project(lua_State* L, lua::output const* out)
+	{
+		lua_getfield(L, LUA_REGISTRYINDEX, handles_key);
+		lua_rawgetp(L, -1, out);
+		lua_remove(L, -2);
+	}
+
+	void clear()
+	{
+		for (uint32_t i {0}; i < projects_size; ++i)
+		{
+			lua::free_output(*projects[i]);
+			tfree(projects[i]);
+		}
+		if (projects)
+			tfree(projects);
+		projects = nullptr;
+		projects_size = 0;
+		projects_capacity = 0;
+		map::release(project_configs);
+	}
+} // namespace prj
\ No newline at end of file
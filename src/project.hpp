@@ -1,8 +1,36 @@
 #pragma once
 
+#include <stdint.h>
+
 struct lua_State;
 
+namespace lua
+{
+	struct output;
+}
+
 namespace prj
 {
+	/// @brief Creates the metatable of project handles. Must be called once per state,
+	/// before any project is created.
+	void init(lua_State* L);
+
+	/// @brief Implements mg.project. Projects are kept in a native registry until
+	/// `clear`, and scripts are given a handle on them, whose fields can be read and
+	/// written like the ones of a table.
 	int new_project(lua_State* L);
-}
\ No newline at end of file
+
+	/// @brief Retrieves the project of the handle at `idx`.
+	/// @return lua::output* Project, or nullptr if the value isn't a project handle.
+	lua::output* to_project(lua_State* L, int32_t idx);
+
+	/// @brief Retrieves the project at `idx`, either a handle or a project table. Tables
+	/// are parsed and added to the registry. Raises an error for other values.
+	lua::output* check_project(lua_State* L, int32_t idx);
+
+	/// @brief Pushes the handle of a project of the registry.
+	void push_project(lua_State* L, lua::output const* out);
+
+	/// @brief Frees all projects of the registry of the calling thread.
+	void clear();
+} // namespace prj
\ No newline at end of file
@@ -19,7 +19,24 @@ struct mingen_state
 	int32_t      config_size {0};
 
 	bool gen_compile_db {false};
+	bool gen_subninja {false};
+	bool check_files {false};
+	bool mem_stats {false};
+
+	// Generates every declared configuration in parallel, each in its own directory
+	bool all_configs {false};
+
+	// Directory the build files are written to, and path of the working directory
+	// relative to it, both ending with '/'
+	char const* build_dir {"build/"};
+	char const* build_to_root {"../"};
+
+	// Honors .gitignore files in source globs, in addition to .mingenignore files
+	bool use_gitignore {false};
+
+	// Lists source globs from the git index of the repository instead of walking
+	bool use_git_index {false};
 };
 
-// declared in main.cpp
-extern mingen_state g;
\ No newline at end of file
+// declared in main.cpp, one per thread running a configuration
+extern thread_local mingen_state g;
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "mem.hpp"
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
 #ifdef _WIN32
@@ -107,4 +109,60 @@ namespace str
 			str_len = static_cast<uint32_t>(strlen(str));
 		return strncmp(str + str_len - buf_len, buf, buf_len) == 0;
 	}
+
+	void reserve(buffer& buf, uint32_t size)
+	{
+		if (buf.capacity >= buf.size + size + 1)
+			return;
+
+		uint32_t new_capacity = buf.capacity ? buf.capacity : 256;
+		while (new_capacity < buf.size + size + 1)
+			new_capacity *= 2;
+
+		buf.data = trealloc(buf.data, new_capacity);
+		buf.capacity = new_capacity;
+	}
+
+	void append(buffer& buf, char const* str, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(str));
+
+		reserve(buf, len);
+		memcpy(buf.data + buf.size, str, len);
+		buf.size += len;
+		buf.data[buf.size] = '\0';
+	}
+
+	void appendf(buffer& buf, char const* fmt, ...)
+	{
+		va_list args;
+		va_start(args, fmt);
+		va_list args_copy;
+		va_copy(args_copy, args);
+
+		// Tries to format in the remaining space first, to only format twice when the
+		// buffer needs to grow.
+		uint32_t available = buf.capacity > buf.size ? buf.capacity - buf.size : 0;
+		int32_t  len = vsnprintf(buf.data ? buf.data + buf.size : nullptr, available,
+		                         fmt, args);
+		va_end(args);
+
+		if (len > 0 && static_cast<uint32_t>(len) >= available)
+		{
+			reserve(buf, len);
+			vsnprintf(buf.data + buf.size, len + 1, fmt, args_copy);
+		}
+		va_end(args_copy);
+
+		if (len > 0)
+			buf.size += len;
+	}
+
+	void release(buffer& buf)
+	{
+		if (buf.data)
+			tfree(buf.data);
+		buf = {};
+	}
 } // namespace str
\ No newline at end of file
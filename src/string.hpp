@@ -56,4 +56,26 @@ namespace str
 	               char const* buf,
 	               uint32_t    str_len = UINT32_MAX,
 	               uint32_t    buf_len = UINT32_MAX);
+
+	/// @brief Growable byte buffer, used to render whole files in memory before
+	/// writing them. `data` is always '\0' terminated once something was appended.
+	struct buffer
+	{
+		char*    data {nullptr};
+		uint32_t size {0};
+		uint32_t capacity {0};
+	};
+
+	/// @brief Ensures `buf` can hold `size` more bytes without reallocating.
+	void reserve(buffer& buf, uint32_t size);
+
+	/// @brief Appends `len` bytes of `str` to `buf`. If `len` is UINT32_MAX, `str` must
+	/// be '\0' terminated.
+	void append(buffer& buf, char const* str, uint32_t len = UINT32_MAX);
+
+	/// @brief Appends a printf-like formatted string to `buf`.
+	void appendf(buffer& buf, char const* fmt, ...);
+
+	/// @brief Frees the memory held by `buf`, and resets it to an empty buffer.
+	void release(buffer& buf);
 };
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "sym.hpp"
+
+#include "job.hpp"
+#include "map.hpp"
+#include "mem.hpp"
+
+#include <string.h>
+
+namespace sym
+{
+	namespace
+	{
+		struct entry
+		{
+			char const* str;
+			uint32_t    len;
+			uint32_t    hash;
+		};
+
+		// Entries are stored in fixed size chunks which are never moved, so they can be
+		// read without locking while other strings are interned.
+		constexpr uint32_t chunk_bits {12};
+		constexpr uint32_t chunk_size {1u << chunk_bits};
+		constexpr uint32_t max_chunks {1u << 16};
+
+		entry*   chunks[max_chunks] {};
+		uint32_t count {1}; // Id 0 is reserved to null
+
+		// Strings are copied in large blocks, freed all at once
+		struct block
+		{
+			block*   next;
+			uint32_t size;
+			uint32_t used;
+		};
+
+		constexpr uint32_t block_size {64 * 1024};
+
+		block* blocks {nullptr};
+
+		// Open addressing table of the ids, probed with the hash of their entry
+		id*      table {nullptr};
+		uint32_t table_capacity {0};
+
+		job::mutex lock;
+
+		bool init_lock()
+		{
+			job::init(lock);
+			return true;
+		}
+
+		// Initialized before main, as the first use can happen from any thread when
+		// configurations are generated in parallel
+		bool lock_init {init_lock()};
+
+		job::mutex& get_lock()
+		{
+			return lock;
+		}
+
+		entry& get(id s)
+		{
+			return chunks[s >> chunk_bits][s & (chunk_size - 1)];
+		}
+
+		char const* store(char const* str, uint32_t len)
+		{
+			block* b = blocks;
+			if (!b || b->size - b->used < len + 1)
+			{
+				// Long strings get their own block, keeping the current one in use
+				uint32_t size = len + 1 > block_size / 4 ? len + 1 : block_size;
+				b = reinterpret_cast<block*>(tmalloc<char>(sizeof(block) + size));
+				b->size = size;
+				b->used = 0;
+				if (size != block_size && blocks)
+				{
+					b->next = blocks->next;
+					blocks->next = b;
+				}
+				else
+				{
+					b->next = blocks;
+					blocks = b;
+				}
+			}
+
+			char* res = reinterpret_cast<char*>(b + 1) + b->used;
+			memcpy(res, str, len);
+			res[len] = '\0';
+			b->used += len + 1;
+			return res;
+		}
+
+		void grow_table()
+		{
+			id*      old_table = table;
+			uint32_t old_capacity = table_capacity;
+
+			table_capacity = old_capacity ? old_capacity * 2 : 1024;
+			table = tmalloc<id>(table_capacity);
+			memset(table, 0, sizeof(id) * table_capacity);
+
+			uint32_t mask = table_capacity - 1;
+			for (uint32_t i {0}; i < old_capacity; ++i)
+			{
+				if (!old_table[i])
+					continue;
+
+				uint32_t j = get(old_table[i]).hash & mask;
+				while (table[j])
+					j = (j + 1) & mask;
+				table[j] = old_table[i];
+			}
+
+			if (old_table)
+				tfree(old_table);
+		}
+	} // namespace
+
+	id intern(char const* str, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(str));
+		uint32_t h = map::hash(str, len);
+
+		job::mutex& m = get_lock();
+		job::lock(m);
+
+		if (count * 2 >= table_capacity)
+			grow_table();
+
+		uint32_t mask = table_capacity - 1;
+		uint32_t i = h & mask;
+		while (table[i])
+		{
+			entry const& e = get(table[i]);
+			if (e.hash == h && e.len == len && memcmp(e.str, str, len) == 0)
+			{
+				id res = table[i];
+				job::unlock(m);
+				return res;
+			}
+			i = (i + 1) & mask;
+		}
+
+		id res = count++;
+		if (!chunks[res >> chunk_bits])
+			chunks[res >> chunk_bits] = tmalloc<entry>(chunk_size);
+		get(res) = {store(str, len), len, h};
+		table[i] = res;
+
+		job::unlock(m);
+		return res;
+	}
+
+	char const* str(id s)
+	{
+		return s ? get(s).str : nullptr;
+	}
+
+	uint32_t len(id s)
+	{
+		return s ? get(s).len : 0;
+	}
+
+	uint32_t hash(id s)
+	{
+		return s ? get(s).hash : 0;
+	}
+
+	void clear()
+	{
+		for (uint32_t i {0}; i < max_chunks && chunks[i]; ++i)
+		{
+			tfree(chunks[i]);
+			chunks[i] = nullptr;
+		}
+		count = 1;
+
+		while (blocks)
+		{
+			block* next = blocks->next;
+			tfree(blocks);
+			blocks = next;
+		}
+
+		if (table)
+			tfree(table);
+		table = nullptr;
+		table_capacity = 0;
+	}
+} // namespace sym
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace sym
+{
+	/// @brief Identifier of an interned string. Each distinct string is stored once, so
+	/// two strings are equal if and only if their ids are. Id 0 stands for no string.
+	using id = uint32_t;
+
+	constexpr id null {0};
+
+	/// @brief Interns a string, copying it on its first occurrence only. Can be called
+	/// from multiple threads.
+	/// @param str String to intern.
+	/// @param len Length of `str`. If UINT32_MAX, `str` must be '\0' terminated.
+	/// @return id Id of the string, never `null`.
+	id intern(char const* str, uint32_t len = UINT32_MAX);
+
+	/// @brief Retrieves the '\0' terminated string of `s`, valid until `clear`. Can be
+	/// called from multiple threads.
+	/// @return char const* String of `s`, or nullptr if `s` is `null`.
+	char const* str(id s);
+
+	/// @brief Retrieves the length of the string of `s`, 0 if `s` is `null`.
+	uint32_t len(id s);
+
+	/// @brief Retrieves the hash of the string of `s`, computed once with `map::hash`,
+	/// 0 if `s` is `null`.
+	uint32_t hash(id s);
+
+	/// @brief Frees all interned strings. Ids previously returned become invalid.
+	void clear();
+} // namespace sym
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "task.hpp"
+
+extern "C"
+{
+#include <lua/lauxlib.h>
+#include <lua/lua.h>
+}
+
+#include "job.hpp"
+#include "map.hpp"
+#include "mem.hpp"
+#include "state.hpp"
+
+#include <string.h>
+
+namespace task
+{
+	namespace
+	{
+		constexpr char const* handle_name {"mg.task"};
+
+		struct entry
+		{
+			desc  d;
+			void* data;
+		};
+
+		// Tasks started by the scripts of the configuration running on this thread, kept
+		// until the pool is destroyed, as handles may be collected while tasks run
+		thread_local job::pool* pool {nullptr};
+		thread_local entry**    entries {nullptr};
+		thread_local uint32_t   entries_size {0};
+		thread_local uint32_t   entries_capacity {0};
+
+		entry* to_entry(lua_State* L, int32_t idx)
+		{
+			void* handle = luaL_testudata(L, idx, handle_name);
+			return handle ? *static_cast<entry**>(handle) : nullptr;
+		}
+
+		int32_t handle_tostring(lua_State* L)
+		{
+			void* handle = luaL_checkudata(L, 1, handle_name);
+			lua_pushfstring(L, "task: %p", *static_cast<entry**>(handle));
+			return 1;
+		}
+
+		// Occurrences of an effect key, in the order the threads reach them
+		struct effect_list
+		{
+			char*    key;
+			effect** effects;
+			uint32_t size;
+			uint32_t capacity;
+		};
+
+		// Effects of every configuration, indexed by key
+		effect_list* effect_lists {nullptr};
+		uint32_t     effect_lists_size {0};
+		uint32_t     effect_lists_capacity {0};
+		map::str_map effect_keys;
+
+		job::mutex effects_lock;
+
+		bool init_effects_lock()
+		{
+			job::init(effects_lock);
+			return true;
+		}
+
+		// Initialized before main, as effects are found from every configuration thread
+		bool effects_lock_init {init_effects_lock()};
+
+		// Occurrences of each effect list reached by the configuration of this thread
+		thread_local uint32_t* effect_counts {nullptr};
+		thread_local uint32_t  effect_counts_size {0};
+	} // namespace
+
+	void start(lua_State* L, desc const& d, void* data)
+	{
+		// Tasks mostly wait on processes or the network, so a worker per core keeps the
+		// machine busy without oversubscribing it when they compute
+		if (!pool)
+			pool = job::create_pool();
+
+		if (entries_size == entries_capacity)
+		{
+			entries_capacity = entries_capacity ? entries_capacity * 2 : 16;
+			entries = trealloc(entries, entries_capacity);
+		}
+		entry* e = tmalloc<entry>();
+		*e = {d, data};
+		entries[entries_size++] = e;
+
+		*static_cast<entry**>(lua_newuserdatauv(L, sizeof(entry*), 0)) = e;
+		luaL_setmetatable(L, handle_name);
+
+		job::submit(pool, d.run, data);
+	}
+
+	int32_t wait_all(lua_State* L)
+	{
+		bool has_tasks = !lua_isnoneornil(L, 1);
+		if (has_tasks)
+			luaL_checktype(L, 1, LUA_TTABLE);
+
+		// Tasks can't be waited one by one, but they all run at once anyway
+		if (pool)
+			job::wait(pool);
+		if (!has_tasks)
+			return 0;
+
+		uint32_t size = lua_rawlen(L, 1);
+		lua_createtable(L, size, 0);
+		for (uint32_t i {0}; i < size; ++i)
+		{
+			lua_rawgeti(L, 1, i + 1);
+			entry* e = to_entry(L, -1);
+			if (!e)
+				luaL_error(L, "wait_all: task expected at index %d", i + 1);
+			lua_pop(L, 1);
+
+			int32_t pushed = e->d.push(L, e->data);
+			if (!pushed)
+				lua_pushnil(L);
+			else if (pushed > 1)
+				lua_pop(L, pushed - 1);
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+	void init(lua_State* L)
+	{
+		luaL_newmetatable(L, handle_name);
+		lua_pushcclosure(L, handle_tostring, 0);
+		lua_setfield(L, -2, "__tostring");
+		lua_pop(L, 1);
+	}
+
+	void clear()
+	{
+		if (pool)
+			job::destroy_pool(pool);
+		pool = nullptr;
+
+		for (uint32_t i {0}; i < entries_size; ++i)
+		{
+			entries[i]->d.release(entries[i]->data);
+			tfree(entries[i]);
+		}
+		if (entries)
+			tfree(entries);
+		entries = nullptr;
+		entries_size = 0;
+		entries_capacity = 0;
+
+		if (effect_counts)
+			tfree(effect_counts);
+		effect_counts = nullptr;
+		effect_counts_size = 0;
+	}
+
+	effect* find_effect(char const* key, uint32_t len)
+	{
+		if (!g.all_configs)
+			return nullptr;
+
+		job::lock(effects_lock);
+		uint32_t i = map::find(effect_keys, key, len);
+		if (i == UINT32_MAX)
+		{
+			if (effect_lists_size == effect_lists_capacity)
+			{
+				effect_lists_capacity =
+					effect_lists_capacity ? effect_lists_capacity * 2 : 16;
+				effect_lists = trealloc(effect_lists, effect_lists_capacity);
+			}
+			char* key_copy = tmalloc<char>(len + 1);
+			memcpy(key_copy, key, len);
+			key_copy[len] = '\0';
+
+			i = effect_lists_size++;
+			effect_lists[i] = {key_copy, nullptr, 0, 0};
+			map::insert(effect_keys, key_copy, i, len);
+		}
+
+		if (i >= effect_counts_size)
+		{
+			uint32_t size = effect_lists_capacity;
+			effect_counts = trealloc(effect_counts, size);
+			memset(effect_counts + effect_counts_size, 0,
+			       sizeof(uint32_t) * (size - effect_counts_size));
+			effect_counts_size = size;
+		}
+
+		effect_list& list = effect_lists[i];
+		uint32_t     occurrence = effect_counts[i]++;
+		if (occurrence == list.size)
+		{
+			if (list.size == list.capacity)
+			{
+				list.capacity = list.capacity ? list.capacity * 2 : 4;
+				list.effects = trealloc(list.effects, list.capacity);
+			}
+			effect* e = tmalloc<effect>();
+			job::init(e->lock);
+			e->done = false;
+			e->result = {};
+			list.effects[list.size++] = e;
+		}
+		effect* res = list.effects[occurrence];
+		job::unlock(effects_lock);
+		return res;
+	}
+
+	bool lock_effect(effect* e)
+	{
+		job::lock(e->lock);
+		return e->done;
+	}
+
+	void unlock_effect(effect* e)
+	{
+		e->done = true;
+		job::unlock(e->lock);
+	}
+
+	void clear_effects()
+	{
+		for (uint32_t i {0}; i < effect_lists_size; ++i)
+		{
+			effect_list& list = effect_lists[i];
+			for (uint32_t j {0}; j < list.size; ++j)
+			{
+				job::destroy(list.effects[j]->lock);
+				str::release(list.effects[j]->result);
+				tfree(list.effects[j]);
+			}
+			if (list.effects)
+				tfree(list.effects);
+			tfree(list.key);
+		}
+		if (effect_lists)
+			tfree(effect_lists);
+		effect_lists = nullptr;
+		effect_lists_size = 0;
+		effect_lists_capacity = 0;
+		map::release(effect_keys);
+	}
+} // namespace task
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "job.hpp"
+#include "string.hpp"
+
+#include <stdint.h>
+
+struct lua_State;
+
+namespace task
+{
+	/// @brief Work started by a script, run in the background while the script goes on.
+	struct desc
+	{
+		/// @brief Runs the task on a worker of the task pool.
+		void (*run)(void* data);
+		/// @brief Pushes the results of the completed task on the stack of the script.
+		/// May raise errors, such as the failure of the task.
+		/// @return int32_t Number of values pushed.
+		int32_t (*push)(lua_State* L, void* data);
+		/// @brief Frees the task data, once its handle can't be waited anymore.
+		void (*release)(void* data);
+	};
+
+	/// @brief Starts a task on the task pool of the calling thread, created on its first
+	/// use with a worker per core, and pushes its handle, to be given to `mg.wait_all`.
+	void start(lua_State* L, desc const& d, void* data);
+
+	/// @brief `mg.wait_all([tasks])`: waits for every task started by the script. If an
+	/// array of handles is given, returns an array of their first result, in the same
+	/// order.
+	int32_t wait_all(lua_State* L);
+
+	/// @brief Registers the metatable of task handles.
+	void init(lua_State* L);
+
+	/// @brief Waits for the tasks started by the calling thread, destroys its pool and
+	/// frees the tasks. Must be called before closing the Lua state holding the handles.
+	void clear();
+
+	/// @brief Side effect of the scripts, such as a download or a command. With
+	/// --all-configurations, each configuration runs the scripts on its own thread: the
+	/// n-th effect with a given key of every thread runs once, and the other threads
+	/// reuse its result.
+	struct effect
+	{
+		job::mutex  lock;
+		bool        done;
+		str::buffer result;
+	};
+
+	/// @brief Finds the next effect with the given key of the configuration running on
+	/// the calling thread, such as the command and its working directory.
+	/// @return effect* Effect shared with the other configurations, or nullptr when
+	/// configurations are not generated in parallel.
+	effect* find_effect(char const* key, uint32_t len);
+
+	/// @brief Locks `e`, waiting for the thread running it if any. Can be called from
+	/// any thread.
+	/// @return true The effect already ran, and `e->result` holds its result.
+	/// @return false The caller must run it, and store its result in `e->result`.
+	bool lock_effect(effect* e);
+
+	/// @brief Unlocks `e`, locked by `lock_effect`, once its result is stored.
+	void unlock_effect(effect* e);
+
+	/// @brief Frees the effects, once every configuration completed.
+	void clear_effects();
+} // namespace task
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "track.hpp"
+
+#include "map.hpp"
+#include "mem.hpp"
+
+#include <string.h>
+
+namespace track
+{
+	namespace
+	{
+		struct input_set
+		{
+			char**       paths {nullptr};
+			uint32_t     size {0};
+			uint32_t     capacity {0};
+			map::str_map index;
+		};
+
+		// Each thread running a configuration records the inputs of its own generation
+		thread_local input_set sets[kind::count];
+	} // namespace
+
+	void add(kind k, char const* path, uint32_t len)
+	{
+		if (len == UINT32_MAX)
+			len = static_cast<uint32_t>(strlen(path));
+
+		if (len >= 2 && path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+		{
+			path += 2;
+			len -= 2;
+		}
+
+		input_set& set = sets[k];
+		if (map::find(set.index, path, len) == UINT32_MAX)
+		{
+			if (set.size == set.capacity)
+			{
+				set.capacity = set.capacity ? set.capacity * 2 : 16;
+				set.paths = trealloc(set.paths, set.capacity);
+			}
+
+			char* copy = tmalloc<char>(len + 1);
+			strncpy(copy, path, len);
+			copy[len] = '\0';
+			set.paths[set.size] = copy;
+			map::insert(set.index, copy, set.size, len);
+			++set.size;
+		}
+	}
+
+	inputs get(kind k)
+	{
+		return {sets[k].paths, sets[k].size};
+	}
+
+	void clear()
+	{
+		for (uint32_t i {0}; i < kind::count; ++i)
+		{
+			for (uint32_t j {0}; j < sets[i].size; ++j)
+				tfree(sets[i].paths[j]);
+			if (sets[i].paths)
+				tfree(sets[i].paths);
+			map::release(sets[i].index);
+			sets[i] = {};
+		}
+	}
+} // namespace track
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace track
+{
+	/// @brief Kinds of inputs the generation depends on. A change on any of them
+	/// requires to run the generation again.
+	enum kind
+	{
+		script,    // Lua file executed
+		directory, // Directory listed by a source glob
+		file,      // File read while listing sources, such as ignore files
+		// Only the kinds above are files the build manifest depends on
+		entry,  // Path only checked for existence
+		env,    // Environment variable read
+		output, // File written by the generation
+		count
+	};
+
+	/// @brief Records `path` as an input of the generation run by the calling thread.
+	/// Duplicates are ignored.
+	/// @param path Path relative to working directory, or absolute. Name of the variable
+	/// for `env`.
+	/// @param len Length of `path`. If UINT32_MAX, `path` must be '\0' terminated.
+	void add(kind k, char const* path, uint32_t len = UINT32_MAX);
+
+	struct inputs
+	{
+		char const* const* paths;
+		uint32_t           size;
+	};
+
+	/// @brief Retrieves the inputs recorded by the calling thread for `k`, in recording
+	/// order.
+	inputs get(kind k);
+
+	/// @brief Frees all inputs recorded by the calling thread.
+	void clear();
+} // namespace track
\ No newline at end of file
@@ -0,0 +1,33 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- The bytecode cache is only used when it matches the checksum saved with it, a
+-- corrupted cache falls back to the script source
+util.write("build/project/lib.cpp", "")
+util.write("build/project/mingen.lua", [[
+mg.configurations({"debug"})
+print("marker-source")
+mg.generate({mg.project({
+	name = "lib",
+	type = mg.project_type.static_library,
+	sources = {"lib.cpp"},
+})})
+]])
+
+local code, out = util.mingen("build/project")
+assert(code == 0 and out:find("marker-source", 1, true), out)
+local cache = util.read("build/project/build/.mingen/bc")
+assert(cache and cache:find("marker-source", 1, true), "bytecode not cached")
+
+-- Still valid bytecode, only the string constant differs
+util.write("build/project/build/.mingen/bc", (cache:gsub("marker%-source", "marker-cached")))
+code, out = util.mingen("build/project")
+assert(code == 0 and out:find("marker-source", 1, true), out)
+assert(not out:find("marker-cached", 1, true), "corrupted bytecode loaded")
+
+-- The cache was saved again, and is used by the next run
+cache = util.read("build/project/build/.mingen/bc")
+assert(cache and not cache:find("marker-cached", 1, true), "corrupted cache kept")
+code, out = util.mingen("build/project")
+assert(code == 0 and out:find("marker-source", 1, true), out)
\ No newline at end of file
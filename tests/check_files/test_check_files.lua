@@ -0,0 +1,32 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- Sources and include directories generated by commands or placed under build/ don't
+-- exist before the build, only the other ones are reported
+util.write("build/project/main.cpp", "")
+util.write("build/project/mingen.lua", [[
+mg.configurations({"debug"})
+local p = mg.project({
+	name = "exe",
+	type = mg.project_type.executable,
+	sources = {"main.cpp", "generated.cpp", "build/obj.cpp", "missing.cpp"},
+	includes = {"build/include", "missing_include"},
+})
+mg.add_pre_build_cmd(p, {input = "gen.txt", output = "generated.cpp", cmd = "touch ${out}"})
+mg.generate({p})
+]])
+
+local code, out = util.mingen("build/project", "--check-files")
+assert(code ~= 0, "missing inputs not reported")
+assert(out:find("'missing.cpp': missing source"), out)
+assert(out:find("'missing_include': missing include directory"), out)
+assert(out:find("'gen.txt': missing command input"), out)
+assert(not out:find("generated.cpp"), out)
+assert(not out:find("build/"), out)
+
+util.write("build/project/missing.cpp", "")
+util.write("build/project/gen.txt", "")
+os.execute("mkdir -p build/project/missing_include")
+code, out = util.mingen("build/project", "--check-files")
+assert(code == 0, out)
\ No newline at end of file
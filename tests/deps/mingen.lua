@@ -1,4 +1,4 @@
-prj_lib = mg.project({
+local prj_lib = mg.project({
 	name = "lib",
 	type = mg.project_type.static_library,
 	sources = {"../src/lib/**.cc"},
@@ -13,4 +13,6 @@ prj_lib = mg.project({
 
 if mg.need_generate() then
 	mg.generate({prj_lib})
-end
\ No newline at end of file
+end
+
+return prj_lib
\ No newline at end of file
@@ -0,0 +1,14 @@
+-- Required by test_require.lua, which sets `name` and counts the runs
+runs = runs + 1
+
+return mg.project({
+	name = name,
+	type = mg.project_type.static_library,
+	sources = {"lib.cpp"},
+	debug = {
+		compile_options = {"-O0"},
+	},
+	release = {
+		compile_options = {"-O2"},
+	},
+})
\ No newline at end of file
@@ -0,0 +1,49 @@
+mg.configurations({"debug", "release"})
+
+local function require_lib(options)
+	return pcall(function()
+		return mg.require("require/lib", options)
+	end)
+end
+
+-- Scripts run once per configuration, later calls return the first result
+runs = 0
+name = "lib"
+local ok, debug_lib = require_lib()
+assert(ok, debug_lib)
+assert(runs == 1, "script not run")
+assert(debug_lib.compile_options == "-O0", "debug keys not used")
+assert(mg.require("require/lib.lua") == debug_lib, "result not cached")
+assert(mg.require("require/lib", {configuration = "debug"}) == debug_lib,
+	"result not cached")
+assert(runs == 1, "script run again")
+
+-- A project can't be declared under two configurations with the same name
+local err
+ok, err = require_lib({configuration = "release"})
+assert(not ok, "duplicate project name accepted")
+assert(err:find("project 'lib' is already declared with configuration 'debug'", 1,
+	true), err)
+
+-- Failed runs are not cached
+name = "lib_release"
+local release_lib
+ok, release_lib = require_lib({configuration = "release"})
+assert(ok, release_lib)
+assert(runs == 3, "failed run cached")
+assert(release_lib.name == "lib_release", "wrong project")
+assert(release_lib.compile_options == "-O2", "release keys not used")
+
+-- The main script can't reuse the name either, nor rename a project to it
+ok, err = pcall(mg.project, {
+	name = "lib_release",
+	type = mg.project_type.static_library,
+	sources = {"lib.cpp"},
+})
+assert(not ok and err:find("configuration 'release'", 1, true), err)
+ok, err = pcall(function()
+	debug_lib.name = "lib_release"
+end)
+assert(not ok and err:find("configuration 'release'", 1, true), err)
+
+mg.generate({debug_lib, release_lib})
\ No newline at end of file
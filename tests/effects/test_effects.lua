@@ -0,0 +1,54 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- With --all-configurations, each command runs once for all the configurations, which
+-- share its results. Commands run several times by a script still run as many times.
+util.write("build/project/lib.cpp", "")
+util.write("build/project/mingen.lua", [[
+mg.configurations({"debug", "release", "profile"})
+os.execute("echo run >> log.txt")
+os.execute("echo run >> log.txt")
+local spawned = mg.wait_all({os.spawn("echo spawn >> log.txt")})
+assert(spawned[1].code == 0)
+-- Not cached between generations, as eval has no binary
+os.execute_cached("eval 'echo cached >> log.txt'")
+
+local dir = mg.get_build_dir()
+os.execute("mkdir -p " .. dir)
+local file = assert(io.open(dir .. "now.txt", "wb"))
+file:write(os.execute("date +%N").stdout)
+file:close()
+
+mg.generate({mg.project({
+	name = "lib",
+	type = mg.project_type.static_library,
+	sources = {"lib.cpp"},
+})})
+]])
+
+local function count(str, pattern)
+	local res = 0
+	for _ in str:gmatch(pattern) do
+		res = res + 1
+	end
+	return res
+end
+
+local code, out = util.mingen("build/project", "--all-configurations")
+assert(code == 0, out)
+local log = util.read("build/project/log.txt")
+assert(count(log, "run") == 2 and count(log, "spawn") == 1 and count(log, "cached") == 1,
+	log)
+
+local now = util.read("build/project/build/debug/now.txt")
+assert(now and #now > 0, "command output missing")
+assert(util.read("build/project/build/release/now.txt") == now, "output not shared")
+assert(util.read("build/project/build/profile/now.txt") == now, "output not shared")
+
+-- A single configuration runs its commands as before
+code, out = util.mingen("build/project")
+assert(code == 0, out)
+log = util.read("build/project/log.txt")
+assert(count(log, "run") == 4 and count(log, "spawn") == 2 and count(log, "cached") == 2,
+	log)
\ No newline at end of file
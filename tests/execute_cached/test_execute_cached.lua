@@ -0,0 +1,65 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- Cached commands print the time they ran, so a result saved by a previous generation
+-- is told apart from a new run
+local dir = "build/project/"
+util.write(dir .. "lib.cpp", "")
+util.write(dir .. "input.txt", "input")
+util.write(dir .. "mingen.lua", [[
+mg.configurations({"debug"})
+if os.getenv("MG_TEST_BUILTIN") then
+	-- eval is a shell builtin, without a binary to track
+	print("builtin:" .. os.execute_cached("eval date +%N").stdout)
+else
+	local res = os.execute_cached("date +%N", {
+		inputs = {"input.txt"},
+		env = {"MG_TEST_VAR"},
+	})
+	print("cached:" .. res.stdout)
+	-- Generates every time, as nothing else changes
+	os.execute("true")
+end
+mg.generate({mg.project({
+	name = "lib",
+	type = mg.project_type.static_library,
+	sources = {"lib.cpp"},
+})})
+]])
+-- Inputs changed too recently are not cached
+util.age(dir .. "input.txt")
+
+local function cached(env)
+	local res = os.execute("cd " .. dir .. " && " .. (env or "") .. " '" ..
+		os.getenv("MINGEN") .. "'")
+	assert(res.code == 0, res.stdout)
+	return res.stdout:match("cached:(%d+)")
+end
+
+local first = cached()
+assert(first, "command not run")
+assert(cached() == first, "result not reused")
+
+-- Changing an input or an environment variable runs the command again
+util.write(dir .. "input.txt", "changed")
+util.age(dir .. "input.txt")
+local changed = cached()
+assert(changed ~= first, "input change not seen")
+assert(cached() == changed, "result not reused")
+local with_env = cached("MG_TEST_VAR=1")
+assert(with_env ~= changed, "environment change not seen")
+assert(cached("MG_TEST_VAR=1") == with_env, "result not reused")
+
+-- Commands without a tool binary run every time, and the generation is not skipped
+local function builtin()
+	local res = os.execute("cd " .. dir .. " && MG_TEST_BUILTIN=1 '" ..
+		os.getenv("MINGEN") .. "'")
+	assert(res.code == 0, res.stdout)
+	return res.stdout and res.stdout:match("builtin:(%d+)")
+end
+
+local before = builtin()
+assert(before, "builtin command not run")
+local after = builtin()
+assert(after and after ~= before, "builtin command cached")
\ No newline at end of file
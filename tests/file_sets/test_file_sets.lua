@@ -0,0 +1,59 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+local sources = mg.collect_files("src/**.cpp")
+local headers = mg.collect_files("src/*.h")
+
+-- Sets are read like arrays of paths
+assert(#sources == 3, "length: " .. #sources)
+local count = 0
+for i, file in ipairs(sources) do
+	assert(sources[i] == file)
+	count = count + 1
+end
+assert(count == 3, "ipairs: " .. count)
+count = 0
+for _, file in pairs(sources) do
+	assert(type(file) == "string")
+	count = count + 1
+end
+assert(count == 3, "pairs: " .. count)
+assert(sources[0] == nil and sources[4] == nil, "out of bounds")
+util.check_files(sources, {"src/a.cpp", "src/b.cpp", "src/sub/d.cpp"}, "collect_files")
+
+-- Filters by patterns, resolved from the script, or by function
+util.check_files(sources:filter("src/*.cpp"), {"src/a.cpp", "src/b.cpp"}, "filter")
+util.check_files(sources:filter({"src/a.cpp", "src/sub/*"}), {"src/a.cpp", "src/sub/d.cpp"},
+	"filter array")
+util.check_files(sources:filter("!src/sub"), {}, "filter negated only")
+util.check_files(sources:filter(function(file) return file:find("b%.cpp") ~= nil end),
+	{"src/b.cpp"}, "filter function")
+
+-- Set operations, without duplicates
+local all = sources + headers
+util.check_files(all, {"src/a.cpp", "src/b.cpp", "src/c.h", "src/sub/d.cpp"}, "union")
+util.check_files(sources:union(sources), {"src/a.cpp", "src/b.cpp", "src/sub/d.cpp"},
+	"union with itself")
+util.check_files(all - sources, {"src/c.h"}, "difference")
+util.check_files(all:difference(headers), {"src/a.cpp", "src/b.cpp", "src/sub/d.cpp"},
+	"difference method")
+
+-- Invalid arguments raise errors, without leaking
+local invalid = "src/" .. string.rep("?", 300)
+assert(not pcall(sources.filter, sources, invalid), "invalid pattern")
+assert(not pcall(sources.filter, sources, {"src/*", {}}), "invalid array")
+assert(not pcall(mg.collect_files, {"src/**", invalid}), "invalid collect pattern")
+assert(not pcall(mg.collect_files, "src/**", {exclude = "src"}), "invalid exclude")
+
+-- Sets are given as is to projects
+local p = mg.project({
+	name = "lib",
+	type = mg.project_type.static_library,
+	sources = {sources:filter("src/*.cpp")},
+})
+local project_sources = {}
+for _, source in ipairs(p.sources) do
+	table.insert(project_sources, source.file)
+end
+util.check_files(project_sources, {"src/a.cpp", "src/b.cpp"}, "project sources")
\ No newline at end of file
@@ -0,0 +1,82 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- The next generation is skipped while nothing it read changed. Inputs changed too
+-- recently can't be told apart from a future change, so every input is aged, the
+-- mingen binary included.
+local dir = "build/project/"
+util.write(dir .. "lib.cpp", "")
+util.write(dir .. "data.txt", "data")
+util.write(dir .. "lines.txt", "lines")
+util.write(dir .. "mingen.lua", [[
+mg.configurations({"debug"})
+print("generated")
+local file = assert(io.open("data.txt", "rb"))
+file:read("a")
+file:close()
+for _ in io.lines("lines.txt") do
+end
+local missing = io.open("missing.txt")
+if missing then
+	missing:close()
+end
+if os.getenv("MG_TEST_WRITE") then
+	io.open("written.txt", "wb"):close()
+end
+-- Lua may be built without popen support, it still prevents skipping
+if os.getenv("MG_TEST_POPEN") then
+	local ok, pipe = pcall(io.popen, "true")
+	if ok then
+		pipe:close()
+	end
+end
+mg.generate({mg.project({
+	name = "lib",
+	type = mg.project_type.static_library,
+	sources = {"lib.cpp"},
+})})
+]])
+assert(os.execute("cp '" .. os.getenv("MINGEN") .. "' " .. dir .. "mingen").code == 0)
+for _, file in ipairs({"lib.cpp", "data.txt", "lines.txt", "mingen.lua", "mingen", ""}) do
+	util.age(dir .. file)
+end
+
+local function generated(env, args)
+	local res = os.execute("cd " .. dir .. " && " .. (env or "") .. " ./mingen " ..
+		(args or ""))
+	assert(res.code == 0, res.stdout)
+	return (res.stdout or ""):find("generated") ~= nil, res.stdout or ""
+end
+
+local function change(file, content)
+	util.write(dir .. file, content)
+	util.age(dir .. file)
+	util.age(dir)
+end
+
+assert(generated(), "first generation skipped")
+assert(not generated(), "generation not skipped")
+
+-- Files read with io.open and io.lines, or missing, are inputs
+change("data.txt", "changed")
+assert(generated(), "io.open input not tracked")
+assert(not generated(), "generation not skipped")
+change("lines.txt", "changed")
+assert(generated(), "io.lines input not tracked")
+assert(not generated(), "generation not skipped")
+change("missing.txt", "")
+assert(generated(), "missing input not tracked")
+assert(not generated(), "generation not skipped")
+
+-- Writing a file or running a command prevents skipping the next generation
+assert(generated("MG_TEST_WRITE=1"), "environment not tracked")
+assert(generated("MG_TEST_WRITE=1"), "write didn't invalidate")
+assert(generated("MG_TEST_POPEN=1"), "environment not tracked")
+assert(generated("MG_TEST_POPEN=1"), "io.popen didn't invalidate")
+
+-- Memory stats report the skipped generation instead of printing nothing
+local gen, out = generated(nil, "--mem-stats")
+assert(gen and out:find("lua heap: ", 1, true), out)
+gen, out = generated(nil, "--mem-stats")
+assert(not gen and out:find("generation, skipped", 1, true), out)
\ No newline at end of file
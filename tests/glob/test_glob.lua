@@ -0,0 +1,35 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+local function check(patterns, expected)
+	local what = type(patterns) == "table" and table.concat(patterns, " ") or patterns
+	util.check_files(mg.collect_files(patterns), expected, what)
+end
+
+check("tree/*.cpp", {"tree/a.cpp"})
+check("tree/?.h", {"tree/b.h"})
+check("tree/[ab].*", {"tree/a.cpp", "tree/b.h"})
+check("tree/[!ab].*", {"tree/c.hpp"})
+check("tree/*.{h,hpp}", {"tree/b.h", "tree/c.hpp"})
+check("tree/{a,sub/c}.cpp", {"tree/a.cpp", "tree/sub/c.cpp"})
+
+-- ** crosses directories, **/ matches zero or more of them
+check("tree/**.cpp", {"tree/a.cpp", "tree/gen/g.cpp", "tree/sub/c.cpp",
+	"tree/sub/deep/d.cpp", "tree/sub/test/e.cpp", "tree/x/test/f.cpp"})
+check("tree/**/test/*.cpp", {"tree/sub/test/e.cpp", "tree/x/test/f.cpp"})
+check("tree/**/*.h", {"tree/b.h"})
+check("tree/sub/**/d.cpp", {"tree/sub/deep/d.cpp"})
+
+-- Negated patterns and excludes remove files, and whole directories
+check({"tree/**.cpp", "!tree/sub"}, {"tree/a.cpp", "tree/gen/g.cpp", "tree/x/test/f.cpp"})
+check({"tree/**.cpp", "!tree/**/test/*.cpp", "!tree/gen/"},
+	{"tree/a.cpp", "tree/sub/c.cpp", "tree/sub/deep/d.cpp"})
+util.check_files(mg.collect_files("tree/**.cpp", {exclude = {"tree/sub", "tree/x/**"}}),
+	{"tree/a.cpp", "tree/gen/g.cpp"}, "exclude option")
+
+-- Files of a directory are listed before the ones of its subdirectories
+local files = mg.collect_files("tree/sub/**.cpp")
+assert(files[1] == "tree/sub/c.cpp", "walk order: " .. tostring(files[1]))
+
+check("tree/none/**.cpp", {})
\ No newline at end of file
@@ -0,0 +1,15 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- Comments, negation, directories, and patterns anchored to the directory of the file
+util.check_files(mg.collect_files("tree/**"), {"tree/.gitignore", "tree/.mingenignore",
+	"tree/a.cpp", "tree/gen/g.cpp", "tree/keep.tmp", "tree/sub/.mingenignore",
+	"tree/sub/b.cpp", "tree/sub/deep/local.cpp"}, "mingenignore")
+
+-- Ignore files of the parent directories apply to the walked one
+util.check_files(mg.collect_files("tree/sub/**.tmp"), {}, "parent ignore file")
+
+mg.use_gitignore(true)
+util.check_files(mg.collect_files("tree/**.cpp"),
+	{"tree/a.cpp", "tree/sub/b.cpp", "tree/sub/deep/local.cpp"}, "gitignore")
\ No newline at end of file
@@ -0,0 +1,38 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- Projects reached through several dependencies are linked once, after every project
+-- depending on them
+for _, file in ipairs({"s.cpp", "a.cpp", "b.cpp", "c.cpp", "main.cpp"}) do
+	util.write("build/project/" .. file, "")
+end
+util.write("build/project/mingen.lua", [[
+mg.configurations({"debug"})
+local s = mg.project({name = "s", type = mg.project_type.sources, sources = {"s.cpp"}})
+local c = mg.project({
+	name = "c",
+	type = mg.project_type.static_library,
+	sources = {"c.cpp"},
+})
+local function lib(name)
+	return mg.project({
+		name = name,
+		type = mg.project_type.static_library,
+		sources = {name .. ".cpp"},
+		dependencies = {s, c},
+	})
+end
+mg.generate({mg.project({
+	name = "exe",
+	type = mg.project_type.executable,
+	sources = {"main.cpp"},
+	dependencies = {lib("a"), lib("b")},
+})})
+]])
+
+local code, out = util.mingen("build/project")
+assert(code == 0, out)
+local manifest = util.read("build/project/build/build.ninja")
+local link = manifest:match("\nbuild bin/exe: link ([^\n]*)")
+assert(link == "obj/exe/main.o lib/a.a lib/b.a obj/s/s.o lib/c.a | a b", link)
\ No newline at end of file
@@ -1,7 +1,6 @@
 mg.configurations({"debug", "release"})
 
--- TODO custom require for relative path resolve + (optional) give config to run the file with
-require("deps/mingen")
+local prj_lib = mg.require("deps/mingen")
 
 print("build_dir main: " .. mg.get_build_dir())
 
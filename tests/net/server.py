@@ -0,0 +1,84 @@
+# HTTP server of test_net.lua, on a free local port written to the file given as first
+# argument. Serves zip archives holding a.txt and b.txt, whose content is the archive
+# name, and writes its statistics to the file given as second argument.
+#   /<name>.zip       archive
+#   /slow/<name>.zip  archive, sent after a delay, to overlap downloads
+#   /reset            resets the statistics
+#   /quit             stops the server, which also stops by itself after a minute
+import http.server
+import io
+import os
+import sys
+import threading
+import time
+import zipfile
+
+port_path, stats_path = sys.argv[1], sys.argv[2]
+lock = threading.Lock()
+stats = {"requests": 0, "active": 0, "max_active": 0}
+
+
+def write_stats():
+    with open(stats_path + ".tmp", "w") as file:
+        file.write("requests=%d max_active=%d\n" % (stats["requests"], stats["max_active"]))
+    os.replace(stats_path + ".tmp", stats_path)
+
+
+def archive(name):
+    buf = io.BytesIO()
+    with zipfile.ZipFile(buf, "w", zipfile.ZIP_STORED) as zip:
+        zip.writestr("a.txt", name)
+        zip.writestr("b.txt", name)
+    return buf.getvalue()
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def do_GET(self):
+        if self.path == "/quit":
+            os._exit(0)
+        if self.path == "/reset":
+            with lock:
+                stats["requests"] = 0
+                stats["max_active"] = 0
+                write_stats()
+            self.send_response(204)
+            self.end_headers()
+            return
+
+        with lock:
+            stats["requests"] += 1
+            stats["active"] += 1
+            stats["max_active"] = max(stats["max_active"], stats["active"])
+        path = self.path
+        if path.startswith("/slow/"):
+            time.sleep(0.3)
+            path = path[5:]
+        # Written before replying, so the client reads them once its downloads complete
+        with lock:
+            stats["active"] -= 1
+            write_stats()
+
+        if path.endswith(".zip") and path.count("/") == 1 and path != "/missing.zip":
+            body = archive(path[1:-4])
+            self.send_response(200)
+            self.send_header("Content-Type", "application/zip")
+        else:
+            body = b"not found"
+            self.send_response(404)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+server.daemon_threads = True
+write_stats()
+with open(port_path + ".tmp", "w") as file:
+    file.write(str(server.server_address[1]))
+os.replace(port_path + ".tmp", port_path)
+threading.Thread(target=server.serve_forever, daemon=True).start()
+time.sleep(60)
\ No newline at end of file
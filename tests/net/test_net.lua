@@ -0,0 +1,82 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- Downloads from a local server, skipped without python3 to run it
+if os.execute("command -v python3").code ~= 0 then
+	print("python3 not found, skipped")
+	return
+end
+
+os.execute("rm -f port.txt stats.txt")
+assert(os.execute("python3 server.py port.txt stats.txt > /dev/null 2>&1 &").code == 0)
+local port
+for _ = 1, 100 do
+	port = util.read("port.txt")
+	if port then
+		break
+	end
+	os.execute("sleep 0.1")
+end
+assert(port, "server not started")
+local url = "http://127.0.0.1:" .. port .. "/"
+
+local function stats()
+	local content = util.read("stats.txt")
+	local requests, max_active = content:match("requests=(%d+) max_active=(%d+)")
+	return tonumber(requests), tonumber(max_active)
+end
+
+local function reset()
+	assert(os.execute("curl -s " .. url .. "reset").code == 0)
+end
+
+local function fails(pattern, ...)
+	local ok, err = pcall(net.download_many, ...)
+	assert(not ok, "no error raised")
+	assert(err:find(pattern, 1, true), err)
+end
+
+local ok, err = pcall(function()
+	-- Archives are extracted, then only downloaded again while they don't change
+	local res = net.download_many({{url .. "a.zip", "deps/a"}, {url .. "b.zip", "deps/b"}})
+	assert(#res == 2 and res[1] and res[2], "archives not extracted")
+	assert(util.read("deps/a/a.txt") == "a" and util.read("deps/b/b.txt") == "b",
+		"wrong content")
+	res = net.download_many({{url .. "a.zip", "deps/a"}, {url .. "b.zip", "deps/b"}})
+	assert(#res == 2 and not res[1] and not res[2], "unchanged archives extracted")
+	assert(#net.download_many({}) == 0, "empty array")
+
+	-- Downloads run in parallel, up to the connection limit
+	local slow = {}
+	for i = 1, 6 do
+		table.insert(slow, {url .. "slow/s" .. i .. ".zip", "deps/s" .. i})
+	end
+	reset()
+	net.download_many(slow, 2)
+	local requests, max_active = stats()
+	assert(requests == 6, "requests: " .. requests)
+	assert(max_active <= 2, "connection limit exceeded: " .. max_active)
+	reset()
+	net.download_many(slow)
+	requests, max_active = stats()
+	assert(requests == 6, "requests: " .. requests)
+	assert(max_active > 2, "downloads not parallel: " .. max_active)
+
+	-- Failures are raised once every download completed
+	os.execute("rm -rf deps/c")
+	fails("Failed to download '" .. url .. "missing.zip'",
+		{{url .. "missing.zip", "deps/missing"}, {url .. "c.zip", "deps/c"}})
+	assert(util.read("deps/c/a.txt") == "c", "download stopped by a failure")
+
+	-- Invalid arguments and duplicate destinations are rejected before downloading
+	reset()
+	fails("'array' expected", "deps/a")
+	fails("'{url, dest}' expected at index 2", {{url .. "a.zip", "deps/a"}, {url}})
+	fails("positive connection count expected", {{url .. "a.zip", "deps/a"}}, 0)
+	fails("destination '", {{url .. "a.zip", "deps/x"}, {url .. "b.zip", "deps/x/"}})
+	fails("given twice at index 2", {{url .. "a.zip", "deps/x"}, {url .. "b.zip", "deps/x"}})
+	assert(stats() == 0, "downloaded despite invalid arguments")
+end)
+os.execute("curl -s " .. url .. "quit")
+assert(ok, err)
\ No newline at end of file
@@ -0,0 +1,75 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- The manifest regenerates itself when an input of the generation changes, and declares
+-- each distinct flag set once
+util.write("build/project/s/a.cpp", "")
+util.write("build/project/s/b.cpp", "")
+util.write("build/project/main.cpp", "")
+util.write("build/project/flags.lua", [[return {"-O2"}]])
+util.write("build/project/mingen.lua", [[
+mg.configurations({"debug"})
+local flags = dofile("flags.lua")
+local s = mg.project({
+	name = "s",
+	type = mg.project_type.sources,
+	sources = mg.collect_files("s/*.cpp"),
+	compile_options = flags,
+})
+mg.generate({mg.project({
+	name = "exe",
+	type = mg.project_type.executable,
+	sources = {"main.cpp"},
+	dependencies = {s},
+	compile_options = flags,
+	link_options = {"-lm"},
+})})
+]])
+
+local function count(str, pattern)
+	local res = 0
+	local pos = 1
+	while true do
+		pos = str:find(pattern, pos, true)
+		if not pos then
+			return res
+		end
+		res = res + 1
+		pos = pos + #pattern
+	end
+end
+
+local function check_regen(manifest, args)
+	assert(manifest:find("\nrule regen\n", 1, true), manifest)
+	assert(manifest:find(" -f \"mingen.lua\" -c debug" .. args .. "\n", 1, true), manifest)
+	assert(manifest:find("    generator = 1\n    restat = 1\n" ..
+		"    depfile = build.ninja.d\n", 1, true), manifest)
+	assert(manifest:find("\nbuild build.ninja: regen ../mingen.lua | ", 1, true), manifest)
+
+	-- Scripts loaded and directories globbed, relative to the build directory
+	local depfile = util.read("build/project/build/build.ninja.d")
+	assert(depfile == "build.ninja: \\\n ../mingen.lua \\\n ../flags.lua \\\n ../s\n",
+		depfile)
+end
+
+local code, out = util.mingen("build/project")
+assert(code == 0, out)
+local manifest = util.read("build/project/build/build.ninja")
+check_regen(manifest, "")
+assert(count(manifest, "\ncxxflags_") == 1, manifest)
+assert(manifest:find("\ncxxflags_0 = -fmacro-prefix-map=\"../=\" -O2\n", 1, true), manifest)
+assert(count(manifest, "    cxxflags = $cxxflags_0\n") == 3, manifest)
+assert(manifest:find("\nlflags_0 = -lm\n", 1, true), manifest)
+assert(manifest:find("\n    lflags = $lflags_0\n", 1, true), manifest)
+
+-- Project files declare the flag sets they use
+code, out = util.mingen("build/project", "--subninja")
+assert(code == 0, out)
+check_regen(util.read("build/project/build/build.ninja"), " --subninja")
+local s = util.read("build/project/build/s.ninja")
+assert(s:find("^cxxflags_0 = %-fmacro%-prefix%-map=\"%.%./=\" %-O2\n\n"), s)
+assert(count(s, "    cxxflags = $cxxflags_0\n") == 2, s)
+local exe = util.read("build/project/build/exe.ninja")
+assert(exe:find("^cxxflags_0 = %-fmacro%-prefix%-map=\"%.%./=\" %-O2\nlflags_0 = %-lm\n\n"), exe)
+assert(exe:find("\n    lflags = $lflags_0\n", 1, true), exe)
\ No newline at end of file
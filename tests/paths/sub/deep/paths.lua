@@ -0,0 +1,6 @@
+local res = {}
+for _, path in ipairs({"a.cpp", "./a.cpp", "x/../a.cpp", "../a.cpp", "../../a.cpp",
+	"../../../a.cpp", "."}) do
+	res[path] = mg.resolve_path(path)
+end
+return res
\ No newline at end of file
@@ -0,0 +1,41 @@
+mg.configurations({"debug"})
+
+local function check(path, expected)
+	local res = mg.resolve_path(path)
+	assert(res == expected, string.format("'%s': expected '%s', got '%s'", path, expected,
+		res))
+end
+
+-- Paths are normalized, and relative to the working directory
+check("a.cpp", "a.cpp")
+check("./a.cpp", "a.cpp")
+check("x/../a.cpp", "a.cpp")
+check("x/./y//b.cpp", "x/y/b.cpp")
+check("../a.cpp", "../a.cpp")
+check("../../../z", "../../../z")
+check(".", "")
+check("..", "../")
+check("/abs/c.cpp", "/abs/c.cpp")
+
+-- Paths are resolved from the script calling the function, whichever way it is run
+local expected = {
+	["a.cpp"] = "sub/deep/a.cpp",
+	["./a.cpp"] = "sub/deep/a.cpp",
+	["x/../a.cpp"] = "sub/deep/a.cpp",
+	["../a.cpp"] = "sub/a.cpp",
+	["../../a.cpp"] = "a.cpp",
+	["../../../a.cpp"] = "../a.cpp",
+	["."] = "sub/deep/",
+}
+local function check_script(res, how)
+	for path, resolved in pairs(expected) do
+		assert(res[path] == resolved, string.format("%s, '%s': expected '%s', got '%s'",
+			how, path, resolved, tostring(res[path])))
+	end
+end
+check_script(dofile("sub/deep/paths.lua"), "dofile")
+check_script(mg.require("sub/deep/paths"), "mg.require")
+check_script(assert(loadfile("sub/deep/paths.lua"))(), "loadfile")
+
+-- Resolving from the main script again uses its own directory
+check("a.cpp", "a.cpp")
\ No newline at end of file
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Runs the sample project, then every tests/*/test_*.lua script, with the given mingen
+# binary, in a copy of tests/. Scripts fail by raising an error.
+# Usage: tests/run.sh bin/mingen
+
+if [ $# -ne 1 ]; then
+	echo "usage: $0 <mingen>"
+	exit 2
+fi
+
+MINGEN=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+export MINGEN
+root=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cp -R "$root/." "$work"
+
+failed=0
+run() {
+	if out=$("$MINGEN" -d "$1" -f "$2" 2>&1); then
+		echo "ok   $3"
+	else
+		echo "FAIL $3"
+		printf '%s\n' "$out"
+		failed=$((failed + 1))
+	fi
+}
+
+run "$work" mingen.lua sample
+for test in "$work"/*/test_*.lua; do
+	[ -e "$test" ] || continue
+	run "$(dirname "$test")" "$(basename "$test")" "${test#"$work"/}"
+done
+
+[ "$failed" -eq 0 ]
\ No newline at end of file
@@ -0,0 +1,42 @@
+mg.configurations({"debug"})
+
+local util = dofile("../util.lua")
+
+-- With --subninja, the root manifest changes along with any project file, as ninja
+-- only reloads the manifests regenerated by the regen edge if the root one changed
+util.write("build/project/s/t.cpp", "")
+util.write("build/project/main.cpp", "")
+util.write("build/project/mingen.lua", [[
+mg.configurations({"debug"})
+local s = mg.project({
+	name = "s",
+	type = mg.project_type.sources,
+	sources = mg.collect_files("s/*.cpp"),
+})
+mg.generate({mg.project({
+	name = "exe",
+	type = mg.project_type.executable,
+	sources = {"main.cpp"},
+	dependencies = {s},
+})})
+]])
+
+local code, out = util.mingen("build/project", "--subninja")
+assert(code == 0, out)
+local root = util.read("build/project/build/build.ninja")
+local fragment = util.read("build/project/build/s.ninja")
+assert(root:find("\nsubninja s.ninja\n", 1, true), root)
+assert(root:find("\nsubninja exe.ninja\n", 1, true), root)
+assert(fragment:find("build obj/s/t.o: cxx ../s/t.cpp", 1, true), fragment)
+
+-- Unchanged projects leave every file as is
+code, out = util.mingen("build/project", "--subninja")
+assert(code == 0, out)
+assert(util.read("build/project/build/build.ninja") == root, "root manifest changed")
+
+util.write("build/project/s/u.cpp", "")
+code, out = util.mingen("build/project", "--subninja")
+assert(code == 0, out)
+fragment = util.read("build/project/build/s.ninja")
+assert(fragment:find("build obj/s/u.o: cxx ../s/u.cpp", 1, true), fragment)
+assert(util.read("build/project/build/build.ninja") ~= root, "root manifest unchanged")
\ No newline at end of file
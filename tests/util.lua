@@ -0,0 +1,59 @@
+-- Helpers of the test scripts, loaded with dofile("../util.lua")
+local util = {}
+
+-- Paths of a file set or array, sorted
+function util.sorted(files)
+	local res = {}
+	for _, file in ipairs(files) do
+		table.insert(res, file)
+	end
+	table.sort(res)
+	return res
+end
+
+function util.check_files(files, expected, what)
+	local actual = util.sorted(files)
+	table.sort(expected)
+	local msg = string.format("%s: expected {%s}, got {%s}", what,
+		table.concat(expected, ", "), table.concat(actual, ", "))
+	assert(#actual == #expected, msg)
+	for i = 1, #actual do
+		assert(actual[i] == expected[i], msg)
+	end
+end
+
+function util.write(path, content)
+	local dir = path:match("^(.*)/[^/]*$")
+	if dir then
+		os.execute("mkdir -p '" .. dir .. "'")
+	end
+	local file = assert(io.open(path, "wb"))
+	file:write(content)
+	file:close()
+end
+
+function util.read(path)
+	local file = io.open(path, "rb")
+	if not file then
+		return nil
+	end
+	local content = file:read("a")
+	file:close()
+	return content
+end
+
+-- Sets the modification time of `path` in the past, so mingen doesn't consider it as
+-- too recent to be fingerprinted
+function util.age(path)
+	assert(os.execute("touch -d '2001-01-01' '" .. path .. "'").code == 0)
+end
+
+-- Runs the mingen binary tested in `dir`, relative to the working directory, and
+-- returns its exit code and output
+function util.mingen(dir, args)
+	local res = os.execute("cd '" .. dir .. "' && '" .. os.getenv("MINGEN") .. "' " ..
+		(args or ""))
+	return res.code, res.stdout or ""
+end
+
+return util
\ No newline at end of file